@@ -0,0 +1,384 @@
+/*  Benchmark, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "benchmark.h"
+#include "memorystats.h"
+#include "codequeries.h"
+#include "stellarsolver.h"
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QFileInfo>
+#include <QDir>
+#include <QMutexLocker>
+#include <qmath.h>
+#include <fitsio.h>
+#include <algorithm>
+#include <climits>
+
+//A star that was found within this many pixels of a true star position counts as recovered
+#define RECOVERY_RADIUS 2.0
+
+QString Benchmark::stageName(Stage stage)
+{
+    switch(stage)
+    {
+        case STAGE_SEXTRACT:
+            return "sextract";
+        case STAGE_SEXTRACT_WITH_HFR:
+            return "sextractWithHFR";
+        case STAGE_SOLVE:
+            return "solve";
+        default:
+            return "";
+    }
+}
+
+//This is a simpler version of the loadFits method in the tester, it only reads the first channel of the image.
+bool Benchmark::loadFITS(const QString &fileName, BenchmarkImage &image, QString &error)
+{
+    fitsfile *fptr = nullptr;
+    int status = 0, anynull = 0;
+    long naxes[3] = {0, 0, 1};
+    int fitsBitPix = 0;
+    FITSImage::Statistic stats;
+
+    if (fits_open_diskfile(&fptr, fileName.toLocal8Bit(), READONLY, &status))
+    {
+        error = QString("Error opening fits file %1").arg(fileName);
+        return false;
+    }
+
+    if (fits_movabs_hdu(fptr, 1, IMAGE_HDU, &status) || fits_get_img_param(fptr, 3, &fitsBitPix, &(stats.ndim), naxes, &status))
+    {
+        error = QString("Could not read the image in %1").arg(fileName);
+        fits_close_file(fptr, &status);
+        return false;
+    }
+
+    if (stats.ndim < 2 || naxes[0] == 0 || naxes[1] == 0 || naxes[0] > UINT16_MAX || naxes[1] > UINT16_MAX)
+    {
+        error = QString("Image %1 has invalid dimensions").arg(fileName);
+        fits_close_file(fptr, &status);
+        return false;
+    }
+
+    switch (fitsBitPix)
+    {
+        case BYTE_IMG:
+            stats.dataType      = TBYTE;
+            stats.bytesPerPixel = sizeof(uint8_t);
+            break;
+        case SHORT_IMG:
+        case USHORT_IMG:
+            stats.dataType      = TUSHORT;
+            stats.bytesPerPixel = sizeof(uint16_t);
+            break;
+        case LONG_IMG:
+        case ULONG_IMG:
+            stats.dataType      = TULONG;
+            stats.bytesPerPixel = sizeof(uint32_t);
+            break;
+        case FLOAT_IMG:
+            stats.dataType      = TFLOAT;
+            stats.bytesPerPixel = sizeof(float);
+            break;
+        case LONGLONG_IMG:
+            stats.dataType      = TLONGLONG;
+            stats.bytesPerPixel = sizeof(int64_t);
+            break;
+        case DOUBLE_IMG:
+            stats.dataType      = TDOUBLE;
+            stats.bytesPerPixel = sizeof(double);
+            break;
+        default:
+            error = QString("Bit depth %1 is not supported.").arg(fitsBitPix);
+            fits_close_file(fptr, &status);
+            return false;
+    }
+
+    stats.width               = static_cast<uint16_t>(naxes[0]);
+    stats.height              = static_cast<uint16_t>(naxes[1]);
+    stats.samples_per_channel = stats.width * stats.height;
+    stats.size                = QFileInfo(fileName).size();
+
+    image.buffer.resize(stats.samples_per_channel * stats.bytesPerPixel);
+    if (fits_read_img(fptr, static_cast<int>(stats.dataType), 1, stats.samples_per_channel, nullptr, image.buffer.data(), &anynull, &status))
+    {
+        error = QString("Error reading image %1").arg(fileName);
+        fits_close_file(fptr, &status);
+        return false;
+    }
+    fits_close_file(fptr, &status);
+
+    image.name = QFileInfo(fileName).fileName();
+    image.stats = stats;
+    image.synthetic = false;
+    image.truePositions.clear();
+    return true;
+}
+
+void Benchmark::setSearchScale(double fov_low, double fov_high, ScaleUnits units)
+{
+    use_scale = true;
+    scalelo = fov_low;
+    scalehi = fov_high;
+    scaleunit = units;
+}
+
+bool Benchmark::haveIndexFiles() const
+{
+    foreach(QString folder, indexFolderPaths)
+    {
+        QDir dir(folder);
+        dir.setNameFilters(QStringList() << "*.fits" << "*.fit");
+        if(dir.exists() && !dir.entryList(QDir::Files).isEmpty())
+            return true;
+    }
+    return false;
+}
+
+//This counts how many of the true star positions have a star that was found near them
+int Benchmark::countRecovered(const QList<FITSImage::Star> &found, const QVector<QPointF> &truePositions)
+{
+    QVector<QPointF> sorted = truePositions;
+    std::sort(sorted.begin(), sorted.end(), [](const QPointF &a, const QPointF &b)
+    {
+        return a.x() < b.x();
+    });
+    QVector<bool> matched(sorted.size(), false);
+    int recovered = 0;
+    foreach(const FITSImage::Star &star, found)
+    {
+        auto first = std::lower_bound(sorted.constBegin(), sorted.constEnd(), star.x - RECOVERY_RADIUS, [](const QPointF &a, double x)
+        {
+            return a.x() < x;
+        });
+        for(auto it = first; it != sorted.constEnd() && it->x() <= star.x + RECOVERY_RADIUS; ++it)
+        {
+            int i = it - sorted.constBegin();
+            double dx = it->x() - star.x;
+            double dy = it->y() - star.y;
+            if(!matched[i] && dx * dx + dy * dy <= RECOVERY_RADIUS * RECOVERY_RADIUS)
+            {
+                matched[i] = true;
+                recovered++;
+                break;
+            }
+        }
+    }
+    return recovered;
+}
+
+Benchmark::Sample Benchmark::runStage(const BenchmarkImage &image, const Parameters &profile, Stage stage)
+{
+    Sample sample;
+    quint64 allocationsBefore = MemoryStats::allocationCount();
+    QElapsedTimer timer;
+    timer.start();
+
+    {
+        StellarSolver solver(image.stats, reinterpret_cast<const uint8_t *>(image.buffer.constData()));
+        solver.setParameters(profile);
+        solver.setLogLevel(LOG_NONE);
+        solver.setSextractorType(SEXTRACTOR_INTERNAL);
+        solver.setSolverType(SOLVER_STELLARSOLVER);
+        solver.setIndexFolderPaths(indexFolderPaths);
+        solver.setUseIndexCache(useIndexCache);
+        solver.setLoadWCS(false);
+        if(use_scale)
+            solver.setSearchScale(scalelo, scalehi, scaleunit);
+        if(codeQueries)
+            codeQueries->recordFrom(solver);
+        if(recordingVerify)
+            solver.setVerifyRecorder(&Benchmark::recordVerify, this);
+
+        if(stage == STAGE_SEXTRACT)
+            solver.sextract();
+        else if(stage == STAGE_SEXTRACT_WITH_HFR)
+            solver.sextractWithHFR();
+        else
+            solver.solve();
+        //This makes sure the thread is done so its cleanup is part of the measurement too
+        solver.wait();
+
+        sample.success = !solver.failed() && (stage == STAGE_SOLVE ? solver.solvingDone() : solver.sextractionDone());
+        sample.stars = solver.getNumStarsFound();
+        if(stage != STAGE_SOLVE && image.synthetic)
+            sample.recovered = countRecovered(solver.getStarList(), image.truePositions);
+        if(stage == STAGE_SOLVE && sample.success)
+            sample.solution = solver.getSolution();
+    }
+
+    sample.nsecs = timer.nsecsElapsed();
+    sample.allocations = MemoryStats::allocationCount() - allocationsBefore;
+    return sample;
+}
+
+void Benchmark::recordVerify(const index_t *index, double seconds, void *baton)
+{
+    Q_UNUSED(index);
+    Benchmark *self = static_cast<Benchmark *>(baton);
+    QMutexLocker locker(&self->verifyLock);
+    self->verifyCount++;
+    self->verifySeconds += seconds;
+}
+
+//This uses the nearest rank method on samples that are already sorted
+static double percentile(const QVector<double> &sorted, double percent)
+{
+    int rank = qCeil(percent / 100.0 * sorted.size());
+    return sorted.at(qBound(0, rank - 1, sorted.size() - 1));
+}
+
+QJsonObject Benchmark::measure(const BenchmarkImage &image, const Parameters &profile, Stage stage)
+{
+    QJsonObject result;
+    result["image"] = image.name;
+    result["profile"] = profile.listName;
+    result["stage"] = stageName(stage);
+
+    if(stage == STAGE_SOLVE && image.synthetic)
+    {
+        result["skipped"] = "synthetic fields are not real sky, so they can't be solved";
+        return result;
+    }
+    if(stage == STAGE_SOLVE && !haveIndexFiles())
+    {
+        result["skipped"] = "there are no index files in the index folders";
+        return result;
+    }
+
+    emit logOutput(QString("%1: %2 with %3").arg(image.name).arg(stageName(stage)).arg(profile.listName));
+
+    //The warm up runs load the index cache and settle the memory allocator, they are not measured
+    for(int i = 0; i < warmUp; i++)
+        runStage(image, profile, stage);
+
+    //While solving, the time of every match verification is added up, so the verify throughput can be reported
+    verifyCount = 0;
+    verifySeconds = 0;
+    recordingVerify = stage == STAGE_SOLVE;
+
+    QVector<Sample> samples;
+    for(int i = 0; i < repeat; i++)
+        samples.append(runStage(image, profile, stage));
+
+    recordingVerify = false;
+
+    //setRepeat makes sure there is at least one run, this is just in case
+    if(samples.isEmpty())
+    {
+        result["skipped"] = "there were no measured runs";
+        return result;
+    }
+
+    QVector<double> latencies;
+    int failures = 0;
+    int minStars = INT_MAX, maxStars = 0;
+    double totalAllocations = 0;
+    quint64 maxAllocations = 0;
+    foreach(const Sample &sample, samples)
+    {
+        latencies.append(sample.nsecs / 1.0e6);
+        if(!sample.success)
+            failures++;
+        minStars = qMin(minStars, sample.stars);
+        maxStars = qMax(maxStars, sample.stars);
+        totalAllocations += sample.allocations;
+        maxAllocations = qMax(maxAllocations, sample.allocations);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double totalLatency = 0;
+    foreach(double latency, latencies)
+        totalLatency += latency;
+
+    result["runs"] = samples.size();
+    result["failures"] = failures;
+
+    QJsonObject latency;
+    latency["min"] = latencies.first();
+    latency["mean"] = totalLatency / latencies.size();
+    latency["p50"] = percentile(latencies, 50);
+    latency["p90"] = percentile(latencies, 90);
+    latency["p99"] = percentile(latencies, 99);
+    latency["max"] = latencies.last();
+    result["latency_ms"] = latency;
+
+    QJsonObject stars;
+    stars["min"] = minStars;
+    stars["max"] = maxStars;
+    stars["last"] = samples.last().stars;
+    if(image.synthetic && !image.truePositions.isEmpty())
+    {
+        stars["true"] = image.truePositions.size();
+        stars["recovered_fraction"] = (double)samples.last().recovered / image.truePositions.size();
+    }
+    result["stars"] = stars;
+
+    if(MemoryStats::canCountAllocations())
+    {
+        QJsonObject allocations;
+        allocations["mean"] = totalAllocations / samples.size();
+        allocations["max"] = (double)maxAllocations;
+        result["allocations"] = allocations;
+    }
+    else
+        result["allocations"] = QJsonValue();
+    result["peak_rss_bytes"] = (double)MemoryStats::peakResidentBytes();
+
+    if(stage == STAGE_SOLVE)
+    {
+        QJsonObject verify;
+        verify["matches"] = (double)verifyCount / samples.size();
+        verify["matchesPerSecond"] = verifySeconds > 0 ? verifyCount / verifySeconds : 0.0;
+        verify["mean_us"] = verifyCount > 0 ? 1.0e6 * verifySeconds / verifyCount : 0.0;
+        result["verify"] = verify;
+    }
+
+    if(stage == STAGE_SOLVE && samples.last().success)
+    {
+        FITSImage::Solution solution = samples.last().solution;
+        QJsonObject json;
+        json["ra"] = solution.ra;
+        json["dec"] = solution.dec;
+        json["orientation"] = solution.orientation;
+        json["pixscale"] = solution.pixscale;
+        json["field_width"] = solution.fieldWidth;
+        json["field_height"] = solution.fieldHeight;
+        json["parity"] = solution.parity;
+        result["solution"] = json;
+    }
+    return result;
+}
+
+QJsonObject Benchmark::run(const QList<BenchmarkImage> &images)
+{
+    QJsonArray results;
+    foreach(const BenchmarkImage &image, images)
+    {
+        foreach(const Parameters &profile, profiles)
+        {
+            foreach(Stage stage, stages)
+            {
+                QJsonObject result = measure(image, profile, stage);
+                result["width"] = image.stats.width;
+                result["height"] = image.stats.height;
+                result["synthetic"] = image.synthetic;
+                results.append(result);
+            }
+        }
+    }
+
+    QJsonObject report;
+    report["repeat"] = repeat;
+    report["warm_up"] = warmUp;
+    report["index_cache"] = useIndexCache;
+    report["counts_allocations"] = MemoryStats::canCountAllocations();
+    report["results"] = results;
+    return report;
+}
@@ -0,0 +1,111 @@
+/*  Benchmark, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+//Includes for this project
+#include "structuredefinitions.h"
+#include "parameters.h"
+
+//QT Includes
+#include <QObject>
+#include <QMutex>
+#include <QVector>
+#include <QPointF>
+#include <QJsonObject>
+#include <QStringList>
+
+//Astrometry.net includes
+extern "C"{
+#include "astrometry/index.h"
+}
+
+using namespace SSolver;
+
+class CodeQueries;
+
+//This is one image for the benchmark, either loaded from a FITS file or made by SyntheticField
+struct BenchmarkImage
+{
+    QString name;
+    FITSImage::Statistic stats;
+    QByteArray buffer;
+    bool synthetic = false;
+    QVector<QPointF> truePositions;     //These are only known for the synthetic images
+};
+
+//This runs the extraction and solving stages on the images with each of the profiles and measures them.
+//Every stage is run on a new StellarSolver each time, the same way a program would use the library.
+class Benchmark : public QObject
+{
+    Q_OBJECT
+public:
+    enum Stage
+    {
+        STAGE_SEXTRACT,
+        STAGE_SEXTRACT_WITH_HFR,
+        STAGE_SOLVE
+    };
+
+    static QString stageName(Stage stage);
+    static bool loadFITS(const QString &fileName, BenchmarkImage &image, QString &error);
+
+    void setProfiles(const QList<Parameters> &list){profiles = list;};
+    void setStages(const QList<Stage> &list){stages = list;};
+    void setRepeat(int count){repeat = qMax(count, 1);};
+    void setWarmUp(int count){warmUp = qMax(count, 0);};
+    void setIndexFolderPaths(const QStringList &paths){indexFolderPaths = paths;};
+    void setUseIndexCache(bool set){useIndexCache = set;};
+    void setSearchScale(double fov_low, double fov_high, ScaleUnits units);
+    //The lookups of every solve are given to these code queries while they are recording
+    void setCodeQueries(CodeQueries *queries){codeQueries = queries;};
+
+    //This returns the JSON report for all of the images, profiles and stages
+    QJsonObject run(const QList<BenchmarkImage> &images);
+
+signals:
+    void logOutput(QString logText);
+
+private:
+    //This is the measurement of one run of one stage
+    struct Sample
+    {
+        qint64 nsecs = 0;
+        bool success = false;
+        int stars = 0;
+        int recovered = 0;
+        quint64 allocations = 0;
+        FITSImage::Solution solution;
+    };
+
+    Sample runStage(const BenchmarkImage &image, const Parameters &profile, Stage stage);
+    QJsonObject measure(const BenchmarkImage &image, const Parameters &profile, Stage stage);
+    bool haveIndexFiles() const;
+    static int countRecovered(const QList<FITSImage::Star> &found, const QVector<QPointF> &truePositions);
+    static void recordVerify(const index_t *index, double seconds, void *baton);
+
+    QList<Parameters> profiles;
+    QList<Stage> stages;
+    int repeat = 5;
+    int warmUp = 1;
+    QStringList indexFolderPaths;
+    bool useIndexCache = true;
+    bool use_scale = false;
+    double scalelo = 0;
+    double scalehi = 0;
+    ScaleUnits scaleunit = DEG_WIDTH;
+    CodeQueries *codeQueries = nullptr;
+
+    //These add up the matches that were verified during the measured solves, from all of the solving threads
+    bool recordingVerify = false;
+    QMutex verifyLock;
+    qint64 verifyCount = 0;
+    double verifySeconds = 0;
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,256 @@
+/*  CodeQueries, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "codequeries.h"
+#include "stellarsolver.h"
+
+#include <QFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QMutexLocker>
+#include <string.h>
+
+//Astrometry.net includes
+extern "C"{
+#include "astrometry/solver.h"
+#include "astrometry/kdtree.h"
+}
+
+//This is at the start of a file of recorded lookups
+#define CODE_QUERIES_MAGIC 0x53534351
+#define CODE_QUERIES_VERSION 1
+//These are the options that solver.c uses for its lookups
+#define CODE_QUERY_OPTIONS (KD_OPTIONS_SMALL_RADIUS | KD_OPTIONS_COMPUTE_DISTS | KD_OPTIONS_NO_RESIZE_RESULTS | KD_OPTIONS_USE_SPLIT)
+//This is the most codes that solver.c looks up together
+#define CODE_QUERY_BATCH 1024
+
+void CodeQueries::recordFrom(StellarSolver &solver)
+{
+    if(recording)
+        solver.setCodeRecorder(&CodeQueries::recordCode, this);
+}
+
+void CodeQueries::recordCode(const index_t *index, const double *code, int dimcode, double tol2, void *baton)
+{
+    CodeQueries *self = static_cast<CodeQueries *>(baton);
+    QMutexLocker locker(&self->recordLock);
+    IndexQueries &indexQueries = self->queries[QString::fromLocal8Bit(index->codefn)];
+    indexQueries.dimcode = dimcode;
+    indexQueries.values.append(tol2);
+    for(int d = 0; d < dimcode; d++)
+        indexQueries.values.append(code[d]);
+}
+
+int CodeQueries::count()
+{
+    QMutexLocker locker(&recordLock);
+    int total = 0;
+    foreach(const IndexQueries &indexQueries, queries)
+        total += indexQueries.values.size() / (indexQueries.dimcode + 1);
+    return total;
+}
+
+bool CodeQueries::save(const QString &fileName, QString &error)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        error = QString("Unable to write the code lookups to %1").arg(fileName);
+        return false;
+    }
+    QMutexLocker locker(&recordLock);
+    QDataStream out(&file);
+    out << (quint32)CODE_QUERIES_MAGIC << (qint32)CODE_QUERIES_VERSION << (qint32)queries.size();
+    for(auto it = queries.constBegin(); it != queries.constEnd(); ++it)
+        out << it.key() << (qint32)it.value().dimcode << it.value().values;
+    if(out.status() != QDataStream::Ok)
+    {
+        error = QString("Unable to write the code lookups to %1").arg(fileName);
+        return false;
+    }
+    return true;
+}
+
+bool CodeQueries::load(const QString &fileName, QString &error)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        error = QString("Unable to read the code lookups in %1").arg(fileName);
+        return false;
+    }
+    QDataStream in(&file);
+    quint32 magic = 0;
+    qint32 version = 0, numIndexes = 0;
+    in >> magic >> version >> numIndexes;
+    if(magic != CODE_QUERIES_MAGIC || version != CODE_QUERIES_VERSION)
+    {
+        error = QString("%1 is not a file of recorded code lookups").arg(fileName);
+        return false;
+    }
+    QMutexLocker locker(&recordLock);
+    queries.clear();
+    for(int i = 0; i < numIndexes; i++)
+    {
+        QString codeFile;
+        qint32 dimcode = 0;
+        IndexQueries indexQueries;
+        in >> codeFile >> dimcode >> indexQueries.values;
+        indexQueries.dimcode = dimcode;
+        if(dimcode <= 0 || indexQueries.values.size() % (dimcode + 1) != 0)
+            break;
+        queries.insert(codeFile, indexQueries);
+    }
+    if(in.status() != QDataStream::Ok || queries.size() != numIndexes)
+    {
+        error = QString("The code lookups in %1 are damaged").arg(fileName);
+        queries.clear();
+        return false;
+    }
+    return true;
+}
+
+QJsonObject CodeQueries::replay(int repeat, QString &error)
+{
+    QMutexLocker locker(&recordLock);
+    QJsonArray indexes;
+    qint64 totalQueries = 0;
+    qint64 plainNsecs = 0;
+    qint64 packedNsecs = 0;
+    qint64 batchNsecs = 0;
+    bool allSame = true;
+    repeat = qMax(repeat, 1);
+
+    for(auto it = queries.constBegin(); it != queries.constEnd(); ++it)
+    {
+        codetree_t *codeTree = codetree_open(it.key().toLocal8Bit().constData());
+        if(codeTree == nullptr)
+        {
+            error = QString("Unable to open the code tree in %1").arg(it.key());
+            return QJsonObject();
+        }
+        kdtree_t *tree = codeTree->tree;
+        const IndexQueries &indexQueries = it.value();
+        int stride = indexQueries.dimcode + 1;
+        int numQueries = indexQueries.values.size() / stride;
+        const double *values = indexQueries.values.constData();
+        kdtree_qres_t *results = nullptr;
+
+        //The first plain run keeps what it found, so the packed and batched runs can be checked against it
+        QVector<int> numFound(numQueries);
+        QVector<quint32> found;
+        qint64 nsecs[3] = {0, 0, 0};
+        bool same = true;
+        bool packed = false;
+        kdtree_batch_res_t batchResults;
+        memset(&batchResults, 0, sizeof(batchResults));
+        QVector<double> codes(CODE_QUERY_BATCH * indexQueries.dimcode);
+        for(int pass = 0; pass < 3; pass++)
+        {
+            if(pass == 1)
+            {
+                packed = kdtree_pack_leaves(tree) == 0;
+                if(!packed)
+                    break;
+            }
+            QElapsedTimer timer;
+            timer.start();
+            for(int r = 0; r < repeat; r++)
+            {
+                int position = 0;
+                for(int q = 0; q < numQueries;)
+                {
+                    //The batched run looks up the codes that were made one after the other with the same tolerance together,
+                    //the way the solver does for the codes of an AB pair
+                    int batchSize = 1;
+                    if(pass == 2)
+                    {
+                        double tol2 = values[(size_t)q * stride];
+                        while(q + batchSize < numQueries && batchSize < CODE_QUERY_BATCH && values[(size_t)(q + batchSize) * stride] == tol2)
+                            batchSize++;
+                        for(int b = 0; b < batchSize; b++)
+                            memcpy(codes.data() + b * indexQueries.dimcode, values + (size_t)(q + b) * stride + 1, indexQueries.dimcode * sizeof(double));
+                        if(kdtree_rangesearch_batch(tree, &batchResults, codes.constData(), batchSize, tol2))
+                        {
+                            error = QString("Unable to look up the codes in %1").arg(it.key());
+                            kdtree_free_batch_results(&batchResults);
+                            kdtree_free_query(results);
+                            codetree_close(codeTree);
+                            return QJsonObject();
+                        }
+                    }
+                    else
+                    {
+                        const double *query = values + (size_t)q * stride;
+                        results = kdtree_rangesearch_options_reuse(tree, results, query + 1, query[0], CODE_QUERY_OPTIONS);
+                    }
+                    for(int b = 0; b < batchSize; b++, q++)
+                    {
+                        if(r > 0)
+                            continue;
+                        const quint32 *inds = pass == 2 ? batchResults.inds + batchResults.first[b] : (results ? results->inds : nullptr);
+                        int numResults = pass == 2 ? batchResults.first[b + 1] - batchResults.first[b] : (results ? results->nres : 0);
+                        if(pass == 0)
+                        {
+                            numFound[q] = numResults;
+                            for(int i = 0; i < numResults; i++)
+                                found.append(inds[i]);
+                        }
+                        else
+                        {
+                            if(numFound.at(q) != numResults)
+                                same = false;
+                            for(int i = 0; same && i < numResults; i++)
+                                same = found.at(position + i) == inds[i];
+                        }
+                        position += numFound.at(q);
+                    }
+                }
+            }
+            nsecs[pass] = timer.nsecsElapsed();
+        }
+        kdtree_free_batch_results(&batchResults);
+        kdtree_free_query(results);
+        kdtree_free_packed_leaves(tree);
+
+        QJsonObject index;
+        index["codeFile"] = it.key();
+        index["dimensions"] = indexQueries.dimcode;
+        index["codes"] = tree->ndata;
+        index["queries"] = numQueries;
+        index["quadsFound"] = found.size();
+        index["plainQueriesPerSecond"] = nsecs[0] > 0 ? 1e9 * numQueries * repeat / nsecs[0] : 0.0;
+        if(packed)
+        {
+            index["packedQueriesPerSecond"] = nsecs[1] > 0 ? 1e9 * numQueries * repeat / nsecs[1] : 0.0;
+            index["batchQueriesPerSecond"] = nsecs[2] > 0 ? 1e9 * numQueries * repeat / nsecs[2] : 0.0;
+            index["sameResults"] = same;
+            totalQueries += numQueries;
+            plainNsecs += nsecs[0];
+            packedNsecs += nsecs[1];
+            batchNsecs += nsecs[2];
+            allSame = allSame && same;
+        }
+        indexes.append(index);
+        codetree_close(codeTree);
+    }
+
+    QJsonObject report;
+    report["repeat"] = repeat;
+    report["indexes"] = indexes;
+    if(plainNsecs > 0 && packedNsecs > 0 && batchNsecs > 0)
+    {
+        report["plainQueriesPerSecond"] = 1e9 * totalQueries * repeat / plainNsecs;
+        report["packedQueriesPerSecond"] = 1e9 * totalQueries * repeat / packedNsecs;
+        report["batchQueriesPerSecond"] = 1e9 * totalQueries * repeat / batchNsecs;
+        report["speedup"] = (double)plainNsecs / packedNsecs;
+        report["batchSpeedup"] = (double)plainNsecs / batchNsecs;
+        report["sameResults"] = allSame;
+    }
+    return report;
+}
@@ -0,0 +1,58 @@
+/*  CodeQueries, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef CODEQUERIES_H
+#define CODEQUERIES_H
+
+//QT Includes
+#include <QMap>
+#include <QMutex>
+#include <QVector>
+#include <QString>
+#include <QJsonObject>
+
+//Astrometry.net includes
+extern "C"{
+#include "astrometry/index.h"
+}
+
+class StellarSolver;
+
+//These are the code tree lookups made by real solves.  They are recorded while the benchmark solves, saved to a file,
+//and replayed later against the code trees of the same index files, so the lookups can be measured by themselves.
+class CodeQueries
+{
+public:
+    //While recording, every code that the solvers given to recordFrom look up is kept, from all of their solving threads
+    void startRecording(){recording = true;};
+    void stopRecording(){recording = false;};
+    void recordFrom(StellarSolver &solver);
+    int count();
+
+    bool save(const QString &fileName, QString &error);
+    bool load(const QString &fileName, QString &error);
+
+    //This looks up all of the codes again, repeat times with the plain search, repeat times with the packed leaves,
+    //and repeat times in batches like the solver does, and reports the lookups per second of each and whether they all found the same quads.
+    QJsonObject replay(int repeat, QString &error);
+
+private:
+    static void recordCode(const index_t *index, const double *code, int dimcode, double tol2, void *baton);
+
+    //Each lookup is the squared tolerance followed by the code
+    struct IndexQueries
+    {
+        int dimcode = 0;
+        QVector<double> values;
+    };
+
+    QMutex recordLock;
+    QMap<QString, IndexQueries> queries;        //These are by the file name of the code tree
+    bool recording = false;
+};
+
+#endif // CODEQUERIES_H
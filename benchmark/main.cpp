@@ -0,0 +1,229 @@
+/*  stellarsolver-bench, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "benchmark.h"
+#include "syntheticfield.h"
+#include "codequeries.h"
+#include "stellarsolver.h"
+#include "version.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QSysInfo>
+#include <QThread>
+#include <QFile>
+#include <stdio.h>
+
+//This adds the details of the run to the report and writes it to the output file, or to the standard output if there isn't one
+static int writeReport(QJsonObject report, const QString &outputFile)
+{
+    report["version"] = StellarSolver_VERSION;
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    QJsonObject host;
+    host["os"] = QSysInfo::prettyProductName();
+    host["cpu"] = QSysInfo::currentCpuArchitecture();
+    host["threads"] = QThread::idealThreadCount();
+    report["host"] = host;
+
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if(!outputFile.isEmpty())
+    {
+        QFile file(outputFile);
+        if(!file.open(QIODevice::WriteOnly))
+        {
+            fprintf(stderr, "Unable to write the report to %s\n", outputFile.toLocal8Bit().constData());
+            return 1;
+        }
+        file.write(json);
+    }
+    else
+        fwrite(json.constData(), 1, json.size(), stdout);
+    return 0;
+}
+
+//This runs the extraction and solving stages headless, with no GUI, and prints the measurements as JSON.
+//For example:  stellarsolver-bench --synthetic 2 --repeat 10 --output results.json image1.fits image2.fits
+//The code tree lookups of the solves can be recorded with --record-queries lookups.dat and measured by themselves later
+//with stellarsolver-bench --replay-queries lookups.dat
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("stellarsolver-bench");
+    QCoreApplication::setApplicationVersion(StellarSolver_VERSION);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the StellarSolver extraction and solving stages and reports the results as JSON.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("files", "The FITS images to measure.", "[files...]");
+    QCommandLineOption repeatOption("repeat", "How many measured runs of each stage.", "N", "5");
+    QCommandLineOption warmUpOption("warmup", "How many runs of each stage before the measured runs.", "N", "1");
+    QCommandLineOption profileOption("profile", "Only use the built in profile with this name, this can be given more than once.", "name");
+    QCommandLineOption stageOption("stage", "Only run this stage: sextract, sextractWithHFR or solve, this can be given more than once.", "stage");
+    QCommandLineOption indexOption("index-folder", "A folder with index files for solving, this can be given more than once.", "folder");
+    QCommandLineOption noCacheOption("no-index-cache", "Load the index files again for every solve instead of keeping them loaded.");
+    QCommandLineOption scaleOption("scale", "The image scale range for solving, low,high in arcseconds per pixel.", "low,high");
+    QCommandLineOption syntheticOption("synthetic", "Also measure this many synthetic star fields.", "N", "0");
+    QCommandLineOption sizeOption("synthetic-size", "The size of the synthetic star fields.", "WxH", "2048x1536");
+    QCommandLineOption starsOption("synthetic-stars", "The number of stars in each synthetic star field.", "N", "400");
+    QCommandLineOption outputOption("output", "Write the JSON report to this file instead of the standard output.", "file");
+    QCommandLineOption recordOption("record-queries", "Record the code tree lookups of the solves in this file, to replay them with --replay-queries.", "file");
+    QCommandLineOption replayOption("replay-queries", "Only replay the code tree lookups recorded in this file, with and without the packed leaves, and report the lookups per second.", "file");
+    parser.addOptions({repeatOption, warmUpOption, profileOption, stageOption, indexOption, noCacheOption, scaleOption,
+                       syntheticOption, sizeOption, starsOption, outputOption, recordOption, replayOption});
+    parser.process(app);
+
+    bool repeatValid = false, warmUpValid = false;
+    int repeat = parser.value(repeatOption).toInt(&repeatValid);
+    int warmUp = parser.value(warmUpOption).toInt(&warmUpValid);
+    if(!repeatValid || repeat < 1)
+    {
+        fprintf(stderr, "The repeat count should be a number that is at least 1\n");
+        return 1;
+    }
+    if(!warmUpValid || warmUp < 0)
+    {
+        fprintf(stderr, "The warm up count should be a number that is at least 0\n");
+        return 1;
+    }
+
+    if(parser.isSet(replayOption))
+    {
+        CodeQueries queries;
+        QString error;
+        if(!queries.load(parser.value(replayOption), error))
+        {
+            fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+            return 1;
+        }
+        QJsonObject report;
+        report["codeQueries"] = queries.replay(repeat, error);
+        if(!error.isEmpty())
+        {
+            fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+            return 1;
+        }
+        return writeReport(report, parser.value(outputOption));
+    }
+
+    Benchmark benchmark;
+    QObject::connect(&benchmark, &Benchmark::logOutput, [](QString logText)
+    {
+        fprintf(stderr, "%s\n", logText.toLocal8Bit().constData());
+    });
+
+    benchmark.setRepeat(repeat);
+    benchmark.setWarmUp(warmUp);
+    benchmark.setUseIndexCache(!parser.isSet(noCacheOption));
+    if(parser.isSet(indexOption))
+        benchmark.setIndexFolderPaths(parser.values(indexOption));
+    else
+        benchmark.setIndexFolderPaths(StellarSolver::getDefaultIndexFolderPaths());
+    if(parser.isSet(scaleOption))
+    {
+        QStringList range = parser.value(scaleOption).split(",");
+        if(range.size() != 2)
+        {
+            fprintf(stderr, "The scale range should be low,high\n");
+            return 1;
+        }
+        benchmark.setSearchScale(range.at(0).toDouble(), range.at(1).toDouble(), ARCSEC_PER_PIX);
+    }
+
+    QList<Parameters> profiles;
+    QStringList profileNames = parser.values(profileOption);
+    foreach(const Parameters &profile, StellarSolver::getBuiltInProfiles())
+    {
+        if(profileNames.isEmpty() || profileNames.contains(profile.listName))
+            profiles.append(profile);
+    }
+    if(profiles.isEmpty())
+    {
+        fprintf(stderr, "None of the profiles were found in the built in profiles\n");
+        return 1;
+    }
+    benchmark.setProfiles(profiles);
+
+    QList<Benchmark::Stage> stages;
+    QStringList stageNames = parser.values(stageOption);
+    foreach(Benchmark::Stage stage, QList<Benchmark::Stage>() << Benchmark::STAGE_SEXTRACT << Benchmark::STAGE_SEXTRACT_WITH_HFR << Benchmark::STAGE_SOLVE)
+    {
+        if(stageNames.isEmpty() || stageNames.contains(Benchmark::stageName(stage)))
+            stages.append(stage);
+    }
+    if(stages.isEmpty())
+    {
+        fprintf(stderr, "None of the stages are valid, use sextract, sextractWithHFR or solve\n");
+        return 1;
+    }
+    benchmark.setStages(stages);
+
+    QList<BenchmarkImage> images;
+    foreach(QString fileName, parser.positionalArguments())
+    {
+        BenchmarkImage image;
+        QString error;
+        if(!Benchmark::loadFITS(fileName, image, error))
+        {
+            fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+            return 1;
+        }
+        images.append(image);
+    }
+
+    int numSynthetic = parser.value(syntheticOption).toInt();
+    QStringList size = parser.value(sizeOption).split("x");
+    for(int i = 0; i < numSynthetic; i++)
+    {
+        SyntheticField field;
+        if(size.size() == 2)
+        {
+            field.width = size.at(0).toInt();
+            field.height = size.at(1).toInt();
+        }
+        field.numStars = parser.value(starsOption).toInt();
+        field.seed = i + 1;
+        if(!field.generate())
+        {
+            fprintf(stderr, "The synthetic star field settings are not valid\n");
+            return 1;
+        }
+        BenchmarkImage image;
+        image.name = QString("synthetic-%1").arg(i + 1);
+        image.stats = field.getStatistics();
+        image.buffer = QByteArray(reinterpret_cast<const char *>(field.getImageBuffer()), image.stats.samples_per_channel * image.stats.bytesPerPixel);
+        image.synthetic = true;
+        image.truePositions = field.getStarPositions();
+        images.append(image);
+    }
+
+    if(images.isEmpty())
+    {
+        fprintf(stderr, "There are no images to measure, give some FITS files or use --synthetic\n");
+        return 1;
+    }
+
+    CodeQueries queries;
+    if(parser.isSet(recordOption))
+        queries.startRecording();
+    benchmark.setCodeQueries(&queries);
+    QJsonObject report = benchmark.run(images);
+    if(parser.isSet(recordOption))
+    {
+        queries.stopRecording();
+        QString error;
+        if(!queries.save(parser.value(recordOption), error))
+        {
+            fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+            return 1;
+        }
+        report["recordedQueries"] = queries.count();
+    }
+    return writeReport(report, parser.value(outputOption));
+}
@@ -0,0 +1,110 @@
+/*  MemoryStats, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "memorystats.h"
+
+#include <stdlib.h>
+#include <new>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifdef BENCHMARK_WRAP_MALLOC
+#include <atomic>
+
+static std::atomic<quint64> allocations(0);
+
+//The linker sends every call to malloc, calloc and realloc in the benchmark and the static library here with --wrap
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+}
+
+//The C++ allocations are sent to malloc so that they are counted too
+void *operator new(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    if(!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+#endif
+
+bool MemoryStats::canCountAllocations()
+{
+#ifdef BENCHMARK_WRAP_MALLOC
+    return true;
+#else
+    return false;
+#endif
+}
+
+quint64 MemoryStats::allocationCount()
+{
+#ifdef BENCHMARK_WRAP_MALLOC
+    return allocations.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+qint64 MemoryStats::peakResidentBytes()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return -1;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#if defined(Q_OS_OSX)
+    return usage.ru_maxrss;            //This is in bytes on macOS
+#else
+    return usage.ru_maxrss * 1024;     //This is in kilobytes on Linux
+#endif
+#endif
+}
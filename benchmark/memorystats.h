@@ -0,0 +1,25 @@
+/*  MemoryStats, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include <QtGlobal>
+
+//These measure the memory used by the benchmark process.
+namespace MemoryStats
+{
+//Heap allocations are only counted when the benchmark is linked with the malloc wrappers, see CMakeLists.txt.
+//They include the allocations made by StellarSolver, Astrometry.net, SEP and the benchmark, but not the ones made inside the Qt libraries.
+bool canCountAllocations();
+quint64 allocationCount();
+
+//This is the peak resident set size of the process in bytes, or -1 if it is not available on this system.
+qint64 peakResidentBytes();
+}
+
+#endif // MEMORYSTATS_H
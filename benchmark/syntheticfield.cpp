@@ -0,0 +1,83 @@
+/*  SyntheticField, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "syntheticfield.h"
+
+#include <fitsio.h>
+#include <qmath.h>
+#include <random>
+
+//The stars are drawn out to this many sigmas from their centers
+#define STAR_RADIUS_SIGMAS 4
+//The faintest star is this many magnitudes fainter than the brightest one
+#define MAGNITUDE_RANGE 6.0
+
+bool SyntheticField::generate()
+{
+    if(width < 64 || height < 64 || width > UINT16_MAX || height > UINT16_MAX || numStars < 0 || fwhm <= 0)
+        return false;
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::normal_distribution<double> normal(0.0, 1.0);
+
+    //The stars are added to a floating point image first so the noise can be added to the total signal afterwards
+    QVector<float> signal(width * height, 0.0f);
+    double sigma = fwhm / (2 * sqrt(2 * M_LN2));
+    int radius = qCeil(STAR_RADIUS_SIGMAS * sigma);
+    int margin = radius + 2;
+    //The stars would not fit inside the margins
+    if(2 * margin >= width || 2 * margin >= height)
+        return false;
+
+    stars.clear();
+    stars.reserve(numStars);
+    for(int i = 0; i < numStars; i++)
+    {
+        double cx = margin + uniform(random) * (width - 2 * margin);
+        double cy = margin + uniform(random) * (height - 2 * margin);
+        //The square root makes more faint stars than bright ones like a real field
+        double magnitude = MAGNITUDE_RANGE * sqrt(uniform(random));
+        double peak = maxPeak * pow(10, -0.4 * magnitude);
+        stars.append(QPointF(cx, cy));
+
+        for(int y = qFloor(cy) - radius; y <= qCeil(cy) + radius; y++)
+        {
+            double dy = y - cy;
+            float *row = signal.data() + y * width;
+            for(int x = qFloor(cx) - radius; x <= qCeil(cx) + radius; x++)
+            {
+                double dx = x - cx;
+                row[x] += peak * exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+            }
+        }
+    }
+
+    pixels.resize(width * height);
+    uint16_t *p = pixels.data();
+    const float *s = signal.constData();
+    for(int y = 0; y < height; y++)
+    {
+        for(int x = 0; x < width; x++, p++, s++)
+        {
+            double sky = background * (1 + gradient * ((double)x / width - 0.5));
+            double value = sky + *s;
+            value += normal(random) * sqrt(value + readNoise * readNoise);
+            *p = static_cast<uint16_t>(qBound(0.0, value, 65535.0));
+        }
+    }
+
+    stats = FITSImage::Statistic();
+    stats.dataType = TUSHORT;
+    stats.bytesPerPixel = sizeof(uint16_t);
+    stats.ndim = 2;
+    stats.width = width;
+    stats.height = height;
+    stats.samples_per_channel = width * height;
+    stats.size = pixels.size() * sizeof(uint16_t);
+    return true;
+}
@@ -0,0 +1,48 @@
+/*  SyntheticField, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef SYNTHETICFIELD_H
+#define SYNTHETICFIELD_H
+
+//Includes for this project
+#include "structuredefinitions.h"
+
+//QT Includes
+#include <QVector>
+#include <QPointF>
+
+//This makes a 16 bit star field with gaussian stars, a sloped sky background and noise.
+//It is used by the benchmark so the extraction can be measured without any image files,
+//and since the true star positions are known, it can also check how many of the stars were found.
+class SyntheticField
+{
+public:
+    int width = 2048;
+    int height = 1536;
+    int numStars = 400;
+    double fwhm = 3.0;              //The FWHM of the stars in pixels
+    double background = 1000;       //The sky level in ADU at the middle of the image
+    double gradient = 0.1;          //How much the sky changes from one side of the image to the other, as a fraction of the sky level
+    double readNoise = 10;          //The read noise in ADU, the shot noise of the sky and the stars is added to this
+    double maxPeak = 40000;         //The peak of the brightest star in ADU
+    unsigned int seed = 1;          //The same seed always makes the same image
+
+    //This makes the image.  It returns false if the size is not valid.
+    bool generate();
+
+    const FITSImage::Statistic &getStatistics() const {return stats;}
+    const uint8_t *getImageBuffer() const {return reinterpret_cast<const uint8_t *>(pixels.constData());}
+    //These are the true positions of the stars that were put in the image
+    const QVector<QPointF> &getStarPositions() const {return stars;}
+
+private:
+    FITSImage::Statistic stats;
+    QVector<uint16_t> pixels;
+    QVector<QPointF> stars;
+};
+
+#endif // SYNTHETICFIELD_H
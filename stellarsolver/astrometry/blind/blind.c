@@ -245,6 +245,23 @@ void blind_set_cancel_file(blind_t* bp, const char* fn) {
     bp->cancelfname = strdup_safe(fn);
 }
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+void blind_set_cancel_token(blind_t* bp, const int* token) {
+    bp->cancel_token = token;
+}
+
+void blind_set_solved_token(blind_t* bp, const int* token) {
+    bp->solved_token = token;
+}
+
+static anbool is_cancel_token_set(blind_t* bp) {
+    if (bp->cancel_token && __atomic_load_n(bp->cancel_token, __ATOMIC_RELAXED))
+        return TRUE;
+    if (bp->solved_token && __atomic_load_n(bp->solved_token, __ATOMIC_RELAXED))
+        return TRUE;
+    return FALSE;
+}
+
 void blind_set_match_file(blind_t* bp, const char* fn) {
     free(bp->matchfname);
     bp->matchfname = strdup_safe(fn);
@@ -488,7 +505,7 @@ void blind_run(blind_t* bp) {
                 break;
             if (bp->single_field_solved)
                 break;
-            if (bp->cancelled)
+            if (bp->cancelled || is_cancel_token_set(bp)) //# Modified by Robert Lancaster for the StellarSolver Internal Library
                 break;
 
             // Load the index...
@@ -596,6 +613,11 @@ int blind_is_run_obsolete(blind_t* bp, solver_t* sp) {
             return 1;
     }
     // Early check to see if this job was cancelled.
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    if (is_cancel_token_set(bp)) {
+        logverb("Run cancelled.\n");
+        return 1;
+    }
     if (bp->cancelfname) {
         if (file_exists(bp->cancelfname)) {
             logerr("Run cancelled.\n");
@@ -876,6 +898,11 @@ static time_t timer_callback(void* user_data) {
         logmsg("File \"%s\" exists: cancelling.\n", bp->cancelfname);
         return 0;
     }
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    if (is_cancel_token_set(bp)) {
+        bp->cancelled = TRUE;
+        return 0;
+    }
     return 1; // wait 1 second... FIXME config?
 }
 
@@ -1002,11 +1029,14 @@ static void solve_fields(blind_t* bp, sip_t* verify_wcs) {
         sp->numscaleok = 0;
         sp->num_cxdx_skipped = 0;
         sp->num_verified = 0;
+        sp->num_scratch_allocs = 0; //# Modified by Robert Lancaster for the StellarSolver Internal Library
         sp->quit_now = FALSE;
         sp->mo_template = &template ;
         sp->record_match_callback = record_match_callback;
         sp->timer_callback = timer_callback;
         sp->userdata = bp;
+        sp->cancel_token = bp->cancel_token; //# Modified by Robert Lancaster for the StellarSolver Internal Library
+        sp->solved_token = bp->solved_token; //# Modified by Robert Lancaster for the StellarSolver Internal Library
         solver_reset_best_match(sp);
 
         bp->fieldnum = fieldnum;
@@ -1037,7 +1067,7 @@ static void solve_fields(blind_t* bp, sip_t* verify_wcs) {
             if (sp->maxmatches && sp->nummatches >= sp->maxmatches)
                 logmsg("  exceeded the number of quads to match: %i >= %i.\n",
                        sp->nummatches, sp->maxmatches);
-            if (bp->cancelled)
+            if (bp->cancelled || is_cancel_token_set(bp))
                 logmsg("  cancelled at user request.\n");
         }
 
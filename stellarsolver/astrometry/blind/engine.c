@@ -212,11 +212,21 @@ int engine_add_index(engine_t* engine, char* path) {
     return 0;
 }
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+//This adds an index that is owned by the caller, it will not be freed by engine_free
+int engine_add_loaded_index(engine_t* engine, index_t* ind) {
+    if (!ind)
+        return -1;
+    return add_index(engine, ind);
+}
+
 static void add_index_to_blind(engine_t* engine, blind_t* bp,
                                int i) {
     index_t* index;
     index = pl_get(engine->indexes, i);
-    if (engine->inparallel) {
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    //Indexes that are already fully loaded (from the cache) don't need to be loaded again by name
+    if (engine->inparallel || index->codekd) {
         blind_add_loaded_index(bp, index);
     } else {
         blind_add_index(bp, index->indexname);
@@ -313,6 +313,27 @@ static const int NBACK = 2;
 
 static void find_field_boundaries(solver_t* solver);
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+void solver_set_code_recorder(solver_t* solver, solver_code_recorder_t recorder,
+                              void* baton) {
+    solver->code_recorder = recorder;
+    solver->code_recorder_baton = baton;
+}
+
+void solver_set_verify_recorder(solver_t* solver, solver_verify_recorder_t recorder,
+                                void* baton) {
+    solver->verify_recorder = recorder;
+    solver->verify_recorder_baton = baton;
+}
+
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+void solver_set_parallel_for(solver_t* solver, solver_parallel_for_t parallel_for,
+                             void* userdata, int nworkers) {
+    solver->parallel_for = parallel_for;
+    solver->parallel_userdata = userdata;
+    solver->nworkers = nworkers;
+}
+
 static inline double getx(const double* d, int ind) {
     return d[ind*2];
 }
@@ -375,6 +396,8 @@ void solver_reset_counters(solver_t* s) {
     s->num_radec_skipped = 0;
     s->num_abscale_skipped = 0;
     s->num_verified = 0;
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    s->num_scratch_allocs = 0;
 }
 
 double solver_field_width(const solver_t* s) {
@@ -529,6 +552,18 @@ void solver_compute_quad_range(const solver_t* sp, const index_t* index,
     }
 }
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+// Checks quit_now as well as the caller's cancel and solved tokens, if they
+// were given, so that a cancelled (or solved elsewhere) run stops without
+// waiting for the timer callback.
+static inline anbool solver_should_quit(solver_t* solver) {
+    if (unlikely(solver->cancel_token && __atomic_load_n(solver->cancel_token, __ATOMIC_RELAXED)))
+        solver->quit_now = TRUE;
+    if (unlikely(solver->solved_token && __atomic_load_n(solver->solved_token, __ATOMIC_RELAXED)))
+        solver->quit_now = TRUE;
+    return solver->quit_now;
+}
+
 static void try_all_codes(const pquad* pq,
                           const int* fieldstars, int dimquad,
                           solver_t* solver, double tol2);
@@ -551,6 +586,201 @@ static void resolve_matches(kdtree_qres_t* krez, const double *field,
 
 static int solver_handle_hit(solver_t* sp, MatchObj* mo, sip_t* sip, anbool fake_match);
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+// Every AB pair with an acceptable scale needs an "xy" and an "inbox" array
+// of numxy elements.  Rather than two mallocs per pair, they are carved out
+// of large blocks, which are all freed together at the end of solver_run.
+#define PQUAD_ARENA_BLOCK_SIZE (4 * 1024 * 1024)
+#define PQUAD_ARENA_ALIGN 16
+
+typedef struct pquad_arena_block {
+    struct pquad_arena_block* next;
+    size_t size;
+    size_t used;
+} pquad_arena_block;
+
+// The block header is padded so the data after it stays aligned.
+#define PQUAD_ARENA_HEADER (((sizeof(pquad_arena_block) + PQUAD_ARENA_ALIGN - 1) / PQUAD_ARENA_ALIGN) * PQUAD_ARENA_ALIGN)
+
+static void* pquad_arena_alloc(pquad_arena_block** arena, size_t size, solver_t* solver) {
+    pquad_arena_block* block = *arena;
+    void* mem;
+    size = ((size + PQUAD_ARENA_ALIGN - 1) / PQUAD_ARENA_ALIGN) * PQUAD_ARENA_ALIGN;
+    if (!block || block->used + size > block->size) {
+        size_t blocksize = MAX(size, PQUAD_ARENA_BLOCK_SIZE);
+        block = malloc(PQUAD_ARENA_HEADER + blocksize);
+        if (!block) {
+            SYSERROR("Failed to allocate %zu bytes of pquad scratch memory", blocksize);
+            return NULL;
+        }
+        block->size = blocksize;
+        block->used = 0;
+        block->next = *arena;
+        *arena = block;
+        solver->num_scratch_allocs++;
+    }
+    mem = (char*)block + PQUAD_ARENA_HEADER + block->used;
+    block->used += size;
+    return mem;
+}
+
+static void pquad_arena_free(pquad_arena_block** arena) {
+    while (*arena) {
+        pquad_arena_block* next = (*arena)->next;
+        free(*arena);
+        *arena = next;
+    }
+}
+
+// Sets up the scratch arrays for an AB pair; returns FALSE if out of memory.
+static anbool pquad_alloc_scratch(pquad* pq, int numxy, pquad_arena_block** arena, solver_t* solver) {
+    pq->xy = pquad_arena_alloc(arena, numxy * 2 * sizeof(double), solver);
+    pq->inbox = pquad_arena_alloc(arena, numxy * sizeof(anbool), solver);
+    if (!pq->xy || !pq->inbox) {
+        pq->scale_ok = FALSE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+// The codes of an AB pair are not looked up in the code tree one at a time.
+// They are kept here, up to CODE_BATCH_MAX at once, and looked up together
+// with kdtree_rangesearch_batch.  Then their matches are resolved in the
+// order the codes were made, with the counters that the matches report set
+// back to what they were when each code was made, so the results are the
+// same as looking them up one at a time.
+#define CODE_BATCH_MAX 1024
+
+typedef struct {
+    int stars[DQMAX];
+    int dimquad;
+    anbool parity;
+    int seq;
+    int numtries;
+    int num_cxdx_skipped;
+    int num_meanx_skipped;
+} code_batch_entry;
+
+struct solver_code_batch {
+    int n;
+    int dimcode;
+    double tol2;
+    code_batch_entry entries[CODE_BATCH_MAX];
+    double codes[CODE_BATCH_MAX * DCMAX];
+    kdtree_batch_res_t res;
+
+    // The codes of the AB pair are numbered as they are made.  If a match
+    // makes the solver quit, the codes of the pair are made again, and the
+    // ones after quitseq are looked up one at a time, the way they would
+    // have been without the batch.
+    int seq;
+    int quitseq;
+    anbool replaying;
+    // The number of the code whose matches are being resolved
+    int resolveseq;
+};
+
+static void code_batch_free(solver_t* solver) {
+    if (!solver->codebatch)
+        return;
+    kdtree_free_batch_results(&solver->codebatch->res);
+    free(solver->codebatch);
+    solver->codebatch = NULL;
+}
+
+static void code_batch_flush(solver_t* solver) {
+    struct solver_code_batch* batch = solver->codebatch;
+    int numtries = solver->numtries;
+    int num_cxdx_skipped = solver->num_cxdx_skipped;
+    int num_meanx_skipped = solver->num_meanx_skipped;
+    int k;
+
+    if (!batch->n)
+        return;
+    if (kdtree_rangesearch_batch(solver->index->codekd->tree, &batch->res,
+                                 batch->codes, batch->n, batch->tol2)) {
+        ERROR("Failed to look up %i codes in the code tree", batch->n);
+        batch->n = 0;
+        solver->quit_now = TRUE;
+        return;
+    }
+    for (k=0; k<batch->n; k++) {
+        const code_batch_entry* entry = batch->entries + k;
+        int first = batch->res.first[k];
+        kdtree_qres_t krez;
+        double pixvals[DQMAX*2];
+        int j;
+
+        if (batch->res.first[k + 1] == first)
+            continue;
+        if (unlikely(solver_should_quit(solver)))
+            break;
+        memset(&krez, 0, sizeof(krez));
+        krez.nres = krez.capacity = batch->res.first[k + 1] - first;
+        krez.inds = batch->res.inds + first;
+        krez.sdists = batch->res.sdists + first;
+        for (j=0; j<entry->dimquad; j++) {
+            setx(pixvals, j, field_getx(solver, entry->stars[j]));
+            sety(pixvals, j, field_gety(solver, entry->stars[j]));
+        }
+        solver->numtries = entry->numtries;
+        solver->num_cxdx_skipped = entry->num_cxdx_skipped;
+        solver->num_meanx_skipped = entry->num_meanx_skipped;
+        batch->resolveseq = entry->seq;
+        resolve_matches(&krez, pixvals, entry->stars, entry->dimquad, solver,
+                        entry->parity);
+        if (unlikely(solver_should_quit(solver))) {
+            batch->quitseq = entry->seq;
+            break;
+        }
+    }
+    solver->numtries = numtries;
+    solver->num_cxdx_skipped = num_cxdx_skipped;
+    solver->num_meanx_skipped = num_meanx_skipped;
+    batch->n = 0;
+}
+
+// Returns FALSE if the code has to be looked up now.
+static anbool code_batch_add(solver_t* solver, const int* stars, int dimquad,
+                             const double* code, anbool parity, double tol2) {
+    struct solver_code_batch* batch = solver->codebatch;
+    int dimcode = 2 * (dimquad - NBACK);
+    code_batch_entry* entry;
+    int seq = batch->seq++;
+
+    if (batch->replaying) {
+        // The match at quitseq has already been handled
+        if (seq == batch->quitseq)
+            solver->quit_now = TRUE;
+        return (seq <= batch->quitseq);
+    }
+    // These are made again in the replay
+    if (batch->quitseq >= 0)
+        return TRUE;
+
+    if (batch->n && (batch->tol2 != tol2 || batch->dimcode != dimcode))
+        code_batch_flush(solver);
+    if (unlikely(solver->code_recorder != NULL))
+        solver->code_recorder(solver->index, code, dimcode, tol2, solver->code_recorder_baton);
+
+    entry = batch->entries + batch->n;
+    memcpy(entry->stars, stars, dimquad * sizeof(int));
+    entry->dimquad = dimquad;
+    entry->parity = parity;
+    entry->seq = seq;
+    entry->numtries = solver->numtries;
+    entry->num_cxdx_skipped = solver->num_cxdx_skipped;
+    entry->num_meanx_skipped = solver->num_meanx_skipped;
+    memcpy(batch->codes + batch->n * dimcode, code, dimcode * sizeof(double));
+    batch->dimcode = dimcode;
+    batch->tol2 = tol2;
+    batch->n++;
+    if (batch->n == CODE_BATCH_MAX)
+        code_batch_flush(solver);
+    return TRUE;
+}
+
 static void check_scale(pquad* pq, solver_t* s) {
     double dx, dy;
     dx = field_getx(s, pq->fieldB) - field_getx(s, pq->fieldA);
@@ -706,7 +936,7 @@ static void add_stars(const pquad* pq, int* field, int fieldoffset,
     for (f[adding]=bottom; f[adding]<fieldtop; f[adding]++) {
         if (!pq->inbox[f[adding]])
             continue;
-        if (unlikely(solver->quit_now))
+        if (unlikely(solver_should_quit(solver)))
             return;
 
         // If we've hit the end of the recursion (we're adding the last star),
@@ -723,6 +953,349 @@ static void add_stars(const pquad* pq, int* field, int fieldoffset,
 }
 
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+// Makes all of the codes of one AB pair with the current index: add_stars
+// adds the n_to_add stars after fieldoffset, or if there are none to add,
+// the quad in "field" is tried by itself.
+static void make_pair_codes(pquad* pq, int* field, int fieldoffset,
+                            int n_to_add, int fieldtop, int dimquad,
+                            solver_t* solver, double tol2) {
+    if (n_to_add)
+        add_stars(pq, field, fieldoffset, n_to_add, 0, fieldtop, dimquad, solver, tol2);
+    else
+        TRY_ALL_CODES(pq, field, dimquad, solver, tol2);
+}
+
+// The match of the code numbered quitseq made the solver quit.  Without the
+// batch, the solver doesn't stop right away, it still looks up a few more
+// codes on its way out, so the codes of the pair are made again to find
+// those.  The counters of the codes made must be back where they were
+// before the pair.
+static void replay_pair_codes(pquad* pq, int* field, int fieldoffset,
+                              int n_to_add, int fieldtop, int dimquad,
+                              solver_t* solver, double tol2, int quitseq) {
+    struct solver_code_batch* batch = solver->codebatch;
+
+    solver->quit_now = FALSE;
+    batch->seq = 0;
+    batch->quitseq = quitseq;
+    batch->replaying = TRUE;
+    make_pair_codes(pq, field, fieldoffset, n_to_add, fieldtop, dimquad, solver, tol2);
+    batch->replaying = FALSE;
+    solver->quit_now = TRUE;
+}
+
+/**
+ Tries all of the quads of one AB pair with the current index.  The codes
+ are looked up in batches, see code_batch_add.
+ */
+static void try_pair_codes(pquad* pq, int* field, int fieldoffset,
+                           int n_to_add, int fieldtop, int dimquad,
+                           solver_t* solver, double tol2) {
+    struct solver_code_batch* batch = solver->codebatch;
+    int numtries = solver->numtries;
+    int num_cxdx_skipped = solver->num_cxdx_skipped;
+    int num_meanx_skipped = solver->num_meanx_skipped;
+
+    batch->seq = 0;
+    batch->quitseq = -1;
+    make_pair_codes(pq, field, fieldoffset, n_to_add, fieldtop, dimquad, solver, tol2);
+    code_batch_flush(solver);
+    // A worker only quits when it is cancelled, its matches are handled
+    // afterwards, see run_quad_units.
+    if (batch->quitseq < 0 || solver->worker)
+        return;
+
+    solver->numtries = numtries;
+    solver->num_cxdx_skipped = num_cxdx_skipped;
+    solver->num_meanx_skipped = num_meanx_skipped;
+    replay_pair_codes(pq, field, fieldoffset, n_to_add, fieldtop, dimquad,
+                      solver, tol2, batch->quitseq);
+}
+
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+// With solver_set_parallel_for, the AB pairs (with each index) of a new star
+// are kept as "units", up to QUAD_UNITS_MAX at once, and their quads are
+// tried by the workers, unit u by worker (u % nworkers).  Each worker
+// searches with its own copy of the solver, and its own code batch and
+// query results; it doesn't verify its matches, it keeps them with what
+// the counters were when they were found.  Then the solver's thread goes
+// through the units in order and handles the matches the way it would have
+// without the workers, so the same matches are verified in the same order
+// and the first one that solves is the same.
+#define QUAD_UNITS_MAX 4096
+// Fewer units than this are tried in the solver's thread
+#define QUAD_UNITS_MIN_PARALLEL 16
+
+// The counters that trying quads adds to
+typedef struct {
+    int numtries;
+    int nummatches;
+    int numscaleok;
+    int num_cxdx_skipped;
+    int num_meanx_skipped;
+    int num_radec_skipped;
+    int num_abscale_skipped;
+} solver_counts;
+
+static void get_counts(const solver_t* s, solver_counts* counts) {
+    counts->numtries = s->numtries;
+    counts->nummatches = s->nummatches;
+    counts->numscaleok = s->numscaleok;
+    counts->num_cxdx_skipped = s->num_cxdx_skipped;
+    counts->num_meanx_skipped = s->num_meanx_skipped;
+    counts->num_radec_skipped = s->num_radec_skipped;
+    counts->num_abscale_skipped = s->num_abscale_skipped;
+}
+
+// Sets the counters to base + add.
+static void set_counts(solver_t* s, const solver_counts* base, const solver_counts* add) {
+    s->numtries = base->numtries + add->numtries;
+    s->nummatches = base->nummatches + add->nummatches;
+    s->numscaleok = base->numscaleok + add->numscaleok;
+    s->num_cxdx_skipped = base->num_cxdx_skipped + add->num_cxdx_skipped;
+    s->num_meanx_skipped = base->num_meanx_skipped + add->num_meanx_skipped;
+    s->num_radec_skipped = base->num_radec_skipped + add->num_radec_skipped;
+    s->num_abscale_skipped = base->num_abscale_skipped + add->num_abscale_skipped;
+}
+
+typedef struct {
+    // What try_pair_codes is called with
+    pquad* pq;
+    index_t* index;
+    int field[DQMAX];
+    int fieldoffset;
+    int n_to_add;
+    int fieldtop;
+    int dimquad;
+    double rel_field_noise2;
+    double tol2;
+    // What the worker found: its matches, and what it added to the counters
+    int firstmatch;
+    int nmatches;
+    solver_counts counts;
+} quad_unit;
+
+typedef struct {
+    MatchObj mo;
+    // The number of the code that matched, and the counters then, from the
+    // start of the unit
+    int seq;
+    solver_counts counts;
+} quad_match;
+
+struct solver_quad_worker {
+    solver_t solver;
+    struct solver_code_batch* codebatch;
+    kdtree_qres_t* qres;
+    quad_match* matches;
+    int nmatches;
+    int maxmatches;
+};
+
+typedef struct {
+    solver_t* solver;
+    quad_unit* units;
+    int n;
+    struct solver_quad_worker* workers;
+    int nworkers;
+} quad_units;
+
+// Called by resolve_matches in a worker, instead of solver_handle_hit.
+static void quad_worker_keep_match(solver_t* solver, const MatchObj* mo) {
+    struct solver_quad_worker* worker = solver->worker;
+    quad_match* match;
+
+    if (worker->nmatches == worker->maxmatches) {
+        int maxmatches = MAX(16, 2 * worker->maxmatches);
+        quad_match* matches = realloc(worker->matches, maxmatches * sizeof(quad_match));
+        if (!matches) {
+            SYSERROR("Failed to allocate room for %i quad matches", maxmatches);
+            solver->quit_now = TRUE;
+            return;
+        }
+        worker->matches = matches;
+        worker->maxmatches = maxmatches;
+        solver->num_scratch_allocs++;
+    }
+    match = worker->matches + worker->nmatches++;
+    memcpy(&match->mo, mo, sizeof(MatchObj));
+    match->seq = solver->codebatch->resolveseq;
+    get_counts(solver, &match->counts);
+}
+
+// Sets up the units and workers; returns FALSE if out of memory.
+static anbool quad_units_init(quad_units* qu, solver_t* solver) {
+    int w;
+    memset(qu, 0, sizeof(quad_units));
+    qu->solver = solver;
+    if (!solver->parallel_for || solver->nworkers <= 1)
+        return TRUE;
+    qu->units = malloc(QUAD_UNITS_MAX * sizeof(quad_unit));
+    qu->workers = calloc(solver->nworkers, sizeof(struct solver_quad_worker));
+    if (!qu->units || !qu->workers) {
+        SYSERROR("Failed to allocate the quad search workers");
+        return FALSE;
+    }
+    qu->nworkers = solver->nworkers;
+    solver->num_scratch_allocs += 2;
+    for (w=0; w<qu->nworkers; w++) {
+        qu->workers[w].codebatch = calloc(1, sizeof(struct solver_code_batch));
+        if (!qu->workers[w].codebatch) {
+            SYSERROR("Failed to allocate the code batch of a quad search worker");
+            return FALSE;
+        }
+        solver->num_scratch_allocs++;
+    }
+    return TRUE;
+}
+
+static void quad_units_free(quad_units* qu) {
+    int w;
+    if (qu->workers) {
+        for (w=0; w<qu->nworkers; w++) {
+            struct solver_quad_worker* worker = qu->workers + w;
+            if (worker->codebatch)
+                kdtree_free_batch_results(&worker->codebatch->res);
+            free(worker->codebatch);
+            kdtree_free_query(worker->qres);
+            free(worker->matches);
+        }
+    }
+    free(qu->workers);
+    free(qu->units);
+    memset(qu, 0, sizeof(quad_units));
+}
+
+// Each worker tries every nworkers-th unit.
+static void quad_units_task(void* baton, int w) {
+    quad_units* qu = baton;
+    struct solver_quad_worker* worker = qu->workers + w;
+    solver_t* solver = &worker->solver;
+    solver_counts zero;
+    int u;
+
+    memset(&zero, 0, sizeof(zero));
+    for (u=w; u<qu->n; u+=qu->nworkers) {
+        quad_unit* unit = qu->units + u;
+        set_counts(solver, &zero, &zero);
+        set_index(solver, unit->index);
+        solver->rel_field_noise2 = unit->rel_field_noise2;
+        unit->firstmatch = worker->nmatches;
+        try_pair_codes(unit->pq, unit->field, unit->fieldoffset, unit->n_to_add,
+                       unit->fieldtop, unit->dimquad, solver, unit->tol2);
+        unit->nmatches = worker->nmatches - unit->firstmatch;
+        get_counts(solver, &unit->counts);
+        if (unlikely(solver_should_quit(solver)))
+            return;
+    }
+}
+
+// Tries the quads of the units that are waiting, and handles their matches.
+static void run_quad_units(quad_units* qu) {
+    solver_t* solver = qu->solver;
+    anbool quit = FALSE;
+    int u, w, k;
+
+    if (!qu->n)
+        return;
+    if (qu->n < QUAD_UNITS_MIN_PARALLEL) {
+        for (u=0; u<qu->n; u++) {
+            quad_unit* unit = qu->units + u;
+            set_index(solver, unit->index);
+            solver->rel_field_noise2 = unit->rel_field_noise2;
+            try_pair_codes(unit->pq, unit->field, unit->fieldoffset, unit->n_to_add,
+                           unit->fieldtop, unit->dimquad, solver, unit->tol2);
+            if (solver_should_quit(solver))
+                break;
+        }
+        qu->n = 0;
+        return;
+    }
+
+    for (w=0; w<qu->nworkers; w++) {
+        struct solver_quad_worker* worker = qu->workers + w;
+        memcpy(&worker->solver, solver, sizeof(solver_t));
+        worker->solver.codebatch = worker->codebatch;
+        worker->solver.qres = worker->qres;
+        worker->solver.worker = worker;
+        worker->solver.parallel_for = NULL;
+        worker->solver.num_scratch_allocs = 0;
+        worker->nmatches = 0;
+    }
+    solver->parallel_for(qu->nworkers, quad_units_task, qu, solver->parallel_userdata);
+    for (w=0; w<qu->nworkers; w++) {
+        struct solver_quad_worker* worker = qu->workers + w;
+        worker->qres = worker->solver.qres;
+        solver->num_scratch_allocs += worker->solver.num_scratch_allocs;
+        if (worker->solver.quit_now)
+            quit = TRUE;
+    }
+    // A worker was cancelled or ran out of memory
+    if (quit) {
+        solver->quit_now = TRUE;
+        qu->n = 0;
+        return;
+    }
+
+    for (u=0; u<qu->n; u++) {
+        quad_unit* unit = qu->units + u;
+        struct solver_quad_worker* worker = qu->workers + (u % qu->nworkers);
+        solver_counts base;
+
+        get_counts(solver, &base);
+        set_index(solver, unit->index);
+        solver->rel_field_noise2 = unit->rel_field_noise2;
+        for (k=0; k<unit->nmatches; k++) {
+            quad_match* match = worker->matches + unit->firstmatch + k;
+            set_counts(solver, &base, &match->counts);
+            match->mo.quads_tried += base.numtries;
+            match->mo.quads_matched += base.nummatches;
+            match->mo.quads_scaleok += base.numscaleok;
+            match->mo.timeused = solver->timeused;
+            if (solver_handle_hit(solver, &match->mo, NULL, FALSE))
+                solver->quit_now = TRUE;
+            if (unlikely(solver_should_quit(solver))) {
+                solver->numtries = base.numtries;
+                solver->num_cxdx_skipped = base.num_cxdx_skipped;
+                solver->num_meanx_skipped = base.num_meanx_skipped;
+                replay_pair_codes(unit->pq, unit->field, unit->fieldoffset, unit->n_to_add,
+                                  unit->fieldtop, unit->dimquad, solver, unit->tol2,
+                                  match->seq);
+                qu->n = 0;
+                return;
+            }
+        }
+        set_counts(solver, &base, &unit->counts);
+    }
+    qu->n = 0;
+}
+
+// Tries the quads of an AB pair with the current index, right away, or
+// later in the workers.
+static void add_quad_unit(quad_units* qu, pquad* pq, int* field, int fieldoffset,
+                          int n_to_add, int fieldtop, int dimquad, double tol2) {
+    solver_t* solver = qu->solver;
+    quad_unit* unit;
+
+    if (!qu->units) {
+        try_pair_codes(pq, field, fieldoffset, n_to_add, fieldtop, dimquad, solver, tol2);
+        return;
+    }
+    unit = qu->units + qu->n++;
+    unit->pq = pq;
+    unit->index = solver->index;
+    memcpy(unit->field, field, sizeof(unit->field));
+    unit->fieldoffset = fieldoffset;
+    unit->n_to_add = n_to_add;
+    unit->fieldtop = fieldtop;
+    unit->dimquad = dimquad;
+    unit->rel_field_noise2 = solver->rel_field_noise2;
+    unit->tol2 = tol2;
+    if (qu->n == QUAD_UNITS_MAX)
+        run_quad_units(qu);
+}
+
 // The real deal
 void solver_run(solver_t* solver) {
     int numxy, newpoint;
@@ -730,6 +1303,9 @@ void solver_run(solver_t* solver) {
     // first timer callback is called after 1 second
     time_t next_timer_callback_time = time(NULL) + 1;
     pquad* pquads;
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    pquad_arena_block* arena = NULL;
+    quad_units units;
     size_t i, num_indexes;
     double tol2;
     int field[DQMAX];
@@ -762,6 +1338,8 @@ void solver_run(solver_t* solver) {
     }
 
     num_indexes = pl_size(solver->indexes);
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    memset(&units, 0, sizeof(units));
     {
 #ifndef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
         double minAB2s[num_indexes];
@@ -810,6 +1388,21 @@ void solver_run(solver_t* solver) {
          */
 
         pquads = calloc(numxy * numxy, sizeof(pquad));
+        //# Modified by Robert Lancaster for the StellarSolver Internal Library
+        if (!pquads) {
+            SYSERROR("Failed to allocate pquad array for %i stars", numxy);
+            goto quitnow;
+        }
+        solver->num_scratch_allocs++;
+        //# Modified by Robert Lancaster for the StellarSolver Internal Library
+        solver->codebatch = calloc(1, sizeof(struct solver_code_batch));
+        if (!solver->codebatch) {
+            SYSERROR("Failed to allocate the code batch");
+            goto quitnow;
+        }
+        solver->num_scratch_allocs++;
+        if (!quad_units_init(&units, solver))
+            goto quitnow;
 
         /* We maintain an array of "potential quads" (pquad) structs, where
          * each struct corresponds to one choice of stars A and B; the struct
@@ -845,8 +1438,9 @@ void solver_run(solver_t* solver) {
                         debug("  bad scale for A=%i, B=%i\n", field[A], field[B]);
                         continue;
                     }
-                    pq->xy = malloc(numxy * 2 * sizeof(double));
-                    pq->inbox = malloc(numxy * sizeof(anbool));
+                    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+                    if (!pquad_alloc_scratch(pq, numxy, &arena, solver))
+                        goto quitnow;
                     memset(pq->inbox, TRUE, solver->startobj);
                     pq->ninbox = solver->startobj;
                     pq->inbox[field[A]] = FALSE;
@@ -887,6 +1481,10 @@ void solver_run(solver_t* solver) {
                 }
             }
 
+            //# Modified by Robert Lancaster for the StellarSolver Internal Library
+            if (solver_should_quit(solver))
+                break;
+
             solver->last_examined_object = newpoint;
             // quads with the new star on the diagonal:
             field[B] = newpoint;
@@ -905,8 +1503,9 @@ void solver_run(solver_t* solver) {
                     continue;
                 }
                 // initialize the "inbox" array:
-                pq->inbox = malloc(numxy * sizeof(anbool));
-                pq->xy = malloc(numxy * 2 * sizeof(double));
+                //# Modified by Robert Lancaster for the StellarSolver Internal Library
+                if (!pquad_alloc_scratch(pq, numxy, &arena, solver))
+                    goto quitnow;
                 // -try all stars up to "newpoint"...
                 assert(sizeof(anbool) == 1);
                 memset(pq->inbox, TRUE, newpoint + 1);
@@ -938,13 +1537,16 @@ void solver_run(solver_t* solver) {
                     tol2 = get_tolerance(solver);
                     // Now look at all sets of (C, D, ...) stars (subject to field[C] < field[D] < ...)
                     // ("dimquads - 2" because we've set stars A and B at this point)
-                    add_stars(pq, field, C, dimquads-2, 0, newpoint, dimquads, solver, tol2);
-                    if (solver->quit_now)
+                    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+                    add_quad_unit(&units, pq, field, C, dimquads-2, newpoint, dimquads, tol2);
+                    if (solver_should_quit(solver))
                         goto quitnow;
                 }
             }
+            //# Modified by Robert Lancaster for the StellarSolver Internal Library
+            run_quad_units(&units);
 
-            if (solver->quit_now)
+            if (solver_should_quit(solver))
                 goto quitnow;
 
             // Now try building quads with the new star not on the diagonal:
@@ -985,33 +1587,37 @@ void solver_run(solver_t* solver) {
 
                         tol2 = get_tolerance(solver);
 
-                        if (dimquads > 3) {
-                            // ("dimquads - 3" because we've set stars A, B, and C at this point)
-                            add_stars(pq, field, D, dimquads-3, 0, newpoint, dimquads, solver, tol2);
-                        } else {
-                            TRY_ALL_CODES(pq, field, dimquads, solver, tol2);
-                        }
-                        if (solver->quit_now)
+                        //# Modified by Robert Lancaster for the StellarSolver Internal Library
+                        // ("dimquads - 3" because we've set stars A, B, and C at this point;
+                        // with none to add, the quad ABC is tried by itself)
+                        add_quad_unit(&units, pq, field, D, dimquads-3, newpoint, dimquads, tol2);
+                        if (solver_should_quit(solver))
                             goto quitnow;
                     }
                 }
             }
+            //# Modified by Robert Lancaster for the StellarSolver Internal Library
+            run_quad_units(&units);
             logverb("object %u of %u: %i quads tried, %i matched.\n",
                     newpoint + 1, numxy, solver->numtries, solver->nummatches);
 
             if ((solver->maxquads && (solver->numtries >= solver->maxquads))
                 || (solver->maxmatches && (solver->nummatches >= solver->maxmatches))
-                || solver->quit_now)
+                || solver_should_quit(solver))
                 break;
         }
 
     quitnow:
-        for (i = 0; i < (numxy*numxy); i++) {
-            pquad* pq = pquads + i;
-            free(pq->inbox);
-            free(pq->xy);
-        }
+        //# Modified by Robert Lancaster for the StellarSolver Internal Library
+        // The pquad arrays all live in the arena blocks.
+        pquad_arena_free(&arena);
         free(pquads);
+        kdtree_free_query(solver->qres);
+        solver->qres = NULL;
+        code_batch_free(solver);
+        quad_units_free(&units);
+        logverb("Solver scratch memory: %i heap allocations for %i quads tried.\n",
+                solver->num_scratch_allocs, solver->numtries);
 
 #ifdef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
         free(minAB2s);
@@ -1077,7 +1683,6 @@ static void try_all_codes_2(const int* fieldstars, int dimquad,
                             const double* code, solver_t* solver,
                             anbool current_parity, double tol2) {
     int i;
-    kdtree_qres_t* result = NULL;
     int dimcode = (dimquad - 2) * 2;
     int stars[DQMAX];
     double flipcode[DCMAX];
@@ -1092,10 +1697,13 @@ static void try_all_codes_2(const int* fieldstars, int dimquad,
     for (i=0; i<DQMAX; i++)
         placed[i] = FALSE;
 
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // The query results are kept in the solver and reused for every quad
+    // of the run, they are freed at the end of solver_run.
     try_permutations(fieldstars, dimquad, code, solver, current_parity,
-                     tol2, stars, NULL, 0, placed, &result);
-    if (unlikely(solver->quit_now))
-        goto bailout;
+                     tol2, stars, NULL, 0, placed, &solver->qres);
+    if (unlikely(solver_should_quit(solver)))
+        return;
 
     // Flipped:
     stars[0] = fieldstars[1];
@@ -1108,10 +1716,7 @@ static void try_all_codes_2(const int* fieldstars, int dimquad,
         placed[i] = FALSE;
 
     try_permutations(fieldstars, dimquad, flipcode, solver, current_parity,
-                     tol2, stars, NULL, 0, placed, &result);
-
- bailout:
-    kdtree_free_query(result);
+                     tol2, stars, NULL, 0, placed, &solver->qres);
 }
 
 /**
@@ -1217,6 +1822,19 @@ static void try_permutations(const int* origstars, int dimquad,
             continue;
 #endif
 				
+            //# Modified by Robert Lancaster for the StellarSolver Internal Library
+            // The code is usually kept, to be looked up with the others of
+            // this AB pair; see code_batch_add.
+            if (code_batch_add(solver, stars, dimquad, code, current_parity, tol2)) {
+                if (unlikely(solver_should_quit(solver)))
+                    return;
+                continue;
+            }
+            if (!*presult)
+                solver->num_scratch_allocs++;
+            if (unlikely(solver->code_recorder != NULL))
+                solver->code_recorder(solver->index, code, 2 * (dimquad - 2), tol2,
+                                      solver->code_recorder_baton);
             // Search with the code we've built.
             *presult = kdtree_rangesearch_options_reuse
                 (solver->index->codekd->tree, *presult, code, tol2, options);
@@ -1233,7 +1851,7 @@ static void try_permutations(const int* origstars, int dimquad,
                 resolve_matches(*presult, pixvals, stars, dimquad, solver,
                                 current_parity);
             }
-            if (unlikely(solver->quit_now))
+            if (unlikely(solver_should_quit(solver)))
                 return;
         }
     }
@@ -1246,22 +1864,15 @@ static void resolve_matches(kdtree_qres_t* krez, const double *field,
     int jj, thisquadno;
     MatchObj mo;
 
-#ifndef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
-        unsigned int star[dimquads];
-#else
-        unsigned int* star = (unsigned int*)malloc(sizeof(unsigned int)*dimquads);
-#endif
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // Fixed-size so that no heap calls are made for each match.
+    unsigned int star[DQMAX];
 
     assert(krez);
 
     for (jj = 0; jj < krez->nres; jj++) {
-
-#ifndef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
-        double starxyz[dimquads*3];
-#else
-        double* starxyz = (double*)malloc(sizeof(double)*dimquads*3);
-#endif
-
+        //# Modified by Robert Lancaster for the StellarSolver Internal Library
+        double starxyz[DQMAX*3];
         double scale;
         double arcsecperpix;
         tan_t wcs;
@@ -1343,25 +1954,21 @@ static void resolve_matches(kdtree_qres_t* krez, const double *field,
 
         set_center_and_radius(solver, &mo, &(mo.wcstan), NULL);
 
+        //# Modified by Robert Lancaster for the StellarSolver Internal Library
+        // A worker keeps the match for the solver's thread, see run_quad_units.
+        if (solver->worker) {
+            quad_worker_keep_match(solver, &mo);
+            if (unlikely(solver->quit_now))
+                return;
+            continue;
+        }
+
         if (solver_handle_hit(solver, &mo, NULL, FALSE))
             solver->quit_now = TRUE;
 
         if (unlikely(solver->quit_now))
-        {
-            #ifdef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
-             free(starxyz);
-             free(star);
-            #endif
             return;
-        }
-
-#ifdef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
-        free(starxyz);
-#endif
     }
-#ifdef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
-        free(star);
-#endif
 }
 
 void solver_inject_match(solver_t* solver, MatchObj* mo, sip_t* sip) {
@@ -1373,6 +1980,8 @@ static int solver_handle_hit(solver_t* sp, MatchObj* mo, sip_t* sip,
     double match_distance_in_pixels2;
     anbool solved;
     double logaccept;
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    double verifystart = 0;
 
     mo->indexid = sp->index->indexid;
     mo->healpix = sp->index->healpix;
@@ -1386,12 +1995,17 @@ static int solver_handle_hit(solver_t* sp, MatchObj* mo, sip_t* sip,
 
     logaccept = MIN(sp->logratio_tokeep, sp->logratio_totune);
 
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    if (unlikely(sp->verify_recorder != NULL))
+        verifystart = timenow();
     verify_hit(sp->index->starkd, sp->index->cutnside,
                mo, sip, sp->vf, match_distance_in_pixels2,
                sp->distractor_ratio, sp->field_maxx, sp->field_maxy,
                sp->logratio_bail_threshold, logaccept,
                sp->logratio_stoplooking,
                sp->distance_from_quad_bonus, fake_match);
+    if (unlikely(sp->verify_recorder != NULL))
+        sp->verify_recorder(sp->index, timenow() - verifystart, sp->verify_recorder_baton);
     mo->nverified = sp->num_verified++;
 
     if (mo->logodds >= sp->best_logodds) {
@@ -67,6 +67,202 @@ typedef struct verify_s verify_t;
 
 static anbool* verify_deduplicate_field_stars(verify_t* v, const verify_field_t* vf, double nsigmas);
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+// Verification needs a handful of arrays the size of the reference and test
+// star lists for every match, and used to build a kd-tree of the reference
+// stars each time.  They are all taken from an arena instead, which is reset
+// at the start of each verification, and the reference stars are put in a
+// grid of cells, which is quicker to make than a tree for so few stars.
+#define VERIFY_ARENA_BLOCK_SIZE (256 * 1024)
+#define VERIFY_ARENA_ALIGN 16
+// About this many reference stars go in each cell of the grid
+#define VERIFY_GRID_STARS_PER_CELL 2
+// The grid has at most this many cells on a side
+#define VERIFY_GRID_MAX_SIDE 256
+
+typedef struct verify_arena_block {
+    struct verify_arena_block* next;
+    size_t size;
+    size_t used;
+} verify_arena_block;
+
+#define VERIFY_ARENA_HEADER (((sizeof(verify_arena_block) + VERIFY_ARENA_ALIGN - 1) / VERIFY_ARENA_ALIGN) * VERIFY_ARENA_ALIGN)
+
+struct verify_workspace_t {
+    verify_arena_block* arena;
+    // The reference stars in the bounding circle of the field
+    kdtree_qres_t* refres;
+};
+typedef struct verify_workspace_t verify_workspace_t;
+
+// The reference stars, sorted by grid cell; "inds" are their positions in
+// the permutation the grid was made with.
+typedef struct {
+    double x0, y0;
+    double invw, invh;
+    int nx, ny;
+    // the stars of cell c are [cellstart[c], cellstart[c+1])
+    int* cellstart;
+    double* xy;
+    int* inds;
+} verify_grid_t;
+
+static void* verify_ws_alloc(verify_workspace_t* ws, size_t size) {
+    verify_arena_block* block = ws->arena;
+    void* mem;
+    size = ((size + VERIFY_ARENA_ALIGN - 1) / VERIFY_ARENA_ALIGN) * VERIFY_ARENA_ALIGN;
+    if (!block || block->used + size > block->size) {
+        size_t blocksize = MAX(size, VERIFY_ARENA_BLOCK_SIZE);
+        block = malloc(VERIFY_ARENA_HEADER + blocksize);
+        if (!block) {
+            logerr("Failed to allocate %zu bytes of verification scratch memory\n", blocksize);
+            return NULL;
+        }
+        block->size = blocksize;
+        block->used = 0;
+        block->next = ws->arena;
+        ws->arena = block;
+    }
+    mem = (char*)block + VERIFY_ARENA_HEADER + block->used;
+    block->used += size;
+    return mem;
+}
+
+// Makes everything taken from the arena available again.  If it took more
+// than one block, they are replaced by one block big enough for all of it,
+// so that after the first few matches the arena doesn't allocate any more.
+static void verify_ws_reset(verify_workspace_t* ws) {
+    verify_arena_block* block = ws->arena;
+    size_t total = 0;
+    if (!block)
+        return;
+    if (!block->next) {
+        block->used = 0;
+        return;
+    }
+    while (block) {
+        verify_arena_block* next = block->next;
+        total += block->size;
+        free(block);
+        block = next;
+    }
+    ws->arena = NULL;
+    if (verify_ws_alloc(ws, total))
+        ws->arena->used = 0;
+}
+
+static void verify_ws_free_memory(verify_workspace_t* ws) {
+    while (ws->arena) {
+        verify_arena_block* next = ws->arena->next;
+        free(ws->arena);
+        ws->arena = next;
+    }
+    kdtree_free_query(ws->refres);
+    ws->refres = NULL;
+}
+
+// Puts the stars xy[perm[i]] in the grid.
+static void verify_grid_build(verify_grid_t* grid, verify_workspace_t* ws,
+                              const double* xy, const int* perm, int N) {
+    double xlo = HUGE_VAL, xhi = -HUGE_VAL, ylo = HUGE_VAL, yhi = -HUGE_VAL;
+    double w, h, ncells, nx, ny;
+    int* cells;
+    int i, c;
+
+    for (i=0; i<N; i++) {
+        const double* p = xy + 2*perm[i];
+        xlo = MIN(xlo, p[0]);
+        xhi = MAX(xhi, p[0]);
+        ylo = MIN(ylo, p[1]);
+        yhi = MAX(yhi, p[1]);
+    }
+    w = xhi - xlo;
+    h = yhi - ylo;
+    ncells = MAX(1.0, (double)N / VERIFY_GRID_STARS_PER_CELL);
+    if (w > 0 && h > 0) {
+        nx = ceil(sqrt(ncells * w / h));
+        ny = ceil(ncells / nx);
+    } else {
+        nx = (w > 0 ? ceil(ncells) : 1);
+        ny = (h > 0 ? ceil(ncells) : 1);
+    }
+    // (clamped before they are made ints, a very thin field could overflow)
+    grid->nx = (int)MIN(MAX(nx, 1), VERIFY_GRID_MAX_SIDE);
+    grid->ny = (int)MIN(MAX(ny, 1), VERIFY_GRID_MAX_SIDE);
+    grid->x0 = xlo;
+    grid->y0 = ylo;
+    grid->invw = (w > 0 ? grid->nx / w : 0.0);
+    grid->invh = (h > 0 ? grid->ny / h : 0.0);
+
+    grid->cellstart = verify_ws_alloc(ws, (grid->nx * grid->ny + 1) * sizeof(int));
+    grid->xy = verify_ws_alloc(ws, 2 * N * sizeof(double));
+    grid->inds = verify_ws_alloc(ws, N * sizeof(int));
+    cells = verify_ws_alloc(ws, N * sizeof(int));
+
+    // Counting sort of the stars by cell
+    memset(grid->cellstart, 0, (grid->nx * grid->ny + 1) * sizeof(int));
+    for (i=0; i<N; i++) {
+        const double* p = xy + 2*perm[i];
+        int cx = MIN((int)((p[0] - xlo) * grid->invw), grid->nx - 1);
+        int cy = MIN((int)((p[1] - ylo) * grid->invh), grid->ny - 1);
+        cells[i] = cy * grid->nx + cx;
+        grid->cellstart[cells[i] + 1]++;
+    }
+    for (c=0; c<grid->nx * grid->ny; c++)
+        grid->cellstart[c + 1] += grid->cellstart[c];
+    for (i=0; i<N; i++) {
+        int k = grid->cellstart[cells[i]]++;
+        grid->xy[2*k+0] = xy[2*perm[i]+0];
+        grid->xy[2*k+1] = xy[2*perm[i]+1];
+        grid->inds[k] = i;
+    }
+    // The starts were moved to the ends, move them back
+    for (c=grid->nx * grid->ny; c>0; c--)
+        grid->cellstart[c] = grid->cellstart[c - 1];
+    grid->cellstart[0] = 0;
+}
+
+// The cell column or row of a coordinate, clamped to the grid
+static int verify_grid_cell(double v, double v0, double inv, int n) {
+    double c = (v - v0) * inv;
+    if (c < 0)
+        return 0;
+    if (c >= n - 1)
+        return n - 1;
+    return (int)c;
+}
+
+// Like kdtree_nearest_neighbour_within: returns the index of the star nearest
+// to "pt" with a squared distance no more than maxd2, or -1.
+static int verify_grid_nearest_within(const verify_grid_t* grid, const double* pt,
+                                      double maxd2, double* p_d2) {
+    double r = sqrt(maxd2);
+    double bestd2 = maxd2;
+    int ibest = -1;
+    int cx0 = verify_grid_cell(pt[0] - r, grid->x0, grid->invw, grid->nx);
+    int cx1 = verify_grid_cell(pt[0] + r, grid->x0, grid->invw, grid->nx);
+    int cy0 = verify_grid_cell(pt[1] - r, grid->y0, grid->invh, grid->ny);
+    int cy1 = verify_grid_cell(pt[1] + r, grid->y0, grid->invh, grid->ny);
+    int cy, k;
+
+    for (cy=cy0; cy<=cy1; cy++) {
+        const int* start = grid->cellstart + cy * grid->nx;
+        // The cells of a row are next to each other
+        for (k=start[cx0]; k<start[cx1 + 1]; k++) {
+            double dx = pt[0] - grid->xy[2*k+0];
+            double dy = pt[1] - grid->xy[2*k+1];
+            double d2 = dx*dx + dy*dy;
+            if (d2 > bestd2)
+                continue;
+            bestd2 = d2;
+            ibest = grid->inds[k];
+        }
+    }
+    if (ibest != -1)
+        *p_d2 = bestd2;
+    return ibest;
+}
+
 verify_field_t* verify_field_preprocess(const starxy_t* fieldxy) {
     verify_field_t* vf;
     int Nleaf = 5;
@@ -95,6 +291,13 @@ verify_field_t* verify_field_preprocess(const starxy_t* fieldxy) {
     vf->do_dedup = TRUE;
     vf->do_ror = TRUE;
 
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    vf->ws = calloc(1, sizeof(verify_workspace_t));
+    if (!vf->ws) {
+        fprintf(stderr, "Failed to allocate the verification workspace.\n");
+        return NULL;
+    }
+
     return vf;
 }
 
@@ -102,6 +305,11 @@ void verify_field_free(verify_field_t* vf) {
     if (!vf)
         return;
     kdtree_free(vf->ftree);
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    if (vf->ws) {
+        verify_ws_free_memory(vf->ws);
+        free(vf->ws);
+    }
     free(vf->xy);
     free(vf->fieldcopy);
     free(vf);
@@ -451,7 +659,9 @@ static void verify_apply_ror(verify_t* v,
         *p_uninh = uni_nh;
 }
 
-static double real_verify_star_lists(verify_t* v,
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+// The arrays returned in p_logodds and p_theta are in the workspace "ws".
+static double real_verify_star_lists(verify_t* v, verify_workspace_t* ws,
                                      double effective_area,
                                      double distractors,
                                      double logodds_bail,
@@ -469,9 +679,8 @@ static double real_verify_star_lists(verify_t* v,
     double logbg;
     double logd;
     //double matchnsigma = 5.0;
-    double* refcopy;
-    kdtree_t* rtree;
-    int Nleaf = 10;
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    verify_grid_t rgrid;
     int* rmatches;
     double* rprobs;
     double* all_logodds = NULL;
@@ -484,32 +693,28 @@ static double real_verify_star_lists(verify_t* v,
         return -HUGE_VAL;
     }
 
-    // Build a tree out of the index stars in pixel space...
-    // kdtree scrambles the data array so make a copy first.
-    refcopy = malloc(2 * v->NR * sizeof(double));
-    // we must pack/unpermute the refxys; remember this packing order in "rperm".
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // Put the index stars in a grid in pixel space.
+    // "refperm" gets changed by the callers, remember the order here in "rperm".
     // we borrow storage for "rperm"...
     if (!v->badguys)
-        v->badguys = malloc(v->NR * sizeof(int));
+        v->badguys = verify_ws_alloc(ws, v->NR * sizeof(int));
     rperm = v->badguys;
-    for (i=0; i<v->NR; i++) {
-        int ri = v->refperm[i];
-        rperm[i] = ri;
-        refcopy[2*i+0] = v->refxy[2*ri+0];
-        refcopy[2*i+1] = v->refxy[2*ri+1];
-    }
-    rtree = kdtree_build(NULL, refcopy, v->NR, 2, Nleaf, KDTT_DOUBLE, KD_BUILD_SPLIT);
+    memcpy(rperm, v->refperm, v->NR * sizeof(int));
+    verify_grid_build(&rgrid, ws, v->refxy, rperm, v->NR);
 
-    rmatches = malloc(v->NR * sizeof(int));
+    rmatches = verify_ws_alloc(ws, v->NR * sizeof(int));
     for (i=0; i<v->NR; i++)
         rmatches[i] = -1;
 
-    rprobs = malloc(v->NR * sizeof(double));
+    rprobs = verify_ws_alloc(ws, v->NR * sizeof(double));
     for (i=0; i<v->NR; i++)
         rprobs[i] = -HUGE_VAL;
 
-    if (p_logodds || data_log_passes(DATALOG_MASK_VERIFY, DLOG_ODDS))
-        all_logodds = calloc(v->NT, sizeof(double));
+    if (p_logodds || data_log_passes(DATALOG_MASK_VERIFY, DLOG_ODDS)) {
+        all_logodds = verify_ws_alloc(ws, v->NT * sizeof(double));
+        memset(all_logodds, 0, v->NT * sizeof(double));
+    }
     if (p_logodds)
         *p_logodds = all_logodds;
 	
@@ -518,7 +723,7 @@ static double real_verify_star_lists(verify_t* v,
     if (p_istopped)
         *p_istopped = -1;
 
-    theta = malloc(v->NT * sizeof(int));
+    theta = verify_ws_alloc(ws, v->NT * sizeof(int));
 
     logbg = log(1.0 / effective_area);
 
@@ -548,7 +753,7 @@ static double real_verify_star_lists(verify_t* v,
         debug2("test star %i: (%.1f,%.1f), sigma: %.1f\n", i, testxy[0], testxy[1], sqrt(sig2));
 
         // find nearest ref star (within 5 sigma)
-        tmpi = kdtree_nearest_neighbour_within(rtree, testxy, sig2 * 25.0, &d2);
+        tmpi = verify_grid_nearest_within(&rgrid, testxy, sig2 * 25.0, &d2);
         if (tmpi == -1) {
             // no nearest neighbour within range.
             debug2("  No nearest neighbour.\n");
@@ -556,8 +761,8 @@ static double real_verify_star_lists(verify_t* v,
             logfg = -HUGE_VAL;
         } else {
             double loggmax;
-            // Note that "refi" is w.r.t. the "refcopy" array (not the original data).
-            refi = kdtree_permute(rtree, tmpi);
+            // Note that "refi" is w.r.t. the "rperm" order (not the original data).
+            refi = tmpi;
             // peak value of the Gaussian
             loggmax = log((1.0 - distractors) / (2.0 * M_PI * sig2 * v->NR));
             // FIXME - do something with uninformative hits?
@@ -754,12 +959,8 @@ static double real_verify_star_lists(verify_t* v,
          */
     }
 
-    free(rmatches);
-
     if (p_theta)
         *p_theta = theta;
-    else
-        free(theta);
 
     if (p_besti)
         *p_besti = besti;
@@ -767,14 +968,6 @@ static double real_verify_star_lists(verify_t* v,
     if (p_worstlogodds)
         *p_worstlogodds = bestworstlogodds;
 
-    if (all_logodds && !*p_logodds)
-        free(all_logodds);
-
-    free(rprobs);
-
-    kdtree_free(rtree);
-    free(refcopy);
-
     return bestlogodds;
 }
 
@@ -1241,12 +1434,16 @@ void verify_hit(const startree_t* skdt, int index_cutnside, MatchObj* mo,
     verify_t* v = &the_v;
     int NRimage;
     int ibailed, istopped;
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    verify_workspace_t* ws = vf->ws;
+    kdtree_qres_t* refres;
 
     assert(mo->wcs_valid || sip);
     assert(isfinite(logaccept));
     assert(isfinite(logbail));
 
     memset(v, 0, sizeof(verify_t));
+    verify_ws_reset(ws);
 
     if (sip)
         v->wcs = sip;
@@ -1292,18 +1489,27 @@ void verify_hit(const startree_t* skdt, int index_cutnside, MatchObj* mo,
      hold these indices temporarily.
      */
     assert(skdt->sweep);
-    // Find all index stars within the bounding circle of the field.
-    startree_search_for(skdt, fieldcenter, fieldr2, &refxyz, NULL, &v->refstarid, &v->NRall);
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // Find all index stars within the bounding circle of the field.  This is
+    // what startree_search_for does, but the results are kept in the workspace.
+    refres = ws->refres = kdtree_rangesearch_options_reuse
+        (skdt->tree, ws->refres, fieldcenter, fieldr2,
+         KD_OPTIONS_SMALL_RADIUS | KD_OPTIONS_RETURN_POINTS | KD_OPTIONS_NO_RESIZE_RESULTS);
+    v->NRall = (refres ? refres->nres : 0);
     debug2("%i reference stars in the bounding circle\n", v->NRall);
-    if (!refxyz) {
+    if (!v->NRall) {
         // no stars in range.
         logverb("No reference stars in the bounding circle\n");
         goto bailout;
     }
+    refxyz = refres->results.d;
+    v->refstarid = verify_ws_alloc(ws, v->NRall * sizeof(int));
+    for (i=0; i<v->NRall; i++)
+        v->refstarid[i] = refres->inds[i];
     //logverb("Found %i reference stars in the bounding circle\n", v->NRall);
     // Find index stars within the rectangular field.
-    v->refxy = malloc(v->NRall * 2 * sizeof(double));
-    v->refperm = malloc(v->NRall * sizeof(int));
+    v->refxy = verify_ws_alloc(ws, v->NRall * 2 * sizeof(double));
+    v->refperm = verify_ws_alloc(ws, v->NRall * sizeof(int));
     igood = 0;
     for (i=0; i<v->NRall; i++) {
         if (!sip_xyzarr2pixelxy(v->wcs, refxyz+i*3, v->refxy+i*2, v->refxy+i*2 +1) ||
@@ -1328,20 +1534,19 @@ void verify_hit(const startree_t* skdt, int index_cutnside, MatchObj* mo,
     // bottom "NRimage" of the "refperm" array will be accessed in the
     // permuted_sort below, so none of
     // the elements between NRimage and NRall will be touched.)
-    sweep = malloc(v->NRall * sizeof(int));
+    sweep = verify_ws_alloc(ws, v->NRall * sizeof(int));
     for (i=0; i<v->NRall; i++)
         sweep[i] = skdt->sweep[v->refstarid[i]];
     // Note here that we're passing in an existing permutation array; it
     // gets re-permuted during this call.
     permuted_sort(sweep, sizeof(int), compare_ints_asc, v->refperm, v->NR);
-    free(sweep);
     sweep = NULL;
     debug2("Found %i reference stars.\n", v->NR);
 
     // "refstarids" are indices into the star kdtree and could be used to
     // retrieve "tag-along" data with, eg, startree_get_data_column().
 
-    v->badguys = malloc(v->NR * sizeof(int));
+    v->badguys = verify_ws_alloc(ws, v->NR * sizeof(int));
 
     // remove reference stars that are part of the quad.
     if (!fake_match) {
@@ -1399,7 +1604,7 @@ void verify_hit(const startree_t* skdt, int index_cutnside, MatchObj* mo,
     }
 
     worst = -HUGE_VAL;
-    K = real_verify_star_lists(v, effA, distractors,
+    K = real_verify_star_lists(v, ws, effA, distractors,
                                logbail, logstoplooking, &besti, &allodds, &theta, &worst,
                                &ibailed, &istopped);
     mo->logodds = K;
@@ -1466,14 +1671,16 @@ void verify_hit(const startree_t* skdt, int index_cutnside, MatchObj* mo,
             }
         }
 
+        //# Modified by Robert Lancaster for the StellarSolver Internal Library
+        // The reference stars are in the workspace, the match gets copies.
         mo->theta = etheta;
         mo->matchodds = eodds;
-        mo->refxyz = refxyz;
-        refxyz = NULL;
-        mo->refxy = v->refxy;
-        v->refxy = NULL;
-        mo->refstarid = v->refstarid;
-        v->refstarid = NULL;
+        mo->refxyz = malloc(v->NRall * 3 * sizeof(double));
+        memcpy(mo->refxyz, refxyz, v->NRall * 3 * sizeof(double));
+        mo->refxy = malloc(v->NRall * 2 * sizeof(double));
+        memcpy(mo->refxy, v->refxy, v->NRall * 2 * sizeof(double));
+        mo->refstarid = malloc(v->NRall * sizeof(int));
+        memcpy(mo->refstarid, v->refstarid, v->NRall * sizeof(int));
         mo->testperm = v->testperm;
         v->testperm = NULL;
 
@@ -1481,16 +1688,11 @@ void verify_hit(const startree_t* skdt, int index_cutnside, MatchObj* mo,
     }
 
  cleanup:
-    free(refxyz);
-    free(theta);
-    free(allodds);
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // The reference stars, theta and allodds are in the workspace.
     free(v->testperm);
     free(v->testsigma);
     free(v->tbadguys);
-    free(v->refperm);
-    free(v->refxy);
-    free(v->refstarid);
-    free(v->badguys);
     return;
 
  bailout:
@@ -1565,8 +1767,10 @@ double verify_star_lists(double* refxys, int NR,
     int besti;
     int* theta;
     double* allodds;
+    verify_workspace_t ws;
 
     memset(&v, 0, sizeof(verify_t));
+    memset(&ws, 0, sizeof(verify_workspace_t));
     v.NRall = v.NR = NR;
     v.NTall = v.NT = NT;
     // discard const here...
@@ -1577,14 +1781,12 @@ double verify_star_lists(double* refxys, int NR,
     v.refperm = permutation_init(NULL, NR);
     v.testperm = permutation_init(NULL, NT);
 
-    X = real_verify_star_lists(&v, effective_area, distractors,
+    X = real_verify_star_lists(&v, &ws, effective_area, distractors,
                                logodds_bail, logodds_stoplooking, &besti,
                                &allodds, &theta,
                                p_worstlogodds, &ibailed, &istopped);
     fixup_theta(theta, allodds, ibailed, istopped, &v, besti, NR, NULL,
                 &etheta, &eodds);
-    free(theta);
-    free(allodds);
 
     if (p_all_logodds)
         *p_all_logodds = eodds;
@@ -1604,7 +1806,8 @@ double verify_star_lists(double* refxys, int NR,
         free(v.testperm);
 
     free(v.refperm);
-    free(v.badguys);
+    // "badguys" is in the workspace.
+    verify_ws_free_memory(&ws);
     return X;
 }
 
@@ -1636,6 +1839,7 @@ double verify_star_lists_ror(double* refxys, int NR,
     int besti = -1;
     int* theta = NULL;
     double* allodds = NULL;
+    verify_workspace_t ws;
     // RoR
     double ror2;
     int igood, ibad;
@@ -1648,6 +1852,7 @@ double verify_star_lists_ror(double* refxys, int NR,
     double effective_area;
 
     memset(&v, 0, sizeof(verify_t));
+    memset(&ws, 0, sizeof(verify_workspace_t));
     v.NRall = v.NR = NR;
     v.NTall = v.NT = NT;
     v.refxy = refxys;
@@ -1728,14 +1933,12 @@ double verify_star_lists_ror(double* refxys, int NR,
     logverb("Ref stars in RoR: %i of %i\n", v.NR, v.NRall);
 
     if (v.NR) {
-        X = real_verify_star_lists(&v, effective_area, distractors,
+        X = real_verify_star_lists(&v, &ws, effective_area, distractors,
                                    logodds_bail, logodds_stoplooking, &besti,
                                    &allodds, &theta,
                                    p_worstlogodds, &ibailed, &istopped);
         fixup_theta(theta, allodds, ibailed, istopped, &v, besti, NR, NULL,
                     &etheta, &eodds);
-        free(theta);
-        free(allodds);
 
         if (p_all_logodds)
             *p_all_logodds = eodds;
@@ -1767,6 +1970,7 @@ double verify_star_lists_ror(double* refxys, int NR,
 
     free(v.badguys);
     free(v.tbadguys);
+    verify_ws_free_memory(&ws);
 	
     return X;
 }
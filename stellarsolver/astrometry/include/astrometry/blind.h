@@ -124,12 +124,21 @@ struct blind_params {
     char* cancelfname;
     anbool cancelled;
 
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // in-memory cancel tokens: when either is non-zero, the run is cancelled
+    // or was solved elsewhere.  Owned by the caller, who may set them from
+    // another thread, so they are read with atomic loads.
+    const int* cancel_token;
+    const int* solved_token;
+
     anbool best_hit_only;
 };
 typedef struct blind_params blind_t;
 
 void blind_set_field_file(blind_t* bp, const char* fn);
 void blind_set_cancel_file(blind_t* bp, const char* fn);
+void blind_set_cancel_token(blind_t* bp, const int* token);
+void blind_set_solved_token(blind_t* bp, const int* token);
 void blind_set_solved_file(blind_t* bp, const char* fn);
 void blind_set_solvedin_file(blind_t* bp, const char* fn);
 void blind_set_solvedout_file(blind_t* bp, const char* fn);
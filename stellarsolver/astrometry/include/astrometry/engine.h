@@ -58,6 +58,8 @@ void engine_add_search_path(engine_t* engine, const char* path);
 char* engine_find_index(engine_t*, const char* name);
 // note that "path" must be a full path name.
 int engine_add_index(engine_t* engine, char* path);
+// adds an already fully loaded index; the caller keeps ownership of it.
+int engine_add_loaded_index(engine_t* engine, index_t* ind);
 // look in all the search path directories for index files.
 int engine_autoindex_search_paths(engine_t* engine);
 int engine_parse_config_file_stream(engine_t* engine, FILE* fconf);
@@ -128,6 +128,10 @@ typedef struct kdtree kdtree_t;
 struct kdtree_qres;
 typedef struct kdtree_qres kdtree_qres_t;
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+struct kdtree_batch_res;
+typedef struct kdtree_batch_res kdtree_batch_res_t;
+
 struct kdtree_funcs {
     void* (*get_data)(const kdtree_t* kd, int i);
     void  (*copy_data_double)(const kdtree_t* kd, int start, int N, double* dest);
@@ -139,6 +143,8 @@ struct kdtree_funcs {
 
     void  (*nearest_neighbour_internal)(const kdtree_t* kd, const void* query, double* bestd2, int* pbest);
     kdtree_qres_t* (*rangesearch)(const kdtree_t* kd, kdtree_qres_t* res, const void* pt, double maxd2, int options);
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    int (*rangesearch_batch)(const kdtree_t* kd, kdtree_batch_res_t* res, const void* pts, int N, double maxd2);
 
     void (*nodes_contained)(const kdtree_t* kd,
                             const void* querylow, const void* queryhi,
@@ -225,6 +231,11 @@ struct kdtree {
      */
     int free_data;
 
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    /* Optional second copy of the data, one dimension after another
+     (dtype x ndim x kdtree_packed_stride()); see kdtree_pack_leaves(). */
+    void* packed;
+
     double* minval;
     double* maxval;
     double scale;    /* kdtype per real -- isotropic */
@@ -261,6 +272,26 @@ struct kdtree_qres {
     u32 *inds;    /* Indexes into original data set */
 };
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+#define KDTREE_BATCH_NWORK 10
+
+/*
+ The results of kdtree_rangesearch_batch.  The results of query q are
+ inds[first[q]] to inds[first[q+1]-1], with their squared distances in
+ sdists.  Start with a zeroed struct and pass it to every call, the
+ arrays are kept and only grow.  Free them with kdtree_free_batch_results.
+ */
+struct kdtree_batch_res {
+    int nqueries;
+    int* first;
+    u32* inds;
+    double* sdists;
+
+    /* Working memory, kept for the next call */
+    void* work[KDTREE_BATCH_NWORK];
+    size_t worksize[KDTREE_BATCH_NWORK];
+};
+
 // Returns the number of data points in this kdtree.
 int kdtree_n(const kdtree_t* kd);
 
@@ -338,6 +369,39 @@ void kdtree_free_query(kdtree_qres_t *res);
 /* Free a tree; does not free kd->data */
 void kdtree_free(kdtree_t *kd);
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+/*
+ Makes the packed copy of the data that range searches of 4 and 6
+ dimensional u16 trees (the code trees) use to check the points of a
+ leaf several at a time.  The points are already in leaf order, so the
+ packed copy keeps that order and only puts each dimension in its own
+ row.  Other trees are left as they are.  Returns 0 if the tree was
+ packed.
+ */
+int kdtree_pack_leaves(kdtree_t* kd);
+
+/* Frees the packed copy, range searches go back to the plain data. */
+void kdtree_free_packed_leaves(kdtree_t* kd);
+
+/* The number of entries in each row of the packed copy. */
+size_t kdtree_packed_stride(const kdtree_t* kd);
+
+/*
+ Range search for N points at once (N x D of the external type), all with
+ the same radius.  The queries go down the tree together, one level at a
+ time, so the queries that reach the same node are handled together and
+ the processor can wait for several of them to come from memory at once.
+ The results of each query are the same, in the same order, as
+ kdtree_rangesearch_options with KD_OPTIONS_COMPUTE_DISTS |
+ KD_OPTIONS_USE_SPLIT would give.
+ Returns 0, or -1 if it ran out of memory.
+ */
+int kdtree_rangesearch_batch(const kdtree_t* kd, kdtree_batch_res_t* res,
+                             const void* pts, int N, double maxd2);
+
+/* Frees the arrays of the batch results, not the struct. */
+void kdtree_free_batch_results(kdtree_batch_res_t* res);
+
 int kdtree_is_node_empty(const kdtree_t* kd, int nodeid);
 
 int kdtree_is_leaf_node_empty(const kdtree_t* kd, int nodeid);
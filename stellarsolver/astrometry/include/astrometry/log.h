@@ -38,6 +38,13 @@ typedef struct log_t log_t;
  */
 void log_use_function(logfunc_t func, void* baton);
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+/**
+ Gets the function and baton set with log_use_function, so that they can
+ be put back later.
+ */
+void log_get_function(logfunc_t* func, void** baton);
+
 /**
  Make all logging commands thread-specific rather than global.
  */
@@ -35,6 +35,19 @@ enum {
 #define DEFAULT_VERIFY_PIX 1.0
 #define DEFAULT_BAIL_THRESHOLD 1e-100
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+// See solver_set_code_recorder and solver_set_verify_recorder.
+typedef void (*solver_code_recorder_t)(const index_t* index, const double* code,
+                                       int dimcode, double tol2, void* baton);
+typedef void (*solver_verify_recorder_t)(const index_t* index, double seconds,
+                                         void* baton);
+
+// Runs task(baton, i) for every i in [0, n), at the same time in several
+// threads, and returns when they have all finished.  See
+// solver_set_parallel_for.
+typedef void (*solver_parallel_for_t)(int n, void (*task)(void* baton, int i),
+                                      void* baton, void* userdata);
+
 struct verify_field_t;
 struct solver_t {
 
@@ -142,6 +155,40 @@ struct solver_t {
     // Bail out ASAP.
     anbool quit_now;
 
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // If non-NULL, the solver bails out as soon as either becomes non-zero.
+    // They are checked with atomic loads in the inner loops, so they may be
+    // set from another thread.
+    const int* cancel_token;
+    const int* solved_token;
+
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // The code tree query results, reused for every quad tried in solver_run.
+    kdtree_qres_t* qres;
+
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // The codes of the current AB pair that are waiting to be looked up
+    // together in the code tree; private to solver.c.
+    struct solver_code_batch* codebatch;
+
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // If set, solver_run tries the quads of many AB pairs at the same time in
+    // "nworkers" threads; see solver_set_parallel_for.  "worker" is only set
+    // in the copies of the solver that the threads search with, it is
+    // private to solver.c.
+    solver_parallel_for_t parallel_for;
+    void* parallel_userdata;
+    int nworkers;
+    struct solver_quad_worker* worker;
+
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // Only for measuring the solver, see solver_set_code_recorder and
+    // solver_set_verify_recorder.
+    solver_code_recorder_t code_recorder;
+    void* code_recorder_baton;
+    solver_verify_recorder_t verify_recorder;
+    void* verify_recorder_baton;
+
     // SOLVER OUTPUTS
     // ==============
     // NOTE: these are only incremented, not initialized.  It's up to you to set
@@ -161,6 +208,9 @@ struct solver_t {
     int num_abscale_skipped;
     // The number of times we ran verification on a quad.
     int num_verified;
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // The number of heap allocations solver_run made for its scratch memory.
+    int num_scratch_allocs;
 
     // INTERNAL PARAMETERS; DO NOT MODIFY
     // ==================================
@@ -406,4 +456,36 @@ void solver_print_to(const solver_t* sp, FILE* stream);
 
 void solver_log_params(const solver_t* sp);
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+/**
+ If a recorder is set, it is called with every code that this solver
+ looks up in a code tree, with the index and the squared tolerance, so
+ that the lookups of real solves can be saved and replayed in a
+ benchmark.  It is called from the threads that solver_run searches in
+ too.  Set it before solver_run, NULL means no recording.
+ */
+void solver_set_code_recorder(solver_t* solver, solver_code_recorder_t recorder,
+                              void* baton);
+
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+/**
+ If a recorder is set, it is called after every match that this solver
+ verifies, with the index and the seconds that verify_hit took, so that
+ a benchmark can measure how many matches are verified per second.  Set
+ it before solver_run, NULL means no recording.
+ */
+void solver_set_verify_recorder(solver_t* solver, solver_verify_recorder_t recorder,
+                                void* baton);
+
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+/**
+ Lets solver_run search in "nworkers" threads.  The quads of the AB pairs
+ (and indexes) of each new star are split between the threads, and the
+ matches they find are verified and handled in this thread, in the same
+ order as without the threads, so the results do not change.  Set a NULL
+ parallel_for or nworkers <= 1 to search in this thread only.
+ */
+void solver_set_parallel_for(solver_t* solver, solver_parallel_for_t parallel_for,
+                             void* userdata, int nworkers);
+
 #endif
@@ -28,6 +28,11 @@ struct verify_field_t {
     anbool do_dedup;
     // apply radius-of-relevance filtering
     anbool do_ror;
+
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // Scratch memory that verify_hit reuses for every match of this field,
+    // so a field must only be verified by one thread at a time.
+    struct verify_workspace_t* ws;
 };
 typedef struct verify_field_t verify_field_t;
 
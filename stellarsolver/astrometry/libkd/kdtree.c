@@ -530,6 +530,105 @@ void kdtree_free_query(kdtree_qres_t *kq) {
     FREE(kq);
 }
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+int kdtree_rangesearch_batch(const kdtree_t* kd, kdtree_batch_res_t* res,
+                             const void* pts, int N, double maxd2) {
+    assert(kd->fun.rangesearch_batch);
+    return kd->fun.rangesearch_batch(kd, res, pts, N, maxd2);
+}
+
+void kdtree_free_batch_results(kdtree_batch_res_t* res) {
+    int i;
+    if (!res) return;
+    for (i=0; i<KDTREE_BATCH_NWORK; i++) {
+        FREE(res->work[i]);
+        res->work[i] = NULL;
+        res->worksize[i] = 0;
+    }
+    res->first = NULL;
+    res->inds = NULL;
+    res->sdists = NULL;
+    res->nqueries = 0;
+}
+
+void* kdtree_batch_work(kdtree_batch_res_t* res, int which, size_t size) {
+    void* mem;
+    if (size <= res->worksize[which])
+        return res->work[which];
+    // grow by half again, so a batch that keeps growing doesn't realloc every time
+    if (size < res->worksize[which] + res->worksize[which] / 2)
+        size = res->worksize[which] + res->worksize[which] / 2;
+    mem = REALLOC(res->work[which], size);
+    if (!mem) {
+        SYSERROR("Failed to allocate %zu bytes for a batch kdtree search", size);
+        return NULL;
+    }
+    res->work[which] = mem;
+    res->worksize[which] = size;
+    return mem;
+}
+
+// The far child is searched before the near one, so a clear bit comes
+// first, and in a leaf the points are in order.
+static int compare_batch_hits(const void* va, const void* vb) {
+    const kd_batch_hit_t* a = va;
+    const kd_batch_hit_t* b = vb;
+    if (a->key != b->key)
+        return (a->key < b->key) ? -1 : 1;
+    return a->i - b->i;
+}
+
+int kdtree_batch_finish(kdtree_batch_res_t* res, int N,
+                        kd_batch_hit_t* hits, size_t nhits) {
+    size_t size = (nhits ? nhits : 1);
+    int* first = kdtree_batch_work(res, KD_BATCH_FIRST, (N + 1) * sizeof(int));
+    int* next = kdtree_batch_work(res, KD_BATCH_POSITIONS, (N + 1) * sizeof(int));
+    kd_batch_hit_t* sorted = kdtree_batch_work(res, KD_BATCH_SORTED, size * sizeof(kd_batch_hit_t));
+    u32* inds = kdtree_batch_work(res, KD_BATCH_INDS, size * sizeof(u32));
+    double* sdists = kdtree_batch_work(res, KD_BATCH_SDISTS, size * sizeof(double));
+    size_t h;
+    int q;
+
+    if (!first || !next || !sorted || !inds || !sdists)
+        return -1;
+
+    // The hits of each query are moved together, keeping their order, and
+    // then each query's hits are sorted.  There are usually only a few.
+    memset(first, 0, (N + 1) * sizeof(int));
+    for (h=0; h<nhits; h++)
+        first[hits[h].q + 1]++;
+    for (q=0; q<N; q++)
+        first[q + 1] += first[q];
+    memcpy(next, first, N * sizeof(int));
+    for (h=0; h<nhits; h++)
+        sorted[next[hits[h].q]++] = hits[h];
+    for (q=0; q<N; q++) {
+        int n = first[q + 1] - first[q];
+        kd_batch_hit_t* qhits = sorted + first[q];
+        int j, k;
+        if (n > 16) {
+            qsort(qhits, n, sizeof(kd_batch_hit_t), compare_batch_hits);
+            continue;
+        }
+        for (j=1; j<n; j++) {
+            kd_batch_hit_t hit = qhits[j];
+            for (k=j; k>0 && compare_batch_hits(&hit, qhits + k - 1) < 0; k--)
+                qhits[k] = qhits[k - 1];
+            qhits[k] = hit;
+        }
+    }
+    for (h=0; h<nhits; h++) {
+        inds[h] = sorted[h].ind;
+        sdists[h] = sorted[h].d2;
+    }
+
+    res->nqueries = N;
+    res->first = first;
+    res->inds = inds;
+    res->sdists = sdists;
+    return 0;
+}
+
 void kdtree_free(kdtree_t *kd) {
     if (!kd) return;
     FREE(kd->name);
@@ -540,6 +639,7 @@ void kdtree_free(kdtree_t *kd) {
     FREE(kd->splitdim);
     if (kd->free_data)
         FREE(kd->data.any);
+    FREE(kd->packed); //# Modified by Robert Lancaster for the StellarSolver Internal Library
     FREE(kd->minval);
     FREE(kd->maxval);
     //FREE(kd->fun);
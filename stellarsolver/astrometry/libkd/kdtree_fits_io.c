@@ -397,6 +397,7 @@ int kdtree_fits_close(kdtree_t* kd) {
     // multiple kdtrees from one file...  reference count??
     if (kd->io)
         kdtree_fits_io_close(kd->io);
+    FREE(kd->packed); //# Modified by Robert Lancaster for the StellarSolver Internal Library
     FREE(kd->name);
     FREE(kd);
     return 0;
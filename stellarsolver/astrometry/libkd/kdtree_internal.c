@@ -1041,6 +1041,148 @@ void MANGLE(kdtree_nn)(const kdtree_t* kd, const void* vquery,
 }
 
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+/*
+ The range search for trees with packed leaves (see kdtree_pack_leaves),
+ which are the 4 and 6 dimensional u16 code trees.  It goes down the
+ splitting planes exactly like kdtree_rangesearch_options does with
+ integer splits, so the results come out the same and in the same order,
+ but the points of the leaves are first checked several at a time by
+ kdtree_packed_candidates.  D is a constant in each caller.
+
+ Returns FALSE, without touching the results, if the query can't be
+ done this way; the caller does the normal search then.
+ */
+static inline anbool packed_rangesearch_dim(const kdtree_t* kd, kdtree_qres_t** pres,
+                                            const etype* query, double maxd2,
+                                            int options, const int D)
+{
+    int nodestack[100];
+    int stackpos = 0;
+    ttype tquery[6];
+    float fquery[6];
+    int candidates[KDTREE_PACKED_CHUNK];
+    anbool do_dists = (options & KD_OPTIONS_COMPUTE_DISTS) ? TRUE : FALSE;
+    anbool do_points = TRUE;
+    kdtree_qres_t* res = *pres;
+    double dtlinf, dlimit;
+    ttype tlinf;
+    float limit;
+    int d;
+
+    if (!TTYPE_INTEGER || !DTYPE_INTEGER)
+        return FALSE;
+    if (!ttype_query(kd, query, tquery))
+        return FALSE;
+    dtlinf = DIST_ET(kd, sqrt(maxd2), );
+    if (!(dtlinf < TTYPE_MAX))
+        return FALSE;
+    tlinf = ceil(dtlinf);
+
+    // The leaf check is done in data units, in single precision.  The query
+    // is inside the tree, so the coordinates are at most 65535 and the
+    // rounding adds much less to the squared distance than this slack.
+    for (d=0; d<D; d++)
+        fquery[d] = POINT_ED(kd, d, query[d], );
+    dlimit = DIST2_ED(kd, maxd2, );
+    limit = dlimit * (1.0 + 1e-6) + 0.02 * sqrt(D * dlimit) + 1.0;
+
+    if (res) {
+        if (!res->capacity) {
+            resize_results(res, KDTREE_MAX_RESULTS, D, do_dists, do_points);
+        } else {
+            if (do_points || (do_dists && !res->sdists) || !res->inds)
+                resize_results(res, res->capacity, D, do_dists, do_points);
+        }
+        res->nres = 0;
+    } else {
+        res = CALLOC(1, sizeof(kdtree_qres_t));
+        if (!res) {
+            SYSERROR("Failed to allocate kdtree_qres_t struct");
+            *pres = NULL;
+            return TRUE;
+        }
+        resize_results(res, KDTREE_MAX_RESULTS, D, do_dists, do_points);
+        *pres = res;
+    }
+
+    nodestack[0] = 0;
+    while (stackpos >= 0) {
+        int nodeid = nodestack[stackpos];
+        int dim;
+        ttype split;
+        stackpos--;
+
+        if (KD_IS_LEAF(kd, nodeid)) {
+            int L = kdtree_left(kd, nodeid);
+            int R = kdtree_right(kd, nodeid);
+            int start;
+            for (start=L; start<=R; start+=KDTREE_PACKED_CHUNK) {
+                int end = (R - start < KDTREE_PACKED_CHUNK) ? R : start + KDTREE_PACKED_CHUNK - 1;
+                int ncand = kdtree_packed_candidates(kd, start, end, fquery, limit, candidates);
+                int j;
+                for (j=0; j<ncand; j++) {
+                    int i = candidates[j];
+                    dtype* data = KD_DATA(kd, D, i);
+                    double dsqd = HUGE_VAL;
+                    if (do_dists) {
+                        anbool bailedout = FALSE;
+                        dist2_bailout(kd, query, data, D, maxd2, &bailedout, &dsqd);
+                        if (bailedout)
+                            continue;
+                    } else if (dist2_exceeds(kd, query, data, D, maxd2))
+                        continue;
+                    if (!add_result(kd, res, dsqd, KD_PERM(kd, i), data,
+                                    D, do_dists, do_points)) {
+                        *pres = NULL;
+                        return TRUE;
+                    }
+                }
+            }
+            continue;
+        }
+
+        split = *KD_SPLIT(kd, nodeid);
+        if (kd->splitdim) {
+            dim = kd->splitdim[nodeid];
+        } else {
+            bigint tmpsplit = split;
+            dim = tmpsplit & kd->dimmask;
+            split = tmpsplit & kd->splitmask;
+        }
+        if (tquery[dim] < split) {
+            nodestack[++stackpos] = KD_CHILD_LEFT(nodeid);
+            if (split - tquery[dim] <= tlinf)
+                nodestack[++stackpos] = KD_CHILD_RIGHT(nodeid);
+        } else {
+            nodestack[++stackpos] = KD_CHILD_RIGHT(nodeid);
+            if (tquery[dim] - split <= tlinf)
+                nodestack[++stackpos] = KD_CHILD_LEFT(nodeid);
+        }
+    }
+
+    if (!(options & KD_OPTIONS_NO_RESIZE_RESULTS))
+        resize_results(res, res->nres, D, do_dists, do_points);
+    if (options & KD_OPTIONS_SORT_DISTS)
+        kdtree_qsort_results(res, D);
+    return TRUE;
+}
+
+static anbool packed_rangesearch(const kdtree_t* kd, kdtree_qres_t** pres,
+                                 const etype* query, double maxd2, int options)
+{
+    // Only the splitting planes are used, as with KD_OPTIONS_USE_SPLIT
+    if (!kd->split.any || (kd->bb.any && !(options & KD_OPTIONS_USE_SPLIT)))
+        return FALSE;
+    if (options & KD_OPTIONS_SORT_DISTS)
+        options |= KD_OPTIONS_COMPUTE_DISTS;
+    if (kd->ndim == 4)
+        return packed_rangesearch_dim(kd, pres, query, maxd2, options, 4);
+    if (kd->ndim == 6)
+        return packed_rangesearch_dim(kd, pres, query, maxd2, options, 6);
+    return FALSE;
+}
+
 kdtree_qres_t* MANGLE(kdtree_rangesearch_options)
      (const kdtree_t* kd, kdtree_qres_t* res, const void* vquery,
       double maxd2, int options)
@@ -1088,6 +1230,14 @@ kdtree_qres_t* MANGLE(kdtree_rangesearch_options)
 #else
     D = kd->ndim;
 #endif
+
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    if (kd->packed && packed_rangesearch(kd, &res, query, maxd2, options)) {
+#ifdef _MSC_VER
+        free(tquery);
+#endif
+        return res;
+    }
 	
     if (options & KD_OPTIONS_SORT_DISTS)
         // gotta compute 'em if ya wanna sort 'em!
@@ -1182,9 +1332,13 @@ kdtree_qres_t* MANGLE(kdtree_rangesearch_options)
         if (!res->capacity) {
             resize_results(res, KDTREE_MAX_RESULTS, D, do_dists, do_points);
         } else {
+            //# Modified by Robert Lancaster for the StellarSolver Internal Library
             // call the resize routine just in case the old result struct was
-            // from a tree of different type or dimensionality.
-            resize_results(res, res->capacity, D, do_dists, do_points);
+            // from a tree of different type or dimensionality.  Only the
+            // points depend on that, so a struct that already has the arrays
+            // this query needs is used as it is, without any realloc calls.
+            if (do_points || (do_dists && !res->sdists) || !res->inds)
+                resize_results(res, res->capacity, D, do_dists, do_points);
         }
         res->nres = 0;
     } else {
@@ -1445,6 +1599,250 @@ kdtree_qres_t* MANGLE(kdtree_rangesearch_options)
 }
 
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+/*
+ The batch range search.  The queries go down the splitting planes
+ together, one level at a time, using the same rule as the single query
+ search to decide which children each query goes to.
+
+ The single query search goes to the far child first.  The hits of a query
+ in a leaf get a key with a bit for every level above it, set where the
+ path went to the near child, and sorting the hits of a query by that key
+ and then by point gives the order of the single query search.
+ */
+typedef struct {
+    const kdtree_t* kd;
+    kdtree_batch_res_t* res;
+    const etype* queries;
+    const ttype* tqueries;
+    const float* fqueries;
+    double maxd2;
+    ttype tlinf;
+    float limit;
+    kd_batch_hit_t* hits;
+    size_t nhits;
+    size_t maxhits;
+} batch_search_t;
+
+static inline void batch_split(const kdtree_t* kd, int nodeid, ttype* split, int* dim) {
+    *split = *KD_SPLIT(kd, nodeid);
+    if (kd->splitdim) {
+        *dim = kd->splitdim[nodeid];
+    } else {
+        bigint tmpsplit = *split;
+        *dim = tmpsplit & kd->dimmask;
+        *split = tmpsplit & kd->splitmask;
+    }
+}
+
+static anbool batch_add_hit(batch_search_t* s, int i, int q, u32 ind, double d2) {
+    kd_batch_hit_t* hit;
+    if (s->nhits == s->maxhits) {
+        s->hits = kdtree_batch_work(s->res, KD_BATCH_HITS, (s->nhits + 1) * sizeof(kd_batch_hit_t));
+        if (!s->hits)
+            return FALSE;
+        s->maxhits = s->res->worksize[KD_BATCH_HITS] / sizeof(kd_batch_hit_t);
+    }
+    hit = s->hits + s->nhits;
+    hit->key = 0;
+    hit->i = i;
+    hit->q = q;
+    hit->ind = ind;
+    hit->d2 = d2;
+    s->nhits++;
+    return TRUE;
+}
+
+static anbool batch_check_point(batch_search_t* s, int q, int i) {
+    const kdtree_t* kd = s->kd;
+    int D = kd->ndim;
+    anbool bailedout = FALSE;
+    double dsqd;
+    dist2_bailout(kd, s->queries + (size_t)q * D, KD_DATA(kd, D, i), D, s->maxd2, &bailedout, &dsqd);
+    if (bailedout)
+        return TRUE;
+    return batch_add_hit(s, i, q, KD_PERM(kd, i), dsqd);
+}
+
+// This goes back up from the leaf to find where query q went to the near child
+static u64 batch_leaf_key(const batch_search_t* s, int nodeid, int q) {
+    const kdtree_t* kd = s->kd;
+    const ttype* tquery = s->tqueries + (size_t)q * kd->ndim;
+    u64 key = 0;
+    int depth = 0;
+    int id;
+
+    for (id=nodeid; id>0; id=(id - 1) / 2)
+        depth++;
+    for (id=nodeid; id>0; id=(id - 1) / 2) {
+        int parent = (id - 1) / 2;
+        ttype split;
+        int dim;
+        batch_split(kd, parent, &split, &dim);
+        depth--;
+        if ((tquery[dim] < split) == (id == KD_CHILD_LEFT(parent)))
+            key |= (u64)1 << (62 - depth);
+    }
+    return key;
+}
+
+static anbool batch_leaf(batch_search_t* s, int nodeid, int q) {
+    const kdtree_t* kd = s->kd;
+    int L = kdtree_left(kd, nodeid);
+    int R = kdtree_right(kd, nodeid);
+    size_t before = s->nhits;
+    size_t h;
+    int i;
+
+    if (kd->packed) {
+        int candidates[KDTREE_PACKED_CHUNK];
+        int first;
+        for (first=L; first<=R; first+=KDTREE_PACKED_CHUNK) {
+            int last = (R - first < KDTREE_PACKED_CHUNK) ? R : first + KDTREE_PACKED_CHUNK - 1;
+            int ncand = kdtree_packed_candidates(kd, first, last, s->fqueries + (size_t)q * kd->ndim,
+                                                 s->limit, candidates);
+            int j;
+            for (j=0; j<ncand; j++)
+                if (!batch_check_point(s, q, candidates[j]))
+                    return FALSE;
+        }
+    } else {
+        for (i=L; i<=R; i++)
+            if (!batch_check_point(s, q, i))
+                return FALSE;
+    }
+    if (s->nhits > before) {
+        u64 key = batch_leaf_key(s, nodeid, q);
+        for (h=before; h<s->nhits; h++)
+            s->hits[h].key = key;
+    }
+    return TRUE;
+}
+
+/*
+ This goes down the tree one level at a time.  All of the (node, query)
+ pairs of a level are independent, so the processor can wait for several
+ of them to come from memory at once, and they are in the order of the
+ nodes, so the queries at the same node are next to each other.
+ */
+static anbool batch_search(batch_search_t* s, int nactive) {
+    const kdtree_t* kd = s->kd;
+    int D = kd->ndim;
+    const ttype* tqueries = s->tqueries;
+    ttype tlinf = s->tlinf;
+    int curslot = KD_BATCH_VISITS;
+    int nextslot = KD_BATCH_NEXTVISITS;
+    kd_batch_visit_t* cur = s->res->work[curslot];
+    size_t n = nactive;
+
+    while (n) {
+        kd_batch_visit_t* next = kdtree_batch_work(s->res, nextslot, 2 * n * sizeof(kd_batch_visit_t));
+        size_t nnext = 0;
+        size_t k;
+        int tmp;
+        if (!next)
+            return FALSE;
+        for (k=0; k<n; k++) {
+            int nodeid = cur[k].node;
+            int q = cur[k].q;
+            ttype split, tq;
+            anbool leftnear;
+            int dim;
+            if (KD_IS_LEAF(kd, nodeid)) {
+                if (!batch_leaf(s, nodeid, q))
+                    return FALSE;
+                continue;
+            }
+            batch_split(kd, nodeid, &split, &dim);
+            tq = tqueries[(size_t)q * D + dim];
+            leftnear = (tq < split);
+            // both are written, and only kept if the query goes that way
+            next[nnext].node = KD_CHILD_LEFT(nodeid);
+            next[nnext].q = q;
+            nnext += (leftnear || (tq - split <= tlinf));
+            next[nnext].node = KD_CHILD_RIGHT(nodeid);
+            next[nnext].q = q;
+            nnext += (!leftnear || (split - tq <= tlinf));
+        }
+        cur = next;
+        n = nnext;
+        tmp = curslot;
+        curslot = nextslot;
+        nextslot = tmp;
+    }
+    return TRUE;
+}
+
+int MANGLE(kdtree_rangesearch_batch)
+     (const kdtree_t* kd, kdtree_batch_res_t* res, const void* vpts,
+      int N, double maxd2)
+{
+    const etype* pts = vpts;
+    int D = kd->ndim;
+    int options = KD_OPTIONS_SMALL_RADIUS | KD_OPTIONS_COMPUTE_DISTS |
+        KD_OPTIONS_NO_RESIZE_RESULTS | KD_OPTIONS_USE_SPLIT;
+    batch_search_t s;
+    ttype* tqueries;
+    float* fqueries;
+    kd_batch_visit_t* visits;
+    kdtree_qres_t* single = NULL;
+    double dtlinf;
+    anbool use_tsplit;
+    int q, d, nactive = 0;
+
+    memset(&s, 0, sizeof(s));
+    s.kd = kd;
+    s.res = res;
+    s.queries = pts;
+    s.maxd2 = maxd2;
+
+    dtlinf = DIST_ET(kd, sqrt(maxd2), );
+    use_tsplit = TTYPE_INTEGER && kd->split.any && (dtlinf < TTYPE_MAX);
+    if (use_tsplit) {
+        double dlimit = DIST2_ED(kd, maxd2, );
+        s.tlinf = ceil(dtlinf);
+        // the same slack as the single query search with packed leaves
+        s.limit = dlimit * (1.0 + 1e-6) + 0.02 * sqrt(D * dlimit) + 1.0;
+    }
+
+    tqueries = kdtree_batch_work(res, KD_BATCH_TQUERIES, MAX(N * D, 1) * sizeof(ttype));
+    fqueries = kdtree_batch_work(res, KD_BATCH_FQUERIES, MAX(N * D, 1) * sizeof(float));
+    visits = kdtree_batch_work(res, KD_BATCH_VISITS, MAX(N, 1) * sizeof(kd_batch_visit_t));
+    if (!tqueries || !fqueries || !visits)
+        return -1;
+    s.hits = res->work[KD_BATCH_HITS];
+    s.maxhits = res->worksize[KD_BATCH_HITS] / sizeof(kd_batch_hit_t);
+
+    for (q=0; q<N; q++) {
+        const etype* query = pts + (size_t)q * D;
+        if (use_tsplit && ttype_query(kd, query, tqueries + (size_t)q * D)) {
+            for (d=0; d<D; d++)
+                fqueries[(size_t)q * D + d] = POINT_ED(kd, d, query[d], );
+            visits[nactive].node = 0;
+            visits[nactive].q = q;
+            nactive++;
+        } else {
+            // This one is searched by itself, its hits keep their order
+            unsigned int j;
+            single = MANGLE(kdtree_rangesearch_options)(kd, single, query, maxd2, options);
+            if (!single)
+                return -1;
+            for (j=0; j<single->nres; j++)
+                if (!batch_add_hit(&s, j, q, single->inds[j], single->sdists[j])) {
+                    kdtree_free_query(single);
+                    return -1;
+                }
+        }
+    }
+    kdtree_free_query(single);
+
+    s.tqueries = tqueries;
+    s.fqueries = fqueries;
+    if (nactive && !batch_search(&s, nactive))
+        return -1;
+    return kdtree_batch_finish(res, N, s.hits, s.nhits);
+}
+
 static void* get_data(const kdtree_t* kd, int i) {
     return KD_DATA(kd, kd->ndim, i);
 }
@@ -2998,6 +3396,7 @@ void MANGLE(kdtree_update_funcs)(kdtree_t* kd) {
     kd->fun.fix_bounding_boxes = MANGLE(kdtree_fix_bounding_boxes);
     kd->fun.nearest_neighbour_internal = MANGLE(kdtree_nn);
     kd->fun.rangesearch = MANGLE(kdtree_rangesearch_options);
+    kd->fun.rangesearch_batch = MANGLE(kdtree_rangesearch_batch); //# Modified by Robert Lancaster for the StellarSolver Internal Library
     kd->fun.nodes_contained = MANGLE(kdtree_nodes_contained);
 }
 
@@ -43,4 +43,58 @@ rtn KDMANGLE(func, d, s, s)args
 */
 int kdtree_compute_levels(int N, int Nleaf);
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+/* kdtree_packed_candidates checks at most this many points in one call. */
+#define KDTREE_PACKED_CHUNK 64
+
+/*
+ Checks points L to R of a tree with packed leaves against a query given
+ in data units, in single precision.  The index of every point whose
+ squared distance may be up to "limit" goes into "candidates", and the
+ number of them is returned.  The limit should have enough slack for
+ the rounding, the candidates are checked again with the exact distance.
+ */
+int kdtree_packed_candidates(const kdtree_t* kd, int L, int R,
+                             const float* query, float limit, int* candidates);
+
+/* The working memory of kdtree_batch_res */
+enum kd_batch_work {
+    KD_BATCH_TQUERIES,
+    KD_BATCH_FQUERIES,
+    KD_BATCH_VISITS,
+    KD_BATCH_NEXTVISITS,
+    KD_BATCH_HITS,
+    KD_BATCH_FIRST,
+    KD_BATCH_INDS,
+    KD_BATCH_SDISTS,
+    KD_BATCH_SORTED,
+    KD_BATCH_POSITIONS
+};
+
+/* A query that has reached a node */
+typedef struct {
+    int node;
+    int q;
+} kd_batch_visit_t;
+
+/* A point found by a query.  "i" is the point in the tree, "ind" is the
+ index into the original data, and the key has a bit for each level above
+ the leaf, which is set if the query went to the nearer child there. */
+typedef struct {
+    u64 key;
+    int i;
+    int q;
+    u32 ind;
+    double d2;
+} kd_batch_hit_t;
+
+/* Returns the working memory "which", grown to at least "size" bytes
+ (keeping what was in it), or NULL if it can't be allocated. */
+void* kdtree_batch_work(kdtree_batch_res_t* res, int which, size_t size);
+
+/* Puts the hits of each query together in the results, in the order the
+ single query search would find them.  Returns -1 if out of memory. */
+int kdtree_batch_finish(kdtree_batch_res_t* res, int N,
+                        kd_batch_hit_t* hits, size_t nhits);
+
 #endif
@@ -0,0 +1,150 @@
+/*
+ # This file is part of libkd.
+ # Licensed under a 3-clause BSD style license - see LICENSE
+ */
+
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+/*
+ Packed leaves for the code trees.
+
+ A code lookup spends most of its time computing the distance from the
+ code to every point of the leaves it reaches.  The points are stored as
+ xyzxyz, so here each dimension of the u16 data gets its own row, and the
+ points of a leaf are checked 8 at a time with SSE2 on x86, NEON on ARM,
+ or plain C.  This is done in single precision against a slightly larger
+ radius, and only the few points that pass are checked again with the
+ exact double precision distance, so the results are the same as before.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "kdtree.h"
+#include "kdtree_internal.h"
+#include "errors.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PACKED_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PACKED_NEON
+#include <arm_neon.h>
+#endif
+
+/* Every row has room for 8 more points after the last one, so a group of 8
+ starting at any point can be loaded without going past the end. */
+size_t kdtree_packed_stride(const kdtree_t* kd) {
+    return ((size_t)kd->ndata + 7 + 7) & ~(size_t)7;
+}
+
+int kdtree_pack_leaves(kdtree_t* kd) {
+    size_t stride;
+    int D, i, d;
+    u16* packed;
+
+    if (kd->packed)
+        return 0;
+    if (kdtree_datatype(kd) != KDT_DATA_U16 || !kd->data.any)
+        return -1;
+    D = kd->ndim;
+    if (D != 4 && D != 6)
+        return -1;
+
+    stride = kdtree_packed_stride(kd);
+    packed = calloc(stride * D, sizeof(u16));
+    if (!packed) {
+        SYSERROR("Failed to allocate the packed leaves of a kdtree");
+        return -1;
+    }
+    for (i=0; i<kd->ndata; i++)
+        for (d=0; d<D; d++)
+            packed[d * stride + i] = kd->data.s[(size_t)i * D + d];
+    kd->packed = packed;
+    return 0;
+}
+
+void kdtree_free_packed_leaves(kdtree_t* kd) {
+    if (!kd)
+        return;
+    free(kd->packed);
+    kd->packed = NULL;
+}
+
+/* D is a constant in each of the callers below, so the loops over the
+ dimensions are unrolled. */
+static inline int packed_candidates(const u16* packed, size_t stride, int D,
+                                    int L, int R, const float* query,
+                                    float limit, int* candidates) {
+    int ncand = 0;
+    int i, d, j;
+
+    for (i=L; i<=R; i+=8) {
+        unsigned int mask;
+#if defined(PACKED_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 vlimit = _mm_set1_ps(limit);
+        __m128 lo2 = _mm_setzero_ps();
+        __m128 hi2 = _mm_setzero_ps();
+        for (d=0; d<D; d++) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(packed + d * stride + i));
+            __m128 q = _mm_set1_ps(query[d]);
+            __m128 lo = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(p, zero)), q);
+            __m128 hi = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(p, zero)), q);
+            lo2 = _mm_add_ps(lo2, _mm_mul_ps(lo, lo));
+            hi2 = _mm_add_ps(hi2, _mm_mul_ps(hi, hi));
+        }
+        mask = (unsigned int)_mm_movemask_ps(_mm_cmple_ps(lo2, vlimit)) |
+            ((unsigned int)_mm_movemask_ps(_mm_cmple_ps(hi2, vlimit)) << 4);
+#elif defined(PACKED_NEON)
+        const float32x4_t vlimit = vdupq_n_f32(limit);
+        float32x4_t lo2 = vdupq_n_f32(0.0f);
+        float32x4_t hi2 = vdupq_n_f32(0.0f);
+        uint32x4_t lomask, himask;
+        for (d=0; d<D; d++) {
+            uint16x8_t p = vld1q_u16(packed + d * stride + i);
+            float32x4_t q = vdupq_n_f32(query[d]);
+            float32x4_t lo = vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(p))), q);
+            float32x4_t hi = vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(p))), q);
+            lo2 = vaddq_f32(lo2, vmulq_f32(lo, lo));
+            hi2 = vaddq_f32(hi2, vmulq_f32(hi, hi));
+        }
+        lomask = vcleq_f32(lo2, vlimit);
+        himask = vcleq_f32(hi2, vlimit);
+        mask = (vgetq_lane_u32(lomask, 0) & 1) | (vgetq_lane_u32(lomask, 1) & 2) |
+            (vgetq_lane_u32(lomask, 2) & 4) | (vgetq_lane_u32(lomask, 3) & 8) |
+            (vgetq_lane_u32(himask, 0) & 16) | (vgetq_lane_u32(himask, 1) & 32) |
+            (vgetq_lane_u32(himask, 2) & 64) | (vgetq_lane_u32(himask, 3) & 128);
+#else
+        float d2[8];
+        for (j=0; j<8; j++)
+            d2[j] = 0.0f;
+        for (d=0; d<D; d++) {
+            const u16* p = packed + d * stride + i;
+            for (j=0; j<8; j++) {
+                float delta = (float)p[j] - query[d];
+                d2[j] += delta * delta;
+            }
+        }
+        mask = 0;
+        for (j=0; j<8; j++)
+            if (d2[j] <= limit)
+                mask |= (1u << j);
+#endif
+        // the last group may go past R
+        if (R - i < 7)
+            mask &= (1u << (R - i + 1)) - 1;
+        for (j=0; mask; j++, mask >>= 1)
+            if (mask & 1)
+                candidates[ncand++] = i + j;
+    }
+    return ncand;
+}
+
+int kdtree_packed_candidates(const kdtree_t* kd, int L, int R,
+                             const float* query, float limit, int* candidates) {
+    const u16* packed = kd->packed;
+    size_t stride = kdtree_packed_stride(kd);
+    if (kd->ndim == 4)
+        return packed_candidates(packed, stride, 4, L, R, query, limit, candidates);
+    return packed_candidates(packed, stride, 6, L, R, query, limit, candidates);
+}
@@ -75,6 +75,13 @@ void log_use_function(logfunc_t func, void* baton) {
     l->baton = baton;
 }
 
+//# Modified by Robert Lancaster for the StellarSolver Internal Library
+void log_get_function(logfunc_t* func, void** baton) {
+    log_t* l = get_logger();
+    *func = l->logfunc;
+    *baton = l->baton;
+}
+
 log_t* log_create(enum log_level level) {
     log_t* logger = calloc(1, sizeof(log_t));
     return logger;
@@ -105,15 +112,23 @@ static void loglvl(const log_t* logger, enum log_level level,
             fprintf(logger->f, "[ %.3f] ", timenow() - logger->t0);
 #endif
         //fprintf(logger->f, "%s:%i ", file, line);
-        vfprintf(logger->f, format, va);
+        //# Modified by Robert Lancaster for the StellarSolver Internal Library
+        // (on a copy, so "va" is still there for the log function)
+        va_list vacopy;
+        va_copy(vacopy, va);
+        vfprintf(logger->f, format, vacopy);
+        va_end(vacopy);
         fflush(logger->f);
     }
-    if (logger->logfunc) {
-        logger->logfunc(logger->baton, level, file, line, func, format, va);
-    }
 #ifndef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
     AN_THREAD_UNLOCK(loglock);
 #endif
+    //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    // The log function is called after the lock is released, so one that
+    // blocks, or that logs again, doesn't stop the other threads.
+    if (logger->logfunc) {
+        logger->logfunc(logger->baton, level, file, line, func, format, va);
+    }
 }
 
 void log_loglevel(enum log_level level,
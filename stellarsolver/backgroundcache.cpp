@@ -0,0 +1,198 @@
+/*  BackgroundCache, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "backgroundcache.h"
+
+#include <QMutexLocker>
+#include <QVector>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+//A model is made again from the whole image after it has been used this many times, so small changes can't add up
+#define BACKGROUND_MAX_REUSE 20
+//This is how many models are kept, for example for a guide camera and a main camera
+#define BACKGROUND_CACHE_ENTRIES 4
+//A model is checked against this many rows spread over the image
+#define BACKGROUND_CHECK_ROWS 16
+//In those rows, every this many pixels are compared
+#define BACKGROUND_CHECK_STEP 4
+
+BackgroundCache *BackgroundCache::instance()
+{
+    static BackgroundCache backgroundCache;
+    return &backgroundCache;
+}
+
+BackgroundCache::~BackgroundCache()
+{
+    clear();
+}
+
+void BackgroundCache::clear()
+{
+    QMutexLocker locker(&cacheLock);
+    foreach(CachedBackground *entry, cache)
+    {
+        sep_bkg_free(entry->bkg);
+        delete entry;
+    }
+    cache.clear();
+}
+
+void BackgroundCache::setTolerance(double fraction)
+{
+    QMutexLocker locker(&cacheLock);
+    tolerance = fraction;
+}
+
+double BackgroundCache::getTolerance()
+{
+    QMutexLocker locker(&cacheLock);
+    return tolerance;
+}
+
+int BackgroundCache::getBackground(sep_image *im, int x, int y, int meshSize, int filterSize, sep_bkg **bkg, bool *reused)
+{
+    *reused = false;
+    sep_bkg *model = nullptr;
+    double maxChange;
+    {
+        QMutexLocker locker(&cacheLock);
+        CachedBackground *entry = findEntry(x, y, im->w, im->h, meshSize, filterSize);
+        if(entry && entry->timesReused < BACKGROUND_MAX_REUSE)
+            model = copyBackground(entry->bkg);
+        maxChange = tolerance;
+    }
+
+    float offset = 0;
+    if(model && checkModel(im, model, maxChange, &offset))
+    {
+        //The spline slopes don't change when the whole model moves up or down, so only the levels are moved
+        for(int i = 0; i < model->n; i++)
+            model->back[i] += offset;
+        model->global += offset;
+        *bkg = model;
+        *reused = true;
+    }
+    else
+    {
+        sep_bkg_free(model);
+        int status = sep_background(im, meshSize, meshSize, filterSize, filterSize, 0.0, bkg);
+        if(status != 0)
+            return status;
+    }
+
+    //The cache keeps its own copy, at the level of this image, so the next image is compared to this one
+    sep_bkg *copy = copyBackground(*bkg);
+    if(copy == nullptr)
+        return 0;
+    QMutexLocker locker(&cacheLock);
+    CachedBackground *entry = findEntry(x, y, im->w, im->h, meshSize, filterSize);
+    if(entry)
+    {
+        sep_bkg_free(entry->bkg);
+        entry->timesReused = *reused ? entry->timesReused + 1 : 0;
+    }
+    else
+    {
+        if(cache.size() >= BACKGROUND_CACHE_ENTRIES)
+        {
+            CachedBackground *oldest = *std::min_element(cache.begin(), cache.end(), [](const CachedBackground *a, const CachedBackground *b)
+            {
+                return a->lastUsed < b->lastUsed;
+            });
+            cache.removeOne(oldest);
+            sep_bkg_free(oldest->bkg);
+            delete oldest;
+        }
+        entry = new CachedBackground;
+        entry->x = x;
+        entry->y = y;
+        entry->meshSize = meshSize;
+        entry->filterSize = filterSize;
+        entry->timesReused = 0;
+        cache.append(entry);
+    }
+    entry->bkg = copy;
+    entry->lastUsed = ++useCounter;
+    return 0;
+}
+
+BackgroundCache::CachedBackground *BackgroundCache::findEntry(int x, int y, int w, int h, int meshSize, int filterSize)
+{
+    foreach(CachedBackground *entry, cache)
+    {
+        if(entry->x == x && entry->y == y && entry->bkg->w == w && entry->bkg->h == h &&
+                entry->meshSize == meshSize && entry->filterSize == filterSize)
+            return entry;
+    }
+    return nullptr;
+}
+
+//This compares the model to some of the rows of the image.  The median of the difference is how far the level has moved,
+//and the spread of the difference should still be the noise of the image.  If the shape of the background changed,
+//the spread gets larger, and if the exposure or the gain changed, the noise is different.
+bool BackgroundCache::checkModel(sep_image *im, const sep_bkg *bkg, double tolerance, float *offset)
+{
+    if(im->dtype != SEP_TFLOAT || bkg->globalrms <= 0)
+        return false;
+    const float *data = static_cast<const float *>(im->data);
+    int numRows = qMin(BACKGROUND_CHECK_ROWS, im->h);
+    QVector<float> line(im->w);
+    QVector<float> differences;
+    differences.reserve(numRows * (im->w / BACKGROUND_CHECK_STEP + 1));
+    for(int row = 0; row < numRows; row++)
+    {
+        int y = (2 * row + 1) * im->h / (2 * numRows);
+        if(sep_bkg_line(const_cast<sep_bkg *>(bkg), y, line.data(), SEP_TFLOAT) != 0)
+            return false;
+        const float *imageRow = data + (size_t)y * im->w;
+        for(int x = 0; x < im->w; x += BACKGROUND_CHECK_STEP)
+            differences.append(imageRow[x] - line.at(x));
+    }
+    if(differences.isEmpty())
+        return false;
+
+    int middle = differences.size() / 2;
+    std::nth_element(differences.begin(), differences.begin() + middle, differences.end());
+    float median = differences.at(middle);
+    for(int i = 0; i < differences.size(); i++)
+        differences[i] = fabs(differences.at(i) - median);
+    std::nth_element(differences.begin(), differences.begin() + middle, differences.end());
+    float rms = 1.4826 * differences.at(middle);
+
+    *offset = median;
+    return fabs(rms - bkg->globalrms) <= tolerance * bkg->globalrms;
+}
+
+//The arrays are allocated with malloc so that the copy can be freed with sep_bkg_free like the ones SEP makes
+sep_bkg *BackgroundCache::copyBackground(const sep_bkg *bkg)
+{
+    if(bkg == nullptr)
+        return nullptr;
+    sep_bkg *copy = (sep_bkg *)malloc(sizeof(sep_bkg));
+    if(copy == nullptr)
+        return nullptr;
+    *copy = *bkg;
+    size_t size = bkg->n * sizeof(float);
+    copy->back = (float *)malloc(size);
+    copy->dback = (float *)malloc(size);
+    copy->sigma = (float *)malloc(size);
+    copy->dsigma = (float *)malloc(size);
+    if(!copy->back || !copy->dback || !copy->sigma || !copy->dsigma)
+    {
+        sep_bkg_free(copy);
+        return nullptr;
+    }
+    memcpy(copy->back, bkg->back, size);
+    memcpy(copy->dback, bkg->dback, size);
+    memcpy(copy->sigma, bkg->sigma, size);
+    memcpy(copy->dsigma, bkg->dsigma, size);
+    return copy;
+}
@@ -0,0 +1,61 @@
+/*  BackgroundCache, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef BACKGROUNDCACHE_H
+#define BACKGROUNDCACHE_H
+
+//QT Includes
+#include <QList>
+#include <QMutex>
+
+//Sextractor Includes
+#include "sep/sep.h"
+
+//This keeps the background model of the last images that were extracted, so that the next image from the same camera doesn't need a new one.
+//The background of a sequence of images changes slowly, mostly in its level, so a model is checked against a few rows of the new image.
+//If the noise around the model is still what it was, the model is moved to the level of the new image and used again,
+//otherwise, or after it has been used too many times, a new model is made from the whole image.
+class BackgroundCache
+{
+public:
+    static BackgroundCache *instance();
+
+    //This gives the background of the image, which is the part of the full image at x, y.  The image must not be background subtracted yet.
+    //The caller owns the background that is returned and frees it with sep_bkg_free.  reused is set if it came from the cache.
+    int getBackground(sep_image *im, int x, int y, int meshSize, int filterSize, sep_bkg **bkg, bool *reused);
+
+    //This frees all of the cached models
+    void clear();
+
+    //The tolerance is how much the noise around a cached model can change, as a fraction of the noise of the image the model was made from
+    void setTolerance(double fraction);
+    double getTolerance();
+
+private:
+    BackgroundCache() {}
+    ~BackgroundCache();
+
+    struct CachedBackground
+    {
+        sep_bkg *bkg;
+        int x, y;
+        int meshSize, filterSize;
+        int timesReused;
+        quint64 lastUsed;
+    };
+
+    CachedBackground *findEntry(int x, int y, int w, int h, int meshSize, int filterSize);
+    static bool checkModel(sep_image *im, const sep_bkg *bkg, double tolerance, float *offset);
+    static sep_bkg *copyBackground(const sep_bkg *bkg);
+
+    QMutex cacheLock;
+    QList<CachedBackground *> cache;
+    double tolerance = 0.1;
+    quint64 useCounter = 0;
+};
+
+#endif // BACKGROUNDCACHE_H
@@ -0,0 +1,245 @@
+/*  BatchSolver, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "batchsolver.h"
+#include "internalsextractorsolver.h"
+#include "solverenginecache.h"
+
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+//This is one frame of the batch while it is being extracted and solved
+struct BatchSolver::FrameJob
+{
+    int frame;
+    InternalSextractorSolver *solver;
+    bool extracted;
+    bool solved;
+    int code;
+};
+
+//This runs one stage of a frame on a thread from one of the pools
+class BatchStageTask : public QRunnable
+{
+public:
+    explicit BatchStageTask(std::function<void()> stage) : work(stage) {}
+    void run() override
+    {
+        work();
+    }
+private:
+    std::function<void()> work;
+};
+
+BatchSolver::BatchSolver(QObject *parent) : QObject(parent)
+{
+    extractPool.setMaxThreadCount(1);
+    solvePool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+BatchSolver::~BatchSolver()
+{
+    abort();
+    extractPool.waitForDone();
+    solvePool.waitForDone();
+}
+
+void BatchSolver::setSearchScale(double fov_low, double fov_high, ScaleUnits units)
+{
+    use_scale = true;
+    scalelo = fov_low;
+    scalehi = fov_high;
+    scaleunit = units;
+}
+
+void BatchSolver::setSolveThreads(int threads)
+{
+    solvePool.setMaxThreadCount(qMax(threads, 1));
+}
+
+void BatchSolver::setLookAhead(int frames)
+{
+    lookAhead = qMax(frames, 0);
+}
+
+//This creates the solver for one frame with the settings of the batch.  It uses the indexes the batch is holding in the SolverEngineCache.
+InternalSextractorSolver *BatchSolver::createFrameSolver(const ImageRef &frame)
+{
+    InternalSextractorSolver *solver = new InternalSextractorSolver(SOLVE, SEXTRACTOR_INTERNAL, SOLVER_STELLARSOLVER, frame.stats, frame.imageBuffer, nullptr);
+    solver->params = params;
+    solver->indexFolderPaths = indexFolderPaths;
+    solver->useIndexCache = useIndexCache;
+    solver->useBackgroundCache = useBackgroundCache;
+    solver->useSharedIndexes = true;
+    solver->basePath = basePath;
+    //Set the log level one less than the batch, like the child solvers of a parallel solve, since many of them run at once
+    if(logLevel == SSolver::LOG_MSG || logLevel == SSolver::LOG_NONE)
+        solver->logLevel = SSolver::LOG_NONE;
+    if(logLevel == SSolver::LOG_VERB)
+        solver->logLevel = SSolver::LOG_MSG;
+    if(logLevel == SSolver::LOG_ALL)
+        solver->logLevel = SSolver::LOG_VERB;
+    if(use_scale)
+        solver->setSearchScale(scalelo, scalehi, scaleunit);
+    if(frame.use_position)
+        solver->setSearchPositionInDegrees(frame.search_ra, frame.search_dec);
+    if(logLevel != SSolver::LOG_NONE)
+        connect(solver, &SextractorSolver::logOutput, this, &BatchSolver::logOutput, Qt::DirectConnection);
+    return solver;
+}
+
+//This is called from the pool threads when a frame finishes extracting or solving, solveBatch picks it up from there.
+void BatchSolver::jobDone(FrameJob *job)
+{
+    QMutexLocker locker(&jobLock);
+    doneJobs.append(job);
+    jobsChanged.wakeAll();
+}
+
+BatchSolver::Result BatchSolver::getResult(FrameJob *job)
+{
+    Result result;
+    result.frame = job->frame;
+    result.code = job->code;
+    result.stars = job->solver->getStarList();
+    if(job->code == 0 && job->solver->solvingDone())
+    {
+        result.solution = job->solver->getSolution();
+        if(job->solver->hasWCSData())
+        {
+            if(loadWCS)
+                result.wcsData = job->solver->getWCSData();
+            result.stars = job->solver->appendStarsRAandDEC(result.stars);
+        }
+    }
+    else if(result.code == 0)
+        result.code = -1;
+    return result;
+}
+
+int BatchSolver::solveBatch(const QVector<ImageRef> &frames, ResultCallback callback)
+{
+    aborted.storeRelease(0);
+    if(frames.isEmpty())
+        return 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    //The indexes are loaded once and held for the whole batch, the frames all share them.
+    //Without inParallel or the cache, only their metadata is loaded, and each frame loads one index at a time while it solves.
+    QList<index_t *> batchIndexes = SolverEngineCache::instance()->acquire(indexFolderPaths, useIndexCache, !params.inParallel && !useIndexCache);
+    if(batchIndexes.isEmpty())
+    {
+        emit logOutput("There are no index files in the index file directories, the batch can't be solved.");
+        return 0;
+    }
+    if(logLevel != SSolver::LOG_NONE)
+        emit logOutput(QString("Starting a batch of %1 frames with %2 indexes, solving %3 frames at a time").arg(frames.size()).arg(batchIndexes.size()).arg(solvePool.maxThreadCount()));
+
+    //This limits how many frames are in memory as extracted star lists at once
+    int maxInFlight = solvePool.maxThreadCount() + lookAhead;
+    int nextFrame = 0;
+    int inFlight = 0;
+    int reported = 0;
+    int numSolved = 0;
+
+    while(reported < frames.size())
+    {
+        while(nextFrame < frames.size() && inFlight < maxInFlight && !isAborted())
+        {
+            FrameJob *job = new FrameJob;
+            job->frame = nextFrame;
+            job->solver = createFrameSolver(frames.at(nextFrame));
+            job->extracted = false;
+            job->solved = false;
+            job->code = -1;
+            jobLock.lock();
+            activeJobs.append(job);
+            jobLock.unlock();
+            extractPool.start(new BatchStageTask([this, job]()
+            {
+                if(!isAborted())
+                    job->code = job->solver->sextract();
+                job->extracted = true;
+                jobDone(job);
+            }));
+            nextFrame++;
+            inFlight++;
+        }
+
+        //If it was aborted, the frames that were never started are reported as failed
+        if(inFlight == 0)
+        {
+            for(; nextFrame < frames.size(); nextFrame++)
+            {
+                Result result;
+                result.frame = nextFrame;
+                reported++;
+                if(callback)
+                    callback(result);
+            }
+            break;
+        }
+
+        QList<FrameJob *> ready;
+        jobLock.lock();
+        while(doneJobs.isEmpty())
+            jobsChanged.wait(&jobLock);
+        ready = doneJobs;
+        doneJobs.clear();
+        jobLock.unlock();
+
+        foreach(FrameJob *job, ready)
+        {
+            //A frame that was extracted goes on to be solved, the solver already has its stars so it just solves them
+            if(!job->solved && job->code == 0 && !isAborted())
+            {
+                job->solved = true;
+                job->code = -1;
+                connect(job->solver, &SextractorSolver::finished, [job](int code)
+                {
+                    job->code = code;
+                });
+                solvePool.start(new BatchStageTask([this, job]()
+                {
+                    job->solver->executeProcess();
+                    jobDone(job);
+                }));
+                continue;
+            }
+
+            Result result = getResult(job);
+            if(result.code == 0)
+                numSolved++;
+            jobLock.lock();
+            activeJobs.removeOne(job);
+            jobLock.unlock();
+            delete job->solver;
+            delete job;
+            inFlight--;
+            reported++;
+            if(callback)
+                callback(result);
+        }
+    }
+
+    SolverEngineCache::instance()->release(batchIndexes);
+    if(logLevel != SSolver::LOG_NONE)
+        emit logOutput(QString("Batch complete, %1 of %2 frames solved in %3 seconds").arg(numSolved).arg(frames.size()).arg(timer.elapsed() / 1000.0));
+    return numSolved;
+}
+
+//This stops starting new frames and aborts the solves of the frames that are running
+void BatchSolver::abort()
+{
+    aborted.storeRelease(1);
+    QMutexLocker locker(&jobLock);
+    foreach(FrameJob *job, activeJobs)
+        job->solver->abort();
+}
@@ -0,0 +1,117 @@
+/*  BatchSolver, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef BATCHSOLVER_H
+#define BATCHSOLVER_H
+
+//Includes for this project
+#include "structuredefinitions.h"
+#include "parameters.h"
+#include "wcsdata.h"
+
+//QT Includes
+#include <QObject>
+#include <QVector>
+#include <QList>
+#include <QDir>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <functional>
+
+using namespace SSolver;
+
+class InternalSextractorSolver;
+
+//This solves many images with the same settings, like a night's worth of frames or an archive.
+//The settings are parsed and the indexes are loaded once for the whole batch, and the threads are reused.
+//The extraction of the next frames runs while the current frames are being solved, and several frames are solved at once.
+//It always uses the internal SEP sextractor and the internal StellarSolver solver.
+class BatchSolver : public QObject
+{
+    Q_OBJECT
+public:
+    //This is one frame of the batch.  The image buffer must stay valid until the result for the frame has been reported.
+    struct ImageRef
+    {
+        FITSImage::Statistic stats;
+        const uint8_t *imageBuffer = nullptr;
+        bool use_position = false;          //Whether or not to use the search position for this frame
+        double search_ra = HUGE_VAL;        //RA of field center for search, format: decimal degrees
+        double search_dec = HUGE_VAL;       //DEC of field center for search, format: decimal degrees
+    };
+
+    //This is the result for one frame of the batch
+    struct Result
+    {
+        int frame = -1;                     //This is the index of the frame in the batch
+        int code = -1;                      //0 means it solved, anything else means it failed or was aborted, like the finished signal
+        FITSImage::Solution solution;
+        QList<FITSImage::Star> stars;       //These have RA and DEC if the frame solved
+        WCSData wcsData;                    //This is only valid if the frame solved and loadWCS is set
+    };
+
+    //The callback is called for each frame as soon as it is done, which is not necessarily in the order of the frames.
+    //It is called on the thread that called solveBatch.
+    typedef std::function<void(const Result &result)> ResultCallback;
+
+    explicit BatchSolver(QObject *parent = nullptr);
+    ~BatchSolver();
+
+    //These set the settings for all of the frames in the batch
+    void setParameters(Parameters parameters){params = parameters;};
+    void setIndexFolderPaths(QStringList indexPaths){indexFolderPaths = indexPaths;};
+    void setSearchScale(double fov_low, double fov_high, ScaleUnits units);
+    void setUseScale(bool set){use_scale = set;};
+    void setUseIndexCache(bool set){useIndexCache = set;};
+    void setUseBackgroundCache(bool set){useBackgroundCache = set;};
+    void setLoadWCS(bool set){loadWCS = set;};
+    void setLogLevel(logging_level level){logLevel = level;};
+    void setSolveThreads(int threads);              //This is the number of frames that are solved at the same time
+    void setLookAhead(int frames);                  //This is how many frames can be extracted ahead of the ones being solved
+
+    //This solves all the frames and returns when they are all done or it was aborted.  It returns the number of frames that solved.
+    //Since it blocks, you would normally call it from a worker thread.
+    int solveBatch(const QVector<ImageRef> &frames, ResultCallback callback);
+    void abort();
+    bool isAborted(){return aborted.loadAcquire() != 0;};
+
+    QString basePath = QDir::tempPath();//This is the path used for saving any temporary files.
+
+signals:
+    //This signals that there is infomation that should be printed to a log file or log window
+    void logOutput(QString logText);
+
+private:
+    struct FrameJob;
+    InternalSextractorSolver *createFrameSolver(const ImageRef &frame);
+    void jobDone(FrameJob *job);
+    Result getResult(FrameJob *job);
+
+    Parameters params;
+    QStringList indexFolderPaths;
+    bool use_scale = false;             //Whether or not to use the image scale parameters
+    double scalelo = 0;                 //Lower bound of image scale estimate
+    double scalehi = 0;                 //Upper bound of image scale estimate
+    ScaleUnits scaleunit;               //In what units are the lower and upper bounds?
+    bool useIndexCache = false;         //Whether or not to keep the index files loaded after the batch is done
+    bool useBackgroundCache = false;    //Whether or not the frames can use the background model of the frame before them
+    bool loadWCS = true;
+    logging_level logLevel = LOG_MSG;
+    int lookAhead = 1;
+
+    QThreadPool extractPool;            //The frames are extracted one at a time since SEP already extracts large images in parallel
+    QThreadPool solvePool;              //The frames are solved on this pool of threads
+    QMutex jobLock;
+    QWaitCondition jobsChanged;
+    QList<FrameJob *> activeJobs;       //These are the frames that have been started and not reported yet
+    QList<FrameJob *> doneJobs;         //These are the frames that finished a stage and are waiting for solveBatch to pick them up
+    QAtomicInt aborted;
+};
+
+#endif // BATCHSOLVER_H
@@ -0,0 +1,157 @@
+/*  BufferPool, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "bufferpool.h"
+
+//Sextractor Includes
+#include "sep/sep.h"
+
+#include <QMutexLocker>
+#include <stdlib.h>
+
+//This is how many bytes of buffers are kept for later by default, more than this are freed when they come back
+#define BUFFER_POOL_MAX_FREE_BYTES (256 * 1024 * 1024)
+//Nothing smaller than this is given out, so the small line buffers all share one size
+#define BUFFER_POOL_MIN_SIZE 4096
+
+BufferPool *BufferPool::instance()
+{
+    static BufferPool bufferPool;
+    return &bufferPool;
+}
+
+BufferPool::BufferPool()
+{
+    maxFreeBytes = BUFFER_POOL_MAX_FREE_BYTES;
+    sep_set_buffer_functions(&BufferPool::sepAlloc, &BufferPool::sepFree);
+}
+
+BufferPool::~BufferPool()
+{
+    sep_set_buffer_functions(nullptr, nullptr);
+    foreach(const Buffer &buffer, freeBuffers)
+        free(buffer.data);
+}
+
+void *BufferPool::sepAlloc(size_t size)
+{
+    return instance()->acquireBytes(size);
+}
+
+void BufferPool::sepFree(void *buffer)
+{
+    instance()->releaseBytes(buffer);
+}
+
+//This rounds the size up to 1, 1.25, 1.5 or 1.75 times a power of two, so at most a fifth of a buffer is wasted
+size_t BufferPool::bucketSize(size_t size)
+{
+    if(size <= BUFFER_POOL_MIN_SIZE)
+        return BUFFER_POOL_MIN_SIZE;
+    size_t power = 1;
+    while(power <= size / 2)
+        power *= 2;
+    size_t step = power / 4;
+    return (size + step - 1) / step * step;
+}
+
+float *BufferPool::acquire(size_t count)
+{
+    return static_cast<float *>(acquireBytes(count * sizeof(float)));
+}
+
+void BufferPool::release(float *buffer)
+{
+    releaseBytes(buffer);
+}
+
+void *BufferPool::acquireBytes(size_t size)
+{
+    size_t bucket = bucketSize(size);
+    QMutexLocker locker(&poolLock);
+    stats.acquires++;
+
+    Buffer buffer = {nullptr, bucket};
+    for(int i = 0; i < freeBuffers.size(); i++)
+    {
+        if(freeBuffers.at(i).size == bucket)
+        {
+            buffer = freeBuffers.takeAt(i);
+            stats.bytesFree -= bucket;
+            stats.hits++;
+            break;
+        }
+    }
+    if(buffer.data == nullptr)
+    {
+        buffer.data = malloc(bucket);
+        if(buffer.data == nullptr)
+            return nullptr;
+        stats.allocations++;
+    }
+
+    usedBuffers.insert(buffer.data, bucket);
+    stats.bytesInUse += bucket;
+    if(stats.bytesInUse + stats.bytesFree > stats.peakBytes)
+        stats.peakBytes = stats.bytesInUse + stats.bytesFree;
+    return buffer.data;
+}
+
+void BufferPool::releaseBytes(void *buffer)
+{
+    if(buffer == nullptr)
+        return;
+    QMutexLocker locker(&poolLock);
+    QHash<void *, size_t>::iterator used = usedBuffers.find(buffer);
+    if(used == usedBuffers.end())
+    {
+        free(buffer);
+        return;
+    }
+    Buffer released = {buffer, used.value()};
+    usedBuffers.erase(used);
+    stats.bytesInUse -= released.size;
+    stats.bytesFree += released.size;
+    freeBuffers.prepend(released);
+    trimLocked(maxFreeBytes);
+}
+
+void BufferPool::trim(qint64 maxFreeBytes)
+{
+    QMutexLocker locker(&poolLock);
+    trimLocked(maxFreeBytes);
+}
+
+//The ones that were used the longest time ago are freed first
+void BufferPool::trimLocked(qint64 maxFreeBytes)
+{
+    while(stats.bytesFree > maxFreeBytes && !freeBuffers.isEmpty())
+    {
+        Buffer buffer = freeBuffers.takeLast();
+        stats.bytesFree -= buffer.size;
+        free(buffer.data);
+    }
+}
+
+void BufferPool::setMaxFreeBytes(qint64 bytes)
+{
+    QMutexLocker locker(&poolLock);
+    maxFreeBytes = bytes;
+    trimLocked(maxFreeBytes);
+}
+
+qint64 BufferPool::getMaxFreeBytes()
+{
+    QMutexLocker locker(&poolLock);
+    return maxFreeBytes;
+}
+
+FITSImage::BufferPoolStats BufferPool::getStats()
+{
+    QMutexLocker locker(&poolLock);
+    return stats;
+}
@@ -0,0 +1,66 @@
+/*  BufferPool, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+//Includes for this project
+#include "structuredefinitions.h"
+
+//QT Includes
+#include <QHash>
+#include <QList>
+#include <QMutex>
+
+//This keeps the large working buffers of the source extraction after an extraction is done, so that the next extraction,
+//which is usually of an image the same size, gets buffers that are already allocated instead of new ones.
+//It holds the float image for SEP, and SEP's own pixel stack and line buffers, which it gets through sep_set_buffer_functions.
+//The sizes are rounded up to steps of a quarter of a power of two, so buffers for images that are close in size can be shared.
+class BufferPool
+{
+public:
+    static BufferPool *instance();
+
+    //This gives a buffer that holds at least count floats, it must be given back with release when it is not needed anymore.
+    float *acquire(size_t count);
+    void release(float *buffer);
+
+    //These do the same for a buffer of size bytes.  A buffer that didn't come from the pool is just freed.
+    void *acquireBytes(size_t size);
+    void releaseBytes(void *buffer);
+
+    //This frees the buffers that are waiting to be used again, the ones used most recently are kept up to maxFreeBytes
+    void trim(qint64 maxFreeBytes = 0);
+    //The pool never keeps more than this many bytes of buffers that are waiting to be used again
+    void setMaxFreeBytes(qint64 bytes);
+    qint64 getMaxFreeBytes();
+
+    FITSImage::BufferPoolStats getStats();
+
+private:
+    BufferPool();
+    ~BufferPool();
+
+    static void *sepAlloc(size_t size);
+    static void sepFree(void *buffer);
+    static size_t bucketSize(size_t size);
+    void trimLocked(qint64 maxFreeBytes);
+
+    struct Buffer
+    {
+        void *data;
+        size_t size;
+    };
+
+    QMutex poolLock;
+    QList<Buffer> freeBuffers;              //These are waiting to be used again, the one released last is first
+    QHash<void *, size_t> usedBuffers;      //These have been given out, they are needed to know the size of a buffer when it comes back
+    qint64 maxFreeBytes;
+    FITSImage::BufferPoolStats stats;
+};
+
+#endif // BUFFERPOOL_H
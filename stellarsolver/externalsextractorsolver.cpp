@@ -254,6 +254,7 @@ SextractorSolver* ExternalSextractorSolver::spawnChildSolver(int n)
     solver->astapBinaryPath = astapBinaryPath;
     solver->wcsPath = wcsPath;
     solver->cleanupTemporaryFiles = cleanupTemporaryFiles;
+    solver->useMemoryTempFiles = useMemoryTempFiles;
     solver->autoGenerateAstroConfig = autoGenerateAstroConfig;
 
     solver->isChildSolver = true;
@@ -271,7 +272,7 @@ SextractorSolver* ExternalSextractorSolver::spawnChildSolver(int n)
     if(use_position)
         solver->setSearchPositionInDegrees(search_ra, search_dec);
     if(logLevel != LOG_NONE)
-        connect(solver, &SextractorSolver::logOutput, this, &SextractorSolver::logOutput);
+        connect(solver, &SextractorSolver::logOutput, this, &SextractorSolver::logOutput, Qt::DirectConnection);
     //This way they all share a solved and cancel fn
     solver->solutionFile = solutionFile;
     solver->cancelfn = cancelfn;
@@ -300,6 +301,21 @@ void ExternalSextractorSolver::abort()
     wasAborted = true;
 }
 
+//On Linux, /dev/shm is a folder in memory, so files written there never have to go to the disk.
+//This returns an empty string if that is not available or it is turned off.
+QString ExternalSextractorSolver::getMemoryTempFolder()
+{
+#ifdef Q_OS_LINUX
+    if(useMemoryTempFiles)
+    {
+        QFileInfo shm("/dev/shm");
+        if(shm.isDir() && shm.isWritable())
+            return shm.absoluteFilePath();
+    }
+#endif
+    return QString();
+}
+
 void ExternalSextractorSolver::cleanupTempFiles()
 {
     if(cleanupTemporaryFiles)
@@ -342,21 +358,14 @@ int ExternalSextractorSolver::runExternalSextractor()
     emit logOutput("+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++");
     emit logOutput("Configuring external Sextractor");
     QFileInfo file(fileToProcess);
-    if(!file.exists())
-        return -1;
-    if(file.suffix() != "fits" && file.suffix() != "fit")
+    //Sextractor only reads the image, so a FITS file that already exists is used where it is without copying it.
+    //Otherwise the image buffer is written straight to a FITS file in memory backed storage if the system has it.
+    if(!file.exists() || (file.suffix() != "fits" && file.suffix() != "fit"))
     {
-        int ret = saveAsFITS();
+        int ret = saveAsFITS(true);
         if(ret != 0)
             return ret;
     }
-    else
-    {
-        QString newFileURL = basePath + "/" + baseName + "." + file.suffix();
-        QFile::copy(fileToProcess, newFileURL);
-        fileToProcess = newFileURL;
-        fileToProcessIsTempFile = true;
-    }
 
     //Configuration arguments for sextractor
     QStringList sextractorArgs;
@@ -477,15 +486,12 @@ int ExternalSextractorSolver::runExternalSextractor()
 
     if(useSubframe)
     {
-        for(int i = 0; i<stars.size();i++)
+        const float *x = stars.x().constData();
+        const float *y = stars.y().constData();
+        stars.filter([&](int i)
         {
-            FITSImage::Star star = stars.at(i);
-            if(!subframe.contains(star.x, star.y))
-            {
-                stars.removeAt(i);
-                i--;
-            }
-        }
+            return subframe.contains(x[i], y[i]);
+        });
     }
 
     applyStarFilters();
@@ -610,7 +616,7 @@ int ExternalSextractorSolver::runExternalASTAPSolver()
     emit logOutput("+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++");
     emit logOutput("Configuring external ASTAP solver");
 
-    if(sextractorType != SEXTRACTOR_BUILTIN)
+    if(sextractorType != SEXTRACTOR_BUILTIN && !fileToProcessIsTempFile)
     {
         QFileInfo file(fileToProcess);
         if(!file.exists())
@@ -867,13 +873,9 @@ int ExternalSextractorSolver::getStarsFromXYLSFile()
 
     fitsfile * new_fptr;
     char error_status[512];
-
-    /* FITS file pointer, defined in fitsio.h */
-    char *val, value[1000], nullptrstr[]="*";
     int status = 0;   /*  CFITSIO status value MUST be initialized to zero!  */
-    int hdunum, hdutype = ANY_HDU, ncols, ii, anynul;
-    long nelements[1000];
-    long jj, nrows, kk;
+    int hdunum, hdutype = ANY_HDU, ncols, anynul;
+    long nrows;
 
     if (fits_open_diskfile(&new_fptr, sextractorFilePath.toLatin1(), READONLY, &status))
     {
@@ -892,22 +894,61 @@ int ExternalSextractorSolver::getStarsFromXYLSFile()
 
     if (!(hdutype == ASCII_TBL || hdutype == BINARY_TBL)) {
         emit logOutput("Wrong type of file");
+        fits_close_file(new_fptr, &status);
         return -1;
     }
 
     fits_get_num_rows(new_fptr, &nrows, &status);
     fits_get_num_cols(new_fptr, &ncols, &status);
 
-    for (jj=1; jj<=ncols; jj++)
-        fits_get_coltype(new_fptr, jj, nullptr, &nelements[jj], nullptr, &status);
+    //These are the columns that are used, in the order they are in the file
+    int numColumns;
+    if(solverType == SOLVER_LOCALASTROMETRY || solverType == SOLVER_ONLINEASTROMETRY)
+        numColumns = 3;     //x, y, flux
+    else if(solverType == SOLVER_ASTAP)
+        numColumns = 2;     //x, y
+    else if(processType == SEXTRACT_WITH_HFR)
+        numColumns = 9;     //x, y, mag, flux, peak, xx, yy, xy, HFR
+    else
+        numColumns = 8;
+    numColumns = qMin(numColumns, ncols);
+
+    //Each column is read in one call, converted to float by cfitsio, instead of reading every value as a string.
+    //If a column has more than one element per row, the last one is used.
+    QVector<QVector<float>> columns(9);
+    for (int col = 0; col < numColumns && !status; col++)
+    {
+        long repeat = 1;
+        fits_get_coltype(new_fptr, col + 1, nullptr, &repeat, nullptr, &status);
+        repeat = qMax(repeat, 1L);
+        QVector<float> values(nrows * repeat);
+        if (nrows > 0 && fits_read_col(new_fptr, TFLOAT, col + 1, 1, 1, nrows * repeat, nullptr, values.data(), &anynul, &status))
+            break;
+        columns[col].resize(nrows);
+        for (long row = 0; row < nrows; row++)
+            columns[col][row] = values.at(row * repeat + repeat - 1);
+    }
+
+    if (status)
+    {
+        fits_get_errstatus(status, error_status);
+        emit logOutput(QString("Error reading the sextractor table: %1").arg(QString::fromUtf8(error_status)));
+        status = 0;
+        fits_close_file(new_fptr, &status);
+        return -1;
+    }
+
+    auto value = [&columns](int col, long row)
+    {
+        return columns.at(col).isEmpty() ? 0.0f : columns.at(col).at(row);
+    };
 
         stars.clear();
+        stars.reserve(nrows);
 
-        /* read each column, row by row */
-        val = value;
-        for (jj = 1; jj <= nrows && !status; jj++) {
-            float starx = 0;
-            float stary = 0;
+        for (long jj = 0; jj < nrows; jj++) {
+            float starx = value(0, jj);
+            float stary = value(1, jj);
             float mag = 0;
             float flux = 0;
             float peak = 0;
@@ -916,52 +957,17 @@ int ExternalSextractorSolver::getStarsFromXYLSFile()
             float xy = 0;
             float HFR = 0;
 
-            for (ii = 1; ii <= ncols; ii++)
+            if(solverType == SOLVER_LOCALASTROMETRY || solverType == SOLVER_ONLINEASTROMETRY)
+                flux = value(2, jj);
+            else if(solverType != SOLVER_ASTAP)
             {
-                for (kk = 1; kk <= nelements[ii]; kk++)
-                {
-                    /* read value as a string, regardless of intrinsic datatype */
-                    if (fits_read_col_str (new_fptr,ii,jj,kk, 1, nullptrstr,
-                                           &val, &anynul, &status) )
-                        break;  /* jump out of loop on error */
-                    if(solverType == SOLVER_LOCALASTROMETRY || solverType == SOLVER_ONLINEASTROMETRY)
-                    {
-                        if(ii == 1)
-                            starx = QString(value).trimmed().toFloat();
-                        if(ii == 2)
-                            stary = QString(value).trimmed().toFloat();
-                        if(ii == 3)
-                            flux = QString(value).trimmed().toFloat();
-                    }
-                    else if(solverType == SOLVER_ASTAP)
-                    {
-                        if(ii == 1)
-                            starx = QString(value).trimmed().toFloat();
-                        if(ii == 2)
-                            stary = QString(value).trimmed().toFloat();
-                    }
-                    else
-                    {
-                        if(ii == 1)
-                            starx = QString(value).trimmed().toFloat();
-                        if(ii == 2)
-                            stary = QString(value).trimmed().toFloat();
-                        if(ii == 3)
-                            mag = QString(value).trimmed().toFloat();
-                        if(ii == 4)
-                            flux = QString(value).trimmed().toFloat();
-                        if(ii == 5)
-                            peak = QString(value).trimmed().toFloat();
-                        if(ii == 6)
-                            xx = QString(value).trimmed().toFloat();
-                        if(ii == 7)
-                            yy = QString(value).trimmed().toFloat();
-                        if(ii == 8)
-                            xy = QString(value).trimmed().toFloat();
-                        if(processType == SEXTRACT_WITH_HFR && ii == 9)
-                            HFR = QString(value).trimmed().toFloat();
-                    }
-                }
+                mag = value(2, jj);
+                flux = value(3, jj);
+                peak = value(4, jj);
+                xx = value(5, jj);
+                yy = value(6, jj);
+                xy = value(7, jj);
+                HFR = value(8, jj);
             }
 
             //  xx  xy      or     a   b
@@ -1226,16 +1232,10 @@ int ExternalSextractorSolver::writeSextractorTable()
     char* tunit[] = { colUnits, colUnits, magUnits };
     const char* extfile = "Sextractor_File";
 
-    float *xArray = new float[stars.size()];
-    float *yArray = new float[stars.size()];
-    float *magArray = new float[stars.size()];
-
-    for (int i = 0; i < stars.size(); i++)
-    {
-        xArray[i] = stars.at(i).x;
-        yArray[i] = stars.at(i).y;
-        magArray[i] = stars.at(i).mag;
-    }
+    //The columns are written straight from the arrays in the star catalog, cfitsio does not change them even though it does not take const pointers
+    float *xArray = const_cast<float *>(stars.x().constData());
+    float *yArray = const_cast<float *>(stars.y().constData());
+    float *magArray = const_cast<float *>(stars.mag().constData());
 
     if(fits_create_tbl(new_fptr, BINARY_TBL, nrows, tfields,
         ttype, tform, tunit, extfile, &status))
@@ -1274,19 +1274,18 @@ int ExternalSextractorSolver::writeSextractorTable()
         return status;
     }
 
-    free(xArray);
-    free(yArray);
-    free(magArray);
-
     return 0;
 }
 
 //This is very necessary for solving non-fits images with external Sextractor
 //This was copied and pasted and modified from ImageToFITS in fitsdata in KStars
-int ExternalSextractorSolver::saveAsFITS()
+//If inMemory is set, the file is written to memory backed storage so it never goes to the disk.
+//That is only for files that are just read by another program, the solvers save other files next to the image.
+int ExternalSextractorSolver::saveAsFITS(bool inMemory)
 {
-    QFileInfo fileInfo(fileToProcess.toLatin1());
     QString newFilename = basePath + "/" + baseName + ".fits";
+    if(inMemory && !getMemoryTempFolder().isEmpty())
+        newFilename = getMemoryTempFolder() + "/" + baseName + ".fits";
 
     int status = 0;
     fitsfile * new_fptr;
@@ -1325,7 +1324,38 @@ int ExternalSextractorSolver::saveAsFITS()
 
     fitsfile *fptr = new_fptr;
 
-    if (fits_create_img(fptr, BYTE_IMG, naxis, naxes, &status))
+    //The image is saved with the bit depth of the buffer so that no data is lost
+    int bitpix = BYTE_IMG;
+    switch(stats.dataType)
+    {
+        case TUSHORT:
+            bitpix = USHORT_IMG;
+            break;
+        case TSHORT:
+            bitpix = SHORT_IMG;
+            break;
+        case TULONG:
+            bitpix = ULONG_IMG;
+            break;
+        case TLONG:
+        case TINT:
+            bitpix = LONG_IMG;
+            break;
+        case TFLOAT:
+            bitpix = FLOAT_IMG;
+            break;
+        case TDOUBLE:
+            bitpix = DOUBLE_IMG;
+            break;
+        case TLONGLONG:
+            bitpix = LONGLONG_IMG;
+            break;
+        default:
+            bitpix = BYTE_IMG;
+            break;
+    }
+
+    if (fits_create_img(fptr, bitpix, naxis, naxes, &status))
     {
         emit logOutput(QString("fits_create_img failed: %1").arg(error_status));
         status = 0;
@@ -1335,15 +1365,13 @@ int ExternalSextractorSolver::saveAsFITS()
     }
 
     /* Write Data */
-    uint8_t *imageBuffer = new uint8_t[stats.samples_per_channel * m_Channels * stats.bytesPerPixel];
-    memcpy(imageBuffer, m_ImageBuffer, stats.samples_per_channel * m_Channels * stats.bytesPerPixel);
-    if (fits_write_img(fptr, stats.dataType, 1, nelements, imageBuffer, &status))
+    //cfitsio does not change the buffer it writes, so the image buffer is written directly instead of making a copy of it first
+    if (fits_write_img(fptr, stats.dataType, 1, nelements, const_cast<uint8_t *>(m_ImageBuffer), &status))
     {
-        delete[] imageBuffer;
         fits_report_error(stderr, status);
+        fits_close_file(fptr, &status);
         return status;
     }
-    delete[] imageBuffer;
 
     /* Write keywords */
 
@@ -1472,44 +1500,11 @@ int ExternalSextractorSolver::loadWCS()
     return 0;
 }
 
-//This was essentially copied from KStars' loadWCS method and split in half with some modifications
-FITSImage::wcs_point *ExternalSextractorSolver::getWCSCoord()
+WCSData ExternalSextractorSolver::getWCSData()
 {
     if(!hasWCS)
-    {
-        emit logOutput("There is no WCS Data.  Did you solve the image first?");
-        return nullptr;
-    }
-
-    int w  = stats.width;
-    int h = stats.height;
-    FITSImage::wcs_point * wcs_coord = new FITSImage::wcs_point[w * h];
-    FITSImage::wcs_point * p = wcs_coord;
-    double imgcrd[2], phi = 0, pixcrd[2], theta = 0, world[2];
-    int status;
-    int stat[2];
-
-    for (int i = 0; i < h; i++)
-    {
-        for (int j = 0; j < w; j++)
-        {
-            pixcrd[0] = j;
-            pixcrd[1] = i;
-
-            if ((status = wcsp2s(m_wcs, 1, 2, &pixcrd[0], &imgcrd[0], &phi, &theta, &world[0], &stat[0])) != 0)
-            {
-                emit logOutput(QString("wcsp2s error %1: %2.").arg(status).arg(wcs_errmsg[status]));
-            }
-            else
-            {
-                p->ra  = world[0];
-                p->dec = world[1];
-
-                p++;
-            }
-        }
-    }
-    return wcs_coord;
+        return WCSData();
+    return WCSData(m_wcs, stats.width, stats.height);
 }
 
 QList<FITSImage::Star> ExternalSextractorSolver::appendStarsRAandDEC(QList<FITSImage::Star> stars)
@@ -1520,31 +1515,24 @@ QList<FITSImage::Star> ExternalSextractorSolver::appendStarsRAandDEC(QList<FITSI
         return stars;
     }
 
-    double imgcrd[2], phi = 0, pixcrd[2], theta = 0, world[2];
-    int status;
-    int stat[2];
+    //The stars are all converted with one call to wcsp2s instead of one call per star
+    QVector<QPointF> pixelPoints;
+    pixelPoints.reserve(stars.size());
+    foreach(const FITSImage::Star &star, stars)
+        pixelPoints.append(QPointF(star.x, star.y));
+    QVector<FITSImage::wcs_point> skyPoints(stars.size());
+    if(!getWCSData().pixelsToWCS(pixelPoints.constData(), pixelPoints.size(), skyPoints.data()))
+    {
+        emit logOutput("wcsp2s error: the RA and DEC could not be computed for the stars.");
+        return stars;
+    }
 
     QList<FITSImage::Star> refinedStars;
-    foreach(FITSImage::Star star, stars)
+    for(int i = 0; i < stars.size(); i++)
     {
-        double ra = HUGE_VAL;
-        double dec = HUGE_VAL;
-        pixcrd[0] = star.x;
-        pixcrd[1] = star.y;
-
-        if ((status = wcsp2s(m_wcs, 1, 2, &pixcrd[0], &imgcrd[0], &phi, &theta, &world[0], &stat[0])) != 0)
-        {
-            emit logOutput(QString("wcsp2s error %1: %2.").arg(status).arg(wcs_errmsg[status]));
-            return stars;
-        }
-        else
-        {
-            ra  = world[0];
-            dec = world[1];
-        }
-
-        //We do need to correct for all the downsampling as well as add RA/DEC info
-        FITSImage::Star refinedStar = {star.x, star.y, star.mag, star.flux, star.peak, star.HFR, star.a, star.b, star.theta, (float)ra, (float)dec};
+        FITSImage::Star refinedStar = stars.at(i);
+        refinedStar.ra = skyPoints.at(i).ra;
+        refinedStar.dec = skyPoints.at(i).dec;
         refinedStars.append(refinedStar);
     }
     return refinedStars;
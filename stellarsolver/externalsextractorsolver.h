@@ -38,6 +38,7 @@ public:
     //External Options
     bool cleanupTemporaryFiles = true;
     bool autoGenerateAstroConfig = true;
+    bool useMemoryTempFiles = true;     //This saves the image for sextractor in memory backed storage like /dev/shm instead of basePath, when there is some
 
     //System File Paths
     QStringList indexFilePaths;
@@ -69,11 +70,12 @@ public:
     int getStarsFromXYLSFile();
     bool getSolutionInformation();
     bool getASTAPSolutionInformation();
-    int saveAsFITS();
+    int saveAsFITS(bool inMemory = false);
+    QString getMemoryTempFolder();
     void cleanupTempFiles();
 
     int loadWCS();
-    FITSImage::wcs_point * getWCSCoord() override;
+    WCSData getWCSData() override;
     QList<FITSImage::Star> appendStarsRAandDEC(QList<FITSImage::Star> stars) override;
     /// WCS Struct
     struct wcsprm *m_wcs
@@ -0,0 +1,229 @@
+/*  FocusMeter, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "focusmeter.h"
+#include "internalsextractorsolver.h"
+#include "imageingest.h"
+#include "qmath.h"
+
+#include <algorithm>
+
+//The window around a star is at least this many pixels from the star to its edge, before the drift is added
+#define FOCUS_MIN_RADIUS 12
+//The window around a star is never larger than this, so a very defocused star can't make it cover the image
+#define FOCUS_MAX_RADIUS 100
+//The window reaches this many times the size of the star in the last image, so the star can grow between images
+#define FOCUS_RADIUS_FACTOR 3
+//A star can move this many pixels between images and still be found in its window
+#define FOCUS_DRIFT 8
+//The background of a window is taken from the pixels this close to its edge
+#define FOCUS_BORDER 2
+//The detection threshold in a window, in standard deviations of the background
+#define FOCUS_THRESHOLD 3.0
+//Stars with a pixel above this fraction of the saturation level have a flat top and a wrong HFR
+#define FOCUS_SATURATION 0.95
+
+//This is how far the edge of the aperture is from the star, it is the same for the window without the drift
+static int apertureRadius(const FITSImage::Star &star)
+{
+    float size = qMax(star.HFR, star.a);
+    return qBound(FOCUS_MIN_RADIUS, qCeil(FOCUS_RADIUS_FACTOR * size), FOCUS_MAX_RADIUS);
+}
+
+//This changes the order of the values
+static float median(QVector<float> &values)
+{
+    int middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    float upper = values.at(middle);
+    if(values.size() % 2 == 1)
+        return upper;
+    float lower = *std::max_element(values.begin(), values.begin() + middle);
+    return (lower + upper) / 2;
+}
+
+FocusMeter::FocusMeter(const FITSImage::Statistic &imagestats, uint8_t const *imageBuffer, const Parameters &parameters)
+{
+    stats = imagestats;
+    m_ImageBuffer = imageBuffer;
+    params = parameters;
+    saturation = InternalSextractorSolver::saturationLevel(stats);
+}
+
+//Stars whose windows would run off the image, stars that are saturated and stars close to a star that was already chosen are skipped,
+//so that each window holds one star that can be measured all the way around.
+QList<FITSImage::Star> FocusMeter::chooseSeeds(const StarCatalog &catalog, int numStars)
+{
+    QList<FITSImage::Star> seeds;
+    for(int i = 0; i < catalog.size() && seeds.size() < numStars; i++)
+    {
+        FITSImage::Star star = catalog.at(i);
+        if(saturation != -1 && star.peak > FOCUS_SATURATION * saturation)
+            continue;
+        int half = apertureRadius(star) + FOCUS_DRIFT;
+        if(star.x - 1 < half || star.y - 1 < half || star.x - 1 + half >= stats.width || star.y - 1 + half >= stats.height)
+            continue;
+        bool crowded = false;
+        foreach(const FITSImage::Star &seed, seeds)
+        {
+            float dx = seed.x - star.x;
+            float dy = seed.y - star.y;
+            int separation = qMax(half, apertureRadius(seed) + FOCUS_DRIFT);
+            if(dx * dx + dy * dy < separation * separation)
+            {
+                crowded = true;
+                break;
+            }
+        }
+        if(!crowded)
+            seeds.append(star);
+    }
+    return seeds;
+}
+
+QVector<FocusMeter::FocusStar> FocusMeter::measure(const QList<FITSImage::Star> &seeds)
+{
+    QVector<FocusStar> measured;
+    measured.reserve(seeds.size());
+    foreach(const FITSImage::Star &seed, seeds)
+    {
+        FocusStar result;
+        if(measureStar(seed, result))
+            measured.append(result);
+    }
+    return measured;
+}
+
+//This finds the star again in a window around where it was, using the same detection as the full extraction but with the background
+//of the window instead of a background map, and measures its HFR in an aperture that is sized from how large it was.
+bool FocusMeter::measureStar(const FITSImage::Star &seed, FocusStar &result)
+{
+    //The star positions follow the FITS convention, where the first pixel is at 1, so they are moved back for SEP
+    float seedX = seed.x - 1;
+    float seedY = seed.y - 1;
+    int radius = apertureRadius(seed);
+    int half = radius + FOCUS_DRIFT;
+    int x0 = qMax(0, qRound(seedX) - half);
+    int y0 = qMax(0, qRound(seedY) - half);
+    int x1 = qMin((int)stats.width, qRound(seedX) + half + 1);
+    int y1 = qMin((int)stats.height, qRound(seedY) + half + 1);
+    int w = x1 - x0;
+    int h = y1 - y0;
+    if(w <= 4 * FOCUS_BORDER || h <= 4 * FOCUS_BORDER)
+        return false;
+
+    QVector<float> window(w * h);
+    if(!ImageIngest::toFloat(stats, m_ImageBuffer, QRect(x0, y0, w, h), 1, window.data()))
+        return false;
+    float *data = window.data();
+
+    QVector<float> border;
+    border.reserve(2 * FOCUS_BORDER * (w + h));
+    float maxValue = data[0];
+    for(int y = 0; y < h; y++)
+    {
+        bool edgeRow = y < FOCUS_BORDER || y >= h - FOCUS_BORDER;
+        for(int x = 0; x < w; x++)
+        {
+            float value = data[y * w + x];
+            maxValue = qMax(maxValue, value);
+            if(edgeRow || x < FOCUS_BORDER || x >= w - FOCUS_BORDER)
+                border.append(value);
+        }
+    }
+    if(saturation != -1 && maxValue > FOCUS_SATURATION * saturation)
+        return false;
+    float background = median(border);
+    for(int i = 0; i < border.size(); i++)
+        border[i] = fabs(border.at(i) - background);
+    float rms = 1.4826 * median(border);
+    if(maxValue <= background)
+        return false;
+    //An image with no noise, like a synthetic one, still needs a threshold above zero
+    if(rms <= 0)
+        rms = (maxValue - background) / 1000;
+    for(int i = 0; i < w * h; i++)
+        data[i] -= background;
+
+    sep_image im = {data, nullptr, nullptr, SEP_TFLOAT, 0, 0, w, h, 0.0, SEP_NOISE_NONE, 1.0, 0.0};
+    sep_catalog *catalog = nullptr;
+    int convSize = sqrt(params.convFilter.size());
+    //Deblending is turned off so that a very defocused star, which is a ring, is not split up into pieces
+    int status = sep_extract(&im, FOCUS_THRESHOLD * rms, SEP_THRESH_ABS, params.minarea, params.convFilter.data(), convSize, convSize, SEP_FILTER_CONV,
+                             params.deblend_thresh, 1.0, params.clean, params.clean_param, &catalog);
+    if(status != 0)
+    {
+        sep_catalog_free(catalog);
+        return false;
+    }
+
+    //The star is the brightest detection that is close enough to where it was
+    int best = -1;
+    for(int i = 0; i < catalog->nobj; i++)
+    {
+        float dx = catalog->x[i] - (seedX - x0);
+        float dy = catalog->y[i] - (seedY - y0);
+        if(dx * dx + dy * dy > FOCUS_DRIFT * FOCUS_DRIFT)
+            continue;
+        if(best == -1 || catalog->flux[i] > catalog->flux[best])
+            best = i;
+    }
+    if(best == -1)
+    {
+        sep_catalog_free(catalog);
+        return false;
+    }
+
+    double requested_frac = 0.5;
+    double HFR = 0;
+    short flag = 0;
+    sep_flux_radius(&im, catalog->x[best], catalog->y[best], radius, params.subpix, 0, nullptr, &requested_frac, 1, &HFR, &flag);
+
+    float xPos = catalog->x[best] + x0 + 1;
+    float yPos = catalog->y[best] + y0 + 1;
+    float a = catalog->a[best];
+    float b = catalog->b[best];
+    float flux = catalog->flux[best];
+    FITSImage::Star star = {xPos, yPos, (float)(params.magzero - 2.5 * log10(flux)), flux, catalog->peak[best],
+                            (float)HFR, a, b, (float)qRadiansToDegrees(catalog->theta[best]), 0, 0, catalog->npix[best]};
+    sep_catalog_free(catalog);
+    if(HFR <= 0)
+        return false;
+
+    result.star = star;
+    //For a gaussian star, a and b are the standard deviations along its axes
+    result.FWHM = 2.3548 * sqrt((a * a + b * b) / 2);
+    return true;
+}
+
+FITSImage::FocusMetric FocusMeter::summarize(const QVector<FocusStar> &measured, int numSeeds)
+{
+    FITSImage::FocusMetric metric;
+    metric.numSeeds = numSeeds;
+    metric.numStars = measured.size();
+    if(measured.isEmpty())
+        return metric;
+
+    QVector<float> HFRs, FWHMs;
+    HFRs.reserve(measured.size());
+    FWHMs.reserve(measured.size());
+    foreach(const FocusStar &focusStar, measured)
+    {
+        HFRs.append(focusStar.star.HFR);
+        FWHMs.append(focusStar.FWHM);
+    }
+    metric.HFR = median(HFRs);
+    metric.FWHM = median(FWHMs);
+
+    //The spread comes from the median absolute deviation so that a star or two that were measured badly don't change it much,
+    //and the error of a median is about 1.25 times the error of a mean
+    for(int i = 0; i < HFRs.size(); i++)
+        HFRs[i] = fabs(HFRs.at(i) - metric.HFR);
+    float sigma = 1.4826 * median(HFRs);
+    metric.HFRError = 1.2533 * sigma / sqrt(measured.size());
+    return metric;
+}
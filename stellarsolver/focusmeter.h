@@ -0,0 +1,52 @@
+/*  FocusMeter, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef FOCUSMETER_H
+#define FOCUSMETER_H
+
+//Includes for this project
+#include "structuredefinitions.h"
+#include "parameters.h"
+#include "starcatalog.h"
+
+//QT Includes
+#include <QList>
+#include <QVector>
+
+using namespace SSolver;
+
+//This measures the HFR of stars in small windows around the positions where they were in the last image of an autofocus run,
+//instead of extracting the whole image again.  Only the pixels in the windows are converted and looked at.
+class FocusMeter
+{
+public:
+    FocusMeter(const FITSImage::Statistic &imagestats, uint8_t const *imageBuffer, const Parameters &parameters);
+
+    //This is a star that was found in its window, with the FWHM from its shape, since the Star struct has no place for it
+    struct FocusStar
+    {
+        FITSImage::Star star;
+        float FWHM;
+    };
+
+    //This picks the brightest stars of a full extraction that can be measured well, the catalog should be sorted from brightest to dimmest
+    QList<FITSImage::Star> chooseSeeds(const StarCatalog &catalog, int numStars);
+    //This looks for each of the seed stars near its position, the stars that were not found are left out
+    QVector<FocusStar> measure(const QList<FITSImage::Star> &seeds);
+    //This takes the medians of the measured stars
+    static FITSImage::FocusMetric summarize(const QVector<FocusStar> &measured, int numSeeds);
+
+private:
+    bool measureStar(const FITSImage::Star &seed, FocusStar &result);
+
+    FITSImage::Statistic stats;
+    uint8_t const *m_ImageBuffer;
+    Parameters params;
+    double saturation;          //Stars brighter than this are not measured, -1 if the saturation level isn't known
+};
+
+#endif // FOCUSMETER_H
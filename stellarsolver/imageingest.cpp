@@ -0,0 +1,114 @@
+/*  ImageIngest, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "imageingest.h"
+
+//CFitsio Includes
+#include "fitsio.h"
+
+//Sextractor Includes
+#include "sep/sep.h"
+
+#include <QVector>
+#include <algorithm>
+#include <type_traits>
+
+//The types that SEP has vectorized converters for get their SEP type, the others are converted here with -1
+bool ImageIngest::toFloat(const FITSImage::Statistic &stats, uint8_t const *imageBuffer, const QRect &frame, int binning, float *destination)
+{
+    switch (stats.dataType)
+    {
+        case TBYTE:
+            ingest<uint8_t>(stats, imageBuffer, SEP_TBYTE, frame, binning, destination);
+            break;
+        case TSHORT:
+            ingest<int16_t>(stats, reinterpret_cast<int16_t const *>(imageBuffer), -1, frame, binning, destination);
+            break;
+        case TUSHORT:
+            ingest<uint16_t>(stats, reinterpret_cast<uint16_t const *>(imageBuffer), SEP_TUSHORT, frame, binning, destination);
+            break;
+        case TLONG:
+            ingest<int32_t>(stats, reinterpret_cast<int32_t const *>(imageBuffer), -1, frame, binning, destination);
+            break;
+        case TULONG:
+            ingest<uint32_t>(stats, reinterpret_cast<uint32_t const *>(imageBuffer), -1, frame, binning, destination);
+            break;
+        case TFLOAT:
+            ingest<float>(stats, reinterpret_cast<float const *>(imageBuffer), SEP_TFLOAT, frame, binning, destination);
+            break;
+        case TDOUBLE:
+            ingest<double>(stats, reinterpret_cast<double const *>(imageBuffer), -1, frame, binning, destination);
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+//Each output row is built up from the binning rows of each channel that go into it.  A source row is converted to float
+//(float images are used as they are), then sep_bin_add_array adds each group of binning pixels to the output pixel, and
+//at the end of the row the sums are turned into averages.
+template <typename T>
+void ImageIngest::ingest(const FITSImage::Statistic &stats, T const *source, int sepType, const QRect &frame, int binning, float *destination)
+{
+    int w = frame.width();
+    int h = frame.height();
+    int d = binning;
+
+    if(d <= 1)
+    {
+        for (int row = 0; row < h; row++)
+        {
+            T const *sourceRow = source + (size_t)(frame.y() + row) * stats.width + frame.x();
+            float *destinationRow = destination + (size_t)row * w;
+            if(sepType != -1)
+                sep_convert_array(sourceRow, sepType, w, destinationRow);
+            else
+            {
+                for (int i = 0; i < w; i++)
+                    destinationRow[i] = sourceRow[i];
+            }
+        }
+        return;
+    }
+
+    int numChannels = stats.ndim < 3 ? 1 : 3;
+    size_t channelSize = (size_t)stats.width * stats.height;
+    float numPixels = d * d * numChannels;
+    QVector<float> line(std::is_same<T, float>::value ? 0 : w * d);
+    float *lineData = line.data();
+
+    for (int row = 0; row < h; row++)
+    {
+        float *destinationRow = destination + (size_t)row * w;
+        std::fill(destinationRow, destinationRow + w, 0.0f);
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            for (int y2 = 0; y2 < d; y2++)
+            {
+                T const *sourceRow = source + channel * channelSize + (size_t)((frame.y() + row) * d + y2) * stats.width + frame.x() * d;
+                const float *values;
+                if(std::is_same<T, float>::value)
+                    values = reinterpret_cast<const float *>(sourceRow);
+                else
+                {
+                    if(sepType != -1)
+                        sep_convert_array(sourceRow, sepType, w * d, lineData);
+                    else
+                    {
+                        for (int i = 0; i < w * d; i++)
+                            lineData[i] = sourceRow[i];
+                    }
+                    values = lineData;
+                }
+                sep_bin_add_array(values, d, w, destinationRow);
+            }
+        }
+        for (int i = 0; i < w; i++)
+            destinationRow[i] /= numPixels;
+    }
+}
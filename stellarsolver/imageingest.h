@@ -0,0 +1,33 @@
+/*  ImageIngest, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef IMAGEINGEST_H
+#define IMAGEINGEST_H
+
+//Includes for this project
+#include "structuredefinitions.h"
+
+//QT Includes
+#include <QRect>
+
+//This turns the image buffer into the float image that SEP works on.  The conversion, the cropping to the subframe
+//and the binning are all done in one pass over the image, so no other copy of the image is ever made.
+class ImageIngest
+{
+public:
+    //This fills destination, which holds frame.width() * frame.height() floats, with the part of the image in frame.
+    //The frame is in binned pixels.  With binning, each float is the average of binning x binning pixels of the image,
+    //and of all three channels if it is a color image.  Without binning, only the first channel is used.
+    //It returns false if the data type of the image isn't supported.
+    static bool toFloat(const FITSImage::Statistic &stats, uint8_t const *imageBuffer, const QRect &frame, int binning, float *destination);
+
+private:
+    template <typename T>
+    static void ingest(const FITSImage::Statistic &stats, T const *source, int sepType, const QRect &frame, int binning, float *destination);
+};
+
+#endif // IMAGEINGEST_H
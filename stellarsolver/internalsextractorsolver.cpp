@@ -5,23 +5,237 @@
     License as published by the Free Software Foundation; either
     version 2 of the License, or (at your option) any later version.
 */
-#if defined(__APPLE__)
-#include <sys/stat.h>
-#elif defined(_WIN32)
+#if defined(_WIN32)
 #include "windows.h"
-#else //Linux
-#include <sys/stat.h>
 #endif
 
 #include "internalsextractorsolver.h"
+#include "solverenginecache.h"
+#include "backgroundcache.h"
+#include "bufferpool.h"
+#include "imageingest.h"
+#include "logsink.h"
 #include "qmath.h"
 
+#include <QThreadPool>
+#include <QRunnable>
+#include <QScopedPointer>
+#include <climits>
+
 extern "C"{
     #include "astrometry/log.h"
 }
 
 using namespace SSolver;
 
+//Images with fewer rows than this per thread are not worth splitting into strips
+#define MIN_STRIP_HEIGHT 512
+//Detection looks this many rows past each edge of a strip, so stars smaller than this are measured completely
+#define STRIP_MARGIN 64
+//When the scale comes from a solution hint, this is how far the scale can be from it, as a fraction
+#define HINT_SCALE_TOLERANCE 0.05
+//The photometry is only split between threads when there are at least this many stars to measure
+#define MIN_PARALLEL_STARS 64
+//The stars to measure are split into about this many groups for each thread
+#define PHOTOMETRY_GROUPS_PER_THREAD 4
+
+//This extracts the sources in one horizontal strip of the image, several of these run at the same time
+class StripExtractTask : public QRunnable
+{
+public:
+    StripExtractTask(sep_image *image, int rowStart, int rowEnd, float threshold, const Parameters &parameters) :
+        im(image), y0(rowStart), y1(rowEnd), thresh(threshold), params(parameters)
+    {
+        setAutoDelete(false);
+    }
+    void run() override
+    {
+        int convSize = sqrt(params.convFilter.size());
+        status = sep_extract_rows(im, y0, y1, STRIP_MARGIN, thresh, SEP_THRESH_ABS, params.minarea, params.convFilter.data(), convSize, convSize, SEP_FILTER_CONV, params.deblend_thresh, params.deblend_contrast, params.clean, params.clean_param, &catalog);
+    }
+    sep_catalog *catalog = nullptr;
+    int status = 0;
+private:
+    sep_image *im;
+    int y0;
+    int y1;
+    float thresh;
+    Parameters params;
+};
+
+//This orders the detections so the heap gives the one with the largest oval first
+static bool smallerOval(const std::pair<int, double> &o1, const std::pair<int, double> &o2)
+{
+    return o1.second < o2.second;
+}
+
+//This does the photometry on one detection from the catalog and makes the star for it.
+//It only reads the image and the catalog, so it can be done for many stars at the same time.
+static FITSImage::Star measureStar(sep_image *im, sep_catalog *catalog, int i, const Parameters &params, bool calculateHFR, int x, int y)
+{
+    //Constant values
+    double r = 6;  //The instructions say to use a fixed value of 6: https://sep.readthedocs.io/en/v1.0.x/api/sep.kron_radius.html
+
+    //Variables that are obtained from the catalog
+    //FOR SOME REASON, I FOUND THAT THE POSITIONS WERE OFF BY 1 PIXEL??
+    //This might be because of this: https://sextractor.readthedocs.io/en/latest/Param.html
+    //" Following the FITS convention, in SExtractor the center of the first image pixel has coordinates (1.0,1.0). "
+    float xPos = catalog->x[i] + 1;
+    float yPos = catalog->y[i] + 1;
+    float a = catalog->a[i];
+    float b = catalog->b[i];
+    float theta = catalog->theta[i];
+    double flux = catalog->flux[i];
+    double peak = catalog->peak[i];
+    int numPixels = catalog->npix[i];
+
+    //Variables that will be obtained through methods
+    double kronrad;
+    short flag;
+    double sum;
+    double sumerr;
+    double area;
+
+    //This will need to be done for both auto and ellipse
+    if(params.apertureShape != SHAPE_CIRCLE)
+    {
+        //Finding the kron radius for the sextraction
+        sep_kron_radius(im, xPos, yPos, a, b, theta, r, &kronrad, &flag);
+    }
+
+    bool use_circle;
+
+    switch(params.apertureShape)
+    {
+        case SHAPE_AUTO:
+            use_circle = kronrad * sqrt(a * b) < params.r_min;
+        break;
+
+        case SHAPE_CIRCLE:
+            use_circle = true;
+        break;
+
+        case SHAPE_ELLIPSE:
+            use_circle = false;
+        break;
+
+    }
+
+    if(use_circle)
+    {
+        sep_sum_circle(im, xPos, yPos, params.r_min, params.subpix, params.inflags, &sum, &sumerr, &area, &flag);
+    }
+    else
+    {
+        sep_sum_ellipse(im, xPos, yPos, a, b, theta, params.kron_fact*kronrad, params.subpix, params.inflags, &sum, &sumerr, &area, &flag);
+    }
+
+    float mag = params.magzero - 2.5 * log10(sum);
+
+    float HFR = 0;
+    if(calculateHFR)
+    {
+        //These are for the HFR
+        double requested_frac[2] = { 0.5, 0.99 };
+        double flux_fractions[2] = {0};
+        short flux_flag = 0;
+        int maxRadius = 50;
+
+        //Get HFR
+        sep_flux_radius(im, catalog->x[i], catalog->y[i], maxRadius, params.subpix, 0, &flux, requested_frac, 2, flux_fractions, &flux_flag);
+        HFR = flux_fractions[0];
+    }
+
+    FITSImage::Star star = {xPos + x, yPos + y, mag, (float)sum, (float)peak, HFR, a, b, qRadiansToDegrees(theta), 0, 0, numPixels};
+    return star;
+}
+
+//This measures a range of the chosen detections, several of these run at the same time.
+//Each star is written to its own place in the results, so they come out in the same order no matter which thread finishes first.
+class PhotometryTask : public QRunnable
+{
+public:
+    PhotometryTask(sep_image *image, sep_catalog *sepCatalog, const int *indexes, FITSImage::Star *results, int count, const Parameters &parameters, bool hfr, int offsetX, int offsetY) :
+        im(image), catalog(sepCatalog), candidates(indexes), stars(results), n(count), params(parameters), calculateHFR(hfr), x(offsetX), y(offsetY)
+    {
+        setAutoDelete(false);
+    }
+    void run() override
+    {
+        for(int k = 0; k < n; k++)
+            stars[k] = measureStar(im, catalog, candidates[k], params, calculateHFR, x, y);
+    }
+private:
+    sep_image *im;
+    sep_catalog *catalog;
+    const int *candidates;
+    FITSImage::Star *stars;
+    int n;
+    Parameters params;
+    bool calculateHFR;
+    int x;
+    int y;
+};
+
+//This is what the quad search workers of one solver share: the pool they run in, and where the solver's log goes,
+//so that the log of the workers goes to the same place as the log of the solver's thread
+struct QuadSearch
+{
+    QThreadPool pool;
+    int logLevel = ::LOG_NONE;      //This is the astrometry.net log level of the solver's thread
+    FILE *logFile = nullptr;
+    LogSink *logSink = nullptr;     //If this is set, the log of the workers goes to the solver's LogSink instead of the file
+};
+
+//This is the search that the logger of a pool thread was set up for
+static thread_local const QuadSearch *threadQuadSearch = nullptr;
+
+//This is one of the workers that solver_run searches for quads with, see solver_set_parallel_for in solver.h
+class QuadSearchTask : public QRunnable
+{
+public:
+    QuadSearchTask(QuadSearch *quadSearch, void (*searchTask)(void *, int), void *searchBaton, int worker) :
+        search(quadSearch), task(searchTask), baton(searchBaton), i(worker)
+    {
+        setAutoDelete(false);
+    }
+    void run() override
+    {
+        //The pool threads get a logger of their own that doesn't log anything, so the first time each one works for this search,
+        //it is set up like the one of the solver's thread.  The pool only lives as long as the search, so the sink outlives its threads.
+        if(threadQuadSearch != search)
+        {
+            threadQuadSearch = search;
+            log_set_level((log_level)search->logLevel);
+            log_to(search->logFile);
+            if(search->logSink)
+                search->logSink->addThread();
+        }
+        task(baton, i);
+    }
+private:
+    QuadSearch *search;
+    void (*task)(void *, int);
+    void *baton;
+    int i;
+};
+
+//solver_run calls this for each batch of AB pairs.  The first worker runs in the solver's thread, the others in the pool.
+static void runQuadSearch(int n, void (*task)(void *, int), void *baton, void *userdata)
+{
+    QuadSearch *search = static_cast<QuadSearch *>(userdata);
+    QList<QuadSearchTask *> tasks;
+    for(int i = 1; i < n; i++)
+    {
+        QuadSearchTask *searchTask = new QuadSearchTask(search, task, baton, i);
+        tasks.append(searchTask);
+        search->pool.start(searchTask);
+    }
+    task(baton, 0);
+    search->pool.waitForDone();
+    qDeleteAll(tasks);
+}
+
 InternalSextractorSolver::InternalSextractorSolver(ProcessType type, SextractorType sexType, SolverType solType, FITSImage::Statistic imagestats, uint8_t const *imageBuffer, QObject *parent) : SextractorSolver(type, sexType, solType, imagestats, imageBuffer, parent)
 {
     processType = type;
@@ -36,20 +250,14 @@ InternalSextractorSolver::InternalSextractorSolver(ProcessType type, SextractorT
 
 InternalSextractorSolver::~InternalSextractorSolver()
 {
-    if(usingDownsampledImage)
-        delete downSampledBuffer;
 }
 
-//This is the abort method.  The way that it works is that it creates a file.  Astrometry.net is monitoring for this file's creation in order to abort.
+//This is the abort method.  It sets the cancel token, which Astrometry.net checks in its search loops in order to abort.
+//When a child is stopped because a sibling already solved it, the solved token already stops it, so the shared cancel token is left alone.
 void InternalSextractorSolver::abort()
 {
-    QFile file(cancelfn);
-    if(QFileInfo(file).dir().exists())
-    {
-        file.open(QIODevice::WriteOnly);
-        file.write("Cancel");
-        file.close();
-    }
+    if(!isChildSolver || !isSolvedElsewhere())
+        cancelToken->store(1);
     if(!isChildSolver)
         emit logOutput("Aborting...");
     wasAborted = true;
@@ -66,6 +274,11 @@ SextractorSolver* InternalSextractorSolver::spawnChildSolver(int n)
     solver->isChildSolver = true;
     solver->params = params;
     solver->indexFolderPaths = indexFolderPaths;
+    solver->useIndexCache = useIndexCache;
+    solver->codeRecorder = codeRecorder;
+    solver->codeRecorderBaton = codeRecorderBaton;
+    solver->verifyRecorder = verifyRecorder;
+    solver->verifyRecorderBaton = verifyRecorderBaton;
     //Set the log level one less than the main solver
     if(logLevel == SSolver::LOG_MSG || logLevel == SSolver::LOG_NONE)
         solver->logLevel = SSolver::LOG_NONE;
@@ -77,11 +290,13 @@ SextractorSolver* InternalSextractorSolver::spawnChildSolver(int n)
         solver->setSearchScale(scalelo, scalehi, scaleunit);
     if(use_position)
         solver->setSearchPositionInDegrees(search_ra, search_dec);
+    if(use_hint)
+        solver->setSolutionHint(hintWCS, hintDrift);
     if(logLevel != SSolver::LOG_NONE)
-        connect(solver, &SextractorSolver::logOutput, this,  &SextractorSolver::logOutput);
-    //This way they all share a solved and cancel fn
-    solver->cancelfn = cancelfn;
-    solver->solvedfn = solvedfn;
+        connect(solver, &SextractorSolver::logOutput, this, &SextractorSolver::logOutput, Qt::DirectConnection);
+    //This way they all stop when one of them solves it or when the solve is aborted
+    solver->cancelToken = cancelToken;
+    solver->solvedToken = solvedToken;
     solver->usingDownsampledImage = usingDownsampledImage;
     return solver;
 }
@@ -102,11 +317,6 @@ void InternalSextractorSolver::run()
             QFile(logFileName).remove();
     }
 
-    if(cancelfn == "")
-        cancelfn = basePath + "/" + baseName + ".cancel";
-    if(solvedfn == "")
-        solvedfn = basePath + "/" + baseName + ".solved";
-
     switch(processType)
     {
         case SEXTRACT:
@@ -127,11 +337,6 @@ void InternalSextractorSolver::run()
 
         default: break;
     }
-    if(!isChildSolver)
-    {
-        QFile(solvedfn).remove();
-        QFile(cancelfn).remove();
-    }
 }
 
 
@@ -144,14 +349,20 @@ int InternalSextractorSolver::runSEPSextractor()
         emit logOutput("No convFilter included.");
         return -1;
     }
+    if(params.backgroundMeshSize < 1 || params.backgroundFilterSize < 1)
+    {
+        emit logOutput("The background mesh and filter sizes must be at least 1.");
+        return -1;
+    }
     emit logOutput("+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++");
     emit logOutput("Starting Internal StellarSolver Sextractor. . .");
 
     //Only downsample images before SEP if the Sextraction is being used for plate solving
-    if(processType == SOLVE && solverType == SOLVER_STELLARSOLVER && params.downsample != 1)
-        downsampleImage(params.downsample);
+    int d = 1;
+    if(processType == SOLVE && solverType == SOLVER_STELLARSOLVER && params.downsample > 1)
+        d = params.downsample;
 
-    int x = 0, y = 0, w = stats.width, h = stats.height, maxRadius = 50;
+    int x = 0, y = 0, w = stats.width / d, h = stats.height / d;
     if(useSubframe)
     {
          x = subframe.x();
@@ -160,62 +371,43 @@ int InternalSextractorSolver::runSEPSextractor()
          h = subframe.height();
     }
 
-    auto * data = new float[w * h];
-
-    switch (stats.dataType)
+    //The image is converted, cropped and downsampled straight into the buffer that SEP uses
+    float *data = BufferPool::instance()->acquire((size_t)w * h);
+    if(!ImageIngest::toFloat(stats, m_ImageBuffer, QRect(x, y, w, h), d, data))
     {
-        case SEP_TBYTE:
-            getFloatBuffer<uint8_t>(data, x, y, w, h);
-            break;
-        case TSHORT:
-            getFloatBuffer<int16_t>(data, x, y, w, h);
-            break;
-        case TUSHORT:
-            getFloatBuffer<uint16_t>(data, x, y, w, h);
-            break;
-        case TLONG:
-            getFloatBuffer<int32_t>(data, x, y, w, h);
-            break;
-        case TULONG:
-            getFloatBuffer<uint32_t>(data, x, y, w, h);
-            break;
-        case TFLOAT:
-            delete [] data;
-            memcpy(data, m_ImageBuffer, sizeof(float)*w*h);
-            break;
-        case TDOUBLE:
-            getFloatBuffer<double>(data, x, y, w, h);
-            break;
-        default:
-            delete [] data;
-            return -1;
+        BufferPool::instance()->release(data);
+        return -1;
     }
+    if(d > 1)
+        useDownsampledSize(d);
 
-    float *imback = nullptr;
     double *fluxerr = nullptr, *area = nullptr;
     short *flag = nullptr;
     int status = 0;
     sep_bkg *bkg = nullptr;
     sep_catalog * catalog = nullptr;
 
-    //These are for the HFR
-    double requested_frac[2] = { 0.5, 0.99 };
-    double flux_fractions[2] = {0};
-    short flux_flag = 0;
     std::vector<std::pair<int, double>> ovals;
+    QVector<int> candidates;
     int numToProcess = 0;
+    bool reusedBackground = false;
 
     // #0 Create SEP Image structure
     sep_image im = {data, nullptr, nullptr, SEP_TFLOAT, 0, 0, w, h, 0.0, SEP_NOISE_NONE, 1.0, 0.0};
 
     // #1 Background estimate
-    status = sep_background(&im, 64, 64, 3, 3, 0.0, &bkg);
-    if (status != 0) goto exit;
-
-    // #2 Background evaluation
-    imback = (float *)malloc((w * h) * sizeof(float));
-    status = sep_bkg_array(bkg, imback, SEP_TFLOAT);
-    if (status != 0) goto exit;
+    if(useBackgroundCache)
+    {
+        status = BackgroundCache::instance()->getBackground(&im, x, y, params.backgroundMeshSize, params.backgroundFilterSize, &bkg, &reusedBackground);
+        if (status != 0) goto exit;
+        if(reusedBackground)
+            emit logOutput("Using the background model from the last image");
+    }
+    else
+    {
+        status = sep_background(&im, params.backgroundMeshSize, params.backgroundMeshSize, params.backgroundFilterSize, params.backgroundFilterSize, 0.0, &bkg);
+        if (status != 0) goto exit;
+    }
 
     //Saving some background information
     background.bh = bkg->bh;
@@ -223,126 +415,64 @@ int InternalSextractorSolver::runSEPSextractor()
     background.global = bkg->global;
     background.globalrms = bkg->globalrms;
 
-    // #3 Background subtraction
+    // #2 Background subtraction
     status = sep_bkg_subarray(bkg, im.data, im.dtype);
     if (status != 0) goto exit;
 
-    // #4 Source Extraction
+    // #3 Source Extraction
     // Note that we set deblend_cont = 1.0 to turn off deblending.
-    status = sep_extract(&im, 2 * bkg->globalrms, SEP_THRESH_ABS, params.minarea, params.convFilter.data(), sqrt(params.convFilter.size()), sqrt(params.convFilter.size()), SEP_FILTER_CONV, params.deblend_thresh, params.deblend_contrast, params.clean, params.clean_param, &catalog);
+    status = extractSources(&im, 2 * bkg->globalrms, &catalog);
     if (status != 0) goto exit;
 
     // Record the number of stars detected.
     background.num_stars_detected = catalog->nobj;
     
-    // Find the oval sizes for each detection in the detected star catalog, and sort by that. Oval size
-    // correlates very well with HFR and likely magnitude.
+    // Find the oval sizes for each detection in the detected star catalog, and take them in order of that. Oval size
+    // correlates very well with HFR and likely magnitude.  The detections are put in a heap instead of being sorted,
+    // so only the ones up to initialKeep are ever put in order.
+    ovals.reserve(catalog->nobj);
     for (int i = 0; i < catalog->nobj; i++)
     {
         const double ovalSizeSq = catalog->a[i] * catalog->a[i] + catalog->b[i] * catalog->b[i];
         ovals.push_back(std::pair<int, double>(i, ovalSizeSq));
     }
-    std::sort(ovals.begin(), ovals.end(), [](const std::pair<int, double> &o1, const std::pair<int, double> &o2) -> bool { return o1.second > o2.second;});
-    
+    std::make_heap(ovals.begin(), ovals.end(), smallerOval);
+
     stars.clear();
     numToProcess = std::min(catalog->nobj, params.initialKeep);
+
+    // The detections to measure are chosen first, then they are all measured at once below.
+    // Every one that passes the filters is measured, the verification and the tweak of a solve use all of the stars, not just the first ones.
     for (int index = 0; index < numToProcess; index++)
     {
-        // Processing detections in the order of the sort above.
-        int i = ovals[index].first;
-
-        //Constant values
-        double r = 6;  //The instructions say to use a fixed value of 6: https://sep.readthedocs.io/en/v1.0.x/api/sep.kron_radius.html
-
-        //Variables that are obtained from the catalog
-        //FOR SOME REASON, I FOUND THAT THE POSITIONS WERE OFF BY 1 PIXEL??
-        //This might be because of this: https://sextractor.readthedocs.io/en/latest/Param.html
-        //" Following the FITS convention, in SExtractor the center of the first image pixel has coordinates (1.0,1.0). "
-        float xPos = catalog->x[i] + 1;
-        float yPos = catalog->y[i] + 1;
-        float a = catalog->a[i];
-        float b = catalog->b[i];
-        float theta = catalog->theta[i];
-        double flux = catalog->flux[i];
-        double peak = catalog->peak[i];
-        int numPixels = catalog->npix[i];
-
-        //Variables that will be obtained through methods
-        double kronrad;
-        short flag;
-        double sum;
-        double sumerr;
-        double area;
-
-        //This will need to be done for both auto and ellipse
-        if(params.apertureShape != SHAPE_CIRCLE)
-        {
-            //Finding the kron radius for the sextraction
-            sep_kron_radius(&im, xPos, yPos, a, b, theta, r, &kronrad, &flag);
-        }
-
-        bool use_circle;
-
-        switch(params.apertureShape)
-        {
-            case SHAPE_AUTO:
-                use_circle = kronrad * sqrt(a * b) < params.r_min;
-            break;
-
-            case SHAPE_CIRCLE:
-                use_circle = true;
-            break;
-
-            case SHAPE_ELLIPSE:
-                use_circle = false;
-            break;
-
-        }
-
-        if(use_circle)
-        {
-            sep_sum_circle(&im, xPos, yPos, params.r_min, params.subpix, params.inflags, &sum, &sumerr, &area, &flag);
-        }
-        else
-        {
-            sep_sum_ellipse(&im, xPos, yPos, a, b, theta, params.kron_fact*kronrad, params.subpix, params.inflags, &sum, &sumerr, &area, &flag);
-        }
-
-        float mag = params.magzero - 2.5 * log10(sum);
-
-        float HFR = 0;
-        if(processType == SEXTRACT_WITH_HFR)
-        {
-            //Get HFR
-            sep_flux_radius(&im, catalog->x[i], catalog->y[i], maxRadius, params.subpix, 0, &flux, requested_frac, 2, flux_fractions, &flux_flag);
-            HFR = flux_fractions[0];
-        }
-
-        FITSImage::Star star = {xPos + x, yPos + y, mag, (float)sum, (float)peak, HFR, a, b, qRadiansToDegrees(theta), 0, 0, numPixels};
-
-        stars.append(star);
+        // Processing detections in the order of their oval sizes, largest first.
+        std::pop_heap(ovals.begin(), ovals.end() - index, smallerOval);
+        int i = ovals[catalog->nobj - 1 - index].first;
+
+        //The filters that only need the catalog values are checked here, so the photometry is not done on stars that would be removed anyway
+        if(!passesCatalogFilters(catalog->a[i], catalog->b[i], catalog->peak[i]))
+            continue;
+        candidates.append(i);
     }
 
+    measureStars(&im, catalog, candidates, x, y);
+
     applyStarFilters();
 
     hasSextracted = true;
 
-    if (stats.dataType != TFLOAT)
-        delete [] data;
+    BufferPool::instance()->release(data);
     sep_bkg_free(bkg);
     sep_catalog_free(catalog);
-    free(imback);
     free(fluxerr);
     free(area);
     free(flag);
     return 0;
 
 exit:
-    if (stats.dataType != TFLOAT)
-        delete [] data;
+    BufferPool::instance()->release(data);
     sep_bkg_free(bkg);
     sep_catalog_free(catalog);
-    free(imback);
     free(fluxerr);
     free(area);
     free(flag);
@@ -358,6 +488,90 @@ exit:
     return -1;
 }
 
+//This runs the source extraction.  Large images are split into horizontal strips that are extracted at the same time in separate threads.
+//SEP keeps no global state during extraction, so this is safe, and the strips overlap so that stars on the boundaries are found whole.
+int InternalSextractorSolver::extractSources(sep_image *im, float thresh, sep_catalog **catalog)
+{
+    int numStrips = 1;
+    if(params.partition)
+        numStrips = qMin(QThread::idealThreadCount(), im->h / MIN_STRIP_HEIGHT);
+
+    if(numStrips <= 1)
+    {
+        int convSize = sqrt(params.convFilter.size());
+        return sep_extract(im, thresh, SEP_THRESH_ABS, params.minarea, params.convFilter.data(), convSize, convSize, SEP_FILTER_CONV, params.deblend_thresh, params.deblend_contrast, params.clean, params.clean_param, catalog);
+    }
+
+    emit logOutput(QString("Sextracting the image in %1 strips in parallel").arg(numStrips));
+
+    QThreadPool stripPool;
+    stripPool.setMaxThreadCount(numStrips);
+    QList<StripExtractTask *> tasks;
+    for(int i = 0; i < numStrips; i++)
+    {
+        StripExtractTask *task = new StripExtractTask(im, i * im->h / numStrips, (i + 1) * im->h / numStrips, thresh, params);
+        tasks.append(task);
+        stripPool.start(task);
+    }
+    stripPool.waitForDone();
+
+    int status = 0;
+    QVector<sep_catalog *> catalogs;
+    foreach(StripExtractTask *task, tasks)
+    {
+        if(task->status != 0)
+            status = task->status;
+        catalogs.append(task->catalog);
+    }
+    if(status == 0)
+        status = sep_catalog_merge(catalogs.data(), catalogs.size(), catalog);
+
+    foreach(StripExtractTask *task, tasks)
+    {
+        sep_catalog_free(task->catalog);
+        delete task;
+    }
+    return status;
+}
+
+//This does the photometry on the chosen detections and adds the stars to the list in the same order as the detections.
+//When there are enough of them, they are split into groups that are measured in separate threads.  There are more groups
+//than threads, because the stars with HFR take different amounts of time, so the threads that finish early take more groups.
+void InternalSextractorSolver::measureStars(sep_image *im, sep_catalog *catalog, const QVector<int> &candidates, int x, int y)
+{
+    QVector<FITSImage::Star> measured(candidates.size());
+    bool calculateHFR = processType == SEXTRACT_WITH_HFR;
+    int numThreads = QThread::idealThreadCount();
+
+    if(candidates.size() < MIN_PARALLEL_STARS || numThreads <= 1)
+    {
+        for(int k = 0; k < candidates.size(); k++)
+            measured[k] = measureStar(im, catalog, candidates.at(k), params, calculateHFR, x, y);
+    }
+    else
+    {
+        int groupSize = qMax(MIN_PARALLEL_STARS / 2, candidates.size() / (numThreads * PHOTOMETRY_GROUPS_PER_THREAD));
+        QThreadPool photometryPool;
+        photometryPool.setMaxThreadCount(numThreads);
+        QList<PhotometryTask *> tasks;
+        for(int start = 0; start < candidates.size(); start += groupSize)
+        {
+            int count = qMin(groupSize, candidates.size() - start);
+            PhotometryTask *task = new PhotometryTask(im, catalog, candidates.constData() + start, measured.data() + start, count, params, calculateHFR, x, y);
+            tasks.append(task);
+            photometryPool.start(task);
+        }
+        photometryPool.waitForDone();
+        qDeleteAll(tasks);
+    }
+
+    stars.reserve(measured.size());
+    foreach(const FITSImage::Star &star, measured)
+        stars.append(star);
+}
+
+//All of the filters are done in one pass over the star catalog, and then the stars that are kept are moved down in each of its arrays.
+//The filters remove the same stars they did when they were done one after the other.
 void InternalSextractorSolver::applyStarFilters()
 {
     if(stars.size() > 1)
@@ -367,231 +581,138 @@ void InternalSextractorSolver::applyStarFilters()
         {
             //Note that a star is dimmer when the mag is greater!
             //We want to sort in decreasing order though!
-            std::sort(stars.begin(), stars.end(), [](const FITSImage::Star &s1, const FITSImage::Star &s2)
-            {
-                return s1.mag < s2.mag;
-            });
+            stars.sortByMagnitude();
         }
 
+        const float *a = stars.a().constData();
+        const float *b = stars.b().constData();
+        const float *peak = stars.peak().constData();
+
         if(params.maxSize > 0.0)
-        {
             emit logOutput(QString("Removing stars wider than %1 pixels").arg(params.maxSize));
-            for(int i = 0; i<stars.size();i++)
-            {
-                FITSImage::Star star = stars.at(i);
-                if(star.a > params.maxSize || star.b > params.maxSize)
-                {
-                    stars.removeAt(i);
-                    i--;
-                }
-            }
-        }
-
         if(params.minSize > 0.0)
-        {
             emit logOutput(QString("Removing stars smaller than %1 pixels").arg(params.minSize));
-            for(int i = 0; i<stars.size();i++)
+        auto passesSizeFilters = [&](int i)
+        {
+            if(params.maxSize > 0.0 && (a[i] > params.maxSize || b[i] > params.maxSize))
+                return false;
+            if(params.minSize > 0.0 && (a[i] < params.minSize || b[i] < params.minSize))
+                return false;
+            return true;
+        };
+
+        //The brightest and dimmest percentages are of the stars that are left after the size filters,
+        //so those are counted first to find which of them are removed
+        int firstToKeep = 0;
+        int lastToKeep = INT_MAX;
+        if(removesPercentages())
+        {
+            int numLeft = 0;
+            for(int i = 0; i < stars.size(); i++)
             {
-                FITSImage::Star star = stars.at(i);
-                if(star.a < params.minSize || star.b < params.minSize)
-                {
-                    stars.removeAt(i);
-                    i--;
-                }
+                if(passesSizeFilters(i))
+                    numLeft++;
             }
-        }
-
-        if(params.resort && params.removeBrightest > 0.0 && params.removeBrightest < 100.0)
-        {
-            int numToRemove = stars.count() * (params.removeBrightest/100.0);
-            emit logOutput(QString("Removing the %1 brightest stars").arg(numToRemove));
-            if(numToRemove > 1)
+            if(params.removeBrightest > 0.0 && params.removeBrightest < 100.0)
             {
-                for(int i = 0; i<numToRemove;i++)
-                    stars.removeFirst();
+                int numToRemove = numLeft * (params.removeBrightest/100.0);
+                emit logOutput(QString("Removing the %1 brightest stars").arg(numToRemove));
+                if(numToRemove > 1)
+                    firstToKeep = numToRemove;
             }
-        }
-
-        if(params.resort && params.removeDimmest > 0.0 && params.removeDimmest < 100.0)
-        {
-            int numToRemove = stars.count() * (params.removeDimmest/100.0);
-            emit logOutput(QString("Removing the %1 dimmest stars").arg(numToRemove));
-            if(numToRemove > 1)
+            lastToKeep = numLeft;
+            if(params.removeDimmest > 0.0 && params.removeDimmest < 100.0)
             {
-                for(int i = 0; i<numToRemove;i++)
-                    stars.removeLast();
+                int numToRemove = (numLeft - firstToKeep) * (params.removeDimmest/100.0);
+                emit logOutput(QString("Removing the %1 dimmest stars").arg(numToRemove));
+                if(numToRemove > 1)
+                    lastToKeep = numLeft - numToRemove;
             }
         }
 
         if(params.maxEllipse > 1)
-        {
             emit logOutput(QString("Removing the stars with a/b ratios greater than %1").arg(params.maxEllipse));
-            for(int i = 0; i<stars.size();i++)
-            {
-                FITSImage::Star star = stars.at(i);
-                double ratio = star.a/star.b;
-                if(ratio>params.maxEllipse)
-                {
-                    stars.removeAt(i);
-                    i--;
-                }
-            }
-        }
 
+        double maxSizeofDataType = -1;
         if(params.saturationLimit > 0.0 && params.saturationLimit < 100.0)
         {
-            double maxSizeofDataType;
-            if(stats.dataType == TSHORT || stats.dataType == TLONG || stats.dataType == TLONGLONG)
-                maxSizeofDataType = pow(2, stats.bytesPerPixel * 8) / 2 - 1;
-            else if(stats.dataType == TUSHORT || stats.dataType == TULONG)
-                maxSizeofDataType = pow(2, stats.bytesPerPixel * 8) - 1;
-            else // Float and Double Images saturation level is not so easy to determine, especially since they were probably processed by another program and the saturation level is now changed.
-                maxSizeofDataType = -1;
-
+            maxSizeofDataType = saturationLevel(stats);
             if(maxSizeofDataType == -1)
-            {
                 emit logOutput("Skipping Saturation filter");
-            }
             else
-            {
                 emit logOutput(QString("Removing the saturated stars with peak values greater than %1 Percent of %2").arg(params.saturationLimit).arg(maxSizeofDataType));
-                for(int i = 0; i<stars.size();i++)
-                {
-                    FITSImage::Star star = stars.at(i);
-                    if(star.peak > (params.saturationLimit/100.0) * maxSizeofDataType)
-                    {
-                        stars.removeAt(i);
-                        i--;
-                    }
-                }
-            }
         }
 
+        int numPassedSize = 0;
+        stars.filter([&](int i)
+        {
+            if(!passesSizeFilters(i))
+                return false;
+            int rank = numPassedSize++;
+            if(rank < firstToKeep || rank >= lastToKeep)
+                return false;
+            if(params.maxEllipse > 1 && a[i] / b[i] > params.maxEllipse)
+                return false;
+            if(maxSizeofDataType != -1 && peak[i] > (params.saturationLimit/100.0) * maxSizeofDataType)
+                return false;
+            return true;
+        });
+
         if(params.resort && params.keepNum > 0.0)
         {
             emit logOutput(QString("Keeping just the %1 brightest stars").arg(params.keepNum));
             int numToRemove = stars.size() - params.keepNum;
             if(numToRemove > 1)
-            {
-                for(int i = 0; i<numToRemove;i++)
-                    stars.removeLast();
-            }
+                stars.truncate(stars.size() - numToRemove);
         }
         emit logOutput(QString("Stars Found after Filtering: %1").arg(stars.size()));
     }
 }
 
-template <typename T>
-void InternalSextractorSolver::getFloatBuffer(float * buffer, int x, int y, int w, int h)
+//This is the largest value the data type of the image can hold, which is used for the saturation filter.
+//Float and Double Images saturation level is not so easy to determine, especially since they were probably processed by another program and the saturation level is now changed.
+//So for those it returns -1.
+double InternalSextractorSolver::saturationLevel(const FITSImage::Statistic &imageStats)
 {
-    auto * rawBuffer = reinterpret_cast<T const *>(m_ImageBuffer);
-    float * floatPtr = buffer;
-
-    int x2 = x + w;
-    int y2 = y + h;
-
-    for (int y1 = y; y1 < y2; y1++)
-    {
-        int offset = y1 * stats.width;
-        for (int x1 = x; x1 < x2; x1++)
-        {
-            *floatPtr++ = rawBuffer[offset + x1];
-        }
-    }
+    if(imageStats.dataType == TSHORT || imageStats.dataType == TLONG || imageStats.dataType == TLONGLONG)
+        return pow(2, imageStats.bytesPerPixel * 8) / 2 - 1;
+    else if(imageStats.dataType == TUSHORT || imageStats.dataType == TULONG)
+        return pow(2, imageStats.bytesPerPixel * 8) - 1;
+    return -1;
 }
 
-void InternalSextractorSolver::downsampleImage(int d)
+//The percentages of brightest and dimmest stars are removed after the size filters but before the others,
+//so when they are used, the ellipse and saturation filters can't be checked ahead of time without changing how many stars get removed.
+bool InternalSextractorSolver::removesPercentages()
 {
-    switch (stats.dataType)
-    {
-        case SEP_TBYTE:
-            downSampleImageType<uint8_t>(d);
-            break;
-        case TSHORT:
-            downSampleImageType<int16_t>(d);
-            break;
-        case TUSHORT:
-            downSampleImageType<uint16_t>(d);
-            break;
-        case TLONG:
-            downSampleImageType<int32_t>(d);
-            break;
-        case TULONG:
-            downSampleImageType<uint32_t>(d);
-            break;
-        case TFLOAT:
-            downSampleImageType<float>(d);
-            break;
-        case TDOUBLE:
-            downSampleImageType<double>(d);
-            break;
-        default:
-            return;
-    }
-
+    return params.resort && ((params.removeBrightest > 0.0 && params.removeBrightest < 100.0) ||
+                             (params.removeDimmest > 0.0 && params.removeDimmest < 100.0));
 }
 
-template <typename T>
-void InternalSextractorSolver::downSampleImageType(int d)
+//This checks the star filters that only need the values in the SEP catalog, before any photometry is done on the star.
+//It removes the same stars that applyStarFilters would.
+bool InternalSextractorSolver::passesCatalogFilters(float a, float b, float peak)
 {
-    int w = stats.width;
-    int h = stats.height;
-
-    int numChannels;
-    if (stats.ndim < 3)
-        numChannels = 1;
-    else
-        numChannels = 3;
-    int oldBufferSize = stats.samples_per_channel * numChannels * stats.bytesPerPixel;
-    int newBufferSize = oldBufferSize / (d * d); //It is d times smaller in width and height
-    downSampledBuffer =new uint8_t[newBufferSize];
-    auto * sourceBuffer = reinterpret_cast<T const *>(m_ImageBuffer);
-    auto * destinationBuffer = reinterpret_cast<T *>(downSampledBuffer);
-
-    //The G pixels are after all the R pixels, Same for the B pixels
-    auto * rSource = sourceBuffer;
-    auto * gSource = sourceBuffer + (w * h);
-    auto * bSource = sourceBuffer + (w * h * 2);
-
-    for(int y = 0; y < h - d; y+=d)
+    if(params.maxSize > 0.0 && (a > params.maxSize || b > params.maxSize))
+        return false;
+    if(params.minSize > 0.0 && (a < params.minSize || b < params.minSize))
+        return false;
+    if(removesPercentages())
+        return true;
+    if(params.maxEllipse > 1 && a / b > params.maxEllipse)
+        return false;
+    if(params.saturationLimit > 0.0 && params.saturationLimit < 100.0)
     {
-        for (int x = 0; x < w - d; x+=d)
-        {
-            //The sum of all the pixels in the sample
-            double total = 0;
-
-            for(int y2 = 0; y2 < d; y2++)
-            {
-                //The offset for the current line of the sample to take, since we have to sample different rows
-                int currentLine = w * y2;
-
-                //Shifting the R, G, and B Pointers to the sample location
-                auto *rSample = rSource + currentLine + x;
-                auto *gSample = gSource + currentLine + x;
-                auto *bSample = bSource + currentLine + x;
-                for(int x2 = 0; x2 < d; x2++)
-                {
-                     //This iterates the sample x2 spots to the right,
-                    total += *rSample++;
-                    //This only samples frome the G and B spots if it is an RGB image
-                    if(numChannels == 3)
-                    {
-                        total += *gSample++;
-                        total += *bSample++;
-                    }
-                }
-            }
-            //This calculates the average pixel value and puts it in the new downsampled image.
-            int pixel = (x/d) + (y/d) * (w/d);
-            destinationBuffer[pixel] = total / (d * d) / numChannels;
-        }
-        //Shifts each pointer by a whole line, d times
-        rSource += w * d;
-        gSource += w * d;
-        bSource += w * d;
+        double maxSizeofDataType = saturationLevel(stats);
+        if(maxSizeofDataType != -1 && peak > (params.saturationLimit / 100.0) * maxSizeofDataType)
+            return false;
     }
+    return true;
+}
 
-    m_ImageBuffer = downSampledBuffer;
+//The image is downsampled when it is converted for SEP, this makes the rest of the solve use the size of the downsampled image
+void InternalSextractorSolver::useDownsampledSize(int d)
+{
     stats.width /= d;
     stats.height /= d;
     scalelo *= d;
@@ -628,8 +749,46 @@ bool InternalSextractorSolver::prepare_job() {
     sp->set_crpix = TRUE;
     sp->set_crpix_center = TRUE;
 
-    blind_set_cancel_file(bp, cancelfn.toLatin1().constData());
-    blind_set_solved_file(bp,solvedfn.toLatin1().constData());
+    //Astrometry.net reads the tokens as ints with atomic loads
+    static_assert(sizeof(std::atomic<int>) == sizeof(int) && ATOMIC_INT_LOCK_FREE == 2, "The tokens must be lock free ints");
+    blind_set_cancel_token(bp, reinterpret_cast<const int *>(cancelToken.get()));
+    blind_set_solved_token(bp, reinterpret_cast<const int *>(solvedToken.get()));
+    solver_set_code_recorder(sp, codeRecorder, codeRecorderBaton);
+    solver_set_verify_recorder(sp, verifyRecorder, verifyRecorderBaton);
+
+    //The solution hint gets verified by blind_run before it starts searching.  The hint is for the full size image, so it has to be scaled if we downsampled.
+    if(use_hint)
+    {
+        sip_t verifyWCS = hintWCS;
+        if(usingDownsampledImage && params.downsample > 1)
+        {
+            //Only the TAN part is kept, that is close enough to verify, and the tweak fits the distortion again.
+            int d = params.downsample;
+            sip_wrap_tan(&hintWCS.wcstan, &verifyWCS);
+            verifyWCS.wcstan.crpix[0] /= d;
+            verifyWCS.wcstan.crpix[1] /= d;
+            verifyWCS.wcstan.cd[0][0] *= d;
+            verifyWCS.wcstan.cd[0][1] *= d;
+            verifyWCS.wcstan.cd[1][0] *= d;
+            verifyWCS.wcstan.cd[1][1] *= d;
+        }
+        verifyWCS.wcstan.imagew = stats.width;
+        verifyWCS.wcstan.imageh = stats.height;
+        blind_add_verify_wcs(bp, &verifyWCS);
+
+        double hintRA, hintDec;
+        sip_get_radec_center(&verifyWCS, &hintRA, &hintDec);
+        emit logOutput(QString("Verifying the solution hint at (RA,Dec) = (%1, %2) deg before searching.").arg(hintRA).arg(hintDec));
+
+        //If it doesn't verify, only search around the hint
+        if(!use_position && hintDrift > 0)
+        {
+            job->use_radec_center = TRUE;
+            job->ra_center = hintRA;
+            job->dec_center = hintDec;
+            job->search_radius = hintDrift;
+        }
+    }
 
     //Logratios for Solving
     bp->logratio_tosolve = params.logratio_tosolve;
@@ -686,6 +845,18 @@ bool InternalSextractorSolver::prepare_job() {
         dl_append(job->scales, appu);
         blind_add_field_range(bp, appl, appu);
     }
+    else if(use_hint)
+    {
+        double hintScale = sip_pixel_scale(&hintWCS);
+        if(usingDownsampledImage)
+            hintScale *= params.downsample;
+        double appl = hintScale * (1 - HINT_SCALE_TOLERANCE);
+        double appu = hintScale * (1 + HINT_SCALE_TOLERANCE);
+        emit logOutput(QString("Using the scale of the solution hint, arcsec per pixel range %1 %2\n").arg (appl).arg (appu));
+        dl_append(job->scales, appl);
+        dl_append(job->scales, appu);
+        blind_add_field_range(bp, appl, appu);
+    }
 
     blind_add_field(bp, 1);
 
@@ -707,6 +878,8 @@ int InternalSextractorSolver::runInternalSolver()
     engine->minwidth = params.minwidth;
     engine->maxwidth = params.maxwidth;
 
+    //Each solver thread has its own logger, so the child solvers of a parallel solve don't change the logging of the others
+    log_set_thread_specific();
     if(isChildSolver)
     {
         if(logLevel == SSolver::LOG_VERB || logLevel == SSolver::LOG_ALL)
@@ -715,43 +888,43 @@ int InternalSextractorSolver::runInternalSolver()
     else
         log_init((log_level)logLevel);
 
+    //The log goes to the file, or through the LogSink to logOutput, until the job is done
+    QScopedPointer<LogSink> logSink;
     if(logLevel != SSolver::LOG_NONE)
     {
         if(logToFile)
         {
             logFile = fopen(logFileName.toLatin1().constData(),"w");
+            if(logFile)
+                log_to(logFile);
         }
         else
-        {
-        #ifndef _WIN32 //Windows does not support FIFO files
-            logFileName = basePath + "/" + baseName + ".logFIFO.txt";
-            int mkFifoSuccess = 0; //Note if the return value of the command is 0 it succeeded, -1 means it failed.
-            if ((mkFifoSuccess = mkfifo(logFileName.toLatin1(), S_IRUSR | S_IWUSR) == 0))
-            {
-                startLogMonitor();
-                logFile = fopen(logFileName.toLatin1().constData(), "r+");
-            }
-            else
-            {
-                emit logOutput("Error making FIFO file");
-                logLevel = SSolver::LOG_NONE; //No need to completely fail the sovle just because of a fifo error
-            }
-        #endif
-        }
-        if(logFile)
-            log_to(logFile);
+            logSink.reset(new LogSink(this));
     }
 
     //gslutils_use_error_system();
 
-    //These set the folders in which Astrometry.net will look for index files, based on the folers set before the solver was started.
-    foreach(QString path, indexFolderPaths)
+    //If we are using the cache, the indexes are already loaded and shared with the other solvers, otherwise the engine loads its own.
+    //Child solvers always share the indexes that the parent StellarSolver loaded for the parallel solve, and batch solves share the ones the BatchSolver loaded.
+    //Without inParallel or the cache, those are only the metadata, and the engine loads each index by name while it solves with it.
+    QList<index_t *> cachedIndexes;
+    if(useIndexCache || useSharedIndexes || isChildSolver)
     {
-        engine_add_search_path(engine,path.toLatin1().constData());
+        cachedIndexes = SolverEngineCache::instance()->acquire(indexFolderPaths, useIndexCache, !params.inParallel && !useIndexCache);
+        foreach(index_t *index, cachedIndexes)
+            engine_add_loaded_index(engine, index);
     }
+    else
+    {
+        //These set the folders in which Astrometry.net will look for index files, based on the folers set before the solver was started.
+        foreach(QString path, indexFolderPaths)
+        {
+            engine_add_search_path(engine,path.toLatin1().constData());
+        }
 
-    //This actually adds the index files in the directories above.
-    engine_autoindex_search_paths(engine);
+        //This actually adds the index files in the directories above.
+        engine_autoindex_search_paths(engine);
+    }
 
     //This checks to see that index files were found in the paths above, if not, it prints this warning and aborts.
     if (!pl_size(engine->indexes)) {
@@ -761,25 +934,40 @@ int InternalSextractorSolver::runInternalSolver()
                "See http://astrometry.net/use.html about how to get some index files.\n"
                "---------------------------------------------------------------------\n"
                "\n"));
+        engine_free(engine);
+        SolverEngineCache::instance()->release(cachedIndexes);
         return -1;
     }
 
     prepare_job();
-    engine->cancelfn = cancelfn.toLatin1().data();
-    engine->solvedfn = solvedfn.toLatin1().data();
 
     blind_t* bp = &(job->bp);
 
+    //The quads of each star are searched for in searchThreads threads, by default all of the cores, so one solver can use all of them.
+    //The child solvers of a parallel solve and the frames of a batch solve already run one per thread, so they search in their own thread only.
+    QuadSearch quadSearch;
+    int numSearchThreads = 1;
+    if(!isChildSolver && !useSharedIndexes)
+        numSearchThreads = params.searchThreads > 0 ? params.searchThreads : QThread::idealThreadCount();
+    if(numSearchThreads > 1)
+    {
+        quadSearch.pool.setMaxThreadCount(numSearchThreads - 1);
+        quadSearch.logLevel = log_get_level();
+        quadSearch.logFile = log_get_fid();
+        quadSearch.logSink = logSink.data();
+        solver_set_parallel_for(&bp->solver, &runQuadSearch, &quadSearch, numSearchThreads);
+    }
+
     //This will set up the field file to solve as an xylist
     double *xArray = new double[stars.size()];
     double *yArray = new double[stars.size()];
 
-    int i = 0;
-    foreach(FITSImage::Star star, stars)
+    const float *starX = stars.x().constData();
+    const float *starY = stars.y().constData();
+    for(int i = 0; i < stars.size(); i++)
     {
-        xArray[i] = star.x;
-        yArray[i] = star.y;
-        i++;
+        xArray[i] = starX[i];
+        yArray[i] = starY[i];
     }
 
     starxy_t* fieldToSolve = (starxy_t*)calloc(1, sizeof(starxy_t));
@@ -816,6 +1004,8 @@ int InternalSextractorSolver::runInternalSolver()
     //This makes sure the min and max widths for the engine make sense, aborting if not.
     if (engine->minwidth <= 0.0 || engine->maxwidth <= 0.0 || engine->minwidth > engine->maxwidth) {
         emit logOutput(QString("\"minwidth\" and \"maxwidth\" must be positive and the maxwidth must be greater!\n"));
+        engine_free(engine);
+        SolverEngineCache::instance()->release(cachedIndexes);
         return -1;
     }
     ///This sets the scales based on the minwidth and maxwidth if the image scale isn't known
@@ -828,9 +1018,10 @@ int InternalSextractorSolver::runInternalSolver()
     }
 
     // These set the time limits for the solver
+    //The CPU time is for the whole process, so it counts the time of all of the search threads
     bp->timelimit = params.solverTimeLimit;
 #ifndef _WIN32
-    bp->cpulimit = params.solverTimeLimit;
+    bp->cpulimit = params.solverTimeLimit * numSearchThreads;
 #endif
 
     // If not running inparallel, set total limits = limits.
@@ -845,31 +1036,19 @@ int InternalSextractorSolver::runInternalSolver()
     if (engine_run_job(engine, job))
         emit logOutput("Failed to run job");
 
-    //Needs to be done whether FIFO or regular file
-    if(logLevel != SSolver::LOG_NONE && logFile)
+    //This sends the rest of the log before the messages about the solution
+    logSink.reset();
+    if(logFile)
+    {
+        log_to(nullptr);
         fclose(logFile);
-
-    //These things need to be done if it is running off the FIFO file
-    #ifndef _WIN32
-        if(!logToFile && logLevel != SSolver::LOG_NONE)
-        {
-            if(logMonitor)
-                logMonitor->quit();
-
-            //Wait up to 10 seconds for the log to finish writing
-            int maxLogTime = 10000;
-            int time = 0;
-            int inc = 10;
-            while(logMonitorRunning && time < maxLogTime)
-            {
-                msleep(inc);
-                time+=inc;
-            }
-        }
-    #endif
+        logFile = nullptr;
+    }
 
     //This deletes or frees the items that are no longer needed.
+    //Note that engine_free does not free the cached indexes, they are just released so they can be reused for the next solve
     engine_free(engine);
+    SolverEngineCache::instance()->release(cachedIndexes);
     bl_free(job->scales);
     dl_free(job->depths);
     free(fieldToSolve);
@@ -880,6 +1059,10 @@ int InternalSextractorSolver::runInternalSolver()
     //I made it return in solve_fields in blind.c before it ran "cleanup".  I also had it wait to clean up solutions, blind and solver in engine.c.  We will do that after we get the solution information.
 
     match = bp->solver.best_match;
+    //When the hint is verified with more than one index, the best match is reset by the indexes after the one that verified it.
+    //The verified match is still the best one in the list of solutions though.
+    if(!match.sip && use_hint && bp->single_field_solved && bl_size(bp->solutions) > 0)
+        match = *(MatchObj*)bl_access(bp->solutions, 0);
     int returnCode = 0;
     if(match.sip)
     {
@@ -929,6 +1112,9 @@ int InternalSextractorSolver::runInternalSolver()
 
         solution = {fieldw, fieldh, ra, dec, orient, pixscale, parity, raErr, decErr};
         hasSolved = true;
+        //This tells the other child solvers that it is solved so they stop right away
+        if(isChildSolver)
+            solvedToken->store(1);
         returnCode = 0;
     }
     else
@@ -938,6 +1124,10 @@ int InternalSextractorSolver::runInternalSolver()
         returnCode = -1;
     }
 
+    //The quad search gets its scratch memory from a few large blocks, this shows how many heap allocations that took
+    if(logLevel == SSolver::LOG_VERB || logLevel == SSolver::LOG_ALL)
+        emit logOutput(QString("Quad search: %1 quads tried with %2 scratch memory allocations").arg(bp->solver.numtries).arg(bp->solver.num_scratch_allocs));
+
     //This code was taken from engine.c and blind.c so that we can clean up all of the allocated memory after we get the solution information out of it so that we can prevent memory leaks.
 
     for (size_t i=0; i<bl_size(bp->solutions); i++) {
@@ -954,35 +1144,13 @@ int InternalSextractorSolver::runInternalSolver()
 }
 
 
-FITSImage::wcs_point * InternalSextractorSolver::getWCSCoord()
+//The WCS is for the downsampled image, so the accessor has to upscale back to the full size image
+WCSData InternalSextractorSolver::getWCSData()
 {
     if(!hasWCS)
-    {
-        emit logOutput("There is no WCS Data.");
-        return nullptr;
-    }
-    //We have to upscale back to the full size image
+        return WCSData();
     int d = params.downsample;
-    int w = stats.width * d;
-    int h = stats.height * d;
-
-
-    FITSImage::wcs_point *wcs_coord = new FITSImage::wcs_point[w * h];
-    FITSImage::wcs_point * p = wcs_coord;
-
-    for (int y = 0; y < h; y++)
-    {
-        for (int x = 0; x < w; x++)
-        {
-            double ra;
-            double dec;
-            sip_pixelxy2radec(&wcs, x/d, y/d, &ra, &dec);
-            p->ra = ra;
-            p->dec = dec;
-            p++;
-        }
-    }
-    return wcs_coord;
+    return WCSData(wcs, d, stats.width * d, stats.height * d);
 }
 
 QList<FITSImage::Star> InternalSextractorSolver::appendStarsRAandDEC(QList<FITSImage::Star> stars)
@@ -993,54 +1161,21 @@ QList<FITSImage::Star> InternalSextractorSolver::appendStarsRAandDEC(QList<FITSI
         return stars;
     }
 
+    //The stars are all converted in one batch, the WCSData takes care of the downsampling
+    QVector<QPointF> pixelPoints;
+    pixelPoints.reserve(stars.size());
+    foreach(const FITSImage::Star &star, stars)
+        pixelPoints.append(QPointF(star.x, star.y));
+    QVector<FITSImage::wcs_point> skyPoints(stars.size());
+    getWCSData().pixelsToWCS(pixelPoints.constData(), pixelPoints.size(), skyPoints.data());
+
     QList<FITSImage::Star> refinedStars;
-    int d = params.downsample;
-    foreach(FITSImage::Star star, stars)
+    for(int i = 0; i < stars.size(); i++)
     {
-        double ra = HUGE_VAL;
-        double dec = HUGE_VAL;
-        sip_pixelxy2radec(&wcs, star.x / d, star.y / d, &ra, &dec);
-        char rastr[32], decstr[32];
-        ra2hmsstring(ra, rastr);
-        dec2dmsstring(dec, decstr);
-
-        //We do need to correct for all the downsampling as well as add RA/DEC info
-        FITSImage::Star refinedStar = {star.x, star.y, star.mag, star.flux, star.peak, star.HFR, star.a, star.b, star.theta, (float)ra, (float)dec};
+        FITSImage::Star refinedStar = stars.at(i);
+        refinedStar.ra = skyPoints.at(i).ra;
+        refinedStar.dec = skyPoints.at(i).dec;
         refinedStars.append(refinedStar);
     }
     return refinedStars;
 }
-
-//This starts a monitor for the FIFO file if on a Mac or Linux Machine
-//That way the output can be logged.
-void InternalSextractorSolver::startLogMonitor()
-{
-    logMonitor = new QThread();
-    connect(logMonitor, &QThread::started, [=]()
-    {
-        QString message;
-        FILE *FIFOReader = fopen(logFileName.toLatin1().constData(), "r");
-        if(FIFOReader)
-        {
-            char c;
-            while((c=getc(FIFOReader)) != EOF)
-            {
-                if( c != '\n')
-                    message += c;
-                else
-                {
-                    emit logOutput(message);
-                    message = "";
-                    //If we don't do this, it could freeze your program it is so much output
-                    if(logLevel == SSolver::LOG_ALL)
-                        msleep(1);
-                }
-            }
-            fclose(FIFOReader);
-            emit logOutput(message);
-            logMonitorRunning = false;
-        }
-    });
-    logMonitor->start();
-    logMonitorRunning = true;
-}
@@ -24,21 +24,24 @@ public:
     int sextract() override;
     //void solve() override;
     void abort() override;
-    FITSImage::wcs_point *getWCSCoord() override;
+    WCSData getWCSData() override;
     QList<FITSImage::Star> appendStarsRAandDEC(QList<FITSImage::Star> stars) override;
     SextractorSolver* spawnChildSolver(int n) override;
 
+    static double saturationLevel(const FITSImage::Statistic &imageStats);   //This is the largest value for the image data type, or -1 if it isn't known
+
 protected:
     int runSEPSextractor();    //This is the method that actually runs the internal sextractor
+    int extractSources(sep_image *im, float thresh, sep_catalog **catalog); //This runs sep_extract, on large images in parallel strips
+    void measureStars(sep_image *im, sep_catalog *catalog, const QVector<int> &candidates, int x, int y); //This does the photometry on the detections, in parallel when there are many
     void applyStarFilters();    //This applies the star filter to the stars list.
+    bool passesCatalogFilters(float a, float b, float peak); //This checks the star filters that can be done before the photometry
+    bool removesPercentages();  //This is true if the brightest or dimmest percentage of the stars will be removed
     bool usingDownsampledImage = false; //This boolean gets set internally if we are using a downsampled image buffer for SEP
 
 
 private:
 
-    // The generic data buffer containing the image data
-    uint8_t *downSampledBuffer { nullptr };
-
     //Job File related stuff
     bool prepare_job();         //This prepares the job object for the solver
     job_t thejob;               //This is the job file that will be created for astrometry.net to solve
@@ -48,22 +51,13 @@ private:
     void run() override;        //This starts the StellarSolver in a separate thread.  Note, ExternalSextractorSolver uses QProcess
     int runInternalSolver();    //This is the method that actually runs the internal solver
 
-    //This is used by the sextractor, it gets a new representation of the buffer that SEP can understand
-    template <typename T>
-    void getFloatBuffer(float * buffer, int x, int y, int w, int h);
-
     MatchObj match;             //This is where the match object gets stored once the solving is done.
     sip_t wcs;                  //This is where the WCS data gets saved once the solving is done
 
-    //This can downsample the image by the requested amount.
-    void downsampleImage(int d);
-    template <typename T>
-    void downSampleImageType(int d);
+    //This changes the size and scale to the ones of the image downsampled by the requested amount.
+    void useDownsampledSize(int d);
 
-    void startLogMonitor();
-    QThread* logMonitor = nullptr;
-    bool logMonitorRunning = false;
-    FILE *logFile = nullptr;
+    FILE *logFile = nullptr;    //This is only used when the log is saved to a file
 };
 
 #endif // INTERNALSEXTRACTORSOLVER_H
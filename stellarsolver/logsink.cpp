@@ -0,0 +1,196 @@
+/*  LogSink, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "logsink.h"
+#include "sextractorsolver.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <stdio.h>
+#include <string.h>
+
+extern "C"{
+    #include "astrometry/log.h"
+}
+
+//The lines are sent when this many of them are waiting
+#define LOG_SINK_BATCH_LINES 50
+//or when a line comes in at least this many ms after the last batch was sent, so a quiet solve still reports right away
+#define LOG_SINK_BATCH_INTERVAL 100
+//This is how much text can wait to be sent, a message that doesn't fit in what is left makes the lines before it get sent
+#define LOG_SINK_BUFFER_SIZE 65536
+
+//On Windows, astrometry.net only has one logger for all of the threads, so the sink for each thread is found here instead of in the logger
+static thread_local LogSink *threadSink = nullptr;
+
+//This is where the logger was sending the log before the first sink took it over, it gets put back when the last one is deleted
+struct LoggerState
+{
+    FILE *file = nullptr;
+    logfunc_t function = nullptr;
+    void *baton = nullptr;
+};
+
+#ifdef _MSC_VER
+//The one logger is taken over by the first sink on any thread and put back by the last one, so deleting one doesn't stop the others
+static QMutex sharedLoggerLock;
+static int numSharedSinks = 0;
+static LoggerState sharedPreviousLogger;
+#else
+static thread_local LoggerState previousLogger;
+#endif
+
+static void sinkLogFunction(void *baton, enum log_level level, const char *file, int line, const char *func, const char *format, va_list va)
+{
+    Q_UNUSED(baton);
+    Q_UNUSED(level);
+    Q_UNUSED(file);
+    Q_UNUSED(line);
+    Q_UNUSED(func);
+    if(threadSink)
+        threadSink->append(format, va);
+}
+
+static void attachLogger()
+{
+#ifdef _MSC_VER
+    //It is set up again even if another sink already did it, in case a solver on another thread has initialized the logger since then
+    QMutexLocker locker(&sharedLoggerLock);
+    LoggerState &previous = sharedPreviousLogger;
+    if(numSharedSinks++ == 0)
+#else
+    LoggerState &previous = previousLogger;
+#endif
+    {
+        previous.file = log_get_fid();
+        log_get_function(&previous.function, &previous.baton);
+    }
+    log_to(nullptr);
+    log_use_function(sinkLogFunction, nullptr);
+}
+
+static void detachLogger()
+{
+#ifdef _MSC_VER
+    QMutexLocker locker(&sharedLoggerLock);
+    if(--numSharedSinks > 0)
+        return;
+    const LoggerState &previous = sharedPreviousLogger;
+#else
+    const LoggerState &previous = previousLogger;
+#endif
+    log_to(previous.file);
+    log_use_function(previous.function, previous.baton);
+}
+
+LogSink::LogSink(SextractorSolver *logSolver) : solver(logSolver)
+{
+    buffer.resize(LOG_SINK_BUFFER_SIZE);
+    sinceLastBatch.start();
+    previousSink = threadSink;
+    threadSink = this;
+    //A nested sink uses the logger that the first one on this thread set up
+    if(previousSink == nullptr)
+        attachLogger();
+}
+
+LogSink::~LogSink()
+{
+    flush();
+    threadSink = previousSink;
+    if(previousSink == nullptr)
+        detachLogger();
+}
+
+void LogSink::addThread()
+{
+    if(threadSink == this)
+        return;
+    threadSink = this;
+    //On Windows the one logger already sends the log here, the other platforms have a logger for each thread
+#ifndef _MSC_VER
+    log_to(nullptr);
+    log_use_function(sinkLogFunction, nullptr);
+#endif
+}
+
+void LogSink::append(const char *format, va_list va)
+{
+    QStringList batches;
+    {
+        QMutexLocker locker(&bufferLock);
+        va_list copy;
+        va_copy(copy, va);
+        int length = vsnprintf(buffer.data() + used, buffer.size() - used, format, copy);
+        va_end(copy);
+        if(length < 0)
+            return;
+
+        //If it didn't fit, what is waiting is taken out to make room, a message that is longer than the buffer is cut off
+        if(used + length >= buffer.size())
+        {
+            if(used > 0)
+                takeLines(used, batches);
+            va_copy(copy, va);
+            length = vsnprintf(buffer.data() + used, buffer.size() - used, format, copy);
+            va_end(copy);
+            if(length < 0)
+                return;
+            length = qMin(length, buffer.size() - used - 1);
+        }
+
+        const char *text = buffer.constData();
+        for(int i = used; i < used + length; i++)
+        {
+            if(text[i] == '\n')
+            {
+                linesEnd = i + 1;
+                numLines++;
+            }
+        }
+        used += length;
+
+        if(numLines >= LOG_SINK_BATCH_LINES || (numLines > 0 && sinceLastBatch.elapsed() >= LOG_SINK_BATCH_INTERVAL))
+            takeLines(linesEnd, batches);
+    }
+    send(batches);
+}
+
+void LogSink::flush()
+{
+    QStringList batches;
+    {
+        QMutexLocker locker(&bufferLock);
+        if(used > 0)
+            takeLines(used, batches);
+    }
+    send(batches);
+}
+
+//This takes the text up to end as one message, without its last newline, and moves what is after it to the start of the buffer.
+void LogSink::takeLines(int end, QStringList &batches)
+{
+    int length = end;
+    if(length > 0 && buffer.at(length - 1) == '\n')
+        length--;
+    batches.append(QString::fromUtf8(buffer.constData(), length));
+
+    memmove(buffer.data(), buffer.constData() + end, used - end);
+    used -= end;
+    linesEnd = 0;
+    numLines = 0;
+    sinceLastBatch.restart();
+}
+
+//The text is copied out and the buffer is unlocked and ready for more before the signal is sent, so a slot that logs again on this thread is fine.
+//astrometry.net calls the log function after it releases its log lock, so a slot that blocks doesn't hold up the other threads.
+void LogSink::send(const QStringList &batches)
+{
+    foreach(const QString &text, batches)
+        emit solver->logOutput(text);
+}
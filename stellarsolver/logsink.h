@@ -0,0 +1,51 @@
+/*  LogSink, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+//QT Includes
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QStringList>
+
+#include <stdarg.h>
+
+class SextractorSolver;
+
+//This sends the log of astrometry.net on the thread that creates it to the logOutput signal of the solver, until it is deleted.
+//The lines are collected and sent a batch at a time, so a verbose solve doesn't send a signal for every line.
+//The log is written and sent on the threads that log, so it doesn't need a file or a thread to read it.
+class LogSink
+{
+public:
+    explicit LogSink(SextractorSolver *solver);
+    ~LogSink();                 //This sends what is left and puts the log back where it was going before
+
+    //This sends the log of the thread that calls it here too, for threads that work for the solver like the quad search workers.
+    //It is set up once for each thread, and the thread must be done logging before the sink is deleted.
+    void addThread();
+
+    void append(const char *format, va_list va);    //This is called for each message, through the log function of astrometry.net
+    void flush();               //This sends all of the text right away, even a line that isn't finished
+
+private:
+    void takeLines(int end, QStringList &batches);
+    void send(const QStringList &batches);
+
+    SextractorSolver *solver;
+    QMutex bufferLock;          //The threads added with addThread write to the same buffer
+    LogSink *previousSink;      //Sinks on one thread can be nested, the log goes back to this one when this one is deleted
+    QByteArray buffer;
+    int used = 0;               //The number of bytes of the buffer that have text
+    int linesEnd = 0;           //The text up to here is complete lines that haven't been sent yet
+    int numLines = 0;
+    QElapsedTimer sinceLastBatch;
+};
+
+#endif // LOGSINK_H
@@ -8,6 +8,7 @@
 #include "onlinesolver.h"
 #include <QTimer>
 #include <QEventLoop>
+#include <QMutexLocker>
 
 OnlineSolver::OnlineSolver(ProcessType type, SextractorType sexType, SolverType solType, FITSImage::Statistic imagestats, uint8_t const *imageBuffer, QObject *parent) : ExternalSextractorSolver(type, sexType, solType, imagestats, imageBuffer, parent)
 {
@@ -79,13 +80,13 @@ void OnlineSolver::run()
 
     while(!hasSolved && !aborted && !timedOut && workflowStage != JOB_PROCESSING_STAGE)
     {
-        msleep(200);
+        waitForStageChange(workflowStage, 200);
         timedOut = solverTimer.elapsed() / 1000.0 > params.solverTimeLimit;
     }
 
     while(!hasSolved && !aborted && !timedOut && (workflowStage == JOB_PROCESSING_STAGE || workflowStage == JOB_QUEUE_STAGE))
     {
-        msleep(JOB_RETRY_DURATION);
+        waitForStageChange(workflowStage, JOB_RETRY_DURATION);
         if (job_retries++ > JOB_RETRY_ATTEMPTS)
         {
             emit logOutput(("Failed to retrieve job ID, it appears to be lost in the queue."));
@@ -107,7 +108,7 @@ void OnlineSolver::run()
 
     while(!hasSolved && !aborted && !timedOut && workflowStage == JOB_MONITORING_STAGE)
     {
-        msleep(STATUS_CHECK_INTERVAL);
+        waitForStageChange(workflowStage, STATUS_CHECK_INTERVAL);
         emit timeToCheckJobs();
         timedOut = solverTimer.elapsed() / 1000.0 > params.solverTimeLimit;
     }
@@ -139,7 +140,7 @@ void OnlineSolver::run()
     //If it does get the file, whether or not it can read it, the stage changes to NO_STAGE and this quits
     while(!aborted && !starsAndWCSTimedOut && (workflowStage == LOG_LOADING_STAGE || workflowStage == WCS_LOADING_STAGE))
     {
-        msleep(STATUS_CHECK_INTERVAL);
+        waitForStageChange(workflowStage, STATUS_CHECK_INTERVAL);
         starsAndWCSTimedOut = solverTimer.elapsed() / 1000.0 > starsAndWCSTimeLimit; //Wait 10 seconds for STARS and WCS, NO LONGER!
     }
 
@@ -156,10 +157,27 @@ void OnlineSolver::run()
 void OnlineSolver::abort()
 {
     disconnect(networkManager, &QNetworkAccessManager::finished, this, &OnlineSolver::onResult);
-    workflowStage  = NO_STAGE;
+    aborted = true;
+    setWorkflowStage(NO_STAGE);
     emit logOutput("Online Solver aborted.");
     emit finished(-1);
-    aborted = true;
+}
+
+//This changes the stage and wakes up the monitoring thread so it can react to the new stage right away
+void OnlineSolver::setWorkflowStage(WorkflowStage stage)
+{
+    stageLock.lock();
+    workflowStage = stage;
+    stageLock.unlock();
+    stageChanged.wakeAll();
+}
+
+//The monitoring thread waits in here between its checks.  It wakes up early if the stage changes or the solver is aborted.
+void OnlineSolver::waitForStageChange(WorkflowStage stage, unsigned long msecs)
+{
+    QMutexLocker locker(&stageLock);
+    if(workflowStage == stage && !hasSolved && !aborted)
+        stageChanged.wait(&stageLock, msecs);
 }
 
 //This will start up the first stage, Authentication
@@ -184,7 +202,7 @@ void OnlineSolver::authenticate()
     QString json_request = QString("request-json=%1").arg(QString(json_doc.toJson(QJsonDocument::Compact)));
     networkManager->post(request, json_request.toUtf8());
 
-    workflowStage = AUTH_STAGE;
+    setWorkflowStage(AUTH_STAGE);
     emit logOutput("Authenticating. . .");
 
 }
@@ -274,28 +292,28 @@ void OnlineSolver::uploadFile()
     QNetworkReply *reply = networkManager->post(request, reqEntity);
     reqEntity->setParent(reply); //So that it can be deleted later
 
-    workflowStage = UPLOAD_STAGE;
+    setWorkflowStage(UPLOAD_STAGE);
     emit logOutput(("Uploading file..."));
 }
 
 //This will start up the third stage, waiting till processing is done
 void OnlineSolver::waitForProcessing()
 {
-    workflowStage = JOB_PROCESSING_STAGE;
+    setWorkflowStage(JOB_PROCESSING_STAGE);
     emit logOutput(("Waiting for Processing to complete..."));
 }
 
 //This will start up the fourth stage, getting the Job ID, essentially waiting in the Job Queue
 void OnlineSolver::getJobID()
 { 
-    workflowStage = JOB_QUEUE_STAGE;
+    setWorkflowStage(JOB_QUEUE_STAGE);
     emit logOutput(("Waiting for the Job to Start..."));
 }
 
 //This will start the fifth stage, monitoring the job to see when it's done
 void OnlineSolver::startMonitoring()
 {
-    workflowStage = JOB_MONITORING_STAGE;
+    setWorkflowStage(JOB_MONITORING_STAGE);
     emit logOutput(("Starting Job Monitoring..."));
 }
 
@@ -307,7 +325,7 @@ void OnlineSolver::checkJobCalibration()
     request.setUrl(getCablirationResult);
     networkManager->get(request);
 
-    workflowStage = JOB_CALIBRATION_STAGE;
+    setWorkflowStage(JOB_CALIBRATION_STAGE);
     emit logOutput(("Requesting the results..."));
 }
 
@@ -317,7 +335,7 @@ void OnlineSolver::getJobLogFile()
     QString URL = QString("http://nova.astrometry.net/joblog/%1").arg(jobID);
     networkManager->get(QNetworkRequest(QUrl(URL)));
 
-    workflowStage = LOG_LOADING_STAGE;
+    setWorkflowStage(LOG_LOADING_STAGE);
     emit logOutput(("Downloading the Log file..."));
 }
 
@@ -327,7 +345,7 @@ void OnlineSolver::getJobWCSFile()
     QString URL = QString("http://nova.astrometry.net/wcs_file/%1").arg(jobID);
     networkManager->get(QNetworkRequest(QUrl(URL)));
 
-    workflowStage = WCS_LOADING_STAGE;
+    setWorkflowStage(WCS_LOADING_STAGE);
     emit logOutput(("Downloading the WCS file..."));
 }
 
@@ -588,7 +606,7 @@ void OnlineSolver::onResult(QNetworkReply *reply)
             file.close();
             loadWCS(); //Attempt to load WCS from the file
             emit finished(0); //Success! We are completely done, whether or not the WCS loading was successful
-            workflowStage = NO_STAGE;
+            setWorkflowStage(NO_STAGE);
         }
             break;
 
@@ -20,6 +20,8 @@
 #include <QVariantMap>
 #include <QTime>
 #include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
 
 #define JOB_RETRY_DURATION    2000 /* 2000 ms */
 #define JOB_RETRY_ATTEMPTS    90
@@ -74,7 +76,12 @@ private:
     void getJobLogFile();       //Starts Stage 7
     void getJobWCSFile();       //Starts Stage 8
 
+    void setWorkflowStage(WorkflowStage stage);
+    void waitForStageChange(WorkflowStage stage, unsigned long msecs);
+
     WorkflowStage workflowStage { NO_STAGE };
+    QMutex stageLock;
+    QWaitCondition stageChanged;            //This wakes up the monitoring thread when the stage changes
     QNetworkAccessManager *networkManager { nullptr };
     QString sessionKey;
     int subID { 0 };
@@ -16,6 +16,9 @@ bool SSolver::Parameters::operator==(const Parameters& o)
             clean == o.clean &&
             clean_param == o.clean_param &&
             fwhm == o.fwhm &&
+            partition == o.partition &&
+            backgroundMeshSize == o.backgroundMeshSize &&
+            backgroundFilterSize == o.backgroundFilterSize &&
             //skip conv filter?? This might be hard to compare
 
             maxSize == o.maxSize &&
@@ -29,6 +32,7 @@ bool SSolver::Parameters::operator==(const Parameters& o)
             multiAlgorithm == o.multiAlgorithm &&
             inParallel == o.inParallel &&
             solverTimeLimit == o.solverTimeLimit &&
+            searchThreads == o.searchThreads &&
             minwidth == o.minwidth &&
             maxwidth == o.maxwidth &&
 
@@ -59,6 +63,9 @@ QMap<QString, QVariant> SSolver::Parameters::convertToMap(Parameters params)
     settingsMap.insert("deblend_contrast", QVariant(params.deblend_contrast));
     settingsMap.insert("clean", QVariant(params.clean));
     settingsMap.insert("clean_param", QVariant(params.clean_param));
+    settingsMap.insert("partition", QVariant(params.partition));
+    settingsMap.insert("backgroundMeshSize", QVariant(params.backgroundMeshSize));
+    settingsMap.insert("backgroundFilterSize", QVariant(params.backgroundFilterSize));
 
     settingsMap.insert("fwhm", QVariant(params.fwhm));
     QStringList conv;
@@ -83,6 +90,7 @@ QMap<QString, QVariant> SSolver::Parameters::convertToMap(Parameters params)
     settingsMap.insert("inParallel", QVariant(params.inParallel)) ;
     settingsMap.insert("multiAlgo", QVariant(params.multiAlgorithm)) ;
     settingsMap.insert("solverTimeLimit", QVariant(params.solverTimeLimit));
+    settingsMap.insert("searchThreads", QVariant(params.searchThreads));
 
     //Astrometry Basic Parameters
     settingsMap.insert("resort", QVariant(params.resort)) ;
@@ -116,6 +124,9 @@ SSolver::Parameters SSolver::Parameters::convertFromMap(QMap<QString, QVariant>
     params.deblend_contrast = settingsMap.value("deblend_contrast", params.deblend_contrast).toDouble();
     params.clean = settingsMap.value("clean", params.clean).toInt();
     params.clean_param = settingsMap.value("clean_param", params.clean_param).toDouble();
+    params.partition = settingsMap.value("partition", params.partition).toBool();
+    params.backgroundMeshSize = settingsMap.value("backgroundMeshSize", params.backgroundMeshSize).toInt();
+    params.backgroundFilterSize = settingsMap.value("backgroundFilterSize", params.backgroundFilterSize).toInt();
 
     //The Conv Filter
     params.fwhm = settingsMap.value("fwhm",params.fwhm).toDouble();
@@ -143,6 +154,7 @@ SSolver::Parameters SSolver::Parameters::convertFromMap(QMap<QString, QVariant>
     params.inParallel = settingsMap.value("inParallel", params.inParallel).toBool() ;
     params.multiAlgorithm = (MultiAlgo)(settingsMap.value("multiAlgo", params.multiAlgorithm)).toInt();
     params.solverTimeLimit = settingsMap.value("solverTimeLimit", params.solverTimeLimit).toInt();
+    params.searchThreads = settingsMap.value("searchThreads", params.searchThreads).toInt();
 
     //Astrometry Basic Parameters
     params.resort = settingsMap.value("resort", params.resort).toBool();
@@ -143,10 +143,11 @@ static QString getCommandString(SSolver::ProcessType processType, SSolver::Sextr
 
 // These are the algorithms used for patallel solving
 // When solving an image, this is one of the Parameters
-typedef enum {NOT_MULTI,    // This option does not use parallel solving
+typedef enum {NOT_MULTI,    // This option does not start parallel solvers.  The internal StellarSolver can still search for quads in several threads, see searchThreads.
               MULTI_SCALES, // This option generates multiple threads based on different image scales
               MULTI_DEPTHS, // This option generates multiple threads based on different image "depths"
-              MULTI_AUTO    // This option generates multiple threads (or not) automatically based on the algorithm that is best
+              MULTI_AUTO    // This option generates multiple threads (or not) automatically based on the algorithm that is best.
+                            // The internal StellarSolver searches in several threads itself, so it does not generate any unless searchThreads is 1.
 }MultiAlgo;
 
 //This gets a string for which Parallel Solving Algorithm we are using
@@ -246,6 +247,9 @@ public:
     int clean = 1;                      // Attempts to 'clean' the image to remove artifacts caused by bright objects
     double clean_param = 1;             // The cleaning parameter, not sure what it does.
     double fwhm = 2;                    // A variable to store the fwhm used to generate the conv filter, changing this WILL NOT change the conv filter, you can use the method below to create the conv filter based on the fwhm
+    bool partition = true;              // Whether or not to split large images into strips that are sextracted in parallel threads
+    int backgroundMeshSize = 64;        // The size in pixels of the boxes the background is estimated in, larger boxes are faster but follow gradients less closely
+    int backgroundFilterSize = 3;       // The number of boxes in the median filter that smooths the background, 1 turns it off
 
     //This is the filter used for convolution. You can create this directly or use the convenience method below.
     QVector<float> convFilter= {0.260856, 0.483068, 0.260856,
@@ -266,6 +270,7 @@ public:
     MultiAlgo multiAlgorithm = NOT_MULTI;// Algorithm for running multiple threads on possibly multiple cores to solve faster
     bool inParallel = true;             // Check the indices in parallel? if the indices you are using take less than 2 GB of space, and you have at least as much physical memory as indices, you want this enabled,
     int solverTimeLimit = 600;          // Give up solving after the specified number of seconds of CPU time
+    int searchThreads = 0;              // The number of threads the internal StellarSolver searches for quads in, 0 uses all of the cores and 1 searches only in the solving thread
     double minwidth = 0.1;              // If no scale estimate is given, this is the limit on the minimum field width in degrees.
     double maxwidth = 180;              // If no scale estimate is given, this is the limit on the maximum field width in degrees.
 
@@ -34,8 +34,8 @@
  * This used to be in analyse() / examineiso().
  */
 
-int analysemthresh(int objnb, objliststruct *objlist, int minarea,
-		   PIXTYPE thresh)
+int analysemthresh(extractctx *ctx, int objnb, objliststruct *objlist,
+		   int minarea, PIXTYPE thresh)
 {
   objstruct *obj = objlist->obj+objnb;
   pliststruct *pixel = objlist->plist;
@@ -61,8 +61,8 @@ int analysemthresh(int objnb, objliststruct *objlist, int minarea,
   for (pixt=pixel+obj->firstpix; pixt>=pixel; pixt=pixel+PLIST(pixt,nextpix))
     {
       /* amount pixel is above threshold */
-      tpix = PLISTPIX(pixt, cdvalue) - (PLISTEXIST(thresh)?
-					PLISTPIX(pixt, thresh):thresh);
+      tpix = PLISTPIX(ctx, pixt, cdvalue) - (PLISTEXIST(ctx, thresh)?
+					PLISTPIX(ctx, pixt, thresh):thresh);
       if (h>0)
         *(heapt++) = (float)tpix;
       else if (h)
@@ -101,7 +101,7 @@ int analysemthresh(int objnb, objliststruct *objlist, int minarea,
 
 /************************* preanalyse **************************************/
 
-void  preanalyse(int no, objliststruct *objlist)
+void  preanalyse(extractctx *ctx, int no, objliststruct *objlist)
 {
   objstruct	*obj = &objlist->obj[no];
   pliststruct	*pixel = objlist->plist, *pixt;
@@ -123,8 +123,8 @@ void  preanalyse(int no, objliststruct *objlist)
     {
       x = PLIST(pixt, x);
       y = PLIST(pixt, y);
-      val = PLISTPIX(pixt, value);
-      cval = PLISTPIX(pixt, cdvalue);
+      val = PLISTPIX(ctx, pixt, value);
+      cval = PLISTPIX(ctx, pixt, cdvalue);
       if (peak < val)
 	{
 	  peak = val;
@@ -170,7 +170,8 @@ void  preanalyse(int no, objliststruct *objlist)
   If robust = 1, you must have run previously with robust=0
 */
 
-void  analyse(int no, objliststruct *objlist, int robust, double gain)
+void  analyse(extractctx *ctx, int no, objliststruct *objlist, int robust,
+	       double gain)
 {
   objstruct	*obj = &objlist->obj[no];
   pliststruct	*pixel = objlist->plist, *pixt;
@@ -182,7 +183,7 @@ void  analyse(int no, objliststruct *objlist, int robust, double gain)
                 errx2, erry2, errxy, cvar, cvarsum;
   int		x, y, xmin, ymin, area2, dnpix;
 
-  preanalyse(no, objlist);
+  preanalyse(ctx, no, objlist);
   
   dnpix = 0;
   mx = my = tv = 0.0;
@@ -202,8 +203,8 @@ void  analyse(int no, objliststruct *objlist, int robust, double gain)
     {
       x = PLIST(pixt,x)-xmin;  /* avoid roundoff errors on big images */
       y = PLIST(pixt,y)-ymin;  /* avoid roundoff errors on big images */
-      cval = PLISTPIX(pixt, cdvalue);
-      tv += (val = PLISTPIX(pixt, value));
+      cval = PLISTPIX(ctx, pixt, cdvalue);
+      tv += (val = PLISTPIX(ctx, pixt, value));
       if (val>thresh)
 	dnpix++;
       if (val > thresh2)
@@ -248,9 +249,9 @@ void  analyse(int no, objliststruct *objlist, int robust, double gain)
       x = PLIST(pixt,x)-xmin;  /* avoid roundoff errors on big images */
       y = PLIST(pixt,y)-ymin;  /* avoid roundoff errors on big images */
 
-      cvar = PLISTEXIST(var)? PLISTPIX(pixt, var): 0.0;
+      cvar = PLISTEXIST(ctx, var)? PLISTPIX(ctx, pixt, var): 0.0;
       if (gain > 0.0) {  /* add poisson noise if given */
-        cval = PLISTPIX(pixt, cdvalue);
+        cval = PLISTPIX(ctx, pixt, cdvalue);
         if (cval > 0.0) cvar += cval / gain;
       }
 
@@ -758,24 +758,112 @@ float sep_bkg_pix(sep_bkg *bkg, int x, int y)
 
 /*****************************************************************************/
 
-int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
-                          float *line)
+/* Workspace for evaluating the background spline line by line. The x
+ * interpolation coefficients only depend on the column, so they are computed
+ * once and reused for every line of the image. Columns are grouped in runs
+ * that share the same pair of background nodes. */
+typedef struct
+{
+  int nruns;
+  int *runstart;     /* first column of each run, nruns+1 elements */
+  float *dx, *cdx;   /* interpolation weights for each column */
+  float *dx3, *cdx3; /* dx*dx-1 and cdx*cdx-1 for each column */
+  float *nodebuf, *dnodebuf, *u;
+} bkg_interp;
+
+void bkg_interp_free(bkg_interp *ip)
+{
+  free(ip->runstart);
+  free(ip->dx);
+  free(ip->cdx);
+  free(ip->dx3);
+  free(ip->cdx3);
+  free(ip->nodebuf);
+  free(ip->dnodebuf);
+  free(ip->u);
+  memset(ip, 0, sizeof(bkg_interp));
+}
+
+int bkg_interp_init(sep_bkg *bkg, bkg_interp *ip)
+{
+  int i,j,x,k, nbx,nbxm1, nx,width, changepoint, status;
+  float	dx,dx0,cdx, xstep;
+
+  status = RETURN_OK;
+  memset(ip, 0, sizeof(bkg_interp));
+
+  width = bkg->w;
+  nbx = bkg->nx;
+  nbxm1 = nbx - 1;
+
+  if (bkg->ny > 1)
+    {
+      QMALLOC(ip->nodebuf, float, nbx, status);
+      QMALLOC(ip->dnodebuf, float, nbx, status);
+      if (nbx>1)
+	QMALLOC(ip->u, float, nbxm1, status);
+    }
+
+  if (nbx>1)
+    {
+      QMALLOC(ip->runstart, int, nbx+1, status);
+      QMALLOC(ip->dx, float, width, status);
+      QMALLOC(ip->cdx, float, width, status);
+      QMALLOC(ip->dx3, float, width, status);
+      QMALLOC(ip->cdx3, float, width, status);
+
+      /* same stepping as the original per-pixel loop, so that the weights
+       * come out exactly the same */
+      nx = bkg->bw;
+      xstep = 1.0/nx;
+      changepoint = nx/2;
+      dx  = (xstep - 1)/2;	/* dx of the first pixel in the row */
+      dx0 = ((nx+1)%2)*xstep/2;	/* dx of the 1st pixel right to a bkgnd node */
+      k = 0;
+      ip->runstart[0] = 0;
+      for (x=i=j=0; j<width; j++, i++, dx += xstep)
+	{
+	  if (i==changepoint && x>0 && x<nbxm1)
+	    {
+	      ip->runstart[++k] = j;
+	      dx = dx0;
+	    }
+	  cdx = 1 - dx;
+	  ip->dx[j] = dx;
+	  ip->cdx[j] = cdx;
+	  ip->dx3[j] = dx*dx-1;
+	  ip->cdx3[j] = cdx*cdx-1;
+
+	  if (i==nx)
+	    {
+	      x++;
+	      i = 0;
+	    }
+	}
+      ip->nruns = k+1;
+      ip->runstart[ip->nruns] = width;
+    }
+
+  return status;
+
+ exit:
+  bkg_interp_free(ip);
+  return status;
+}
+
+void bkg_interp_line(sep_bkg *bkg, bkg_interp *ip, float *values,
+		     float *dvalues, int y, float *line, int subtract)
 /* Interpolate background at line y (bicubic spline interpolation between
- * background map vertices) and save to line.
+ * background map vertices) and save to line, or subtract it from line.
  * (values, dvalues) is either (bkg->back, bkg->dback) or
  * (bkg->sigma, bkg->dsigma) depending on whether the background value or rms
  * is being evaluated. */
 {
-  int i,j,x,yl, nbx,nbxm1,nby, nx,width, ystep, changepoint, status;
-  float	dx,dx0,dy,dy3, cdx,cdy,cdy3, temp, xstep;
-  float *nodebuf, *dnodebuf, *u;
+  int k,x,yl, nbx,nbxm1,nby, width, ystep, start;
+  float	dy,dy3, cdy,cdy3, temp;
+  float *u;
   float *node, *nodep, *dnode, *blo, *bhi, *dblo, *dbhi;
 
-  status = RETURN_OK;
-  nodebuf = node = NULL;
-  dnodebuf = dnode = NULL;
-  u = NULL;
-
   width = bkg->w;
   nbx = bkg->nx;
   nbxm1 = nbx - 1;
@@ -803,18 +891,16 @@ int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
       bhi = blo + nbx;
       dblo = dvalues + ystep;
       dbhi = dblo + nbx;
-      QMALLOC(nodebuf, float, nbx, status);  /* Interpolated background */
-      nodep = node = nodebuf;
+      nodep = node = ip->nodebuf;	/* Interpolated background */
       for (x=nbx; x--;)
 	*(nodep++) = cdy**(blo++) + dy**(bhi++) + cdy3**(dblo++) +
 	  dy3**(dbhi++);
 
       /*-- Computation of 2nd derivatives along x */
-      QMALLOC(dnodebuf, float, nbx, status);  /* 2nd derivative along x */
-      dnode = dnodebuf;
+      dnode = ip->dnodebuf;
       if (nbx>1)
 	{
-	  QMALLOC(u, float, nbxm1, status);  /* temporary array */
+	  u = ip->u;
 	  *dnode = *u = 0.0;	/* "natural" lower boundary condition */
 	  nodep = node+1;
 	  for (x=nbxm1; --x; nodep++)
@@ -830,10 +916,8 @@ int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
 	      temp = *(dnode--);
 	      *dnode = (*dnode*temp+*(u--))/6.0;
 	    }
-	  free(u);
-	  u = NULL;
-	  dnode--;
 	}
+      dnode = ip->dnodebuf;
     }
   else
     {
@@ -845,47 +929,33 @@ int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
   /*-- Interpolation along x */
   if (nbx>1)
     {
-      nx = bkg->bw;
-      xstep = 1.0/nx;
-      changepoint = nx/2;
-      dx  = (xstep - 1)/2;	/* dx of the first pixel in the row */
-      dx0 = ((nx+1)%2)*xstep/2;	/* dx of the 1st pixel right to a bkgnd node */
-      blo = node;
-      bhi = node + 1;
-      dblo = dnode;
-      dbhi = dnode + 1;
-      for (x=i=0,j=width; j--; i++, dx += xstep)
+      for (k=0; k<ip->nruns; k++)
 	{
-	  if (i==changepoint && x>0 && x<nbxm1)
-	    {
-	      blo++;
-	      bhi++;
-	      dblo++;
-	      dbhi++;
-	      dx = dx0;
-	    }
-	  cdx = 1 - dx;
-
-	  *(line++) = (float)(cdx*(*blo+(cdx*cdx-1)**dblo) 
-			      + dx*(*bhi+(dx*dx-1)**dbhi));
-
-	  if (i==nx)
-	    {
-	      x++;
-	      i = 0;
-	    }
+	  start = ip->runstart[k];
+	  simd_bkg_interp(ip->dx+start, ip->cdx+start, ip->dx3+start,
+			  ip->cdx3+start, node[k], dnode[k], node[k+1],
+			  dnode[k+1], ip->runstart[k+1]-start, line+start,
+			  subtract);
 	}
     }
+  else if (subtract)
+    for (x=width; x--;)
+      *(line++) -= *node;
   else
-    for (j=width; j--;)
-      {
-	*(line++) = (float)*node;
-      }
+    for (x=width; x--;)
+      *(line++) = (float)*node;
+}
 
- exit:
-  if (nodebuf) free(nodebuf);
-  if (dnodebuf) free(dnodebuf);
-  if (u) free(u);
+int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
+                          float *line)
+{
+  bkg_interp ip;
+  int status;
+
+  if ((status = bkg_interp_init(bkg, &ip)) != RETURN_OK)
+    return status;
+  bkg_interp_line(bkg, &ip, values, dvalues, y, line, 0);
+  bkg_interp_free(&ip);
   return status;
 }
 
@@ -969,6 +1039,7 @@ int sep_bkg_array(sep_bkg *bkg, void *arr, int dtype)
 {
   int y, width, size, status;
   array_writer write_array;
+  bkg_interp ip;
   float *tmpline;
   BYTE *line;
 
@@ -978,10 +1049,12 @@ int sep_bkg_array(sep_bkg *bkg, void *arr, int dtype)
 
   if (dtype == SEP_TFLOAT)
     {
+      if ((status = bkg_interp_init(bkg, &ip)) != RETURN_OK)
+	return status;
       tmpline = (float *)arr;
       for (y=0; y<bkg->h; y++, tmpline+=width)
-	if ((status = sep_bkg_line_flt(bkg, y, tmpline)) != RETURN_OK)
-	  return status;
+	bkg_interp_line(bkg, &ip, bkg->back, bkg->dback, y, tmpline, 0);
+      bkg_interp_free(&ip);
       return status;
     }
   
@@ -1007,6 +1080,7 @@ int sep_bkg_rmsarray(sep_bkg *bkg, void *arr, int dtype)
 {
   int y, width, size, status;
   array_writer write_array;
+  bkg_interp ip;
   float *tmpline;
   BYTE *line;
 
@@ -1016,10 +1090,12 @@ int sep_bkg_rmsarray(sep_bkg *bkg, void *arr, int dtype)
 
   if (dtype == SEP_TFLOAT)
     {
+      if ((status = bkg_interp_init(bkg, &ip)) != RETURN_OK)
+	return status;
       tmpline = (float *)arr;
       for (y=0; y<bkg->h; y++, tmpline+=width)
-	if ((status = sep_bkg_rmsline_flt(bkg, y, tmpline)) != RETURN_OK)
-	  return status;
+	bkg_interp_line(bkg, &ip, bkg->sigma, bkg->dsigma, y, tmpline, 0);
+      bkg_interp_free(&ip);
       return status;
     }
   
@@ -1073,12 +1149,24 @@ int sep_bkg_subarray(sep_bkg *bkg, void *arr, int dtype)
   int y, status, size, width;
   PIXTYPE *tmpline;
   BYTE *arrt;
+  bkg_interp ip;
 
   tmpline = NULL;
   status = RETURN_OK;
   width = bkg->w;
   arrt = (BYTE *)arr;
 
+  /* interpolate and subtract in a single pass over each line */
+  if (dtype == SEP_TFLOAT)
+    {
+      if ((status = bkg_interp_init(bkg, &ip)) != RETURN_OK)
+	return status;
+      for (y=0; y<bkg->h; y++, arrt+=(width*sizeof(float)))
+	bkg_interp_line(bkg, &ip, bkg->back, bkg->dback, y, (float *)arrt, 1);
+      bkg_interp_free(&ip);
+      return status;
+    }
+
   QMALLOC(tmpline, PIXTYPE, width, status);
 
   status = get_array_subtractor(dtype, &subtract_array, &size);
@@ -91,8 +91,7 @@ int convolve(arraybuffer *buf, int y, float *conv, int convw, int convh,
 	}
 
       /* multiply and add the values */
-      while (dst < dstend)
-	*(dst++) += conv[i] * *(src++);
+      simd_scale_add(dst, src, conv[i], (int)(dstend - dst));
     }
 
   return RETURN_OK;
@@ -28,9 +28,7 @@
 #include "sepcore.h"
 #include "extract.h"
 
-#ifndef	RAND_MAX
-#define	RAND_MAX 2147483647
-#endif
+#define	DEBLEND_RAND_MAX 32767
 #define	NSONMAX	1024  /* max. number per level */
 #define NSONMAX_STR "1024" /* just for error message */
 #define	NBRANCH	16    /* starting number per branch */
@@ -39,10 +37,16 @@
 
 int belong(int, objliststruct *, int, objliststruct *);
 int *createsubmap(objliststruct *, int, int *, int *, int *, int *);
-int gatherup(objliststruct *, objliststruct *);
+int gatherup(extractctx *, objliststruct *, objliststruct *);
 
-static objliststruct *objlist=NULL;
-static short	     *son=NULL, *ok=NULL;
+/* rand() keeps its state across threads, so deblending uses its own
+ * generator (the example one from the C standard), seeded for each call to
+ * sep_extract() to give consistent results. */
+static int deblend_rand(extractctx *ctx)
+{
+  ctx->randseed = ctx->randseed*1103515245 + 12345;
+  return (int)((ctx->randseed/65536) % 32768);
+}
 
 /******************************** deblend ************************************/
 /*
@@ -52,11 +56,14 @@ NOTE: Even if the object is not deblended, the output objlist threshold is
 
 This can return two error codes: DEBLEND_OVERFLOW or MEMORY_ALLOC_ERROR
 */
-int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
-	    int deblend_nthresh, double deblend_mincont, int minarea)
+int deblend(extractctx *ctx, objliststruct *objlistin, int l,
+	    objliststruct *objlistout, int deblend_nthresh,
+	    double deblend_mincont, int minarea)
 {
   objstruct		*obj;
-  static objliststruct	debobjlist, debobjlist2;
+  objliststruct		debobjlist, debobjlist2;
+  objliststruct		*objlist = ctx->objlist;
+  short			*son = ctx->son, *ok = ctx->ok;
   double		thresh, thresh0, value0;
   int			h,i,j,k,m,subx,suby,subh,subw,
                         xn,
@@ -68,7 +75,7 @@ int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
   status = RETURN_OK;
   xn = deblend_nthresh;
 
-  /* reset global static objlist for deblending */
+  /* reset the deblending objlist */
   memset(objlist, 0, (size_t)xn*sizeof(objliststruct));
 
   /* initialize local object lists */
@@ -93,9 +100,9 @@ int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
   objlistout->thresh = debobjlist2.thresh = thresh0;
 
   /* add input object to global deblending objlist and one local objlist */
-  if ((status = addobjdeep(l, objlistin, &objlist[0])) != RETURN_OK)
+  if ((status = addobjdeep(ctx, l, objlistin, &objlist[0])) != RETURN_OK)
     goto exit;
-  if ((status = addobjdeep(l, objlistin, &debobjlist2)) != RETURN_OK)
+  if ((status = addobjdeep(ctx, l, objlistin, &debobjlist2)) != RETURN_OK)
     goto exit;
 
   value0 = objlist[0].obj[0].fdflux*deblend_mincont;
@@ -116,7 +123,7 @@ int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
       
       for (i=0; i<objlist[k-1].nobj; i++)
 	{
-	  status = lutz(objlistin->plist, submap, subx, suby, subw,
+	  status = lutz(ctx, objlistin->plist, submap, subx, suby, subw,
 			&objlist[k-1].obj[i], &debobjlist, minarea);
 	  if (status != RETURN_OK)
 	    goto exit;
@@ -125,7 +132,7 @@ int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
 	    if (belong(j, &debobjlist, i, &objlist[k-1]))
 	      {
 		debobjlist.obj[j].thresh = debobjlist.thresh;
-		if ((status = addobjdeep(j, &debobjlist, &objlist[k]))
+		if ((status = addobjdeep(ctx, j, &debobjlist, &objlist[k]))
 		    != RETURN_OK)
 		  goto exit;
 		m = objlist[k].nobj - 1;
@@ -135,7 +142,7 @@ int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
 		    goto exit;
 		  }
 		if (h>=nbm-1)
-		  if (!(son = (short *)
+		  if (!(son = ctx->son = (short *)
 			realloc(son,xn*NSONMAX*(nbm+=16)*sizeof(short))))
 		    {
 		      status = MEMORY_ALLOC_ERROR;
@@ -167,7 +174,7 @@ int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
 		    obj[j].fdflux - obj[j].thresh * obj[j].fdnpix > value0)
 		  {
 		    objlist[k+1].obj[j].flag |= SEP_OBJ_MERGED;
-		    status = addobjdeep(j, &objlist[k+1], &debobjlist2);
+		    status = addobjdeep(ctx, j, &objlist[k+1], &debobjlist2);
 		    if (status != RETURN_OK)
 		      goto exit;
 		  }
@@ -177,9 +184,9 @@ int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
     }
   
   if (ok[0])
-    status = addobjdeep(0, &debobjlist2, objlistout);
+    status = addobjdeep(ctx, 0, &debobjlist2, objlistout);
   else
-    status = gatherup(&debobjlist2, objlistout);
+    status = gatherup(ctx, &debobjlist2, objlistout);
   
  exit:
   if (status == DEBLEND_OVERFLOW)
@@ -207,33 +214,33 @@ int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
 
 /******************************* allocdeblend ******************************/
 /*
-Allocate the memory allocated by global pointers in refine.c
+Allocate the deblending buffers of the extraction context
 */
-int allocdeblend(int deblend_nthresh)
+int allocdeblend(extractctx *ctx, int deblend_nthresh)
 {
   int status=RETURN_OK;
-  QMALLOC(son, short,  deblend_nthresh*NSONMAX*NBRANCH, status);
-  QMALLOC(ok, short,  deblend_nthresh*NSONMAX, status);
-  QMALLOC(objlist, objliststruct, deblend_nthresh, status);
+  QMALLOC(ctx->son, short,  deblend_nthresh*NSONMAX*NBRANCH, status);
+  QMALLOC(ctx->ok, short,  deblend_nthresh*NSONMAX, status);
+  QMALLOC(ctx->objlist, objliststruct, deblend_nthresh, status);
 
   return status;
  exit:
-  freedeblend();
+  freedeblend(ctx);
   return status;
 }
 
 /******************************* freedeblend *******************************/
 /*
-Free the memory allocated by global pointers in refine.c
+Free the deblending buffers of the extraction context
 */
-void freedeblend(void)
+void freedeblend(extractctx *ctx)
 {
-  free(son);
-  son = NULL;
-  free(ok);
-  ok = NULL;
-  free(objlist);
-  objlist = NULL;
+  free(ctx->son);
+  ctx->son = NULL;
+  free(ctx->ok);
+  ctx->ok = NULL;
+  free(ctx->objlist);
+  ctx->objlist = NULL;
   return;
 }
 
@@ -242,7 +249,8 @@ void freedeblend(void)
 Collect faint remaining pixels and allocate them to their most probable
 progenitor.
 */
-int gatherup(objliststruct *objlistin, objliststruct *objlistout)
+int gatherup(extractctx *ctx, objliststruct *objlistin,
+	     objliststruct *objlistout)
 {
   char        *bmp;
   float       *amp, *p, dx,dy, drand, dist, distmin;
@@ -265,7 +273,7 @@ int gatherup(objliststruct *objlistin, objliststruct *objlistout)
   QMALLOC(n, int, nobj, status);
 
   for (i=1; i<nobj; i++)
-    analyse(i, objlistin, 0, 0.0);
+    analyse(ctx, i, objlistin, 0, 0.0);
 
   p[0] = 0.0;
   bmwidth = objin->xmax - (xs=objin->xmin) + 1;
@@ -287,7 +295,7 @@ int gatherup(objliststruct *objlistin, objliststruct *objlistout)
 	   pixt=pixelin+PLIST(pixt,nextpix))
 	bmp[(PLIST(pixt,x)-xs) + (PLIST(pixt,y)-ys)*bmwidth] = '\1';
       
-      status = addobjdeep(i, objlistin, objlistout);
+      status = addobjdeep(ctx, i, objlistin, objlistout);
       if (status != RETURN_OK)
 	goto exit;
       n[i] = objlistout->nobj - 1;
@@ -303,7 +311,7 @@ int gatherup(objliststruct *objlistin, objliststruct *objlistout)
   objout = objlistout->obj;		/* DO NOT MOVE !!! */
 
   if (!(pixelout=(pliststruct *)realloc(objlistout->plist,
-					(objlistout->npix + npix)*plistsize)))
+					(objlistout->npix + npix)*ctx->plistsize)))
     {
       status = MEMORY_ALLOC_ERROR;
       goto exit;
@@ -319,8 +327,8 @@ int gatherup(objliststruct *objlistin, objliststruct *objlistout)
       y = PLIST(pixt,y);
       if (!bmp[(x-xs) + (y-ys)*bmwidth])
 	{
-	  pixt2 = pixelout + (l=(k++*plistsize));
-	  memcpy(pixt2, pixt, (size_t)plistsize);
+	  pixt2 = pixelout + (l=(k++*ctx->plistsize));
+	  memcpy(pixt2, pixt, (size_t)ctx->plistsize);
 	  PLIST(pixt2, nextpix) = -1;
 	  distmin = 1e+31;
 	  for (objt = objin+(i=1); i<nobj; i++, objt++)
@@ -337,7 +345,7 @@ int gatherup(objliststruct *objlistin, objliststruct *objlistout)
 	    }			
 	  if (p[nobj-1] > 1.0e-31)
 	    {
-	      drand = p[nobj-1]*rand()/RAND_MAX;
+	      drand = p[nobj-1]*deblend_rand(ctx)/DEBLEND_RAND_MAX;
 	      for (i=1; i<nobj && p[i]<drand; i++);
 	      if (i==nobj)
 		i=iclst;
@@ -350,7 +358,7 @@ int gatherup(objliststruct *objlistin, objliststruct *objlistout)
 
   objlistout->npix = k;
   if (!(objlistout->plist = (pliststruct *)realloc(pixelout,
-						   objlistout->npix*plistsize)))
+						   objlistout->npix*ctx->plistsize)))
     status = MEMORY_ALLOC_ERROR;
 
  exit:
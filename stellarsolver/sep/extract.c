@@ -35,9 +35,6 @@
 			             /* thresholding filtered weight-maps */
 
 /* globals */
-int plistexist_cdvalue, plistexist_thresh, plistexist_var;
-int plistoff_value, plistoff_cdvalue, plistoff_thresh, plistoff_var;
-int plistsize;
 size_t extract_pixstack = 300000;
 
 /* get and set pixstack */
@@ -51,13 +48,16 @@ size_t sep_get_extract_pixstack()
   return extract_pixstack;
 }
 
-int sortit(infostruct *info, objliststruct *objlist, int minarea,
-	   objliststruct *finalobjlist,
+int sortit(extractctx *ctx, infostruct *info, objliststruct *objlist,
+	   int minarea, objliststruct *finalobjlist,
 	   int deblend_nthresh, double deblend_mincont, double gain);
-void plistinit(int hasconv, int hasvar);
+void plistinit(extractctx *ctx, int hasconv, int hasvar);
 void clean(objliststruct *objlist, double clean_param, int *survives);
 int convert_to_catalog(objliststruct *objlist, int *survives,
                        sep_catalog *cat, int w, int include_pixels);
+int alloc_catalog_fields(sep_catalog *cat, int nobj, int totnpix);
+void copy_catalog_object(sep_catalog *dst, int j, sep_catalog *src, int i,
+			 int dy, int w, int *k);
 
 int arraybuffer_init(arraybuffer *buf, void *arr, int dtype, int w, int h,
                      int bufw, int bufh);
@@ -81,7 +81,11 @@ int arraybuffer_init(arraybuffer *buf, void *arr, int dtype, int w, int h,
 
   /* buffer array info */
   buf->bptr = NULL;
-  QMALLOC(buf->bptr, PIXTYPE, bufw*bufh, status);
+  if (!(buf->bptr = sep_buffer_alloc(sizeof(PIXTYPE)*bufw*bufh)))
+    {
+      status = MEMORY_ALLOC_ERROR;
+      goto exit;
+    }
   buf->bw = bufw;
   buf->bh = bufh;
 
@@ -103,7 +107,7 @@ int arraybuffer_init(arraybuffer *buf, void *arr, int dtype, int w, int h,
   return status;
 
  exit:
-  free(buf->bptr);
+  sep_buffer_free(buf->bptr);
   buf->bptr = NULL;
   return status;
 }
@@ -131,7 +135,7 @@ void arraybuffer_readline(arraybuffer *buf)
 
 void arraybuffer_free(arraybuffer *buf)
 {
-  free(buf->bptr);
+  sep_buffer_free(buf->bptr);
   buf->bptr = NULL;
 }
 
@@ -175,6 +179,7 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
 		int clean_flag, double clean_param,
 		sep_catalog **catalog)
 {
+  extractctx        ctxdata, *ctx;
   arraybuffer       dbuf, nbuf, mbuf;
   infostruct        curpixinfo, initinfo, freeinfo;
   objliststruct     objlist;
@@ -204,6 +209,8 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
   sep_catalog       *cat;
 
   status = RETURN_OK;
+  ctx = &ctxdata;
+  memset(ctx, 0, sizeof(extractctx));
   pixel = NULL;
   convnorm = NULL;
   scan = wscan = cdscan = dummyscan = NULL;
@@ -228,9 +235,15 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
   
   mem_pixstack = sep_get_extract_pixstack();
 
+  /* An image can't have more pixels above the threshold than it has pixels,
+   * so small images, like the windows around stars, don't need to allocate
+   * and link up the whole pixel stack on every call. */
+  if (mem_pixstack > (size_t)(w+1)*(h+1))
+    mem_pixstack = (size_t)(w+1)*(h+1);
+
   /* seed the random number generator consistently on each call to get
-   * consistent results. rand() is used in deblending. */
-  srand(1);
+   * consistent results. It is used in deblending. */
+  ctx->randseed = 1;
 
   /* Noise characteristics of the image: None, scalar or variable? */
   if (image->noise_type == SEP_NOISE_NONE) { } /* nothing to do */
@@ -284,9 +297,9 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
   QMALLOC(psstack, pixstatus, stacksize, status);
   QCALLOC(start, int, stacksize, status);
   QMALLOC(end, int, stacksize, status);
-  if ((status = lutzalloc(w, h)) != RETURN_OK)
+  if ((status = lutzalloc(ctx, w, h)) != RETURN_OK)
     goto exit;
-  if ((status = allocdeblend(deblend_nthresh)) != RETURN_OK)
+  if ((status = allocdeblend(ctx, deblend_nthresh)) != RETURN_OK)
     goto exit;
 
   /* Initialize buffers for input array(s).
@@ -339,8 +352,8 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
 
 
   /* Allocate memory for the pixel list */
-  plistinit((conv != NULL), (image->noise_type != SEP_NOISE_NONE));
-  if (!(pixel = objlist.plist = malloc(nposize=mem_pixstack*plistsize)))
+  plistinit(ctx, (conv != NULL), (image->noise_type != SEP_NOISE_NONE));
+  if (!(pixel = objlist.plist = sep_buffer_alloc(nposize=mem_pixstack*ctx->plistsize)))
     {
       status = MEMORY_ALLOC_ERROR;
       goto exit;
@@ -348,9 +361,10 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
 
   /*----- at the beginning, "free" object fills the whole pixel list */
   freeinfo.firstpix = 0;
-  freeinfo.lastpix = nposize-plistsize;
+  freeinfo.lastpix = nposize-ctx->plistsize;
   pixt = pixel;
-  for (i=plistsize; i<nposize; i += plistsize, pixt += plistsize)
+  for (i=ctx->plistsize; i<nposize;
+       i += ctx->plistsize, pixt += ctx->plistsize)
     PLIST(pixt, nextpix) = i;
   PLIST(pixt, nextpix) = -1;
 
@@ -497,12 +511,12 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
 	      PLIST(pixt, x) = xl;
 	      PLIST(pixt, y) = yl;
 	      PLIST(pixt, value) = scan[xl];
-	      if (PLISTEXIST(cdvalue))
-		PLISTPIX(pixt, cdvalue) = cdnewsymbol;
-	      if (PLISTEXIST(var))
-		PLISTPIX(pixt, var) = pixvar;
-	      if (PLISTEXIST(thresh))
-		PLISTPIX(pixt, thresh) = thresh;
+	      if (PLISTEXIST(ctx, cdvalue))
+		PLISTPIX(ctx, pixt, cdvalue) = cdnewsymbol;
+	      if (PLISTEXIST(ctx, var))
+		PLISTPIX(ctx, pixt, var) = pixvar;
+	      if (PLISTEXIST(ctx, thresh))
+		PLISTPIX(ctx, pixt, thresh) = thresh;
 
 	      /* Check if we have run out of free pixels in objlist.plist */
 	      if (freeinfo.firstpix==freeinfo.lastpix)
@@ -529,26 +543,28 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
 		  /* increase the stack size */
 		  oldnposize = nposize;
  		  mem_pixstack = (int)(mem_pixstack * 2);
-		  nposize = mem_pixstack * plistsize;
-		  pixel = (pliststruct *)realloc(pixel, nposize);
-		  objlist.plist = pixel;
-		  if (!pixel)
+		  nposize = mem_pixstack * ctx->plistsize;
+		  objlist.plist = (pliststruct *)sep_buffer_alloc(nposize);
+		  if (!objlist.plist)
 		    {
 		      status = MEMORY_ALLOC_ERROR;
 		      goto exit;
 		    }
+		  memcpy(objlist.plist, pixel, oldnposize);
+		  sep_buffer_free(pixel);
+		  pixel = objlist.plist;
 
 		  /* set next free pixel to the start of the new block 
 		   * and link up all the pixels in the new block */
 		  PLIST(pixel+freeinfo.firstpix, nextpix) = oldnposize;
 		  pixt = pixel + oldnposize;
-		  for (i=oldnposize + plistsize; i<nposize;
-		       i += plistsize, pixt += plistsize)
+		  for (i=oldnposize + ctx->plistsize; i<nposize;
+		       i += ctx->plistsize, pixt += ctx->plistsize)
 		    PLIST(pixt, nextpix) = i;
 		  PLIST(pixt, nextpix) = -1;
 
 		  /* last free pixel is now at the end of the new block */
-		  freeinfo.lastpix = nposize - plistsize;
+		  freeinfo.lastpix = nposize - ctx->plistsize;
 		}
 	      /*------------------------------------------------------------*/
 
@@ -629,7 +645,7 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
 			      /* update threshold before object is processed */
 			      objlist.thresh = thresh;
 
-			      status = sortit(&info[co], &objlist, minarea,
+			      status = sortit(ctx, &info[co], &objlist, minarea,
 					      finalobjlist,
 					      deblend_nthresh,deblend_cont,
                                               image->gain);
@@ -687,7 +703,7 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
       /* Calculate mthresh for all objects in the list (needed for cleaning) */
       for (i=0; i<finalobjlist->nobj; i++)
 	{
-	  status = analysemthresh(i, finalobjlist, minarea, thresh);
+	  status = analysemthresh(ctx, i, finalobjlist, minarea, thresh);
 	  if (status != RETURN_OK)
 	    goto exit;
 	}
@@ -705,9 +721,9 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
   free(finalobjlist->obj);
   free(finalobjlist->plist);
   free(finalobjlist);
-  freedeblend();
-  free(pixel);
-  lutzfree();
+  freedeblend(ctx);
+  sep_buffer_free(pixel);
+  lutzfree(ctx);
   free(info);
   free(store);
   free(marker);
@@ -748,12 +764,12 @@ int sep_extract(sep_image *image, float thresh, int thresh_type,
 /*
 build the object structure.
 */
-int sortit(infostruct *info, objliststruct *objlist, int minarea,
-	   objliststruct *finalobjlist,
+int sortit(extractctx *ctx, infostruct *info, objliststruct *objlist,
+	   int minarea, objliststruct *finalobjlist,
 	   int deblend_nthresh, double deblend_mincont, double gain)
 {
   objliststruct	        objlistout, *objlist2;
-  static objstruct	obj;
+  objstruct		obj;
   int 			i, status;
 
   status=RETURN_OK;  
@@ -772,10 +788,10 @@ int sortit(infostruct *info, objliststruct *objlist, int minarea,
   obj.flag = info->flag;
   obj.thresh = objlist->thresh;
 
-  preanalyse(0, objlist);
+  preanalyse(ctx, 0, objlist);
 
-  status = deblend(objlist, 0, &objlistout, deblend_nthresh, deblend_mincont,
-		   minarea);
+  status = deblend(ctx, objlist, 0, &objlistout, deblend_nthresh,
+		   deblend_mincont, minarea);
   if (status)
     {
       /* formerly, this wasn't a fatal error, so a flag was set for
@@ -793,14 +809,14 @@ int sortit(infostruct *info, objliststruct *objlist, int minarea,
   /* Analyze the deblended objects and add to the final list */
   for (i=0; i<objlist2->nobj; i++)
     {
-      analyse(i, objlist2, 1, gain);
+      analyse(ctx, i, objlist2, 1, gain);
 
       /* this does nothing if DETECT_MAXAREA is 0 (and it currently is) */
       if (DETECT_MAXAREA && objlist2->obj[i].fdnpix > DETECT_MAXAREA)
 	continue;
 
       /* add the object to the final list */
-      status = addobjdeep(i, objlist2, finalobjlist);
+      status = addobjdeep(ctx, i, objlist2, finalobjlist);
       if (status != RETURN_OK)
 	goto exit;
     }
@@ -818,12 +834,14 @@ Add object number `objnb` from list `objl1` to list `objl2`.
 Unlike `addobjshallow` this also copies plist pixels to the second list.
 */
 
-int addobjdeep(int objnb, objliststruct *objl1, objliststruct *objl2)
+int addobjdeep(extractctx *ctx, int objnb, objliststruct *objl1,
+	       objliststruct *objl2)
 {
   objstruct	*objl2obj;
   pliststruct	*plist1 = objl1->plist, *plist2 = objl2->plist;
-  int		fp, i, j, npx, objnb2;
+  int		fp, i, j, npx, objnb2, plistsize;
   
+  plistsize = ctx->plistsize;
   fp = objl2->npix;      /* 2nd list's plist size in pixels */
   j = fp*plistsize;      /* 2nd list's plist size in bytes */
   objnb2 = objl2->nobj;  /* # of objects currently in 2nd list*/
@@ -880,39 +898,39 @@ int addobjdeep(int objnb, objliststruct *objl1, objliststruct *objl2)
  * (originally init_plist() in sextractor)
 PURPOSE	initialize a pixel-list and its components.
  ***/
-void plistinit(int hasconv, int hasvar)
+void plistinit(extractctx *ctx, int hasconv, int hasvar)
 {
   pbliststruct	*pbdum = NULL;
 
-  plistsize = sizeof(pbliststruct);
-  plistoff_value = (char *)&pbdum->value - (char *)pbdum;
+  ctx->plistsize = sizeof(pbliststruct);
+  ctx->plistoff_value = (char *)&pbdum->value - (char *)pbdum;
 
   if (hasconv)
     {
-      plistexist_cdvalue = 1;
-      plistoff_cdvalue = plistsize;
-      plistsize += sizeof(PIXTYPE);
+      ctx->plistexist_cdvalue = 1;
+      ctx->plistoff_cdvalue = ctx->plistsize;
+      ctx->plistsize += sizeof(PIXTYPE);
     }
   else
     {
-      plistexist_cdvalue = 0;
-      plistoff_cdvalue = plistoff_value;
+      ctx->plistexist_cdvalue = 0;
+      ctx->plistoff_cdvalue = ctx->plistoff_value;
     }
 
   if (hasvar)
     {
-      plistexist_var = 1;
-      plistoff_var = plistsize;
-      plistsize += sizeof(PIXTYPE);
+      ctx->plistexist_var = 1;
+      ctx->plistoff_var = ctx->plistsize;
+      ctx->plistsize += sizeof(PIXTYPE);
 
-      plistexist_thresh = 1;
-      plistoff_thresh = plistsize;
-      plistsize += sizeof(PIXTYPE);
+      ctx->plistexist_thresh = 1;
+      ctx->plistoff_thresh = ctx->plistsize;
+      ctx->plistsize += sizeof(PIXTYPE);
     }
   else
     {
-      plistexist_var = 0;
-      plistexist_thresh = 0;
+      ctx->plistexist_var = 0;
+      ctx->plistexist_thresh = 0;
     }
 
   return;
@@ -1199,3 +1217,227 @@ void sep_catalog_free(sep_catalog *catalog)
     free_catalog_fields(catalog);
   free(catalog);
 }
+
+
+/************************* extraction in strips ******************************/
+
+/* Allocate the fields of a catalog for `nobj` objects holding `totnpix`
+ * pixels in total. */
+int alloc_catalog_fields(sep_catalog *cat, int nobj, int totnpix)
+{
+  int status = RETURN_OK;
+
+  memset(cat, 0, sizeof(sep_catalog));
+  cat->nobj = nobj;
+  QMALLOC(cat->thresh, float, nobj, status);
+  QMALLOC(cat->npix, int, nobj, status);
+  QMALLOC(cat->tnpix, int, nobj, status);
+  QMALLOC(cat->xmin, int, nobj, status);
+  QMALLOC(cat->xmax, int, nobj, status);
+  QMALLOC(cat->ymin, int, nobj, status);
+  QMALLOC(cat->ymax, int, nobj, status);
+  QMALLOC(cat->x, double, nobj, status);
+  QMALLOC(cat->y, double, nobj, status);
+  QMALLOC(cat->x2, double, nobj, status);
+  QMALLOC(cat->y2, double, nobj, status);
+  QMALLOC(cat->xy, double, nobj, status);
+  QMALLOC(cat->errx2, double, nobj, status);
+  QMALLOC(cat->erry2, double, nobj, status);
+  QMALLOC(cat->errxy, double, nobj, status);
+  QMALLOC(cat->a, float, nobj, status);
+  QMALLOC(cat->b, float, nobj, status);
+  QMALLOC(cat->theta, float, nobj, status);
+  QMALLOC(cat->cxx, float, nobj, status);
+  QMALLOC(cat->cyy, float, nobj, status);
+  QMALLOC(cat->cxy, float, nobj, status);
+  QMALLOC(cat->cflux, float, nobj, status);
+  QMALLOC(cat->flux, float, nobj, status);
+  QMALLOC(cat->cpeak, float, nobj, status);
+  QMALLOC(cat->peak, float, nobj, status);
+  QMALLOC(cat->xcpeak, int, nobj, status);
+  QMALLOC(cat->ycpeak, int, nobj, status);
+  QMALLOC(cat->xpeak, int, nobj, status);
+  QMALLOC(cat->ypeak, int, nobj, status);
+  QMALLOC(cat->flag, short, nobj, status);
+  QMALLOC(cat->objectspix, int, totnpix, status);
+  QMALLOC(cat->pix, int*, nobj, status);
+
+  return status;
+
+ exit:
+  free_catalog_fields(cat);
+  return status;
+}
+
+/* Copy object `i` of `src` to index `j` of `dst`, moving it down by `dy`
+ * rows of an image `w` pixels wide. Its pixels are written to `dst`'s pixel
+ * buffer starting at *k, which is advanced past them. */
+void copy_catalog_object(sep_catalog *dst, int j, sep_catalog *src, int i,
+			 int dy, int w, int *k)
+{
+  int n;
+
+  dst->thresh[j] = src->thresh[i];
+  dst->npix[j] = src->npix[i];
+  dst->tnpix[j] = src->tnpix[i];
+  dst->xmin[j] = src->xmin[i];
+  dst->xmax[j] = src->xmax[i];
+  dst->ymin[j] = src->ymin[i] + dy;
+  dst->ymax[j] = src->ymax[i] + dy;
+  dst->x[j] = src->x[i];
+  dst->y[j] = src->y[i] + dy;
+  dst->x2[j] = src->x2[i];
+  dst->y2[j] = src->y2[i];
+  dst->xy[j] = src->xy[i];
+  dst->errx2[j] = src->errx2[i];
+  dst->erry2[j] = src->erry2[i];
+  dst->errxy[j] = src->errxy[i];
+  dst->a[j] = src->a[i];
+  dst->b[j] = src->b[i];
+  dst->theta[j] = src->theta[i];
+  dst->cxx[j] = src->cxx[i];
+  dst->cyy[j] = src->cyy[i];
+  dst->cxy[j] = src->cxy[i];
+  dst->cflux[j] = src->cflux[i];
+  dst->flux[j] = src->flux[i];
+  dst->cpeak[j] = src->cpeak[i];
+  dst->peak[j] = src->peak[i];
+  dst->xcpeak[j] = src->xcpeak[i];
+  dst->ycpeak[j] = src->ycpeak[i] + dy;
+  dst->xpeak[j] = src->xpeak[i];
+  dst->ypeak[j] = src->ypeak[i] + dy;
+  dst->flag[j] = src->flag[i];
+
+  dst->pix[j] = dst->objectspix + *k;
+  for (n=0; n<src->npix[i]; n++)
+    dst->objectspix[(*k)++] = src->pix[i][n] + dy*w;
+}
+
+int sep_extract_rows(sep_image *image, int y0, int y1, int margin,
+		     float thresh, int thresh_type,
+		     int minarea, float *conv, int convw, int convh,
+		     int filter_type, int deblend_nthresh, double deblend_cont,
+		     int clean_flag, double clean_param,
+		     sep_catalog **catalog)
+{
+  array_converter   convert;
+  sep_image         strip;
+  sep_catalog       *stripcat, *cat;
+  double            yc;
+  int               ystart, yend, size, nobj, totnpix, i, j, k, status;
+  int               *keep;
+
+  stripcat = cat = NULL;
+  keep = NULL;
+  *catalog = NULL;
+
+  if (y0 < 0)
+    y0 = 0;
+  if (y1 > image->h)
+    y1 = image->h;
+  if (y1 <= y0)
+    {
+      QCALLOC(cat, sep_catalog, 1, status);
+      goto exit;
+    }
+  ystart = y0 - margin < 0 ? 0 : y0 - margin;
+  yend = y1 + margin > image->h ? image->h : y1 + margin;
+
+  /* the strip shares the image arrays, starting at row `ystart` */
+  strip = *image;
+  strip.h = yend - ystart;
+  if ((status = get_array_converter(image->dtype, &convert, &size))
+      != RETURN_OK)
+    return status;
+  strip.data = (BYTE *)image->data + (size_t)ystart*image->w*size;
+  if (image->noise)
+    {
+      if ((status = get_array_converter(image->ndtype, &convert, &size))
+	  != RETURN_OK)
+	return status;
+      strip.noise = (BYTE *)image->noise + (size_t)ystart*image->w*size;
+    }
+  if (image->mask)
+    {
+      if ((status = get_array_converter(image->mdtype, &convert, &size))
+	  != RETURN_OK)
+	return status;
+      strip.mask = (BYTE *)image->mask + (size_t)ystart*image->w*size;
+    }
+
+  status = sep_extract(&strip, thresh, thresh_type, minarea, conv, convw,
+		       convh, filter_type, deblend_nthresh, deblend_cont,
+		       clean_flag, clean_param, &stripcat);
+  if (status != RETURN_OK)
+    goto exit;
+
+  /* only keep the objects centered in our rows, the ones centered in the
+   * margins belong to the neighbouring strips */
+  QMALLOC(keep, int, stripcat->nobj > 0 ? stripcat->nobj : 1, status);
+  nobj = totnpix = 0;
+  for (i=0; i<stripcat->nobj; i++)
+    {
+      yc = stripcat->y[i] + ystart;
+      keep[i] = (yc >= y0 - 0.5 && yc < y1 - 0.5);
+      if (keep[i])
+	{
+	  nobj++;
+	  totnpix += stripcat->npix[i];
+	}
+    }
+
+  QCALLOC(cat, sep_catalog, 1, status);
+  if ((status = alloc_catalog_fields(cat, nobj, totnpix)) != RETURN_OK)
+    goto exit;
+  for (i=j=k=0; i<stripcat->nobj; i++)
+    if (keep[i])
+      copy_catalog_object(cat, j++, stripcat, i, ystart, image->w, &k);
+
+ exit:
+  sep_catalog_free(stripcat);
+  free(keep);
+  if (status != RETURN_OK)
+    {
+      sep_catalog_free(cat);
+      cat = NULL;
+    }
+  *catalog = cat;
+  return status;
+}
+
+int sep_catalog_merge(sep_catalog **catalogs, int n, sep_catalog **merged)
+{
+  sep_catalog *cat;
+  int         nobj, totnpix, c, i, j, k, status;
+
+  status = RETURN_OK;
+  cat = NULL;
+
+  nobj = totnpix = 0;
+  for (c=0; c<n; c++)
+    if (catalogs[c])
+      {
+	nobj += catalogs[c]->nobj;
+	for (i=0; i<catalogs[c]->nobj; i++)
+	  totnpix += catalogs[c]->npix[i];
+      }
+
+  QCALLOC(cat, sep_catalog, 1, status);
+  if ((status = alloc_catalog_fields(cat, nobj, totnpix)) != RETURN_OK)
+    goto exit;
+
+  j = k = 0;
+  for (c=0; c<n; c++)
+    if (catalogs[c])
+      for (i=0; i<catalogs[c]->nobj; i++)
+	copy_catalog_object(cat, j++, catalogs[c], i, 0, 0, &k);
+
+ exit:
+  if (status != RETURN_OK)
+    {
+      sep_catalog_free(cat);
+      cat = NULL;
+    }
+  *merged = cat;
+  return status;
+}
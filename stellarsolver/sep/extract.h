@@ -33,9 +33,9 @@
 
 /* plist-related macros */
 #define	PLIST(ptr, elem)	(((pbliststruct *)(ptr))->elem)
-#define	PLISTEXIST(elem)	(plistexist_##elem)
-#define	PLISTPIX(ptr, elem)	(*((PIXTYPE *)((ptr)+plistoff_##elem)))
-#define	PLISTFLAG(ptr, elem)	(*((FLAGTYPE *)((ptr)+plistoff_##elem)))
+#define	PLISTEXIST(ctx, elem)	((ctx)->plistexist_##elem)
+#define	PLISTPIX(ctx, ptr, elem) (*((PIXTYPE *)((ptr)+(ctx)->plistoff_##elem)))
+#define	PLISTFLAG(ctx, ptr, elem) (*((FLAGTYPE *)((ptr)+(ctx)->plistoff_##elem)))
 
 /* Extraction status */
 typedef	enum {COMPLETE, INCOMPLETE, NONOBJECT, OBJECT} pixstatus;
@@ -75,11 +75,6 @@ typedef struct
 } arraybuffer;
 
 
-/* globals */
-extern int plistexist_cdvalue, plistexist_thresh, plistexist_var;
-extern int plistoff_value, plistoff_cdvalue, plistoff_thresh, plistoff_var;
-extern int plistsize;
-
 typedef struct
 {
   /* thresholds */
@@ -131,29 +126,55 @@ typedef struct
   PIXTYPE       thresh;   /* detection threshold */
 } objliststruct;
 
-
-int analysemthresh(int objnb, objliststruct *objlist, int minarea,
-		   PIXTYPE thresh);
-void preanalyse(int, objliststruct *);
-void analyse(int, objliststruct *, int, double);
-
-int  lutzalloc(int, int);
-void lutzfree(void);
-int  lutz(pliststruct *plistin,
+/* State of one call to sep_extract(). Nothing used during extraction lives in
+ * static or global variables, so several extractions can run at the same
+ * time in different threads. */
+typedef struct
+{
+  /* pixel list layout, set by plistinit() */
+  int plistexist_cdvalue, plistexist_thresh, plistexist_var;
+  int plistoff_value, plistoff_cdvalue, plistoff_thresh, plistoff_var;
+  int plistsize;
+
+  /* buffers for lutz() */
+  infostruct  *info, *store;
+  char        *marker;
+  pixstatus   *psstack;
+  int         *start, *end, *discan;
+  int         xmin, ymin, xmax, ymax;
+
+  /* buffers for deblend() */
+  objliststruct *objlist;
+  short         *son, *ok;
+
+  /* state of the random number generator used by gatherup() */
+  unsigned int randseed;
+} extractctx;
+
+
+int analysemthresh(extractctx *ctx, int objnb, objliststruct *objlist,
+		   int minarea, PIXTYPE thresh);
+void preanalyse(extractctx *, int, objliststruct *);
+void analyse(extractctx *, int, objliststruct *, int, double);
+
+int  lutzalloc(extractctx *, int, int);
+void lutzfree(extractctx *);
+int  lutz(extractctx *ctx, pliststruct *plistin,
 	  int *objrootsubmap, int subx, int suby, int subw,
 	  objstruct *objparent, objliststruct *objlist, int minarea);
 
 void update(infostruct *, infostruct *, pliststruct *);
 
-int  allocdeblend(int);
-void freedeblend(void);
-int  deblend(objliststruct *, int, objliststruct *, int, double, int);
+int  allocdeblend(extractctx *, int);
+void freedeblend(extractctx *);
+int  deblend(extractctx *, objliststruct *, int, objliststruct *, int, double,
+	     int);
 
 /*int addobjshallow(objstruct *, objliststruct *);
 int rmobjshallow(int, objliststruct *);
 void mergeobjshallow(objstruct *, objstruct *);
 */
-int addobjdeep(int, objliststruct *, objliststruct *);
+int addobjdeep(extractctx *, int, objliststruct *, objliststruct *);
 
 int convolve(arraybuffer *buf, int y, float *conv, int convw, int convh,
              PIXTYPE *out);
@@ -32,45 +32,37 @@
 
 #define	NOBJ 256  /* starting number of obj. */
 
-void lutzsort(infostruct *, objliststruct *);
-
-/*------------------------- Static buffers for lutz() -----------------------*/
-
-static infostruct  *info=NULL, *store=NULL;
-static char	   *marker=NULL;
-static pixstatus   *psstack=NULL;
-static int         *start=NULL, *end=NULL, *discan=NULL;
-static int         xmin, ymin, xmax, ymax;
+void lutzsort(extractctx *, infostruct *, objliststruct *);
 
 
 /******************************* lutzalloc ***********************************/
 /*
 Allocate once for all memory space for buffers used by lutz().
 */
-int lutzalloc(int width, int height)
+int lutzalloc(extractctx *ctx, int width, int height)
 {
   int *discant;
   int stacksize, i, status=RETURN_OK;
 
   stacksize = width+1;
-  xmin = ymin = 0;
-  xmax = width-1;
-  ymax = height-1;
-  QMALLOC(info, infostruct, stacksize, status);
-  QMALLOC(store, infostruct, stacksize, status);
-  QMALLOC(marker, char, stacksize, status);
-  QMALLOC(psstack, pixstatus, stacksize, status);
-  QMALLOC(start, int, stacksize, status);
-  QMALLOC(end, int, stacksize, status);
-  QMALLOC(discan, int, stacksize, status);
-  discant = discan;
+  ctx->xmin = ctx->ymin = 0;
+  ctx->xmax = width-1;
+  ctx->ymax = height-1;
+  QMALLOC(ctx->info, infostruct, stacksize, status);
+  QMALLOC(ctx->store, infostruct, stacksize, status);
+  QMALLOC(ctx->marker, char, stacksize, status);
+  QMALLOC(ctx->psstack, pixstatus, stacksize, status);
+  QMALLOC(ctx->start, int, stacksize, status);
+  QMALLOC(ctx->end, int, stacksize, status);
+  QMALLOC(ctx->discan, int, stacksize, status);
+  discant = ctx->discan;
   for (i=stacksize; i--;)
     *(discant++) = -1;
 
   return status;
 
  exit:
-  lutzfree();
+  lutzfree(ctx);
 
   return status;
 }
@@ -79,22 +71,22 @@ int lutzalloc(int width, int height)
 /*
 Free once for all memory space for buffers used by lutz().
 */
-void lutzfree()
+void lutzfree(extractctx *ctx)
 {
-  free(discan);
-  discan = NULL;
-  free(info);
-  info = NULL;
-  free(store);
-  store = NULL;
-  free(marker);
-  marker = NULL;
-  free(psstack);
-  psstack = NULL;
-  free(start);
-  start = NULL;
-  free(end);
-  end = NULL;
+  free(ctx->discan);
+  ctx->discan = NULL;
+  free(ctx->info);
+  ctx->info = NULL;
+  free(ctx->store);
+  ctx->store = NULL;
+  free(ctx->marker);
+  ctx->marker = NULL;
+  free(ctx->psstack);
+  ctx->psstack = NULL;
+  free(ctx->start);
+  ctx->start = NULL;
+  free(ctx->end);
+  ctx->end = NULL;
   return;
 }
 
@@ -104,11 +96,16 @@ void lutzfree()
 C implementation of R.K LUTZ' algorithm for the extraction of 8-connected pi-
 xels in an image
 */
-int lutz(pliststruct *plistin,
+int lutz(extractctx *ctx, pliststruct *plistin,
 	 int *objrootsubmap, int subx, int suby, int subw,
 	 objstruct *objparent, objliststruct *objlist, int minarea)
 {
-  static infostruct	curpixinfo,initinfo;
+  infostruct		curpixinfo,initinfo;
+  infostruct		*info = ctx->info, *store = ctx->store;
+  char			*marker = ctx->marker;
+  pixstatus		*psstack = ctx->psstack;
+  int			*start = ctx->start, *end = ctx->end;
+  int			plistsize = ctx->plistsize;
   objstruct		*obj;
   pliststruct		*plist,*pixel, *plistint;
   
@@ -169,15 +166,16 @@ int lutz(pliststruct *plistin,
 
   objlist->nobj = 0;
   co = pstop = 0;
+  curpixinfo = initinfo;
   curpixinfo.pixnb = 1;
 
   for (yl=sty; yl<=eny; yl++, iscan += step)
     {
       ps = COMPLETE;
       cs = NONOBJECT;
-      trunflag = (yl==0 || yl==ymax) ? SEP_OBJ_TRUNC : 0;
+      trunflag = (yl==0 || yl==ctx->ymax) ? SEP_OBJ_TRUNC : 0;
       if (yl==eny)
-	iscan = discan;
+	iscan = ctx->discan;
 
       for (xl=stx; xl<=enx; xl++)
 	{
@@ -189,11 +187,11 @@ int lutz(pliststruct *plistin,
 	    {
 	      curpixinfo.flag = trunflag;
 	      plistint = plistin+inewsymbol;
-	      luflag = (PLISTPIX(plistint, cdvalue) > thresh?1:0);
+	      luflag = (PLISTPIX(ctx, plistint, cdvalue) > thresh?1:0);
 	    }
 	  if (luflag)
 	    {
-	      if (xl==0 || xl==xmax)
+	      if (xl==0 || xl==ctx->xmax)
 		curpixinfo.flag |= SEP_OBJ_TRUNC;
 	      memcpy(pixel, plistint, (size_t)plistsize);
 	      PLIST(pixel, nextpix) = -1;
@@ -275,7 +273,7 @@ int lutz(pliststruct *plistin,
 				    out = MEMORY_ALLOC_ERROR;
 				    goto exit_lutz;
 				  }
-			      lutzsort(&info[co], objlist);
+			      lutzsort(ctx, &info[co], objlist);
 			    }
 			}
 		      else
@@ -347,7 +345,7 @@ int lutz(pliststruct *plistin,
 /*
 Add an object to the object list based on info (pixel info)
 */
-void  lutzsort(infostruct *info, objliststruct *objlist)
+void  lutzsort(extractctx *ctx, infostruct *info, objliststruct *objlist)
 {
   objstruct *obj = objlist->obj+objlist->nobj;
 
@@ -357,7 +355,7 @@ void  lutzsort(infostruct *info, objliststruct *objlist)
   obj->flag = info->flag;
   objlist->npix += info->pixnb;
   
-  preanalyse(objlist->nobj, objlist);
+  preanalyse(ctx, objlist->nobj, objlist);
   
   objlist->nobj++;
   
@@ -22,6 +22,7 @@
 
 /* datatype codes */
 #define SEP_TBYTE        11  /* 8-bit unsigned byte */
+#define SEP_TUSHORT      20  /* 16-bit unsigned short */
 #define SEP_TINT         31  /* native int type */
 #define SEP_TFLOAT       42
 #define SEP_TDOUBLE      82
@@ -229,10 +230,47 @@ int sep_extract(sep_image *image,
 
 
 
+/* sep_extract_rows()
+ *
+ * Same as sep_extract(), but only returns the objects whose barycenter falls
+ * in rows [y0, y1) of the image. Detection also looks at `margin` rows above
+ * and below, so objects crossing y0 or y1 are measured completely as long as
+ * they are smaller than the margin. Coordinates and pixel indices in the
+ * catalog are those of the full image.
+ *
+ * sep_extract() keeps no global state, so a large image can be extracted in
+ * parallel by calling this on adjacent row ranges from several threads and
+ * joining the results with sep_catalog_merge().
+ */
+int sep_extract_rows(sep_image *image,
+		     int y0, int y1,       /* rows to report objects for       */
+		     int margin,           /* extra rows used for detection    */
+		     float thresh, int thresh_type,
+		     int minarea, float *conv, int convw, int convh,
+		     int filter_type, int deblend_nthresh, double deblend_cont,
+		     int clean_flag, double clean_param,
+		     sep_catalog **catalog);
+
+/* sep_catalog_merge()
+ *
+ * Join `n` catalogs (NULL entries are skipped) into a new catalog, in order.
+ * The input catalogs are not modified and must still be freed.
+ */
+int sep_catalog_merge(sep_catalog **catalogs, int n, sep_catalog **merged);
+
 /* set and get the size of the pixel stack used in extract() */
 void sep_set_extract_pixstack(size_t val);
 size_t sep_get_extract_pixstack(void);
 
+/* sep_set_buffer_functions()
+ *
+ * Set the functions used to allocate and free the large working buffers of
+ * sep_extract(): the pixel stack and the line buffers. They must be thread
+ * safe. Passing NULL for either goes back to malloc() and free().
+ */
+void sep_set_buffer_functions(void *(*alloc_func)(size_t),
+                              void (*free_func)(void *));
+
 /* free memory associated with a catalog */
 void sep_catalog_free(sep_catalog *catalog);
 
@@ -389,6 +427,24 @@ int sep_ellipse_axes(double cxx, double cyy, double cxy,
 void sep_ellipse_coeffs(double a, double b, double theta,
 			double *cxx, double *cyy, double *cxy);
 
+/*-------------------------- type conversion --------------------------------*/
+
+/* sep_convert_array()
+ *
+ * Convert `n` pixels of type `dtype` from `src` to float in `dst`, using
+ * the vector instructions of the CPU when available. Useful for building the
+ * float image passed to the other routines one line at a time.
+ */
+int sep_convert_array(const void *src, int dtype, int n, float *dst);
+
+/* sep_bin_add_array()
+ *
+ * Add the sum of each group of `binning` neighbouring pixels in `src` to the
+ * `n` pixels of `dst`, so `src` holds `n * binning` pixels. Calling it once
+ * for each of `binning` lines bins an image. 2x2 binning is vectorized.
+ */
+void sep_bin_add_array(const float *src, int binning, int n, float *dst);
+
 /*----------------------- info & error messaging ----------------------------*/
 
 /* sep_version_string : library version (e.g., "0.2.0") */
@@ -79,7 +79,22 @@ typedef void (*array_writer)(float *ptr, int n, void *target);
 float fqmedian(float *ra, int n);
 void put_errdetail(char *errtext);
 
+/* allocate and free the working buffers, see sep_set_buffer_functions() */
+void *sep_buffer_alloc(size_t size);
+void sep_buffer_free(void *ptr);
+
 int get_converter(int dtype, converter *f, int *size);
 int get_array_converter(int dtype, array_converter *f, int *size);
 int get_array_writer(int dtype, array_writer *f, int *size);
 int get_array_subtractor(int dtype, array_writer *f, int *size);
+
+/* vectorized kernels, see simd.c */
+void simd_scale_add(float *dst, const float *src, float k, int n);
+void simd_subtract(float *dst, const float *src, int n);
+void simd_bin_add(float *dst, const float *src, int d, int n);
+void simd_convert_byt(const BYTE *src, int n, float *dst);
+void simd_convert_ush(const unsigned short *src, int n, float *dst);
+void simd_convert_int(const int *src, int n, float *dst);
+void simd_bkg_interp(const float *dx, const float *cdx, const float *dx3,
+                     const float *cdx3, float blo, float dblo, float bhi,
+                     float dbhi, int n, float *line, int subtract);
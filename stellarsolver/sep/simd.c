@@ -0,0 +1,525 @@
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+*
+* This file is part of SEP
+*
+* Copyright 2014 SEP developers
+*
+* SEP is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* SEP is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with SEP.  If not, see <http://www.gnu.org/licenses/>.
+*
+*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
+
+/* Vectorized inner loops for the float pixel pipeline (type conversion,
+ * background interpolation & subtraction, convolution).
+ *
+ * The instruction set is picked at runtime: AVX2 when the CPU has it, else
+ * SSE2 on x86, NEON on ARM, or plain C. Every kernel uses a separate multiply
+ * and add (never FMA) in the same order as the scalar code, so all paths
+ * give bitwise identical results. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "sep.h"
+#include "sepcore.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_AVX2
+#include <immintrin.h>
+#define AVX2_FUNC __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#define SIMD_LEVEL_NONE 0
+#define SIMD_LEVEL_SSE2 1
+#define SIMD_LEVEL_AVX2 2
+#define SIMD_LEVEL_NEON 3
+
+static int simd_level = -1;
+
+/* Detected once; a race between threads just stores the same value twice */
+static int get_simd_level(void)
+{
+  int level;
+
+  if (simd_level >= 0)
+    return simd_level;
+
+  level = SIMD_LEVEL_NONE;
+#if defined(SIMD_SSE2)
+  level = SIMD_LEVEL_SSE2;
+#if defined(SIMD_AVX2)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    level = SIMD_LEVEL_AVX2;
+#endif
+#elif defined(SIMD_NEON)
+  level = SIMD_LEVEL_NEON;
+#endif
+
+  simd_level = level;
+  return level;
+}
+
+/*****************************************************************************/
+/* dst[i] += k * src[i] */
+
+#ifdef SIMD_AVX2
+AVX2_FUNC static int scale_add_avx2(float *dst, const float *src, float k,
+                                    int n)
+{
+  __m256 vk = _mm256_set1_ps(k);
+  int i;
+
+  for (i=0; i+8<=n; i+=8)
+    _mm256_storeu_ps(dst+i, _mm256_add_ps(_mm256_loadu_ps(dst+i),
+			  _mm256_mul_ps(vk, _mm256_loadu_ps(src+i))));
+  return i;
+}
+#endif
+
+void simd_scale_add(float *dst, const float *src, float k, int n)
+{
+  int i = 0;
+
+  switch (get_simd_level())
+    {
+#ifdef SIMD_AVX2
+    case SIMD_LEVEL_AVX2:
+      i = scale_add_avx2(dst, src, k, n);
+      break;
+#endif
+#ifdef SIMD_SSE2
+    case SIMD_LEVEL_SSE2:
+      {
+	__m128 vk = _mm_set1_ps(k);
+	for (; i+4<=n; i+=4)
+	  _mm_storeu_ps(dst+i, _mm_add_ps(_mm_loadu_ps(dst+i),
+					  _mm_mul_ps(vk, _mm_loadu_ps(src+i))));
+      }
+      break;
+#endif
+#ifdef SIMD_NEON
+    case SIMD_LEVEL_NEON:
+      {
+	float32x4_t vk = vdupq_n_f32(k);
+	for (; i+4<=n; i+=4)
+	  vst1q_f32(dst+i, vaddq_f32(vld1q_f32(dst+i),
+				     vmulq_f32(vk, vld1q_f32(src+i))));
+      }
+      break;
+#endif
+    default:
+      break;
+    }
+
+  for (; i<n; i++)
+    dst[i] += k * src[i];
+}
+
+/*****************************************************************************/
+/* dst[i] -= src[i] */
+
+#ifdef SIMD_AVX2
+AVX2_FUNC static int subtract_avx2(float *dst, const float *src, int n)
+{
+  int i;
+
+  for (i=0; i+8<=n; i+=8)
+    _mm256_storeu_ps(dst+i, _mm256_sub_ps(_mm256_loadu_ps(dst+i),
+					  _mm256_loadu_ps(src+i)));
+  return i;
+}
+#endif
+
+void simd_subtract(float *dst, const float *src, int n)
+{
+  int i = 0;
+
+  switch (get_simd_level())
+    {
+#ifdef SIMD_AVX2
+    case SIMD_LEVEL_AVX2:
+      i = subtract_avx2(dst, src, n);
+      break;
+#endif
+#ifdef SIMD_SSE2
+    case SIMD_LEVEL_SSE2:
+      for (; i+4<=n; i+=4)
+	_mm_storeu_ps(dst+i, _mm_sub_ps(_mm_loadu_ps(dst+i),
+					_mm_loadu_ps(src+i)));
+      break;
+#endif
+#ifdef SIMD_NEON
+    case SIMD_LEVEL_NEON:
+      for (; i+4<=n; i+=4)
+	vst1q_f32(dst+i, vsubq_f32(vld1q_f32(dst+i), vld1q_f32(src+i)));
+      break;
+#endif
+    default:
+      break;
+    }
+
+  for (; i<n; i++)
+    dst[i] -= src[i];
+}
+
+/*****************************************************************************/
+/* dst[i] += src[d*i] + src[d*i+1] + ... + src[d*i+d-1]
+ * This bins a line of pixels by d. Only 2x2 binning, which is the common
+ * one, is vectorized. */
+
+#ifdef SIMD_AVX2
+AVX2_FUNC static int bin2_add_avx2(float *dst, const float *src, int n)
+{
+  int i;
+
+  for (i=0; i+8<=n; i+=8)
+    {
+      __m256 a = _mm256_loadu_ps(src+2*i);
+      __m256 b = _mm256_loadu_ps(src+2*i+8);
+      /* the shuffle works within each 128 bit lane, the permute puts the
+       * lanes back in order */
+      __m256 even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+				_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0))), 0xD8));
+      __m256 odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+				_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1))), 0xD8));
+      _mm256_storeu_ps(dst+i, _mm256_add_ps(_mm256_loadu_ps(dst+i),
+					    _mm256_add_ps(even, odd)));
+    }
+  return i;
+}
+#endif
+
+void simd_bin_add(float *dst, const float *src, int d, int n)
+{
+  int i = 0, k;
+  float sum;
+
+  if (d == 2)
+    switch (get_simd_level())
+      {
+#ifdef SIMD_AVX2
+      case SIMD_LEVEL_AVX2:
+	i = bin2_add_avx2(dst, src, n);
+	break;
+#endif
+#ifdef SIMD_SSE2
+      case SIMD_LEVEL_SSE2:
+	for (; i+4<=n; i+=4)
+	  {
+	    __m128 a = _mm_loadu_ps(src+2*i);
+	    __m128 b = _mm_loadu_ps(src+2*i+4);
+	    __m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+	    __m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1));
+	    _mm_storeu_ps(dst+i, _mm_add_ps(_mm_loadu_ps(dst+i),
+					    _mm_add_ps(even, odd)));
+	  }
+	break;
+#endif
+#ifdef SIMD_NEON
+      case SIMD_LEVEL_NEON:
+	for (; i+4<=n; i+=4)
+	  {
+	    float32x4x2_t p = vld2q_f32(src+2*i);
+	    vst1q_f32(dst+i, vaddq_f32(vld1q_f32(dst+i),
+				       vaddq_f32(p.val[0], p.val[1])));
+	  }
+	break;
+#endif
+      default:
+	break;
+      }
+
+  for (; i<n; i++)
+    {
+      sum = src[d*i];
+      for (k=1; k<d; k++)
+	sum += src[d*i+k];
+      dst[i] += sum;
+    }
+}
+
+/*****************************************************************************/
+/* Integer to float conversion. All of these are exact (or, for int, rounded
+ * to nearest just like a C cast). */
+
+#ifdef SIMD_AVX2
+AVX2_FUNC static int convert_byt_avx2(const BYTE *src, int n, float *dst)
+{
+  int i;
+
+  for (i=0; i+8<=n; i+=8)
+    {
+      __m128i b = _mm_loadl_epi64((const __m128i *)(src+i));
+      _mm256_storeu_ps(dst+i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b)));
+    }
+  return i;
+}
+
+AVX2_FUNC static int convert_ush_avx2(const unsigned short *src, int n,
+                                      float *dst)
+{
+  int i;
+
+  for (i=0; i+8<=n; i+=8)
+    {
+      __m128i s = _mm_loadu_si128((const __m128i *)(src+i));
+      _mm256_storeu_ps(dst+i, _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(s)));
+    }
+  return i;
+}
+
+AVX2_FUNC static int convert_int_avx2(const int *src, int n, float *dst)
+{
+  int i;
+
+  for (i=0; i+8<=n; i+=8)
+    _mm256_storeu_ps(dst+i, _mm256_cvtepi32_ps(
+			  _mm256_loadu_si256((const __m256i *)(src+i))));
+  return i;
+}
+#endif
+
+void simd_convert_byt(const BYTE *src, int n, float *dst)
+{
+  int i = 0;
+
+  switch (get_simd_level())
+    {
+#ifdef SIMD_AVX2
+    case SIMD_LEVEL_AVX2:
+      i = convert_byt_avx2(src, n, dst);
+      break;
+#endif
+#ifdef SIMD_SSE2
+    case SIMD_LEVEL_SSE2:
+      {
+	__m128i zero = _mm_setzero_si128();
+	for (; i+16<=n; i+=16)
+	  {
+	    __m128i b = _mm_loadu_si128((const __m128i *)(src+i));
+	    __m128i lo = _mm_unpacklo_epi8(b, zero);
+	    __m128i hi = _mm_unpackhi_epi8(b, zero);
+	    _mm_storeu_ps(dst+i,
+			  _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+	    _mm_storeu_ps(dst+i+4,
+			  _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+	    _mm_storeu_ps(dst+i+8,
+			  _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+	    _mm_storeu_ps(dst+i+12,
+			  _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+	  }
+      }
+      break;
+#endif
+#ifdef SIMD_NEON
+    case SIMD_LEVEL_NEON:
+      for (; i+8<=n; i+=8)
+	{
+	  uint16x8_t s = vmovl_u8(vld1_u8(src+i));
+	  vst1q_f32(dst+i, vcvtq_f32_u32(vmovl_u16(vget_low_u16(s))));
+	  vst1q_f32(dst+i+4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(s))));
+	}
+      break;
+#endif
+    default:
+      break;
+    }
+
+  for (; i<n; i++)
+    dst[i] = src[i];
+}
+
+void simd_convert_ush(const unsigned short *src, int n, float *dst)
+{
+  int i = 0;
+
+  switch (get_simd_level())
+    {
+#ifdef SIMD_AVX2
+    case SIMD_LEVEL_AVX2:
+      i = convert_ush_avx2(src, n, dst);
+      break;
+#endif
+#ifdef SIMD_SSE2
+    case SIMD_LEVEL_SSE2:
+      {
+	__m128i zero = _mm_setzero_si128();
+	for (; i+8<=n; i+=8)
+	  {
+	    __m128i s = _mm_loadu_si128((const __m128i *)(src+i));
+	    _mm_storeu_ps(dst+i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(s, zero)));
+	    _mm_storeu_ps(dst+i+4,
+			  _mm_cvtepi32_ps(_mm_unpackhi_epi16(s, zero)));
+	  }
+      }
+      break;
+#endif
+#ifdef SIMD_NEON
+    case SIMD_LEVEL_NEON:
+      for (; i+8<=n; i+=8)
+	{
+	  uint16x8_t s = vld1q_u16(src+i);
+	  vst1q_f32(dst+i, vcvtq_f32_u32(vmovl_u16(vget_low_u16(s))));
+	  vst1q_f32(dst+i+4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(s))));
+	}
+      break;
+#endif
+    default:
+      break;
+    }
+
+  for (; i<n; i++)
+    dst[i] = src[i];
+}
+
+void simd_convert_int(const int *src, int n, float *dst)
+{
+  int i = 0;
+
+  switch (get_simd_level())
+    {
+#ifdef SIMD_AVX2
+    case SIMD_LEVEL_AVX2:
+      i = convert_int_avx2(src, n, dst);
+      break;
+#endif
+#ifdef SIMD_SSE2
+    case SIMD_LEVEL_SSE2:
+      for (; i+4<=n; i+=4)
+	_mm_storeu_ps(dst+i,
+		      _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src+i))));
+      break;
+#endif
+#ifdef SIMD_NEON
+    case SIMD_LEVEL_NEON:
+      for (; i+4<=n; i+=4)
+	vst1q_f32(dst+i, vcvtq_f32_s32(vld1q_s32(src+i)));
+      break;
+#endif
+    default:
+      break;
+    }
+
+  for (; i<n; i++)
+    dst[i] = (float)src[i];
+}
+
+/*****************************************************************************/
+/* Bicubic spline interpolation of the background along x for a run of pixels
+ * that share the same pair of background nodes:
+ *
+ *   v = cdx*(blo + cdx3*dblo) + dx*(bhi + dx3*dbhi)
+ *
+ * where cdx = 1-dx, cdx3 = cdx*cdx-1 and dx3 = dx*dx-1 come from per-column
+ * tables. The result is written to line, or subtracted from it when
+ * `subtract` is set, so that background subtraction needs only one pass. */
+
+#ifdef SIMD_AVX2
+AVX2_FUNC static int bkg_interp_avx2(const float *dx, const float *cdx,
+                                     const float *dx3, const float *cdx3,
+                                     float blo, float dblo, float bhi,
+                                     float dbhi, int n, float *line,
+                                     int subtract)
+{
+  __m256 vblo = _mm256_set1_ps(blo), vdblo = _mm256_set1_ps(dblo);
+  __m256 vbhi = _mm256_set1_ps(bhi), vdbhi = _mm256_set1_ps(dbhi);
+  __m256 lo, hi, v;
+  int i;
+
+  for (i=0; i+8<=n; i+=8)
+    {
+      lo = _mm256_add_ps(vblo, _mm256_mul_ps(_mm256_loadu_ps(cdx3+i), vdblo));
+      hi = _mm256_add_ps(vbhi, _mm256_mul_ps(_mm256_loadu_ps(dx3+i), vdbhi));
+      v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(cdx+i), lo),
+			_mm256_mul_ps(_mm256_loadu_ps(dx+i), hi));
+      if (subtract)
+	v = _mm256_sub_ps(_mm256_loadu_ps(line+i), v);
+      _mm256_storeu_ps(line+i, v);
+    }
+  return i;
+}
+#endif
+
+void simd_bkg_interp(const float *dx, const float *cdx, const float *dx3,
+                     const float *cdx3, float blo, float dblo, float bhi,
+                     float dbhi, int n, float *line, int subtract)
+{
+  float v;
+  int i = 0;
+
+  switch (get_simd_level())
+    {
+#ifdef SIMD_AVX2
+    case SIMD_LEVEL_AVX2:
+      i = bkg_interp_avx2(dx, cdx, dx3, cdx3, blo, dblo, bhi, dbhi, n, line,
+			  subtract);
+      break;
+#endif
+#ifdef SIMD_SSE2
+    case SIMD_LEVEL_SSE2:
+      {
+	__m128 vblo = _mm_set1_ps(blo), vdblo = _mm_set1_ps(dblo);
+	__m128 vbhi = _mm_set1_ps(bhi), vdbhi = _mm_set1_ps(dbhi);
+	__m128 lo, hi, vv;
+	for (; i+4<=n; i+=4)
+	  {
+	    lo = _mm_add_ps(vblo, _mm_mul_ps(_mm_loadu_ps(cdx3+i), vdblo));
+	    hi = _mm_add_ps(vbhi, _mm_mul_ps(_mm_loadu_ps(dx3+i), vdbhi));
+	    vv = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(cdx+i), lo),
+			    _mm_mul_ps(_mm_loadu_ps(dx+i), hi));
+	    if (subtract)
+	      vv = _mm_sub_ps(_mm_loadu_ps(line+i), vv);
+	    _mm_storeu_ps(line+i, vv);
+	  }
+      }
+      break;
+#endif
+#ifdef SIMD_NEON
+    case SIMD_LEVEL_NEON:
+      {
+	float32x4_t vblo = vdupq_n_f32(blo), vdblo = vdupq_n_f32(dblo);
+	float32x4_t vbhi = vdupq_n_f32(bhi), vdbhi = vdupq_n_f32(dbhi);
+	float32x4_t lo, hi, vv;
+	for (; i+4<=n; i+=4)
+	  {
+	    lo = vaddq_f32(vblo, vmulq_f32(vld1q_f32(cdx3+i), vdblo));
+	    hi = vaddq_f32(vbhi, vmulq_f32(vld1q_f32(dx3+i), vdbhi));
+	    vv = vaddq_f32(vmulq_f32(vld1q_f32(cdx+i), lo),
+			   vmulq_f32(vld1q_f32(dx+i), hi));
+	    if (subtract)
+	      vv = vsubq_f32(vld1q_f32(line+i), vv);
+	    vst1q_f32(line+i, vv);
+	  }
+      }
+      break;
+#endif
+    default:
+      break;
+    }
+
+  for (; i<n; i++)
+    {
+      v = cdx[i]*(blo+cdx3[i]*dblo) + dx[i]*(bhi+dx3[i]*dbhi);
+      if (subtract)
+	line[i] -= v;
+      else
+	line[i] = v;
+    }
+}
@@ -25,7 +25,19 @@
 #define DETAILSIZE 512
 
 char *sep_version_string = "0.6.0";
-static char _errdetail_buffer[DETAILSIZE] = "";
+/* the error details are kept per thread, so that concurrent extractions
+ * don't overwrite each other's messages */
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+static THREAD_LOCAL char _errdetail_buffer[DETAILSIZE] = "";
+
+/* functions used for the large working buffers, see sep_set_buffer_functions */
+static void *(*_buffer_alloc)(size_t) = malloc;
+static void (*_buffer_free)(void *) = free;
 
 /****************************************************************************/
 /* data type conversion mechanics for runtime type conversion */
@@ -103,18 +115,17 @@ void convert_array_dbl(void *ptr, int n, PIXTYPE *target)
 
 void convert_array_int(void *ptr, int n, PIXTYPE *target)
 {
-  int *source = (int *)ptr;
-  int i;
-  for (i=0; i<n; i++, source++)
-    target[i] = *source;
+  simd_convert_int((int *)ptr, n, target);
+}
+
+void convert_array_ush(void *ptr, int n, PIXTYPE *target)
+{
+  simd_convert_ush((unsigned short *)ptr, n, target);
 }
 
 void convert_array_byt(void *ptr, int n, PIXTYPE *target)
 {
-  BYTE *source = (BYTE *)ptr;
-  int i;
-  for (i=0; i<n; i++, source++)
-    target[i] = *source;
+  simd_convert_byt((BYTE *)ptr, n, target);
 }
 
 int get_array_converter(int dtype, array_converter *f, int *size)
@@ -131,6 +142,11 @@ int get_array_converter(int dtype, array_converter *f, int *size)
       *f = convert_array_byt;
       *size = sizeof(BYTE);
     }
+  else if (dtype == SEP_TUSHORT)
+    {
+      *f = convert_array_ush;
+      *size = sizeof(unsigned short);
+    }
   else if (dtype == SEP_TINT)
     {
       *f = convert_array_int;
@@ -151,6 +167,22 @@ int get_array_converter(int dtype, array_converter *f, int *size)
 }
 
 
+int sep_convert_array(const void *src, int dtype, int n, float *dst)
+{
+  array_converter convert;
+  int size, status;
+
+  status = get_array_converter(dtype, &convert, &size);
+  if (status == RETURN_OK)
+    convert((void *)src, n, dst);
+  return status;
+}
+
+void sep_bin_add_array(const float *src, int binning, int n, float *dst)
+{
+  simd_bin_add(dst, src, binning, n);
+}
+
 /****************************************************************************/
 /* Copy a float array to various sorts of arrays */
 
@@ -206,10 +238,7 @@ void subtract_array_dbl(float *ptr, int n, void *target)
 
 void subtract_array_flt(float *ptr, int n, void *target)
 {
-  float *t = (float *)target;
-  int i;
-  for (i=0; i<n; i++, ptr++)
-    t[i] -= *ptr;
+  simd_subtract((float *)target, ptr, n);
 }
 
 void subtract_array_int(float *ptr, int n, void *target)
@@ -314,6 +343,35 @@ void put_errdetail(char *errtext)
 
 }
 
+/*****************************************************************************/
+/* Working buffers */
+
+void sep_set_buffer_functions(void *(*alloc_func)(size_t),
+                              void (*free_func)(void *))
+{
+  if (alloc_func && free_func)
+    {
+      _buffer_alloc = alloc_func;
+      _buffer_free = free_func;
+    }
+  else
+    {
+      _buffer_alloc = malloc;
+      _buffer_free = free;
+    }
+}
+
+void *sep_buffer_alloc(size_t size)
+{
+  return _buffer_alloc(size);
+}
+
+void sep_buffer_free(void *ptr)
+{
+  if (ptr)
+    _buffer_free(ptr);
+}
+
 /*****************************************************************************/
 /* Array median */
 
@@ -47,12 +47,70 @@ void SextractorSolver::setSearchPositionInDegrees(double ra, double dec)
     search_dec = dec;
 }
 
+//This sets a WCS for the full size image that the solver should verify before searching
+//If the search position or scale are not set, the search is limited to maxDrift degrees around the hint and to the scale of the hint.
+void SextractorSolver::setSolutionHint(const sip_t &wcs, double maxDrift)
+{
+    use_hint = true;
+    hintWCS = wcs;
+    hintDrift = maxDrift;
+}
+
 void SextractorSolver::startProcess()
 {
+    resetTokens();
     start();
 }
 
 void SextractorSolver::executeProcess()
 {
+    resetTokens();
     run();
 }
+
+//A solve that was solved by a child solver before must not stop the next one, but an abort that came before the process started still counts.
+void SextractorSolver::resetTokens()
+{
+    if(isChildSolver)
+        return;
+    cancelToken->store(wasAborted ? 1 : 0);
+    solvedToken->store(0);
+}
+
+FITSImage::wcs_point *SextractorSolver::getWCSCoord()
+{
+    WCSData wcsData = getWCSData();
+    if(!wcsData.isValid())
+    {
+        emit logOutput("There is no WCS Data.");
+        return nullptr;
+    }
+    return wcsData.getFullGrid();
+}
+
+bool SextractorSolver::appendCatalogRAandDEC(StarCatalog &catalog)
+{
+    WCSData wcsData = getWCSData();
+    if(!wcsData.isValid())
+    {
+        emit logOutput("There is no WCS Data.");
+        return false;
+    }
+
+    //The stars are all converted in one batch, then the coordinates are written straight into the catalog
+    QVector<QPointF> pixelPoints(catalog.size());
+    const float *x = catalog.x().constData();
+    const float *y = catalog.y().constData();
+    for(int i = 0; i < catalog.size(); i++)
+        pixelPoints[i] = QPointF(x[i], y[i]);
+    QVector<FITSImage::wcs_point> skyPoints(catalog.size());
+    if(!wcsData.pixelsToWCS(pixelPoints.constData(), pixelPoints.size(), skyPoints.data()))
+    {
+        emit logOutput("wcsp2s error: the RA and DEC could not be computed for the stars.");
+        return false;
+    }
+
+    for(int i = 0; i < catalog.size(); i++)
+        catalog.setRAandDEC(i, skyPoints.at(i).ra, skyPoints.at(i).dec);
+    return true;
+}
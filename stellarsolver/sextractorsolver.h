@@ -12,8 +12,12 @@
 #include <QThread>
 #include <QRect>
 #include <QDir>
+#include <memory>
+#include <atomic>
 #include "structuredefinitions.h"
 #include "parameters.h"
+#include "wcsdata.h"
+#include "starcatalog.h"
 
 //CFitsio Includes
 #include "fitsio.h"
@@ -47,8 +51,13 @@ public:
     virtual SextractorSolver* spawnChildSolver(int n) = 0;
     //This will abort the solver
 
-    virtual FITSImage::wcs_point *getWCSCoord() = 0;
+    //This returns the accessor for the WCS from the solve, the coordinates are only computed as they are needed.
+    virtual WCSData getWCSData() = 0;
+    //This computes the coordinates of every pixel in the image, the caller must delete [] the array.
+    virtual FITSImage::wcs_point *getWCSCoord();
     virtual QList<FITSImage::Star> appendStarsRAandDEC(QList<FITSImage::Star> stars) = 0;
+    //This sets the RA and DEC of the stars in the catalog in place, it returns false if they could not be computed
+    bool appendCatalogRAandDEC(StarCatalog &catalog);
 
     //Logging Settings for Astrometry
     bool logToFile = false;             //This determines whether or not to save the output from Astrometry.net to a file
@@ -61,6 +70,15 @@ public:
 
     Parameters params;                  //The currently set parameters for StellarSolver
     QStringList indexFolderPaths;       //This is the list of folder paths that the solver will use to search for index files
+    bool useIndexCache = false;         //This determines whether the index files are kept loaded in the SolverEngineCache between solves
+    bool useBackgroundCache = false;    //This determines whether the background model of the last image in the BackgroundCache can be used again
+    bool useSharedIndexes = false;      //This is set when the caller already holds the indexes in the SolverEngineCache for this solve, like the BatchSolver does
+
+    //These are only for measuring the internal solver, see solver_set_code_recorder and solver_set_verify_recorder in solver.h
+    solver_code_recorder_t codeRecorder = nullptr;
+    void *codeRecorderBaton = nullptr;
+    solver_verify_recorder_t verifyRecorder = nullptr;
+    void *verifyRecorderBaton = nullptr;
 
     //Astrometry Scale Parameters, These are not saved parameters and change for each image, use the methods to set them
     bool use_scale = false;             //Whether or not to use the image scale parameters
@@ -73,6 +91,12 @@ public:
     double search_ra = HUGE_VAL;        //RA of field center for search, format: decimal degrees
     double search_dec = HUGE_VAL;       //DEC of field center for search, format: decimal degrees
 
+    //Astrometry Solution Hint, This is a WCS that should be close to the solution, like the one from the last frame of a sequence
+    //The internal solver verifies it against the indexes before it searches, and only searches if it doesn't verify.
+    bool use_hint = false;              //Whether or not to verify the hint before searching
+    sip_t hintWCS;                      //The WCS of the hint for the full size image
+    double hintDrift = 0;               //How far the field center can be from the center of the hint, format: decimal degrees
+
     QString getScaleUnitString()
     {
         switch(scaleunit)
@@ -95,16 +119,20 @@ public:
 
     void setSearchScale(double fov_low, double fov_high, ScaleUnits units); //This sets the scale range for the image to speed up the solver                                                    //This sets the search RA/DEC/Radius to speed up the solver
     void setSearchPositionInDegrees(double ra, double dec);
+    void setSolutionHint(const sip_t &wcs, double maxDrift);
     int depthlo = -1;                       //This is the low depth of this child solver
     int depthhi = -1;                       //This is the high depth of this child solver
 
 
     FITSImage::Background getBackground(){return background;}
     int getNumStarsFound(){return stars.size();};
-    QList<FITSImage::Star> getStarList(){return stars;}
+    QList<FITSImage::Star> getStarList(){return stars.toList();}
+    const StarCatalog &getStarCatalog(){return stars;}
     FITSImage::Solution getSolution(){return solution;};
     bool hasWCSData(){return hasWCS;};
     bool solvingDone(){return hasSolved;};
+    bool isAborted(){return wasAborted || cancelToken->load() != 0;};
+    bool isSolvedElsewhere(){return solvedToken->load() != 0;};
     bool isCalculatingHFR(){return processType==SEXTRACT_WITH_HFR;};
     void setUseSubframe(QRect frame){useSubframe = true; subframe = frame;};
 
@@ -121,15 +149,21 @@ protected:  //Note: These items are not private because they are needed by Exter
 
     //The Results
     FITSImage::Background background;      //This is a report on the background levels found during sextraction
-    QList<FITSImage::Star> stars;          //This is the list of stars that get sextracted from the image, saved to the file, and then solved by astrometry.net
+    StarCatalog stars;                     //This is the list of stars that get sextracted from the image, saved to the file, and then solved by astrometry.net
     FITSImage::Solution solution;          //This is the solution that comes back from the Solver
     bool runSEPSextractor();    //This is the method that actually runs the internal sextractor
     bool hasWCS = false;        //This boolean gets set if the StellarSolver has WCS data to retrieve
 
-    bool wasAborted = false;
+    std::atomic<bool> wasAborted { false };    //This is read by the child solver tasks on the pool threads while abort can set it
     // This is the cancel file path that astrometry.net monitors.  If it detects this file, it aborts the solve
     QString cancelfn;           //Filename whose creation signals the process to stop
     QString solvedfn;           //Filename whose creation tells astrometry.net it already solved the field.
+    //These are checked by the internal solver while it is solving.  The cancel token gets set to stop the solve when it is aborted,
+    //the solved token gets set by a child solver that solved it, so the other children stop.
+    //Child solvers share the tokens of the solver that spawned them, they are reset when a solver that is not a child starts a process.
+    std::shared_ptr<std::atomic<int>> cancelToken { std::make_shared<std::atomic<int>>(0) };
+    std::shared_ptr<std::atomic<int>> solvedToken { std::make_shared<std::atomic<int>>(0) };
+    void resetTokens();
 
     bool isChildSolver = false;              //This identifies that this solver is in fact a child solver.
 
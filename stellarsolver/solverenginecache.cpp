@@ -0,0 +1,254 @@
+/*  SolverEngineCache, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "solverenginecache.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+SolverEngineCache *SolverEngineCache::instance()
+{
+    static SolverEngineCache engineCache;
+    return &engineCache;
+}
+
+SolverEngineCache::~SolverEngineCache()
+{
+    clear();
+}
+
+int SolverEngineCache::warmUp(const QStringList &indexFolders)
+{
+    QList<index_t *> indexes = acquire(indexFolders);
+    int numLoaded = indexes.size();
+    release(indexes);
+    return numLoaded;
+}
+
+//The key of a metadata only index gets this added to its path
+#define METADATA_ONLY_SUFFIX "#metadata"
+
+QList<index_t *> SolverEngineCache::acquire(const QStringList &indexFolders, bool keepLoaded, bool metadataOnly)
+{
+    QMutexLocker locker(&cacheLock);
+    QList<index_t *> indexes;
+    QStringList foldersDone;
+    foreach(QString folder, indexFolders)
+    {
+        QString path = QDir(folder).absolutePath();
+        if(foldersDone.contains(path))
+            continue;
+        foldersDone.append(path);
+
+        QList<CachedIndex *> folderIndexes;
+        refreshFolder(path, metadataOnly, folderIndexes);
+        foreach(CachedIndex *entry, folderIndexes)
+        {
+            //Indexes kept loaded between solves get the packed copy of the code tree for the faster search, it costs another copy of the codes.
+            //It is only made while nobody else is searching the tree.
+            if(keepLoaded && entry->refCount == 0 && !entry->metadataOnly && !entry->transient)
+                packCodeTree(entry);
+            entry->refCount++;
+            if(keepLoaded)
+                entry->keepLoaded = true;
+            inUse.insert(entry->index, entry);
+            indexes.append(entry->index);
+        }
+    }
+    return indexes;
+}
+
+void SolverEngineCache::packCodeTree(CachedIndex *entry)
+{
+    if(!entry->index->codekd)
+        return;
+    kdtree_t *tree = entry->index->codekd->tree;
+    if(tree->packed || kdtree_pack_leaves(tree) != 0)
+        return;
+    qint64 packedSize = kdtree_packed_stride(tree) * tree->ndim * sizeof(quint16);
+    entry->size += packedSize;
+    memoryUsed += packedSize;
+}
+
+void SolverEngineCache::release(const QList<index_t *> &indexes)
+{
+    QMutexLocker locker(&cacheLock);
+    foreach(index_t *index, indexes)
+    {
+        CachedIndex *entry = inUse.value(index, nullptr);
+        if(!entry)
+            continue;
+        entry->refCount--;
+        if(entry->refCount > 0)
+            continue;
+        inUse.remove(index);
+        //A transient index can stay if the other indexes were freed and it fits in the budget now
+        if(entry->transient && entry->keepLoaded && (memoryBudget <= 0 || memoryUsed <= memoryBudget))
+            entry->transient = false;
+        if(entry->stale)
+            freeEntry(entry);
+        else if(!entry->keepLoaded || entry->transient)
+            dropEntry(entry);
+    }
+}
+
+void SolverEngineCache::clear()
+{
+    QMutexLocker locker(&cacheLock);
+    foreach(CachedIndex *entry, cache.values())
+        dropEntry(entry);
+    notIndexFiles.clear();
+}
+
+void SolverEngineCache::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&cacheLock);
+    memoryBudget = bytes;
+    trimToBudget(0);
+}
+
+qint64 SolverEngineCache::getMemoryBudget()
+{
+    QMutexLocker locker(&cacheLock);
+    return memoryBudget;
+}
+
+qint64 SolverEngineCache::getMemoryUsed()
+{
+    QMutexLocker locker(&cacheLock);
+    return memoryUsed;
+}
+
+int SolverEngineCache::getNumIndexesLoaded()
+{
+    QMutexLocker locker(&cacheLock);
+    int numLoaded = 0;
+    foreach(CachedIndex *entry, cache)
+    {
+        if(!entry->metadataOnly)
+            numLoaded++;
+    }
+    return numLoaded;
+}
+
+//This compares the cache to what is currently in the folder.  Changed or removed files get dropped and new ones get loaded.
+//The indexes for the folder are returned in the same order that engine_autoindex_search_paths would add them.
+//Note that the cacheLock must be held when this is called.
+void SolverEngineCache::refreshFolder(const QString &folder, bool metadataOnly, QList<CachedIndex *> &folderIndexes)
+{
+    useCounter++;
+    QDir dir(folder);
+    QFileInfoList fileList;
+    if(dir.exists())
+        fileList = dir.entryInfoList(QDir::Files, QDir::Name | QDir::Reversed);
+
+    QStringList currentFiles;
+    foreach(QFileInfo fileInfo, fileList)
+        currentFiles.append(fileInfo.absoluteFilePath());
+
+    //Indexes in this folder should not be trimmed to make room for other indexes in the same folder
+    foreach(CachedIndex *entry, cache.values())
+    {
+        if(entry->folder != folder)
+            continue;
+        if(currentFiles.contains(entry->path))
+            entry->lastUsed = useCounter;
+        else
+            dropEntry(entry);
+    }
+
+    foreach(QFileInfo fileInfo, fileList)
+    {
+        QString path = fileInfo.absoluteFilePath();
+        QString key = metadataOnly ? path + METADATA_ONLY_SUFFIX : path;
+        CachedIndex *entry = cache.value(key, nullptr);
+        if(entry)
+        {
+            if(entry->fileSize == fileInfo.size() && entry->lastModified == fileInfo.lastModified())
+            {
+                folderIndexes.append(entry);
+                continue;
+            }
+            dropEntry(entry);
+        }
+
+        if(notIndexFiles.contains(path) && notIndexFiles.value(path) == fileInfo.lastModified())
+            continue;
+        if(!index_is_file_index(path.toLatin1().constData()))
+        {
+            notIndexFiles.insert(path, fileInfo.lastModified());
+            continue;
+        }
+        notIndexFiles.remove(path);
+
+        qint64 size = metadataOnly ? 0 : fileInfo.size();
+        trimToBudget(size);
+        index_t *index = index_load(path.toLatin1().constData(), metadataOnly ? INDEX_ONLY_LOAD_METADATA : 0, NULL);
+        if(!index)
+            continue;
+
+        entry = new CachedIndex;
+        entry->index = index;
+        entry->key = key;
+        entry->path = path;
+        entry->folder = folder;
+        entry->size = size;
+        entry->fileSize = fileInfo.size();
+        entry->lastModified = fileInfo.lastModified();
+        entry->metadataOnly = metadataOnly;
+        entry->refCount = 0;
+        entry->lastUsed = useCounter;
+        entry->keepLoaded = false;
+        entry->stale = false;
+
+        //If it doesn't fit in the budget, it is still cached so the other solves share it, but only until the last one releases it
+        entry->transient = memoryBudget > 0 && entry->size > 0 && memoryUsed + entry->size > memoryBudget;
+        cache.insert(key, entry);
+        memoryUsed += entry->size;
+        folderIndexes.append(entry);
+    }
+}
+
+//This removes the entry from the cache, it is freed now if nobody is using it, or when it is released.
+void SolverEngineCache::dropEntry(CachedIndex *entry)
+{
+    if(cache.value(entry->key, nullptr) == entry)
+    {
+        cache.remove(entry->key);
+        memoryUsed -= entry->size;
+    }
+    if(entry->refCount > 0)
+        entry->stale = true;
+    else
+        freeEntry(entry);
+}
+
+void SolverEngineCache::freeEntry(CachedIndex *entry)
+{
+    index_free(entry->index);
+    delete entry;
+}
+
+//This frees the least recently used indexes that are not in use until there is room for the needed bytes.
+void SolverEngineCache::trimToBudget(qint64 needed)
+{
+    if(memoryBudget <= 0)
+        return;
+    while(memoryUsed + needed > memoryBudget)
+    {
+        CachedIndex *oldest = nullptr;
+        foreach(CachedIndex *entry, cache)
+        {
+            if(entry->refCount == 0 && entry->lastUsed < useCounter && (!oldest || entry->lastUsed < oldest->lastUsed))
+                oldest = entry;
+        }
+        if(!oldest)
+            return;
+        dropEntry(oldest);
+    }
+}
@@ -0,0 +1,89 @@
+/*  SolverEngineCache, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef SOLVERENGINECACHE_H
+#define SOLVERENGINECACHE_H
+
+//QT Includes
+#include <QMap>
+#include <QList>
+#include <QMutex>
+#include <QDateTime>
+#include <QStringList>
+
+//Astrometry.net includes
+extern "C"{
+#include "astrometry/index.h"
+}
+
+//This keeps the index files loaded in memory across solves and across the parallel child solvers.
+//The solvers share the loaded indexes read only, each one holds a reference to them while it is solving.
+//If an index file in a folder changes or is removed, the cached copy is dropped once nobody is using it.
+class SolverEngineCache
+{
+public:
+    static SolverEngineCache *instance();
+
+    //This loads all of the index files in the folders so the first solve doesn't have to.  It returns the number of indexes that are ready.
+    int warmUp(const QStringList &indexFolders);
+
+    //This returns the loaded indexes for these folders, loading any that are new or changed.
+    //Each call to acquire must be paired with a call to release with the same list when the solve is done.
+    //If keepLoaded is false, indexes that nobody asked to keep are freed as soon as the last user releases them.
+    //If metadataOnly is true, only the metadata of the indexes is loaded.  The engine then loads each index by name,
+    //one at a time, while it solves with it, which is what it does when inParallel is off.
+    QList<index_t *> acquire(const QStringList &indexFolders, bool keepLoaded = true, bool metadataOnly = false);
+    void release(const QList<index_t *> &indexes);
+
+    //This frees all of the cached indexes.  Any that are currently in use get freed when they are released.
+    void clear();
+
+    //The memory budget is in bytes, 0 means there is no limit.
+    //If the budget is exceeded, the least recently used indexes are freed.  Indexes that don't fit are still shared by the solves that
+    //acquire them while they are loaded, and they are freed as soon as the last one releases them.
+    void setMemoryBudget(qint64 bytes);
+    qint64 getMemoryBudget();
+    qint64 getMemoryUsed();
+    int getNumIndexesLoaded();
+
+private:
+    SolverEngineCache() {}
+    ~SolverEngineCache();
+
+    struct CachedIndex
+    {
+        index_t *index;
+        QString key;            //This is the path, with a suffix for the metadata only indexes, so the same file can be cached both ways
+        QString path;
+        QString folder;
+        qint64 size;            //This is the memory it uses, the metadata only indexes don't count
+        qint64 fileSize;
+        QDateTime lastModified;
+        bool metadataOnly;
+        int refCount;
+        quint64 lastUsed;
+        bool stale;             //This gets set when the index should be freed as soon as it is released
+        bool keepLoaded;        //This gets set when the index should stay in the cache after it is released
+        bool transient;         //This gets set when the index didn't fit in the budget, it is only cached while it is in use
+    };
+
+    void refreshFolder(const QString &folder, bool metadataOnly, QList<CachedIndex *> &folderIndexes);
+    void dropEntry(CachedIndex *entry);
+    void freeEntry(CachedIndex *entry);
+    void trimToBudget(qint64 needed);
+    void packCodeTree(CachedIndex *entry);
+
+    QMutex cacheLock;
+    QMap<QString, CachedIndex *> cache;             //This is the list of cached indexes by their key
+    QMap<index_t *, CachedIndex *> inUse;           //This finds the entry for an index when it is released
+    QMap<QString, QDateTime> notIndexFiles;         //Files in the folders that we already know are not indexes
+    qint64 memoryBudget = 0;
+    qint64 memoryUsed = 0;
+    quint64 useCounter = 0;
+};
+
+#endif // SOLVERENGINECACHE_H
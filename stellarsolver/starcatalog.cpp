@@ -0,0 +1,170 @@
+/*  StarCatalog, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "starcatalog.h"
+
+#include <algorithm>
+#include <numeric>
+
+//This moves the values that are kept down to the front of one array, in order, and then shortens it
+template <typename T>
+static void compactColumn(QVector<T> &column, const QVector<bool> &kept, int numKept)
+{
+    T *values = column.data();
+    int next = 0;
+    for(int i = 0; i < kept.size(); i++)
+    {
+        if(kept.at(i))
+            values[next++] = values[i];
+    }
+    column.resize(numKept);
+}
+
+//This puts the values of one array in the order given by the list of indexes
+template <typename T>
+static void reorderColumn(QVector<T> &column, const QVector<int> &order)
+{
+    QVector<T> reordered(order.size());
+    const T *values = column.constData();
+    T *result = reordered.data();
+    for(int i = 0; i < order.size(); i++)
+        result[i] = values[order.at(i)];
+    column.swap(reordered);
+}
+
+void StarCatalog::clear()
+{
+    m_x.clear();
+    m_y.clear();
+    m_mag.clear();
+    m_flux.clear();
+    m_peak.clear();
+    m_HFR.clear();
+    m_a.clear();
+    m_b.clear();
+    m_theta.clear();
+    m_ra.clear();
+    m_dec.clear();
+    m_numPixels.clear();
+}
+
+void StarCatalog::reserve(int size)
+{
+    m_x.reserve(size);
+    m_y.reserve(size);
+    m_mag.reserve(size);
+    m_flux.reserve(size);
+    m_peak.reserve(size);
+    m_HFR.reserve(size);
+    m_a.reserve(size);
+    m_b.reserve(size);
+    m_theta.reserve(size);
+    m_ra.reserve(size);
+    m_dec.reserve(size);
+    m_numPixels.reserve(size);
+}
+
+void StarCatalog::append(const FITSImage::Star &star)
+{
+    m_x.append(star.x);
+    m_y.append(star.y);
+    m_mag.append(star.mag);
+    m_flux.append(star.flux);
+    m_peak.append(star.peak);
+    m_HFR.append(star.HFR);
+    m_a.append(star.a);
+    m_b.append(star.b);
+    m_theta.append(star.theta);
+    m_ra.append(star.ra);
+    m_dec.append(star.dec);
+    m_numPixels.append(star.numPixels);
+}
+
+FITSImage::Star StarCatalog::at(int i) const
+{
+    FITSImage::Star star = {m_x.at(i), m_y.at(i), m_mag.at(i), m_flux.at(i), m_peak.at(i), m_HFR.at(i),
+                            m_a.at(i), m_b.at(i), m_theta.at(i), m_ra.at(i), m_dec.at(i), m_numPixels.at(i)};
+    return star;
+}
+
+QList<FITSImage::Star> StarCatalog::toList() const
+{
+    QList<FITSImage::Star> list;
+    list.reserve(size());
+    for(int i = 0; i < size(); i++)
+        list.append(at(i));
+    return list;
+}
+
+StarCatalog StarCatalog::fromList(const QList<FITSImage::Star> &list)
+{
+    StarCatalog catalog;
+    catalog.reserve(list.size());
+    foreach(const FITSImage::Star &star, list)
+        catalog.append(star);
+    return catalog;
+}
+
+//Only the magnitudes are looked at for the sort, then every array is put in that order once
+void StarCatalog::sortByMagnitude()
+{
+    QVector<int> order(size());
+    std::iota(order.begin(), order.end(), 0);
+    const float *mags = m_mag.constData();
+    //Note that a star is dimmer when the mag is greater!
+    std::stable_sort(order.begin(), order.end(), [mags](int i1, int i2)
+    {
+        return mags[i1] < mags[i2];
+    });
+
+    reorderColumn(m_x, order);
+    reorderColumn(m_y, order);
+    reorderColumn(m_mag, order);
+    reorderColumn(m_flux, order);
+    reorderColumn(m_peak, order);
+    reorderColumn(m_HFR, order);
+    reorderColumn(m_a, order);
+    reorderColumn(m_b, order);
+    reorderColumn(m_theta, order);
+    reorderColumn(m_ra, order);
+    reorderColumn(m_dec, order);
+    reorderColumn(m_numPixels, order);
+}
+
+void StarCatalog::truncate(int count)
+{
+    if(count < 0 || count >= size())
+        return;
+    m_x.resize(count);
+    m_y.resize(count);
+    m_mag.resize(count);
+    m_flux.resize(count);
+    m_peak.resize(count);
+    m_HFR.resize(count);
+    m_a.resize(count);
+    m_b.resize(count);
+    m_theta.resize(count);
+    m_ra.resize(count);
+    m_dec.resize(count);
+    m_numPixels.resize(count);
+}
+
+void StarCatalog::compact(const QVector<bool> &kept, int numKept)
+{
+    compactColumn(m_x, kept, numKept);
+    compactColumn(m_y, kept, numKept);
+    compactColumn(m_mag, kept, numKept);
+    compactColumn(m_flux, kept, numKept);
+    compactColumn(m_peak, kept, numKept);
+    compactColumn(m_HFR, kept, numKept);
+    compactColumn(m_a, kept, numKept);
+    compactColumn(m_b, kept, numKept);
+    compactColumn(m_theta, kept, numKept);
+    compactColumn(m_ra, kept, numKept);
+    compactColumn(m_dec, kept, numKept);
+    compactColumn(m_numPixels, kept, numKept);
+}
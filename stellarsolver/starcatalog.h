@@ -0,0 +1,96 @@
+/*  StarCatalog, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef STARCATALOG_H
+#define STARCATALOG_H
+
+//Includes for this project
+#include "structuredefinitions.h"
+
+//QT Includes
+#include <QList>
+#include <QVector>
+
+//This holds the stars found in an image with each of the values of the stars in its own array, instead of as a list of Star structs.
+//The filters only read the values they check, so removing stars is one pass over the few arrays that are needed
+//followed by moving the stars that are kept down in each array, and the arrays can be handed straight to cfitsio or the solver.
+//The arrays are implicitly shared like the other Qt containers, so copying a catalog does not copy the stars until one of the copies is changed.
+class StarCatalog
+{
+public:
+    StarCatalog() = default;
+
+    int size() const {return m_x.size();}
+    int count() const {return m_x.size();}
+    bool isEmpty() const {return m_x.isEmpty();}
+    void clear();
+    void reserve(int size);
+    void append(const FITSImage::Star &star);
+    FITSImage::Star at(int i) const;
+
+    //These convert to and from the list of Star structs that the rest of the API uses
+    QList<FITSImage::Star> toList() const;
+    static StarCatalog fromList(const QList<FITSImage::Star> &list);
+
+    //These give the arrays of the values without copying them
+    const QVector<float> &x() const {return m_x;}
+    const QVector<float> &y() const {return m_y;}
+    const QVector<float> &mag() const {return m_mag;}
+    const QVector<float> &flux() const {return m_flux;}
+    const QVector<float> &peak() const {return m_peak;}
+    const QVector<float> &HFR() const {return m_HFR;}
+    const QVector<float> &a() const {return m_a;}
+    const QVector<float> &b() const {return m_b;}
+    const QVector<float> &theta() const {return m_theta;}
+    const QVector<float> &ra() const {return m_ra;}
+    const QVector<float> &dec() const {return m_dec;}
+    const QVector<int> &numPixels() const {return m_numPixels;}
+
+    void setRAandDEC(int i, float ra, float dec) {m_ra[i] = ra; m_dec[i] = dec;}
+
+    //This puts the stars in order from the brightest to the dimmest.  Stars with the same magnitude keep their order.
+    void sortByMagnitude();
+    //This removes all the stars after the first count stars
+    void truncate(int count);
+
+    //This keeps only the stars where keep(i) returns true and keeps them in the same order, it returns how many were removed.
+    //keep is called once for each star, in order, before any of the stars are moved, so it can look at the values of star i or count the stars it has kept.
+    template <typename Predicate>
+    int filter(Predicate keep)
+    {
+        QVector<bool> kept(size());
+        int numKept = 0;
+        for(int i = 0; i < size(); i++)
+        {
+            kept[i] = keep(i);
+            if(kept[i])
+                numKept++;
+        }
+        int numRemoved = size() - numKept;
+        if(numRemoved > 0)
+            compact(kept, numKept);
+        return numRemoved;
+    }
+
+private:
+    void compact(const QVector<bool> &kept, int numKept);
+
+    QVector<float> m_x;
+    QVector<float> m_y;
+    QVector<float> m_mag;
+    QVector<float> m_flux;
+    QVector<float> m_peak;
+    QVector<float> m_HFR;
+    QVector<float> m_a;
+    QVector<float> m_b;
+    QVector<float> m_theta;
+    QVector<float> m_ra;
+    QVector<float> m_dec;
+    QVector<int> m_numPixels;
+};
+
+#endif // STARCATALOG_H
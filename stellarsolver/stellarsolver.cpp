@@ -17,10 +17,40 @@
 #include "sextractorsolver.h"
 #include "externalsextractorsolver.h"
 #include "onlinesolver.h"
-#include <QApplication>
+#include "solverenginecache.h"
+#include "backgroundcache.h"
+#include "bufferpool.h"
+#include "internalsextractorsolver.h"
+#include "focusmeter.h"
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFutureWatcher>
 
 using namespace SSolver;
 
+//A focus measurement looks for the stars again with a full extraction if fewer than this many of them (or half of them) were found near where they were
+#define FOCUS_MIN_STARS 3
+
+//This runs one child solver of a parallel solve on a thread from the pool.
+//If the solve was already finished or aborted before this one got a thread, it just reports that it didn't solve.
+class ChildSolverTask : public QRunnable
+{
+public:
+    ChildSolverTask(SextractorSolver *solver, StellarSolver *parentSolver) : childSolver(solver), parent(parentSolver) {}
+    void run() override
+    {
+        if(childSolver->isAborted() || childSolver->isSolvedElsewhere())
+            emit childSolver->finished(-1);
+        else
+            childSolver->executeProcess();
+        parent->childSolverDone();
+    }
+private:
+    SextractorSolver *childSolver;
+    StellarSolver *parent;
+};
+
 StellarSolver::StellarSolver(ProcessType type, FITSImage::Statistic imagestats, const uint8_t *imageBuffer, QObject *parent) : QThread(parent)
 {
      processType = type;
@@ -38,7 +68,7 @@ StellarSolver::StellarSolver(FITSImage::Statistic imagestats, uint8_t const *ima
 
 StellarSolver::~StellarSolver()
 {
-
+    parallelPool.waitForDone();
 }
 
 SextractorSolver* StellarSolver::createSextractorSolver()
@@ -66,6 +96,7 @@ SextractorSolver* StellarSolver::createSextractorSolver()
         extSolver->astapBinaryPath = astapBinaryPath;
         extSolver->wcsPath = wcsPath;
         extSolver->cleanupTemporaryFiles = cleanupTemporaryFiles;
+        extSolver->useMemoryTempFiles = useMemoryTempFiles;
         extSolver->autoGenerateAstroConfig = autoGenerateAstroConfig;
         solver = extSolver;
     }
@@ -78,12 +109,21 @@ SextractorSolver* StellarSolver::createSextractorSolver()
     solver->basePath = basePath;
     solver->params = params;
     solver->indexFolderPaths = indexFolderPaths;
+    solver->useIndexCache = useIndexCache;
+    solver->useBackgroundCache = useBackgroundCache;
+    solver->codeRecorder = codeRecorder;
+    solver->codeRecorderBaton = codeRecorderBaton;
+    solver->verifyRecorder = verifyRecorder;
+    solver->verifyRecorderBaton = verifyRecorderBaton;
     if(use_scale)
         solver->setSearchScale(scalelo, scalehi, scaleunit);
     if(use_position)
         solver->setSearchPositionInDegrees(search_ra, search_dec);
+    if(use_hint)
+        solver->setSolutionHint(hintWCS, hintDrift);
+    //The solvers report from the thread they run on, so they don't depend on an event loop in this thread
     if(logLevel != LOG_NONE)
-        connect(solver, &SextractorSolver::logOutput, this, &StellarSolver::logOutput);
+        connect(solver, &SextractorSolver::logOutput, this, &StellarSolver::logOutput, Qt::DirectConnection);
 
     return solver;
 }
@@ -119,6 +159,13 @@ void StellarSolver::sextractWithHFR(QRect frame)
     executeProcess();
 }
 
+void StellarSolver::solve()
+{
+    processType = SOLVE;
+    useSubframe = false;
+    executeProcess();
+}
+
 void StellarSolver::startsextraction()
 {
     processType = SEXTRACT;
@@ -131,18 +178,145 @@ void StellarSolver::startSextractionWithHFR()
     startProcess();
 }
 
+QFuture<int> StellarSolver::sextractAsync()
+{
+    processType = SEXTRACT;
+    useSubframe = false;
+    return startProcessAsync();
+}
+
+QFuture<int> StellarSolver::sextractWithHFRAsync()
+{
+    processType = SEXTRACT_WITH_HFR;
+    useSubframe = false;
+    return startProcessAsync();
+}
+
+QFuture<int> StellarSolver::solveAsync()
+{
+    processType = SOLVE;
+    useSubframe = false;
+    return startProcessAsync();
+}
+
+QFuture<int> StellarSolver::startProcessAsync()
+{
+    startProcess();
+    return processFuture.future();
+}
+
+//The results of the last process are cleared here, before the thread starts, so nobody waiting on this process sees them.
+//If the thread is still finishing the last process, it is waited for, since a running thread can't be started again.
 void StellarSolver::startProcess()
 {
+    if(isRunning())
+        wait();
+    hasFailed = false;
+    if(processType == SEXTRACT || processType == SEXTRACT_WITH_HFR)
+        hasSextracted = false;
+    else
+        hasSolved = false;
+    wasAborted = false;
+    processCode = -1;
+    processFuture = QFutureInterface<int>();
+    processFuture.reportStarted();
     sextractorSolver = createSextractorSolver();
     start();
 }
 
+//This measures the focus on the stars from the last image, which are the seeds, so that only small windows around them are looked at.
+//The first time, or when too many of the stars have moved away or faded, the whole image is extracted to choose new seeds.
+FITSImage::FocusMetric StellarSolver::measureFocus(int numStars)
+{
+    FITSImage::FocusMetric metric;
+    if(m_ImageBuffer == nullptr || isRunning())
+    {
+        emit logOutput("The focus can't be measured without an image or while the StellarSolver is running.");
+        return metric;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    FocusMeter meter(stats, m_ImageBuffer, params);
+    QVector<FocusMeter::FocusStar> measured;
+    if(!focusSeeds.isEmpty())
+        measured = meter.measure(focusSeeds);
+
+    int numNeeded = qMax(qMin(FOCUS_MIN_STARS, focusSeedCount), focusSeedCount / 2);
+    bool redetect = focusSeeds.isEmpty() || measured.size() < numNeeded;
+    if(redetect)
+    {
+        InternalSextractorSolver detector(SEXTRACT, SEXTRACTOR_INTERNAL, SOLVER_STELLARSOLVER, stats, m_ImageBuffer);
+        if(useSubframe)
+            detector.setUseSubframe(subframe);
+        detector.logLevel = logLevel;
+        detector.params = params;
+        detector.useBackgroundCache = useBackgroundCache;
+        if(logLevel != LOG_NONE)
+            connect(&detector, &SextractorSolver::logOutput, this, &StellarSolver::logOutput);
+        if(detector.sextract() != 0)
+        {
+            emit logOutput("The stars for the focus measurement could not be found.");
+            return metric;
+        }
+        StarCatalog detected = detector.getStarCatalog();
+        detected.sortByMagnitude();
+        focusSeeds = meter.chooseSeeds(detected, numStars);
+        focusSeedCount = focusSeeds.size();
+        measured = meter.measure(focusSeeds);
+    }
+
+    int numSeeds = focusSeeds.size();
+    //The next image looks for the stars where they are now, with the size they are now
+    focusSeeds.clear();
+    foreach(const FocusMeter::FocusStar &focusStar, measured)
+        focusSeeds.append(focusStar.star);
+
+    metric = FocusMeter::summarize(measured, numSeeds);
+    metric.redetected = redetect;
+    if(logLevel != LOG_NONE)
+        emit logOutput(QString("Focus HFR %1 +/- %2 from %3 of %4 stars in %5 ms%6").arg(metric.HFR).arg(metric.HFRError).arg(metric.numStars)
+                       .arg(metric.numSeeds).arg(timer.elapsed()).arg(redetect ? ", the stars were found again" : ""));
+    return metric;
+}
+
+void StellarSolver::setFocusSeeds(const QList<FITSImage::Star> &seeds)
+{
+    focusSeeds = seeds;
+    focusSeedCount = seeds.size();
+}
+
+//This lets the same StellarSolver measure each new image of a sequence, keeping its settings and the focus seeds
+bool StellarSolver::loadNewImageBuffer(const FITSImage::Statistic &imagestats, uint8_t const *imageBuffer)
+{
+    if(isRunning())
+        return false;
+    stats = imagestats;
+    m_ImageBuffer = imageBuffer;
+    if(!useSubframe)
+        subframe = QRect(0,0,stats.width,stats.height);
+    hasSextracted = false;
+    hasSolved = false;
+    hasFailed = false;
+    return true;
+}
+
+//This blocks until the process is complete, it doesn't need a QApplication.
+//The online solver gets the replies from the server through the event loop of this thread, so it gets one while it waits.
 void StellarSolver::executeProcess()
 {
-    sextractorSolver = createSextractorSolver();
-    start();
-    while(!hasSextracted && !hasSolved && !hasFailed && !wasAborted)
-        QApplication::processEvents();
+    QFuture<int> future = startProcessAsync();
+    if(processType == SOLVE && solverType == SOLVER_ONLINEASTROMETRY)
+    {
+        QEventLoop loop;
+        QFutureWatcher<int> watcher;
+        connect(&watcher, &QFutureWatcher<int>::finished, &loop, &QEventLoop::quit);
+        watcher.setFuture(future);
+        if(!future.isFinished())
+            loop.exec();
+    }
+    else
+        future.waitForFinished();
 }
 
 bool StellarSolver::checkParameters()
@@ -162,7 +336,10 @@ bool StellarSolver::checkParameters()
 
     if(params.multiAlgorithm == MULTI_AUTO)
     {
-        if(use_scale && use_position)
+        //The internal solver searches for quads in several threads itself, so it doesn't need more solvers to use all of the cores
+        if(solverType == SOLVER_STELLARSOLVER && params.searchThreads != 1)
+            params.multiAlgorithm = NOT_MULTI;
+        else if(use_scale && use_position)
             params.multiAlgorithm = NOT_MULTI;
         else if(use_position)
             params.multiAlgorithm = MULTI_SCALES;
@@ -197,14 +374,11 @@ void StellarSolver::run()
     if(checkParameters() == false)
     {
         emit logOutput("There is an issue with your parameters.  Terminating the process.");
+        reportProcessComplete();
         return;
     }
-
-    hasFailed = false;
-    if(processType == SEXTRACT || processType == SEXTRACT_WITH_HFR)
-        hasSextracted = false;
-    else
-        hasSolved = false;
+    //The solver was made before the parameters were checked, it needs to know if inParallel was turned off because there isn't enough RAM
+    sextractorSolver->params.inParallel = params.inParallel;
 
     //These are the solvers that support parallelization, ASTAP and the online ones do not
     if(params.multiAlgorithm != NOT_MULTI && processType == SOLVE && (solverType == SOLVER_STELLARSOLVER || solverType == SOLVER_LOCALASTROMETRY))
@@ -212,40 +386,54 @@ void StellarSolver::run()
         sextractorSolver->sextract();
         parallelSolve();
 
+        parallelLock.lock();
         while(!hasSolved && !wasAborted && parallelSolversAreRunning())
-            msleep(100);
+            parallelDone.wait(&parallelLock);
+        parallelLock.unlock();
 
         if(loadWCS && hasWCS && solverWithWCS)
         {
-            wcs_coord = solverWithWCS->getWCSCoord();
-            if(wcs_coord)
+            wcsData = solverWithWCS->getWCSData();
+            if(wcsData.isValid())
             {
                 if(stars.count() > 0)
-                    stars = solverWithWCS->appendStarsRAandDEC(stars);
+                    solverWithWCS->appendCatalogRAandDEC(stars);
                 emit wcsDataisReady();
             }
         }
-        while(parallelSolversAreRunning())
-            msleep(100);
+        //The other child solvers were aborted, this lets them stop before the indexes they use are released
+        parallelPool.waitForDone();
+        SolverEngineCache::instance()->release(parallelIndexes);
+        parallelIndexes.clear();
     }
     else if(solverType == SOLVER_ONLINEASTROMETRY)
     {
-        connect(sextractorSolver, &SextractorSolver::finished, this, &StellarSolver::processFinished);
+        connect(sextractorSolver, &SextractorSolver::finished, this, &StellarSolver::processFinished, Qt::DirectConnection);
         sextractorSolver->startProcess();
-        while(sextractorSolver->isRunning())
-            msleep(100);
+        sextractorSolver->wait();
     }
     else
     {
-        connect(sextractorSolver, &SextractorSolver::finished, this, &StellarSolver::processFinished);
+        connect(sextractorSolver, &SextractorSolver::finished, this, &StellarSolver::processFinished, Qt::DirectConnection);
         sextractorSolver->executeProcess();
     }
     if(logLevel != LOG_NONE)
         emit logOutput("All Processes Complete");
+    reportProcessComplete();
+}
+
+//This is the end of every process, the results are all in place by now
+void StellarSolver::reportProcessComplete()
+{
+    if(completionCallback)
+        completionCallback(processCode);
+    processFuture.reportResult(processCode);
+    processFuture.reportFinished();
 }
 
 //This allows us to start multiple threads to search simulaneously in separate threads/cores
 //to attempt to efficiently use modern multi core computers to speed up the solve
+//The search is split into more bands than there are threads, so a thread that finishes its band early picks up the next one.
 void StellarSolver::parallelSolve()
 {
     if(params.multiAlgorithm == NOT_MULTI || !(solverType == SOLVER_STELLARSOLVER || solverType == SOLVER_LOCALASTROMETRY))
@@ -253,6 +441,13 @@ void StellarSolver::parallelSolve()
     parallelSolvers.clear();
     parallelFails = 0;
     int threads = idealThreadCount();
+    int bands = threads * 2;
+    parallelPool.setMaxThreadCount(threads);
+
+    //The internal child solvers all share one set of loaded indexes, the parent holds them until all the children are done.
+    //Without inParallel or the cache, only their metadata is loaded, and each child loads one index at a time while it solves.
+    if(solverType == SOLVER_STELLARSOLVER)
+        parallelIndexes = SolverEngineCache::instance()->acquire(indexFolderPaths, useIndexCache, !params.inParallel && !useIndexCache);
 
     if(params.multiAlgorithm == MULTI_SCALES)
     {
@@ -274,15 +469,18 @@ void StellarSolver::parallelSolve()
             maxScale = params.maxwidth;
             units = DEG_WIDTH;
         }
-        double scaleConst = (maxScale - minScale) / pow(threads,2);
+        double scaleConst = (maxScale - minScale) / pow(bands,2);
         if(logLevel != LOG_NONE)
-            emit logOutput(QString("Starting %1 threads to solve on multiple scales").arg(threads));
-        for(double thread = 0; thread < threads; thread++)
+            emit logOutput(QString("Starting %1 threads to solve on %2 scale bands").arg(threads).arg(bands));
+        for(double band = 0; band < bands; band++)
         {
-            double low = minScale + scaleConst * pow(thread,2);
-            double high = minScale + scaleConst * pow(thread + 1, 2);
-            SextractorSolver *solver = sextractorSolver->spawnChildSolver(thread);
-            connect(solver, &SextractorSolver::finished, this, &StellarSolver::finishParallelSolve);
+            double low = minScale + scaleConst * pow(band,2);
+            double high = minScale + scaleConst * pow(band + 1, 2);
+            SextractorSolver *solver = sextractorSolver->spawnChildSolver(band);
+            connect(solver, &SextractorSolver::finished, this, [this, solver](int code)
+            {
+                finishParallelSolve(solver, code);
+            }, Qt::DirectConnection);
             solver->setSearchScale(low, high, units);
             parallelSolvers.append(solver);
             if(logLevel != LOG_NONE)
@@ -298,16 +496,19 @@ void StellarSolver::parallelSolve()
         int sourceNum = 200;
         if(params.keepNum !=0)
             sourceNum = params.keepNum;
-        int inc = sourceNum / threads;
+        int inc = sourceNum / bands;
         //We don't need an unnecessary number of threads
         if(inc < 10)
             inc = 10;
         if(logLevel != LOG_NONE)
-            emit logOutput(QString("Starting %1 threads to solve on multiple depths").arg(sourceNum / inc));
+            emit logOutput(QString("Starting %1 threads to solve on %2 depth bands").arg(threads).arg(sourceNum / inc));
         for(int i = 1; i < sourceNum; i += inc)
         {
             SextractorSolver *solver = sextractorSolver->spawnChildSolver(i);
-            connect(solver, &SextractorSolver::finished, this, &StellarSolver::finishParallelSolve);
+            connect(solver, &SextractorSolver::finished, this, [this, solver](int code)
+            {
+                finishParallelSolve(solver, code);
+            }, Qt::DirectConnection);
             solver->depthlo = i;
             solver->depthhi = i + inc;
             parallelSolvers.append(solver);
@@ -315,19 +516,27 @@ void StellarSolver::parallelSolve()
                 emit logOutput(QString("Child Solver # %1, Depth Low %2, Depth High %3").arg(parallelSolvers.count()).arg(i).arg(i + inc));
         }
     }
+    parallelSolversRunning.storeRelease(parallelSolvers.count());
     foreach(SextractorSolver *solver, parallelSolvers)
-        solver->startProcess();
+        parallelPool.start(new ChildSolverTask(solver, this));
 }
 
 bool StellarSolver::parallelSolversAreRunning()
 {
-    foreach(SextractorSolver *solver, parallelSolvers)
-        if(solver->isRunning())
-            return true;
-    return false;
+    return parallelSolversRunning.loadAcquire() > 0;
+}
+
+void StellarSolver::childSolverDone()
+{
+    parallelLock.lock();
+    parallelSolversRunning.fetchAndAddOrdered(-1);
+    parallelLock.unlock();
+    parallelDone.wakeAll();
 }
+
 void StellarSolver::processFinished(int code)
 {
+    processCode = code;
     numStars  = sextractorSolver->getNumStarsFound();
     if(code == 0)
     {
@@ -345,11 +554,11 @@ void StellarSolver::processFinished(int code)
         //This means it was a Sextraction Command
         else
         {
-            stars = sextractorSolver->getStarList();
+            stars = sextractorSolver->getStarCatalog();
             background = sextractorSolver->getBackground();
             calculateHFR = sextractorSolver->isCalculatingHFR();
             if(solverWithWCS)
-                stars = solverWithWCS->appendStarsRAandDEC(stars);
+                solverWithWCS->appendCatalogRAandDEC(stars);
             hasSextracted = true;
         }
     }
@@ -360,57 +569,65 @@ void StellarSolver::processFinished(int code)
     {
         if(loadWCS && hasWCS && solverWithWCS)
         {
-            wcs_coord = solverWithWCS->getWCSCoord();
-            stars = solverWithWCS->appendStarsRAandDEC(stars);
-            if(wcs_coord)
+            wcsData = solverWithWCS->getWCSData();
+            solverWithWCS->appendCatalogRAandDEC(stars);
+            if(wcsData.isValid())
                 emit wcsDataisReady();
         }
     }
 }
 
 
-//This slot listens for signals from the child solvers that they are in fact done with the solve
-//If they
-void StellarSolver::finishParallelSolve(int success)
+//This is called by each child solver, on its own thread, when it is done with the solve.
+//The first one that solves it shuts down the others, and if none of them solve it, the solve failed.
+void StellarSolver::finishParallelSolve(SextractorSolver *reportingSolver, int success)
 {
-    SextractorSolver *reportingSolver = (SextractorSolver*)sender();
-    int whichSolver = 0;
-    for(int i =0; i<parallelSolvers.count(); i++ )
-    {
-        SextractorSolver *solver = parallelSolvers.at(i);
-        if(solver == reportingSolver)
-            whichSolver = i + 1;
-    }
+    int whichSolver = parallelSolvers.indexOf(reportingSolver) + 1;
 
     if(success == 0)
     {
-        numStars  = reportingSolver->getNumStarsFound();
+        {
+            QMutexLocker locker(&parallelLock);
+            //Another child solver could have solved it at the same time
+            if(hasSolved)
+                return;
+            numStars  = reportingSolver->getNumStarsFound();
+            solution = reportingSolver->getSolution();
+            if(reportingSolver->hasWCSData())
+            {
+                solverWithWCS = reportingSolver;
+                hasWCS = true;
+            }
+            processCode = 0;
+            hasSolved = true;
+        }
+        parallelDone.wakeAll();
         if(logLevel != LOG_NONE)
             emit logOutput(QString("Successfully solved with child solver: %1").arg(whichSolver));
         if(logLevel != LOG_NONE)
             emit logOutput("Shutting down other child solvers");
         foreach(SextractorSolver *solver, parallelSolvers)
         {
-            disconnect(solver, &SextractorSolver::finished, this, &StellarSolver::finishParallelSolve);
-            disconnect(solver, &SextractorSolver::logOutput, this, &StellarSolver::logOutput);
-            if(solver != reportingSolver && solver->isRunning())
+            disconnect(solver, nullptr, this, nullptr);
+            //This also stops the ones that are still waiting in the pool from starting
+            if(solver != reportingSolver)
                 solver->abort();
         }
-        solution = reportingSolver->getSolution();
-        if(reportingSolver->hasWCSData())
-        {
-            solverWithWCS = reportingSolver;
-            hasWCS = true;
-        }
-        hasSolved = true;
         emit finished(0);
     }
     else
     {
-        parallelFails++;
+        bool allFailed;
+        {
+            QMutexLocker locker(&parallelLock);
+            parallelFails++;
+            allFailed = parallelFails == parallelSolvers.count() && !hasSolved;
+            if(allFailed)
+                hasFailed = true;
+        }
         if(logLevel != LOG_NONE)
             emit logOutput(QString("Child solver: %1 did not solve or was aborted").arg(whichSolver));
-        if(parallelFails == parallelSolvers.count())
+        if(allFailed)
             emit finished(-1);
     }
 }
@@ -422,7 +639,10 @@ void StellarSolver::abort()
         solver->abort();
     if(sextractorSolver)
         sextractorSolver->abort();
+    parallelLock.lock();
     wasAborted = true;
+    parallelLock.unlock();
+    parallelDone.wakeAll();
 }
 
 //This method uses a fwhm value to generate the conv filter the sextractor will use.
@@ -608,6 +828,39 @@ void StellarSolver::setSearchPositionInDegrees(double ra, double dec)
     search_dec = dec;
 }
 
+//This makes a TAN WCS for the full size image from a solution so that it can be verified as a hint.
+//The CD matrix is built so that sip_get_orientation gives back the orientation of the solution.
+void StellarSolver::setSolutionHint(const FITSImage::Solution &solution, double maxDrift)
+{
+    tan_t tan;
+    memset(&tan, 0, sizeof(tan_t));
+    double scale = arcsec2deg(solution.pixscale);
+    double orient = deg2rad(solution.orientation);
+    //Note, positive parity means a negative determinant of the CD matrix
+    double parity = (solution.parity == "pos") ? -1.0 : 1.0;
+    tan.crval[0] = solution.ra;
+    tan.crval[1] = solution.dec;
+    tan.crpix[0] = 0.5 + 0.5 * stats.width;
+    tan.crpix[1] = 0.5 + 0.5 * stats.height;
+    tan.cd[0][0] = parity * scale * cos(orient);
+    tan.cd[0][1] = scale * sin(orient);
+    tan.cd[1][0] = -parity * scale * sin(orient);
+    tan.cd[1][1] = scale * cos(orient);
+    tan.imagew = stats.width;
+    tan.imageh = stats.height;
+
+    sip_t wcs;
+    sip_wrap_tan(&tan, &wcs);
+    setSolutionHint(wcs, maxDrift);
+}
+
+void StellarSolver::setSolutionHint(const sip_t &wcs, double maxDrift)
+{
+    use_hint = true;
+    hintWCS = wcs;
+    hintDrift = maxDrift;
+}
+
 void addPathToListIfExists(QStringList *list, QString path)
 {
     if(list)
@@ -639,11 +892,56 @@ QStringList StellarSolver::getDefaultIndexFolderPaths()
 }
 
 
+int StellarSolver::warmUpIndexCache(QStringList indexFolders)
+{
+    return SolverEngineCache::instance()->warmUp(indexFolders);
+}
+
+void StellarSolver::clearIndexCache()
+{
+    SolverEngineCache::instance()->clear();
+}
+
+void StellarSolver::setIndexCacheMemoryBudget(qint64 bytes)
+{
+    SolverEngineCache::instance()->setMemoryBudget(bytes);
+}
+
+qint64 StellarSolver::getIndexCacheMemoryUsed()
+{
+    return SolverEngineCache::instance()->getMemoryUsed();
+}
+
+void StellarSolver::clearBackgroundCache()
+{
+    BackgroundCache::instance()->clear();
+}
+
+void StellarSolver::setBackgroundCacheTolerance(double fraction)
+{
+    BackgroundCache::instance()->setTolerance(fraction);
+}
+
+void StellarSolver::trimBufferPool(qint64 maxFreeBytes)
+{
+    BufferPool::instance()->trim(maxFreeBytes);
+}
+
+void StellarSolver::setBufferPoolBudget(qint64 bytes)
+{
+    BufferPool::instance()->setMaxFreeBytes(bytes);
+}
+
+FITSImage::BufferPoolStats StellarSolver::getBufferPoolStats()
+{
+    return BufferPool::instance()->getStats();
+}
 
+//Note that this computes the coordinates for every pixel each time it is called, the caller must delete [] the array.
 FITSImage::wcs_point * StellarSolver::getWCSCoord()
 {
     if(hasWCS)
-        return wcs_coord;
+        return wcsData.getFullGrid();
     else
         return nullptr;
 }
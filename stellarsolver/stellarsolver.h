@@ -20,6 +20,13 @@
 #include <QVariant>
 #include <QVector>
 #include <QRect>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QWaitCondition>
+#include <functional>
 
 using namespace SSolver;
 
@@ -89,10 +96,32 @@ public:
     void startsextraction();
     void startSextractionWithHFR();
     void solve();
-    virtual void executeProcess();                      //This runs the process without threading.
+    virtual void executeProcess();                      //This runs the process and waits until it is complete, without an event loop
     virtual void startProcess();                        //This starts the process in a separate thread
     virtual void abort();                       //This will abort the solver
 
+    //These start the process in a separate thread and return right away, like startProcess.  The future gets the same code as
+    //the finished signal when the process is complete, so it can be waited on, or watched with a QFutureWatcher, without polling.
+    QFuture<int> sextractAsync();
+    QFuture<int> sextractWithHFRAsync();
+    QFuture<int> solveAsync();
+    QFuture<int> startProcessAsync();                   //This uses the process type and subframe that are already set
+    //This is called with the same code on the StellarSolver's thread when each process is complete, for programs without a Qt event loop.
+    //It must not start another process itself.
+    void setCompletionCallback(std::function<void(int)> callback){completionCallback = callback;}
+    //These are only for measuring the internal solver, like the benchmark does, see solver_set_code_recorder and solver_set_verify_recorder in solver.h.
+    //The recorders are called from every thread that solves for this StellarSolver, set them before starting the process.
+    void setCodeRecorder(solver_code_recorder_t recorder, void *baton){codeRecorder = recorder; codeRecorderBaton = baton;}
+    void setVerifyRecorder(solver_verify_recorder_t recorder, void *baton){verifyRecorder = recorder; verifyRecorderBaton = baton;}
+
+    //These are for autofocus, measureFocus finds the HFR of the image from numStars stars without extracting the whole image.
+    //It looks for the stars where they were in the last image it measured, so load each new image with loadNewImageBuffer.
+    FITSImage::FocusMetric measureFocus(int numStars = 30);
+    void setFocusSeeds(const QList<FITSImage::Star> &seeds);     //Use these stars for the next measurement, for example from sextract
+    QList<FITSImage::Star> getFocusSeeds(){return focusSeeds;}
+    void clearFocusSeeds(){focusSeeds.clear(); focusSeedCount = 0;}
+    bool loadNewImageBuffer(const FITSImage::Statistic &imagestats, uint8_t const *imageBuffer); //This fails if it is running
+
     //These set the settings for the StellarSolver
     void setParameters(Parameters parameters){params = parameters;};
     void setParameterProfile(SSolver::Parameters::ParametersProfile profile);
@@ -103,21 +132,44 @@ public:
     void setUsePostion(bool set){use_position = set;};
     void setSearchPositionRaDec(double ra, double dec);                                                    //This sets the search RA/DEC/Radius to speed up the solver
     void setSearchPositionInDegrees(double ra, double dec);
+    //These set a solution that should be close to this one, like the one from the last frame of a guiding or mosaic sequence.
+    //The internal solver verifies it first and only searches if it doesn't verify.  maxDrift is how far the center may have moved, in degrees.
+    void setSolutionHint(const FITSImage::Solution &solution, double maxDrift);
+    void setSolutionHint(const sip_t &wcs, double maxDrift);                                    //The WCS is for the full size image
+    void clearSolutionHint(){use_hint = false;};
     void setProcessType(ProcessType type){processType = type;};
     void setSextractorType(SextractorType type){sextractorType = type;};
     void setSolverType(SolverType type){solverType = type;};
     void setLogToFile(bool change){logToFile = change;};
     void setLogLevel(logging_level level){logLevel = level;};
+    void setUseIndexCache(bool set){useIndexCache = set;};
+    void setUseBackgroundCache(bool set){useBackgroundCache = set;};      //For a sequence of images from one camera, the background model of the last image is used again if it still fits
 
     //These static methods can be used by classes to configure parameters or paths
     static void createConvFilterFromFWHM(Parameters *params, double fwhm);                      //This creates the conv filter from a fwhm
     static QList<Parameters> getBuiltInProfiles();
     static QStringList getDefaultIndexFolderPaths();
 
+    //These static methods control the index cache that is shared by all StellarSolvers that use it (see setUseIndexCache)
+    static int warmUpIndexCache(QStringList indexFolders);                                     //This loads the indexes ahead of the first solve, it returns the number loaded
+    static void clearIndexCache();
+    static void setIndexCacheMemoryBudget(qint64 bytes);                                        //0 means there is no limit
+    static qint64 getIndexCacheMemoryUsed();
+
+    //These control the background models that are shared by all StellarSolvers that use them (see setUseBackgroundCache)
+    static void clearBackgroundCache();
+    static void setBackgroundCacheTolerance(double fraction);                                   //How much the noise around a model may change before a new model is made
+
+    //These control the pool of working buffers that all source extractions share, so each extraction doesn't allocate its own
+    static void trimBufferPool(qint64 maxFreeBytes = 0);                                        //This frees the buffers that are not being used, down to maxFreeBytes
+    static void setBufferPoolBudget(qint64 bytes);                                              //The most bytes of unused buffers that are kept for later
+    static FITSImage::BufferPoolStats getBufferPoolStats();
+
 
     //Accessor Method for external classes
     int getNumStarsFound(){return numStars;}
-    QList<FITSImage::Star> getStarList(){return stars;}
+    QList<FITSImage::Star> getStarList(){return stars.toList();}
+    const StarCatalog &getStarCatalog(){return stars;}      //This gives the same stars as getStarList, with each value in its own array, without copying them
     FITSImage::Background getBackground(){return background;}
     QList<FITSImage::Star> getStarListFromSolve(){return starsFromSolve;}
     FITSImage::Solution getSolution(){return solution;}
@@ -127,23 +179,30 @@ public:
     bool failed(){return hasFailed;}
     void setLoadWCS(bool set){loadWCS = set;}
     bool hasWCSData(){return hasWCS;};
-    int getNumThreads(){if(parallelSolvers.size()==0) return 1; else return parallelSolvers.size();}
+    int getNumThreads(){if(parallelSolvers.size()==0) return 1; else return qMin(parallelSolvers.size(), parallelPool.maxThreadCount());}
 
     Parameters getCurrentParameters(){return params;}
     bool isCalculatingHFR(){return calculateHFR;}
     bool isUsingScale(){return use_scale;}
     bool isUsingPosition(){return use_position;}
+    bool isUsingIndexCache(){return useIndexCache;}
+    bool isUsingBackgroundCache(){return useBackgroundCache;}
+    bool isUsingSolutionHint(){return use_hint;}
 
     //Static Utility
     static double snr(const FITSImage::Background &background,
                       const FITSImage::Star &star, double gain = 0.5);
 
+    //This is the accessor for the WCS from the last solve, use it to get RA and DEC for pixels or tiles as you need them.
+    WCSData getWCSData(){return wcsData;}
+    //This computes the coordinates of every pixel in the image, which is slow for large images.  The caller must delete [] the array.
     virtual FITSImage::wcs_point *getWCSCoord();
     virtual QList<FITSImage::Star> appendStarsRAandDEC(QList<FITSImage::Star> stars);
 
     //External Options
     QString fileToProcess;
     bool cleanupTemporaryFiles = true;
+    bool useMemoryTempFiles = true;     //On Linux, the image for the external sextractor is saved in /dev/shm instead of basePath
     bool autoGenerateAstroConfig = true;
 
     //System File Paths
@@ -181,7 +240,6 @@ public:
 public slots:
     void processFinished(int code);
     void parallelSolve();
-    void finishParallelSolve(int success);
 
 protected:  //Note: These items are not private because they are needed by ExternalSextractorSolver
 
@@ -192,9 +250,16 @@ protected:  //Note: These items are not private because they are needed by Exter
     SextractorSolver *solverWithWCS = nullptr;
     int parallelFails = 0;
     bool parallelSolversAreRunning();
+    QThreadPool parallelPool;                   //The child solvers for a parallel solve are run as tasks on this fixed pool of threads
+    QAtomicInt parallelSolversRunning;          //This counts the child solvers that are queued or still running in the pool
+    QMutex parallelLock;                        //The child solvers report back from their own threads, so this protects the results
+    QWaitCondition parallelDone;                //This wakes up run when a child solver solves, all of them are done, or it is aborted
+    QList<index_t *> parallelIndexes;           //These are the indexes from the SolverEngineCache that are shared by all the child solvers
 
     Parameters params;           //The currently set parameters for StellarSolver
     QStringList indexFolderPaths = getDefaultIndexFolderPaths();       //This is the list of folder paths that the solver will use to search for index files
+    bool useIndexCache = false;         //Whether or not to keep the index files loaded between solves so they don't have to be loaded again
+    bool useBackgroundCache = false;    //Whether or not to use the background model of the last image again when it still fits
 
     //Astrometry Scale Parameters, These are not saved parameters and change for each image, use the methods to set them
     bool use_scale = false;             //Whether or not to use the image scale parameters
@@ -207,6 +272,11 @@ protected:  //Note: These items are not private because they are needed by Exter
     double search_ra = HUGE_VAL;        //RA of field center for search, format: decimal degrees
     double search_dec = HUGE_VAL;       //DEC of field center for search, format: decimal degrees
 
+    //Astrometry Solution Hint, This is verified before searching, use the methods to set it
+    bool use_hint = false;              //Whether or not to verify the hint before searching
+    sip_t hintWCS;                      //The WCS of the hint for the full size image
+    double hintDrift = 0;               //How far the field center can be from the center of the hint, format: decimal degrees
+
     //StellarSolver Internal settings that are needed by ExternalSextractorSolver as well
     bool calculateHFR = false;          //Whether or not the HFR of the image should be calculated using sep_flux_radius.  Don't do it unless you need HFR
     bool hasSextracted = false;         //This boolean is set when the sextraction is done
@@ -217,23 +287,40 @@ protected:  //Note: These items are not private because they are needed by Exter
 
     //The Results
     FITSImage::Background background;      //This is a report on the background levels found during sextraction
-    QList<FITSImage::Star> stars;          //This is the list of stars that get sextracted from the image, saved to the file, and then solved by astrometry.net
+    StarCatalog stars;                     //This is the list of stars that get sextracted from the image, saved to the file, and then solved by astrometry.net
     QList<FITSImage::Star> starsFromSolve; //This is the list of stars that were sextracted for the last successful solve
     int numStars;               //The number of stars found in the last operation
     FITSImage::Solution solution;          //This is the solution that comes back from the Solver
     bool loadWCS = true;
     bool hasWCS = false;        //This boolean gets set if the StellarSolver has WCS data to retrieve
-    FITSImage::wcs_point * wcs_coord = nullptr;
+    WCSData wcsData;            //This is the accessor for the WCS, it is set when the WCS data is ready
 
     bool wasAborted = false;
     // This is the cancel file path that astrometry.net monitors.  If it detects this file, it aborts the solve
     QString cancelfn;           //Filename whose creation signals the process to stop
     QString solvedfn;           //Filename whose creation tells astrometry.net it already solved the field.
 
+    //Focus Measurement
+    QList<FITSImage::Star> focusSeeds;  //The stars that measureFocus looks for in the next image
+    int focusSeedCount = 0;             //How many seeds there were when they were last chosen, some might have been lost since then
+
 private:
     bool checkParameters();
     void run() override;
     SextractorSolver* createSextractorSolver();
+    void finishParallelSolve(SextractorSolver *reportingSolver, int success);
+    void childSolverDone();
+    void reportProcessComplete();
+
+    friend class ChildSolverTask;
+
+    QFutureInterface<int> processFuture;        //This is where the end of the process is reported for the futures and executeProcess
+    int processCode = -1;                       //The code that the process finished with
+    std::function<void(int)> completionCallback;
+    solver_code_recorder_t codeRecorder = nullptr;
+    void *codeRecorderBaton = nullptr;
+    solver_verify_recorder_t verifyRecorder = nullptr;
+    void *verifyRecorderBaton = nullptr;
 
 signals:
 
@@ -63,6 +63,30 @@ typedef struct
     int num_stars_detected; // Number of stars detected before any reduction.
 } Background;
 
+// This struct holds the focus of an image, measured on a few of its stars
+// It is returned by measureFocus
+typedef struct
+{
+    float HFR = -1;         // The median half flux radius of the stars in pixels, -1 if no stars could be measured
+    float HFRError = 0;     // The standard error of the median HFR, from the spread of the stars
+    float FWHM = -1;        // The median full width at half maximum of the stars in pixels, from their shape
+    int numStars = 0;       // The number of stars that were measured
+    int numSeeds = 0;       // The number of stars that were looked for
+    bool redetected = false;// Whether the stars had to be found again with a full source extraction for this image
+} FocusMetric;
+
+// This struct tells how the pool of working buffers for the source extraction is being used
+// It is returned by StellarSolver::getBufferPoolStats
+typedef struct
+{
+    qint64 bytesInUse = 0;  // The bytes in buffers that are being used by an extraction right now
+    qint64 bytesFree = 0;   // The bytes in buffers that are kept to be used again
+    qint64 peakBytes = 0;   // The most bytes that the pool has held at one time
+    qint64 acquires = 0;    // The number of buffers that have been asked for
+    qint64 hits = 0;        // The number of those that were given a buffer that was already allocated
+    qint64 allocations = 0; // The number of those that needed a new buffer
+} BufferPoolStats;
+
 // This struct contains information about the astrometric solution
 // for an image.
 typedef struct
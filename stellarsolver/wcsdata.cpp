@@ -0,0 +1,492 @@
+/*  WCSData, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "wcsdata.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <qmath.h>
+#include <wcs.h>
+#include <functional>
+#include <memory>
+
+//Astrometry.net includes
+extern "C"{
+#include "astrometry/starutil.h"
+}
+
+//These are the largest and smallest grid spacings in pixels that are tried for the interpolation grid
+#define MAX_GRID_SPACING 256
+#define MIN_GRID_SPACING 8
+//Tiles with at least this many pixels are split into bands of rows that are converted at the same time in separate threads
+#define MIN_PARALLEL_PIXELS 262144
+
+struct WCSData::Private
+{
+    ~Private();
+
+    bool usingSIP = true;
+    sip_t sip;
+    int downsample = 1;
+    struct wcsprm *wcs = nullptr;
+    //wcsp2s uses the wcsprm for scratch space, so only one thread can use it at a time.  The threads of getTile use their own copies.
+    QMutex wcsLock;
+    int width = 0;
+    int height = 0;
+
+    //The interpolation grid, the points are stored as unit vectors so that RA wrapping around 0 and the poles don't need special cases
+    struct Grid
+    {
+        int spacing = 0;
+        int width = 0;
+        int height = 0;
+        QVector<double> points;
+    };
+    //A grid is not changed after it is built.  The readers take the current one under the gridLock and use it without the lock,
+    //so setInterpolationError can replace it, even from a copy of this WCSData, while they are still using the old one.
+    QMutex gridLock;
+    double maxError = 0;
+    bool gridBuilt = false;
+    std::shared_ptr<const Grid> currentGrid;
+
+    bool exactXYZ(double x, double y, double *xyz);
+    bool exactRADec(struct wcsprm *rowWCS, const double *pixcrd, int count, double *world, int *stat);
+    struct wcsprm *copyWCS() const;
+    bool fillRows(const QRect &tile, const QRect &area, int rowStart, int rowEnd, const Grid *grid, FITSImage::wcs_point *coords);
+    bool interpolatedXYZ(const Grid &grid, double x, double y, double *xyz) const;
+    std::shared_ptr<const Grid> useGrid();
+    bool buildGrid(Grid &grid, int gridSpacing);
+};
+
+WCSData::Private::~Private()
+{
+    if(wcs)
+    {
+        wcsfree(wcs);
+        free(wcs);
+    }
+}
+
+bool WCSData::Private::exactXYZ(double x, double y, double *xyz)
+{
+    double pixcrd[2] = {x, y}, world[2];
+    int stat = 0;
+    QMutexLocker locker(usingSIP ? nullptr : &wcsLock);
+    if(!exactRADec(wcs, pixcrd, 1, world, &stat) || stat != 0)
+        return false;
+    radecdeg2xyzarr(world[0], world[1], xyz);
+    return true;
+}
+
+//This converts count pixels at once, pixcrd and world hold x,y and ra,dec pairs.  stat is set to non zero for the points that could not be converted.
+//For wcslib the whole array is converted in one call to wcsp2s, which is much faster than one call per point.
+bool WCSData::Private::exactRADec(struct wcsprm *rowWCS, const double *pixcrd, int count, double *world, int *stat)
+{
+    if(usingSIP)
+    {
+        for(int i = 0; i < count; i++)
+        {
+            sip_pixelxy2radec(&sip, pixcrd[2 * i] / downsample, pixcrd[2 * i + 1] / downsample, &world[2 * i], &world[2 * i + 1]);
+            stat[i] = 0;
+        }
+        return true;
+    }
+    QVector<double> imgcrd(2 * count), phi(count), theta(count);
+    int status = wcsp2s(rowWCS, count, 2, pixcrd, imgcrd.data(), phi.data(), theta.data(), world, stat);
+    //WCSERR_BAD_PIX means only some of the points were invalid, those are marked in stat
+    return status == 0 || status == WCSERR_BAD_PIX;
+}
+
+//This makes a copy of the WCS for a thread that converts a band of rows
+struct wcsprm *WCSData::Private::copyWCS() const
+{
+    struct wcsprm *copy = (struct wcsprm *)calloc(1, sizeof(struct wcsprm));
+    copy->flag = -1;
+    if(wcssub(1, wcs, 0x0, 0x0, copy) != 0 || wcsset(copy) != 0)
+    {
+        wcsfree(copy);
+        free(copy);
+        return nullptr;
+    }
+    return copy;
+}
+
+//This fills in the coordinates for the rows from rowStart up to rowEnd of the area, which is the part of the tile inside the image.
+//The exact coordinates are computed a whole row at a time.  If a grid is given, the coordinates are interpolated from it instead.
+bool WCSData::Private::fillRows(const QRect &tile, const QRect &area, int rowStart, int rowEnd, const Grid *grid, FITSImage::wcs_point *coords)
+{
+    struct wcsprm *rowWCS = nullptr;
+    if(!usingSIP && !grid)
+    {
+        rowWCS = copyWCS();
+        if(!rowWCS)
+            return false;
+    }
+
+    bool success = true;
+    int count = area.width();
+    QVector<double> pixcrd(2 * count), world(2 * count);
+    QVector<int> stat(count);
+    for(int y = rowStart; y < rowEnd; y++)
+    {
+        FITSImage::wcs_point *p = coords + (y - tile.top()) * tile.width() + (area.left() - tile.left());
+        if(grid)
+        {
+            //The area is inside the image, so every point can be interpolated from the grid
+            for(int x = area.left(); x <= area.right(); x++, p++)
+            {
+                double xyz[3], ra, dec;
+                if(!interpolatedXYZ(*grid, x, y, xyz))
+                {
+                    success = false;
+                    continue;
+                }
+                xyzarr2radecdeg(xyz, &ra, &dec);
+                p->ra = ra;
+                p->dec = dec;
+            }
+            continue;
+        }
+
+        for(int i = 0; i < count; i++)
+        {
+            pixcrd[2 * i] = area.left() + i;
+            pixcrd[2 * i + 1] = y;
+        }
+        if(!exactRADec(rowWCS, pixcrd.constData(), count, world.data(), stat.data()))
+        {
+            success = false;
+            continue;
+        }
+        for(int i = 0; i < count; i++, p++)
+        {
+            if(stat[i] != 0)
+            {
+                success = false;
+                continue;
+            }
+            p->ra = world[2 * i];
+            p->dec = world[2 * i + 1];
+        }
+    }
+
+    if(rowWCS)
+    {
+        wcsfree(rowWCS);
+        free(rowWCS);
+    }
+    return success;
+}
+
+//This converts one band of rows of a tile, several of these run at the same time for large tiles
+class WCSBandTask : public QRunnable
+{
+public:
+    WCSBandTask(std::function<bool()> band) : work(band)
+    {
+        setAutoDelete(false);
+    }
+    void run() override
+    {
+        success = work();
+    }
+    bool success = false;
+private:
+    std::function<bool()> work;
+};
+
+//This does the bilinear interpolation between the four grid points around the pixel
+bool WCSData::Private::interpolatedXYZ(const Grid &grid, double x, double y, double *xyz) const
+{
+    if(x < 0 || y < 0 || x > width - 1 || y > height - 1)
+        return false;
+
+    int i = qMin((int)(x / grid.spacing), grid.width - 2);
+    int j = qMin((int)(y / grid.spacing), grid.height - 2);
+    double x0 = i * grid.spacing;
+    double y0 = j * grid.spacing;
+    double x1 = qMin(x0 + grid.spacing, (double)(width - 1));
+    double y1 = qMin(y0 + grid.spacing, (double)(height - 1));
+    double tx = (x - x0) / (x1 - x0);
+    double ty = (y - y0) / (y1 - y0);
+
+    const double *p00 = grid.points.constData() + 3 * (j * grid.width + i);
+    const double *p10 = p00 + 3;
+    const double *p01 = p00 + 3 * grid.width;
+    const double *p11 = p01 + 3;
+    double norm = 0;
+    for(int k = 0; k < 3; k++)
+    {
+        double top = p00[k] + tx * (p10[k] - p00[k]);
+        double bottom = p01[k] + tx * (p11[k] - p01[k]);
+        xyz[k] = top + ty * (bottom - top);
+        norm += xyz[k] * xyz[k];
+    }
+    norm = sqrt(norm);
+    for(int k = 0; k < 3; k++)
+        xyz[k] /= norm;
+    return true;
+}
+
+//This makes sure the grid is built if it was asked for, it returns the grid to use, or nullptr if the points should be computed exactly.
+std::shared_ptr<const WCSData::Private::Grid> WCSData::Private::useGrid()
+{
+    QMutexLocker locker(&gridLock);
+    if(maxError <= 0)
+        return nullptr;
+    if(!gridBuilt)
+    {
+        currentGrid.reset();
+        if(width > 1 && height > 1)
+        {
+            std::shared_ptr<Grid> grid = std::make_shared<Grid>();
+            for(int gridSpacing = MAX_GRID_SPACING; gridSpacing >= MIN_GRID_SPACING; gridSpacing /= 2)
+            {
+                if(buildGrid(*grid, gridSpacing))
+                {
+                    currentGrid = grid;
+                    break;
+                }
+            }
+        }
+        gridBuilt = true;
+    }
+    return currentGrid;
+}
+
+//This computes the grid points exactly and then checks the interpolation against the exact coordinates at the middle of each cell.
+//It returns false if the error is over the limit anywhere.
+bool WCSData::Private::buildGrid(Grid &grid, int gridSpacing)
+{
+    int spacing = gridSpacing;
+    grid.spacing = spacing;
+    grid.width = (width - 1 + spacing - 1) / spacing + 1;
+    grid.height = (height - 1 + spacing - 1) / spacing + 1;
+    grid.points.resize(3 * grid.width * grid.height);
+
+    double *p = grid.points.data();
+    for(int j = 0; j < grid.height; j++)
+    {
+        double y = qMin(j * spacing, height - 1);
+        for(int i = 0; i < grid.width; i++)
+        {
+            double x = qMin(i * spacing, width - 1);
+            if(!exactXYZ(x, y, p))
+                return false;
+            p += 3;
+        }
+    }
+
+    double maxChord = arcsec2rad(maxError);
+    for(int j = 0; j < grid.height - 1; j++)
+    {
+        double y = (j * spacing + qMin((j + 1) * spacing, height - 1)) / 2.0;
+        for(int i = 0; i < grid.width - 1; i++)
+        {
+            double x = (i * spacing + qMin((i + 1) * spacing, width - 1)) / 2.0;
+            double exact[3], interpolated[3];
+            if(!exactXYZ(x, y, exact) || !interpolatedXYZ(grid, x, y, interpolated))
+                return false;
+            double dx = exact[0] - interpolated[0];
+            double dy = exact[1] - interpolated[1];
+            double dz = exact[2] - interpolated[2];
+            if(sqrt(dx * dx + dy * dy + dz * dz) > maxChord)
+                return false;
+        }
+    }
+    return true;
+}
+
+WCSData::WCSData(const sip_t &sip, int downsample, int width, int height)
+{
+    d.reset(new Private);
+    d->usingSIP = true;
+    d->sip = sip;
+    d->downsample = qMax(downsample, 1);
+    d->width = width;
+    d->height = height;
+}
+
+WCSData::WCSData(const struct wcsprm *wcs, int width, int height)
+{
+    if(!wcs)
+        return;
+    std::shared_ptr<Private> data(new Private);
+    data->usingSIP = false;
+    data->width = width;
+    data->height = height;
+    data->wcs = (struct wcsprm *)calloc(1, sizeof(struct wcsprm));
+    data->wcs->flag = -1;
+    if(wcssub(1, wcs, 0x0, 0x0, data->wcs) != 0 || wcsset(data->wcs) != 0)
+        return;
+    d = data;
+}
+
+int WCSData::width() const
+{
+    return d ? d->width : 0;
+}
+
+int WCSData::height() const
+{
+    return d ? d->height : 0;
+}
+
+bool WCSData::pixelToWCS(const QPointF &pixelPoint, FITSImage::wcs_point &skyPoint) const
+{
+    if(!d)
+        return false;
+    double xyz[3];
+    std::shared_ptr<const Private::Grid> grid = d->useGrid();
+    if(!(grid && d->interpolatedXYZ(*grid, pixelPoint.x(), pixelPoint.y(), xyz)))
+    {
+        if(!d->exactXYZ(pixelPoint.x(), pixelPoint.y(), xyz))
+            return false;
+    }
+    double ra, dec;
+    xyzarr2radecdeg(xyz, &ra, &dec);
+    skyPoint.ra = ra;
+    skyPoint.dec = dec;
+    return true;
+}
+
+bool WCSData::pixelsToWCS(const QPointF *pixelPoints, int count, FITSImage::wcs_point *skyPoints) const
+{
+    if(!d || !pixelPoints || !skyPoints)
+        return false;
+    if(count <= 0)
+        return true;
+
+    bool success = true;
+    std::shared_ptr<const Private::Grid> grid = d->useGrid();
+    if(grid)
+    {
+        for(int i = 0; i < count; i++)
+        {
+            double xyz[3], ra, dec;
+            if(!d->interpolatedXYZ(*grid, pixelPoints[i].x(), pixelPoints[i].y(), xyz) && !d->exactXYZ(pixelPoints[i].x(), pixelPoints[i].y(), xyz))
+            {
+                success = false;
+                continue;
+            }
+            xyzarr2radecdeg(xyz, &ra, &dec);
+            skyPoints[i].ra = ra;
+            skyPoints[i].dec = dec;
+        }
+        return success;
+    }
+
+    QVector<double> pixcrd(2 * count), world(2 * count);
+    QVector<int> stat(count);
+    for(int i = 0; i < count; i++)
+    {
+        pixcrd[2 * i] = pixelPoints[i].x();
+        pixcrd[2 * i + 1] = pixelPoints[i].y();
+    }
+    {
+        QMutexLocker locker(d->usingSIP ? nullptr : &d->wcsLock);
+        if(!d->exactRADec(d->wcs, pixcrd.constData(), count, world.data(), stat.data()))
+            return false;
+    }
+    for(int i = 0; i < count; i++)
+    {
+        if(stat[i] != 0)
+        {
+            success = false;
+            continue;
+        }
+        skyPoints[i].ra = world[2 * i];
+        skyPoints[i].dec = world[2 * i + 1];
+    }
+    return success;
+}
+
+bool WCSData::getTile(const QRect &tile, FITSImage::wcs_point *coords) const
+{
+    if(!d || !coords)
+        return false;
+    QRect area = tile.intersected(QRect(0, 0, d->width, d->height));
+    if(area.isEmpty())
+        return true;
+    //The bands keep their own reference to the grid, so it stays valid even if the interpolation error is changed while they work
+    std::shared_ptr<const Private::Grid> grid = d->useGrid();
+
+    int numBands = 1;
+    if((qint64)area.width() * area.height() >= MIN_PARALLEL_PIXELS)
+        numBands = qMin(QThread::idealThreadCount(), area.height());
+    if(numBands <= 1)
+        return d->fillRows(tile, area, area.top(), area.bottom() + 1, grid.get(), coords);
+
+    Private *data = d.get();
+    QThreadPool bandPool;
+    bandPool.setMaxThreadCount(numBands);
+    QList<WCSBandTask *> tasks;
+    for(int i = 0; i < numBands; i++)
+    {
+        int rowStart = area.top() + i * area.height() / numBands;
+        int rowEnd = area.top() + (i + 1) * area.height() / numBands;
+        WCSBandTask *task = new WCSBandTask([data, tile, area, rowStart, rowEnd, grid, coords]()
+        {
+            return data->fillRows(tile, area, rowStart, rowEnd, grid.get(), coords);
+        });
+        tasks.append(task);
+        bandPool.start(task);
+    }
+    bandPool.waitForDone();
+
+    bool success = true;
+    foreach(WCSBandTask *task, tasks)
+        success = success && task->success;
+    qDeleteAll(tasks);
+    return success;
+}
+
+FITSImage::wcs_point *WCSData::getFullGrid() const
+{
+    if(!d)
+        return nullptr;
+    FITSImage::wcs_point *coords = new FITSImage::wcs_point[d->width * d->height];
+    if(!getTile(QRect(0, 0, d->width, d->height), coords))
+    {
+        delete [] coords;
+        return nullptr;
+    }
+    return coords;
+}
+
+void WCSData::setInterpolationError(double maxError)
+{
+    if(!d)
+        return;
+    QMutexLocker locker(&d->gridLock);
+    if(maxError == d->maxError)
+        return;
+    d->maxError = maxError;
+    //Anyone still using the old grid keeps it until they are done
+    d->gridBuilt = false;
+    d->currentGrid.reset();
+}
+
+double WCSData::getInterpolationError() const
+{
+    if(!d)
+        return 0;
+    QMutexLocker locker(&d->gridLock);
+    return d->maxError;
+}
+
+int WCSData::getGridSpacing() const
+{
+    if(!d)
+        return 0;
+    QMutexLocker locker(&d->gridLock);
+    return d->gridBuilt && d->currentGrid ? d->currentGrid->spacing : 0;
+}
@@ -0,0 +1,73 @@
+/*  WCSData, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#ifndef WCSDATA_H
+#define WCSDATA_H
+
+//Includes for this project
+#include "structuredefinitions.h"
+
+//QT Includes
+#include <QPointF>
+#include <QRect>
+#include <memory>
+
+//Astrometry.net includes
+extern "C"{
+#include "astrometry/sip.h"
+}
+
+struct wcsprm;
+
+//This converts pixel coordinates in the image to RA and DEC using the WCS from a solve.
+//Nothing is computed until a coordinate is asked for, so a mouse-over readout only pays for the pixels it looks at.
+//It can also use a coarse grid of exact coordinates and interpolate between them, within an error bound you set.
+//Copies are cheap and share the same WCS and grid, the WCS is copied so it is still valid after the solver is gone.
+class WCSData
+{
+public:
+    WCSData() {}
+    //This is for the internal solver, the SIP WCS is for the downsampled image if it was downsampled
+    WCSData(const sip_t &sip, int downsample, int width, int height);
+    //This is for the solvers that load the WCS from the solution file with wcslib
+    WCSData(const struct wcsprm *wcs, int width, int height);
+
+    bool isValid() const {return d != nullptr;}
+    int width() const;
+    int height() const;
+
+    //This gets the RA and DEC in degrees for a point in the full size image.  It returns false if there is no WCS or it can't be converted.
+    //If the interpolation grid is on, the point is interpolated from the grid instead of computed exactly.
+    bool pixelToWCS(const QPointF &pixelPoint, FITSImage::wcs_point &skyPoint) const;
+
+    //This converts a list of points at once, like the stars in a star list.  It is much faster than calling pixelToWCS for each one.
+    //It returns false if any of the points could not be converted.
+    bool pixelsToWCS(const QPointF *pixelPoints, int count, FITSImage::wcs_point *skyPoints) const;
+
+    //This fills coords with the RA and DEC of every pixel in the tile, row by row.  coords must hold tile.width() * tile.height() points.
+    //The tile is clipped to the image, points outside the image are left as they were.
+    //Each row is converted in one batch, and large tiles are split into bands of rows that are converted in separate threads.
+    bool getTile(const QRect &tile, FITSImage::wcs_point *coords) const;
+
+    //This returns a new array with the coordinates of every pixel in the image, the caller must delete [] it.
+    //This is slow and uses a lot of memory for large images, use pixelToWCS or getTile when you can.
+    FITSImage::wcs_point *getFullGrid() const;
+
+    //This turns on the coarse grid with bilinear interpolation.  The grid spacing is chosen so that the interpolation error
+    //at the middle of each grid cell is no more than maxError arcseconds.  0 turns the grid off and every point is computed exactly.
+    //The grid is built the first time it is needed.  If no spacing meets the bound, points are computed exactly.
+    void setInterpolationError(double maxError);
+    double getInterpolationError() const;
+    //This is the grid spacing in pixels that was chosen, 0 if the grid is not built or not used.
+    int getGridSpacing() const;
+
+private:
+    struct Private;
+    std::shared_ptr<Private> d;
+};
+
+#endif // WCSDATA_H
@@ -625,7 +625,7 @@ void MainWindow::solveImage()
     if(hasWCSData)
     {
         hasWCSData = false;
-        delete [] wcs_coord;
+        wcsData = WCSData();
     }
 
     stellarSolver->setProcessType(processType);
@@ -901,11 +901,11 @@ bool MainWindow::solverComplete(int error)
 bool MainWindow::loadWCSComplete()
 {
     disconnect(stellarSolver, &StellarSolver::wcsDataisReady, this, &MainWindow::loadWCSComplete);
-    FITSImage::wcs_point * coord = stellarSolver->getWCSCoord();
-    if(coord)
+    WCSData data = stellarSolver->getWCSData();
+    if(data.isValid())
     {
         hasWCSData = true;
-        wcs_coord = coord;
+        wcsData = data;
         stars = stellarSolver->getStarList();
         hasHFRData = stellarSolver->isCalculatingHFR();
         if(stars.count() > 0)
@@ -976,7 +976,7 @@ bool MainWindow::imageLoad()
     }
     if(hasWCSData)
     {
-        delete [] wcs_coord;
+        wcsData = WCSData();
         hasWCSData = false;
     }
 
@@ -1706,11 +1706,9 @@ void MainWindow::mouseMovedOverImage(QPoint location)
         }
 
         QString mouseText = "";
-        if(hasWCSData)
-        {
-            int index = x + y * stats.width;      
-            mouseText = QString("RA: %1, DEC: %2, Value: %3").arg(StellarSolver::raString(wcs_coord[index].ra)).arg(StellarSolver::decString(wcs_coord[index].dec)).arg(getValue(x,y));
-        }
+        FITSImage::wcs_point skyPoint;
+        if(hasWCSData && wcsData.pixelToWCS(QPointF(x, y), skyPoint))
+            mouseText = QString("RA: %1, DEC: %2, Value: %3").arg(StellarSolver::raString(skyPoint.ra)).arg(StellarSolver::decString(skyPoint.dec)).arg(getValue(x,y));
         else
             mouseText = QString("X: %1, Y: %2, Value: %3").arg(x).arg(y).arg(getValue(x,y));
         if(useSubframe)
@@ -150,7 +150,7 @@ private:
     void addSextractionToTable();
     FITSImage::Solution lastSolution;
 
-    FITSImage::wcs_point *wcs_coord { nullptr };
+    WCSData wcsData;
 
 public slots:
 